@@ -0,0 +1,984 @@
+// Keep-alive HTTP load generator for `make bench`.
+// Launches webserv, replays every scenario file for a fixed duration over N
+// nonblocking connections driven by one epoll loop, then writes RPS, latency
+// percentiles and the server's CPU / RSS to a JSON report. Scenarios may run
+// over TLS, with or without session resumption.
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+
+namespace
+{
+    struct Fixture {
+        std::string path;
+        size_t      size;
+        int         count;  // > 0 creates path-0 .. path-(count-1)
+    };
+
+    struct Scenario {
+        std::string          file;
+        std::string          name;
+        std::string          method;
+        std::string          path;
+        std::vector<std::string> headers;
+        size_t               bodySize;
+        size_t               chunkSize;     // 0: Content-Length body
+        std::string          multipartName; // non-empty: multipart/form-data upload
+        std::vector<int>     expect;        // accepted status codes
+        int                  connections;   // 0: use the command line value
+        int                  duration;
+        std::string          socketPath;    // non-empty: connect over this Unix socket instead of host:port
+        int                  port;          // 0: the command line port
+        bool                 tls;
+        bool                 tlsResume;     // offer the last session on every new connection
+        std::vector<Fixture> fixtures;
+        std::string          request;       // built once, replayed on every connection
+    };
+
+    struct Result {
+        unsigned long               requests;
+        unsigned long               errors;
+        unsigned long               connectErrors;
+        unsigned long               reconnects;
+        unsigned long               handshakes;
+        unsigned long               resumed;
+        unsigned long long          bytesIn;
+        unsigned long long          bytesOut;
+        double                      elapsed;
+        std::vector<unsigned int>   latencies;  // microseconds
+        double                      serverCpu;  // seconds of utime + stime
+        long                        serverRssKb;
+        long                        serverHwmKb;
+
+        Result() : requests(0), errors(0), connectErrors(0), reconnects(0), handshakes(0), resumed(0), bytesIn(0), bytesOut(0),
+            elapsed(0), serverCpu(0), serverRssKb(0), serverHwmKb(0) {}
+    };
+
+    enum BodyMode { BODY_NONE, BODY_LENGTH, BODY_CHUNKED, BODY_UNTIL_CLOSE };
+    enum ChunkState { CHUNK_SIZE, CHUNK_DATA, CHUNK_DATA_END, CHUNK_TRAILER };
+
+    struct Connection {
+        int         fd;
+        SSL*        ssl;
+        bool        connected;
+        bool        handshakeDone;
+        size_t      sent;
+        std::string in;
+        bool        headersDone;
+        int         status;
+        bool        closeAfter;
+        BodyMode    bodyMode;
+        size_t      remaining;
+        ChunkState  chunkState;
+        long long   startUs;
+
+        Connection() : fd(-1), ssl(NULL), connected(false), handshakeDone(false), sent(0), headersDone(false), status(0), closeAfter(false),
+            bodyMode(BODY_NONE), remaining(0), chunkState(CHUNK_SIZE), startUs(0) {}
+    };
+
+    struct Options {
+        std::string host;
+        int         port;
+        int         connections;
+        int         duration;
+        std::string server;
+        std::string config;
+        std::string scenarioDir;
+        std::string output;
+        std::string serverLog;
+        pid_t       attachPid;
+
+        Options() : host("127.0.0.1"), port(8090), connections(32), duration(5), scenarioDir("bench/scenarios"),
+            output("bench/results/latest.json"), serverLog("/dev/null"), attachPid(0) {}
+    };
+
+    long long nowUs()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<long long>(ts.tv_sec) * 1000000LL + ts.tv_nsec / 1000;
+    }
+
+    std::string trim(const std::string& s)
+    {
+        size_t b = s.find_first_not_of(" \t\r\n");
+        if (b == std::string::npos)
+            return "";
+        size_t e = s.find_last_not_of(" \t\r\n");
+        return s.substr(b, e - b + 1);
+    }
+
+    std::string lower(std::string s)
+    {
+        for (size_t i = 0; i < s.size(); ++i)
+            s[i] = static_cast<char>(std::tolower(static_cast<unsigned char>(s[i])));
+        return s;
+    }
+
+    template <typename T>
+    std::string str(T value)
+    {
+        std::ostringstream oss;
+        oss << value;
+        return oss.str();
+    }
+
+    // "512", "64K", "4M"
+    size_t parseSize(const std::string& value)
+    {
+        char* end = NULL;
+        size_t n = std::strtoul(value.c_str(), &end, 10);
+        if (end && (*end == 'k' || *end == 'K'))
+            n *= 1024;
+        else if (end && (*end == 'm' || *end == 'M'))
+            n *= 1024 * 1024;
+        return n;
+    }
+
+    void die(const std::string& message)
+    {
+        std::cerr << "loadgen: " << message << std::endl;
+        std::exit(1);
+    }
+
+    std::string payload(size_t size)
+    {
+        std::string body(size, 'x');
+        for (size_t i = 0; i < size; ++i)
+            body[i] = static_cast<char>('a' + i % 26);
+        return body;
+    }
+
+    // Request line, headers and body of a scenario, serialised once.
+    void buildRequest(Scenario& sc, const Options& opt)
+    {
+        std::string head = sc.method + " " + sc.path + " HTTP/1.1\r\n";
+        head += "Host: " + opt.host + ":" + str(opt.port) + "\r\n";
+        // a scenario 'header Connection: ...' replaces the keep-alive default
+        bool connection = false;
+        for (size_t i = 0; i < sc.headers.size(); ++i)
+            connection = connection || strncasecmp(sc.headers[i].c_str(), "Connection:", 11) == 0;
+        if (!connection)
+            head += "Connection: keep-alive\r\n";
+        head += "User-Agent: webserv-loadgen\r\n";
+        for (size_t i = 0; i < sc.headers.size(); ++i)
+            head += sc.headers[i] + "\r\n";
+
+        std::string body;
+        if (!sc.multipartName.empty()) {
+            std::string boundary = "----webservbench7d1f";
+            body = "--" + boundary + "\r\n";
+            body += "Content-Disposition: form-data; name=\"file\"; filename=\"" + sc.multipartName + "\"\r\n";
+            body += "Content-Type: application/octet-stream\r\n\r\n";
+            body += payload(sc.bodySize);
+            body += "\r\n--" + boundary + "--\r\n";
+            head += "Content-Type: multipart/form-data; boundary=" + boundary + "\r\n";
+        }
+        else if (sc.bodySize > 0)
+            body = payload(sc.bodySize);
+
+        if (sc.chunkSize > 0) {
+            head += "Transfer-Encoding: chunked\r\n\r\n";
+            std::ostringstream chunked;
+            for (size_t pos = 0; pos < body.size(); pos += sc.chunkSize) {
+                size_t len = std::min(sc.chunkSize, body.size() - pos);
+                chunked << std::hex << len << "\r\n";
+                chunked.write(body.data() + pos, len);
+                chunked << "\r\n";
+            }
+            chunked << "0\r\n\r\n";
+            sc.request = head + chunked.str();
+        }
+        else {
+            if (!body.empty() || sc.method == "POST" || sc.method == "PUT")
+                head += "Content-Length: " + str(body.size()) + "\r\n";
+            sc.request = head + "\r\n" + body;
+        }
+    }
+
+    Scenario parseScenario(const std::string& file)
+    {
+        std::ifstream in(file.c_str());
+        if (!in)
+            die("cannot open scenario " + file);
+        Scenario sc;
+        sc.file = file;
+        sc.method = "GET";
+        sc.path = "/";
+        sc.bodySize = 0;
+        sc.chunkSize = 0;
+        sc.connections = 0;
+        sc.duration = 0;
+        sc.port = 0;
+        sc.tls = false;
+        sc.tlsResume = false;
+        std::string line;
+        int lineNo = 0;
+        while (std::getline(in, line)) {
+            ++lineNo;
+            line = trim(line);
+            if (line.empty() || line[0] == '#')
+                continue;
+            std::istringstream words(line);
+            std::string key;
+            words >> key;
+            std::string rest = trim(line.substr(key.size()));
+            if (key == "name")
+                sc.name = rest;
+            else if (key == "method")
+                sc.method = rest;
+            else if (key == "path")
+                sc.path = rest;
+            else if (key == "header")
+                sc.headers.push_back(rest);
+            else if (key == "body_size")
+                sc.bodySize = parseSize(rest);
+            else if (key == "chunked")
+                sc.chunkSize = parseSize(rest);
+            else if (key == "multipart") {
+                std::string size;
+                words >> sc.multipartName >> size;
+                sc.bodySize = parseSize(size);
+            }
+            else if (key == "expect") {
+                int status;
+                while (words >> status)
+                    sc.expect.push_back(status);
+            }
+            else if (key == "connections")
+                sc.connections = std::atoi(rest.c_str());
+            else if (key == "duration")
+                sc.duration = std::atoi(rest.c_str());
+            else if (key == "socket") {
+                if (rest.compare(0, 6, "unix:/") != 0 || rest.size() - 5 >= sizeof(((struct sockaddr_un*)0)->sun_path))
+                    die(file + ":" + str(lineNo) + ": socket expects unix:/path");
+                sc.socketPath = rest.substr(5);
+            }
+            else if (key == "port")
+                sc.port = std::atoi(rest.c_str());
+            else if (key == "tls" || key == "tls_resume") {
+                if (rest != "on" && rest != "off")
+                    die(file + ":" + str(lineNo) + ": " + key + " expects on or off");
+                (key == "tls" ? sc.tls : sc.tlsResume) = (rest == "on");
+            }
+            else if (key == "fixture") {
+                Fixture fx;
+                std::string size;
+                fx.count = 0;
+                words >> fx.path >> size >> fx.count;
+                fx.size = parseSize(size);
+                sc.fixtures.push_back(fx);
+            }
+            else
+                die(file + ":" + str(lineNo) + ": unknown key " + key);
+        }
+        if (sc.expect.empty())
+            sc.expect.push_back(200);
+        if (sc.tlsResume)
+            sc.tls = true;
+        if (sc.name.empty()) {
+            size_t slash = file.find_last_of('/');
+            sc.name = file.substr(slash == std::string::npos ? 0 : slash + 1);
+        }
+        return sc;
+    }
+
+    std::vector<std::string> listScenarios(const std::string& dir)
+    {
+        std::vector<std::string> files;
+        DIR* d = opendir(dir.c_str());
+        if (!d)
+            die("cannot open scenario directory " + dir);
+        struct dirent* ent;
+        while ((ent = readdir(d)) != NULL) {
+            std::string name = ent->d_name;
+            if (name.size() > 4 && name.compare(name.size() - 4, 4, ".scn") == 0)
+                files.push_back(dir + "/" + name);
+        }
+        closedir(d);
+        std::sort(files.begin(), files.end());
+        return files;
+    }
+
+    void mkdirs(const std::string& path)
+    {
+        for (size_t pos = 1; pos < path.size(); ++pos) {
+            if (path[pos] == '/')
+                mkdir(path.substr(0, pos).c_str(), 0755);
+        }
+    }
+
+    void writeFixture(const std::string& path, size_t size)
+    {
+        struct stat st;
+        if (stat(path.c_str(), &st) == 0 && static_cast<size_t>(st.st_size) == size)
+            return;
+        mkdirs(path);
+        std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+        if (!out)
+            die("cannot create fixture " + path);
+        std::string block = payload(64 * 1024);
+        for (size_t written = 0; written < size; written += block.size())
+            out.write(block.data(), std::min(block.size(), size - written));
+    }
+
+    void createFixtures(const Scenario& sc)
+    {
+        for (size_t i = 0; i < sc.fixtures.size(); ++i) {
+            const Fixture& fx = sc.fixtures[i];
+            if (fx.count <= 0)
+                writeFixture(fx.path, fx.size);
+            for (int n = 0; n < fx.count; ++n)
+                writeFixture(fx.path + "-" + str(n), fx.size);
+        }
+    }
+
+    // utime + stime of a process, in seconds.
+    double processCpu(pid_t pid)
+    {
+        std::ifstream in(("/proc/" + str(pid) + "/stat").c_str());
+        std::string stat;
+        std::getline(in, stat);
+        size_t paren = stat.rfind(')');
+        if (paren == std::string::npos)
+            return 0;
+        std::istringstream fields(stat.substr(paren + 2));
+        std::string field;
+        unsigned long utime = 0, stime = 0;
+        // fields after the command name start at #3 (state); utime and stime are #14 and #15
+        for (int i = 3; i <= 15 && fields >> field; ++i) {
+            if (i == 14)
+                utime = std::strtoul(field.c_str(), NULL, 10);
+            else if (i == 15)
+                stime = std::strtoul(field.c_str(), NULL, 10);
+        }
+        return static_cast<double>(utime + stime) / sysconf(_SC_CLK_TCK);
+    }
+
+    long processStatusKb(pid_t pid, const std::string& key)
+    {
+        std::ifstream in(("/proc/" + str(pid) + "/status").c_str());
+        std::string line;
+        while (std::getline(in, line)) {
+            if (line.compare(0, key.size(), key) == 0)
+                return std::atol(line.c_str() + key.size() + 1);
+        }
+        return 0;
+    }
+
+    bool canConnect(const Options& opt)
+    {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(opt.port);
+        inet_pton(AF_INET, opt.host.c_str(), &addr.sin_addr);
+        bool ok = connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == 0;
+        close(fd);
+        return ok;
+    }
+
+    pid_t launchServer(const Options& opt)
+    {
+        if (canConnect(opt))
+            die("port " + str(opt.port) + " is already in use");
+        pid_t pid = fork();
+        if (pid < 0)
+            die("fork failed");
+        if (pid == 0) {
+            int log = open(opt.serverLog.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (log >= 0) {
+                dup2(log, STDOUT_FILENO);
+                dup2(log, STDERR_FILENO);
+                close(log);
+            }
+            char* argv[3];
+            argv[0] = const_cast<char*>(opt.server.c_str());
+            argv[1] = const_cast<char*>(opt.config.c_str());
+            argv[2] = NULL;
+            execv(argv[0], argv);
+            _exit(127);
+        }
+        for (int i = 0; i < 100; ++i) {
+            if (canConnect(opt))
+                return pid;
+            int status;
+            if (waitpid(pid, &status, WNOHANG) == pid)
+                die("server exited during startup, see " + opt.serverLog);
+            usleep(50000);
+        }
+        kill(pid, SIGKILL);
+        die("server did not start listening on port " + str(opt.port));
+        return -1;
+    }
+
+    void stopServer(pid_t pid)
+    {
+        kill(pid, SIGTERM);
+        for (int i = 0; i < 50; ++i) {
+            if (waitpid(pid, NULL, WNOHANG) == pid)
+                return;
+            usleep(100000);
+        }
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+    }
+
+    class LoadRun {
+        private:
+            const Options&          _opt;
+            const Scenario&         _sc;
+            Result&                 _result;
+            int                     _epfd;
+            std::vector<Connection> _conns;
+            std::map<int, size_t>   _byFd;
+            struct sockaddr_storage _addr;
+            socklen_t               _addrLen;
+            SSL_CTX*                _tls;
+            SSL_SESSION*            _session;  // last resumable session (tls_resume)
+
+            void openConnection(size_t index)
+            {
+                Connection& c = _conns[index];
+                c = Connection();
+                c.fd = socket(_addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK, 0);
+                if (c.fd < 0)
+                    die("socket failed");
+                if (_tls) {
+                    c.ssl = SSL_new(_tls);
+                    if (!c.ssl || SSL_set_fd(c.ssl, c.fd) != 1)
+                        die("SSL_new failed");
+                    SSL_set_connect_state(c.ssl);
+                    SSL_set_tlsext_host_name(c.ssl, "localhost");
+                    if (_session)
+                        SSL_set_session(c.ssl, _session);
+                }
+                int one = 1;
+                if (_addr.ss_family == AF_INET)
+                    setsockopt(c.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                if (connect(c.fd, reinterpret_cast<struct sockaddr*>(&_addr), _addrLen) < 0 && errno != EINPROGRESS) {
+                    _result.connectErrors++;
+                    SSL_free(c.ssl);
+                    c.ssl = NULL;
+                    close(c.fd);
+                    c.fd = -1;
+                    return;
+                }
+                struct epoll_event ev;
+                ev.events = EPOLLOUT | EPOLLIN;
+                ev.data.fd = c.fd;
+                epoll_ctl(_epfd, EPOLL_CTL_ADD, c.fd, &ev);
+                _byFd[c.fd] = index;
+                c.startUs = nowUs();
+            }
+
+            void closeConnection(size_t index)
+            {
+                Connection& c = _conns[index];
+                if (c.fd < 0)
+                    return;
+                epoll_ctl(_epfd, EPOLL_CTL_DEL, c.fd, NULL);
+                _byFd.erase(c.fd);
+                if (c.ssl) {
+                    // TLS 1.3 tickets arrive after the handshake: take the session at close
+                    SSL_SESSION* session = _sc.tlsResume && c.handshakeDone ? SSL_get1_session(c.ssl) : NULL;
+                    if (session && SSL_SESSION_is_resumable(session)) {
+                        if (_session)
+                            SSL_SESSION_free(_session);
+                        _session = session;
+                    } else if (session)
+                        SSL_SESSION_free(session);
+                    // without close_notify OpenSSL marks the session not resumable when it is freed
+                    if (c.handshakeDone)
+                        SSL_shutdown(c.ssl);
+                    SSL_free(c.ssl);
+                    c.ssl = NULL;
+                }
+                close(c.fd);
+                c.fd = -1;
+            }
+
+            // Advances the client handshake; true once requests can be sent.
+            bool handshake(size_t index)
+            {
+                Connection& c = _conns[index];
+                ERR_clear_error();
+                int ret = SSL_do_handshake(c.ssl);
+                if (ret == 1) {
+                    c.handshakeDone = true;
+                    _result.handshakes++;
+                    if (SSL_session_reused(c.ssl))
+                        _result.resumed++;
+                    setInterest(c, EPOLLOUT | EPOLLIN);
+                    return true;
+                }
+                int err = SSL_get_error(c.ssl, ret);
+                if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) {
+                    setInterest(c, err == SSL_ERROR_WANT_READ ? EPOLLIN : EPOLLOUT);
+                    return false;
+                }
+                _result.connectErrors++;
+                closeConnection(index);
+                openConnection(index);
+                return false;
+            }
+
+            // send() / recv() through the TLS session when there is one.
+            ssize_t transfer(Connection& c, char* data, size_t len, bool out)
+            {
+                if (!c.ssl)
+                    return out ? send(c.fd, data, len, MSG_NOSIGNAL) : recv(c.fd, data, len, 0);
+                ERR_clear_error();
+                int n = out ? SSL_write(c.ssl, data, static_cast<int>(len)) : SSL_read(c.ssl, data, static_cast<int>(len));
+                if (n > 0)
+                    return n;
+                int err = SSL_get_error(c.ssl, n);
+                if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) {
+                    errno = EAGAIN;
+                    return -1;
+                }
+                if (err == SSL_ERROR_ZERO_RETURN || (err == SSL_ERROR_SYSCALL && errno == 0))
+                    return 0;
+                errno = ECONNRESET;
+                return -1;
+            }
+
+            void setInterest(const Connection& c, unsigned int events)
+            {
+                struct epoll_event ev;
+                ev.events = events;
+                ev.data.fd = c.fd;
+                epoll_ctl(_epfd, EPOLL_CTL_MOD, c.fd, &ev);
+            }
+
+            void startRequest(Connection& c)
+            {
+                c.sent = 0;
+                c.in.clear();
+                c.headersDone = false;
+                c.status = 0;
+                c.closeAfter = false;
+                c.bodyMode = BODY_NONE;
+                c.remaining = 0;
+                c.chunkState = CHUNK_SIZE;
+                c.startUs = nowUs();
+                setInterest(c, EPOLLOUT | EPOLLIN);
+            }
+
+            void finishRequest(size_t index, bool ok)
+            {
+                Connection& c = _conns[index];
+                long long elapsed = nowUs() - c.startUs;
+                _result.requests++;
+                if (!ok || std::find(_sc.expect.begin(), _sc.expect.end(), c.status) == _sc.expect.end())
+                    _result.errors++;
+                _result.latencies.push_back(static_cast<unsigned int>(elapsed));
+                if (!ok || c.closeAfter) {
+                    closeConnection(index);
+                    _result.reconnects++;
+                    openConnection(index);
+                }
+                else
+                    startRequest(c);
+            }
+
+            bool parseHead(Connection& c)
+            {
+                size_t end = c.in.find("\r\n\r\n");
+                if (end == std::string::npos)
+                    return false;
+                std::string head = c.in.substr(0, end);
+                c.in.erase(0, end + 4);
+                c.headersDone = true;
+                size_t sp = head.find(' ');
+                c.status = sp == std::string::npos ? 0 : std::atoi(head.c_str() + sp + 1);
+                c.bodyMode = BODY_UNTIL_CLOSE;
+                std::istringstream lines(head);
+                std::string line;
+                std::getline(lines, line);
+                while (std::getline(lines, line)) {
+                    size_t colon = line.find(':');
+                    if (colon == std::string::npos)
+                        continue;
+                    std::string name = lower(trim(line.substr(0, colon)));
+                    std::string value = lower(trim(line.substr(colon + 1)));
+                    if (name == "content-length" && c.bodyMode != BODY_CHUNKED) {
+                        c.bodyMode = BODY_LENGTH;
+                        c.remaining = std::strtoul(value.c_str(), NULL, 10);
+                    }
+                    else if (name == "transfer-encoding" && value.find("chunked") != std::string::npos)
+                        c.bodyMode = BODY_CHUNKED;
+                    else if (name == "connection" && value == "close")
+                        c.closeAfter = true;
+                }
+                if (_sc.method == "HEAD" || c.status == 204 || c.status == 304 || c.status < 200)
+                    c.bodyMode = BODY_NONE;
+                return true;
+            }
+
+            // True once the whole chunked body has been consumed.
+            bool consumeChunked(Connection& c)
+            {
+                for (;;) {
+                    if (c.chunkState == CHUNK_DATA) {
+                        size_t take = std::min(c.remaining, c.in.size());
+                        c.in.erase(0, take);
+                        c.remaining -= take;
+                        if (c.remaining > 0)
+                            return false;
+                        c.chunkState = CHUNK_DATA_END;
+                        continue;
+                    }
+                    size_t eol = c.in.find("\r\n");
+                    if (eol == std::string::npos)
+                        return false;
+                    std::string line = c.in.substr(0, eol);
+                    c.in.erase(0, eol + 2);
+                    if (c.chunkState == CHUNK_DATA_END)
+                        c.chunkState = CHUNK_SIZE;
+                    else if (c.chunkState == CHUNK_SIZE) {
+                        c.remaining = std::strtoul(line.c_str(), NULL, 16);
+                        c.chunkState = c.remaining ? CHUNK_DATA : CHUNK_TRAILER;
+                    }
+                    else if (line.empty())
+                        return true;
+                }
+            }
+
+            // True when the response on this connection is complete.
+            bool consumeResponse(Connection& c)
+            {
+                if (!c.headersDone && !parseHead(c))
+                    return false;
+                if (c.bodyMode == BODY_NONE)
+                    return true;
+                if (c.bodyMode == BODY_LENGTH) {
+                    size_t take = std::min(c.remaining, c.in.size());
+                    c.in.erase(0, take);
+                    c.remaining -= take;
+                    return c.remaining == 0;
+                }
+                if (c.bodyMode == BODY_CHUNKED)
+                    return consumeChunked(c);
+                c.in.clear();
+                return false;
+            }
+
+            void onWritable(size_t index)
+            {
+                Connection& c = _conns[index];
+                if (!c.connected) {
+                    int err = 0;
+                    socklen_t len = sizeof(err);
+                    getsockopt(c.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+                    if (err != 0) {
+                        _result.connectErrors++;
+                        closeConnection(index);
+                        openConnection(index);
+                        return;
+                    }
+                    c.connected = true;
+                }
+                if (c.ssl && !c.handshakeDone && !handshake(index))
+                    return;
+                const std::string& req = _sc.request;
+                while (c.sent < req.size()) {
+                    ssize_t n = transfer(c, const_cast<char*>(req.data()) + c.sent, req.size() - c.sent, true);
+                    if (n <= 0)
+                        break;
+                    c.sent += n;
+                    _result.bytesOut += n;
+                }
+                if (c.sent == req.size())
+                    setInterest(c, EPOLLIN);
+            }
+
+            void onReadable(size_t index)
+            {
+                Connection& c = _conns[index];
+                if (c.ssl && !c.handshakeDone) {
+                    if (!c.connected || !handshake(index))
+                        return;
+                    onWritable(index);
+                    return;
+                }
+                char buf[65536];
+                for (;;) {
+                    ssize_t n = transfer(c, buf, sizeof(buf), false);
+                    if (n > 0) {
+                        _result.bytesIn += n;
+                        c.in.append(buf, n);
+                        if (consumeResponse(c)) {
+                            finishRequest(index, true);
+                            return;
+                        }
+                        continue;
+                    }
+                    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                        return;
+                    // peer closed: complete for close-delimited bodies, an error otherwise
+                    bool complete = c.headersDone && c.bodyMode == BODY_UNTIL_CLOSE;
+                    if (c.sent == 0 && c.in.empty() && !c.headersDone) {
+                        // keep-alive connection closed by the server between requests
+                        closeConnection(index);
+                        if (c.connected)
+                            _result.reconnects++;
+                        else
+                            _result.connectErrors++;
+                        openConnection(index);
+                        return;
+                    }
+                    c.closeAfter = true;
+                    finishRequest(index, complete);
+                    return;
+                }
+            }
+
+        public:
+            LoadRun(const Options& opt, const Scenario& sc, Result& result)
+                : _opt(opt), _sc(sc), _result(result), _epfd(epoll_create(1)), _tls(NULL), _session(NULL)
+            {
+                if (sc.tls) {
+                    // the bench certificate is self-signed: no verification
+                    _tls = SSL_CTX_new(TLS_client_method());
+                    if (!_tls)
+                        die("SSL_CTX_new failed");
+                    SSL_CTX_set_verify(_tls, SSL_VERIFY_NONE, NULL);
+                    SSL_CTX_set_mode(_tls, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+                }
+                std::memset(&_addr, 0, sizeof(_addr));
+                if (!sc.socketPath.empty()) {
+                    struct sockaddr_un* un = reinterpret_cast<struct sockaddr_un*>(&_addr);
+                    un->sun_family = AF_UNIX;
+                    std::strncpy(un->sun_path, sc.socketPath.c_str(), sizeof(un->sun_path) - 1);
+                    _addrLen = sizeof(struct sockaddr_un);
+                } else {
+                    struct sockaddr_in* in = reinterpret_cast<struct sockaddr_in*>(&_addr);
+                    in->sin_family = AF_INET;
+                    in->sin_port = htons(sc.port ? sc.port : opt.port);
+                    inet_pton(AF_INET, opt.host.c_str(), &in->sin_addr);
+                    _addrLen = sizeof(struct sockaddr_in);
+                }
+            }
+
+            ~LoadRun()
+            {
+                for (size_t i = 0; i < _conns.size(); ++i)
+                    closeConnection(i);
+                if (_session)
+                    SSL_SESSION_free(_session);
+                if (_tls)
+                    SSL_CTX_free(_tls);
+                close(_epfd);
+            }
+
+            void run(int connections, int seconds)
+            {
+                _conns.resize(connections);
+                for (int i = 0; i < connections; ++i)
+                    openConnection(i);
+                long long start = nowUs();
+                long long deadline = start + static_cast<long long>(seconds) * 1000000LL;
+                struct epoll_event events[256];
+                while (nowUs() < deadline) {
+                    int n = epoll_wait(_epfd, events, 256, 100);
+                    for (int i = 0; i < n; ++i) {
+                        std::map<int, size_t>::iterator it = _byFd.find(events[i].data.fd);
+                        if (it == _byFd.end())
+                            continue;
+                        size_t index = it->second;
+                        int fd = events[i].data.fd;
+                        if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+                            onReadable(index);
+                        if (_conns[index].fd == fd && (events[i].events & EPOLLOUT))
+                            onWritable(index);
+                    }
+                }
+                _result.elapsed = (nowUs() - start) / 1e6;
+            }
+    };
+
+    unsigned int percentile(const std::vector<unsigned int>& sorted, double p)
+    {
+        if (sorted.empty())
+            return 0;
+        size_t rank = static_cast<size_t>(p * sorted.size() + 0.999999);
+        if (rank == 0)
+            rank = 1;
+        return sorted[std::min(rank, sorted.size()) - 1];
+    }
+
+    std::string jsonEscape(const std::string& s)
+    {
+        std::string out;
+        for (size_t i = 0; i < s.size(); ++i) {
+            if (s[i] == '"' || s[i] == '\\')
+                out += '\\';
+            out += s[i];
+        }
+        return out;
+    }
+
+    void writeReport(const Options& opt, const std::vector<Scenario>& scenarios, std::vector<Result>& results)
+    {
+        char stamp[32];
+        time_t now = time(NULL);
+        strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+        std::ostringstream js;
+        js.setf(std::ios::fixed);
+        js.precision(3);
+        js << "{\n  \"timestamp\": \"" << stamp << "\",\n"
+           << "  \"server\": \"" << jsonEscape(opt.server) << "\",\n"
+           << "  \"config\": \"" << jsonEscape(opt.config) << "\",\n"
+           << "  \"connections\": " << opt.connections << ",\n"
+           << "  \"duration_s\": " << opt.duration << ",\n"
+           << "  \"scenarios\": [";
+        for (size_t i = 0; i < results.size(); ++i) {
+            Result& r = results[i];
+            std::sort(r.latencies.begin(), r.latencies.end());
+            double rps = r.elapsed > 0 ? r.requests / r.elapsed : 0;
+            js << (i ? "," : "") << "\n    {\n"
+               << "      \"name\": \"" << jsonEscape(scenarios[i].name) << "\",\n"
+               << "      \"transport\": \"" << (scenarios[i].socketPath.empty() ? "tcp" : "unix")
+               << (scenarios[i].tls ? "+tls" : "") << "\",\n"
+               << "      \"requests\": " << r.requests << ",\n"
+               << "      \"errors\": " << r.errors << ",\n"
+               << "      \"connect_errors\": " << r.connectErrors << ",\n"
+               << "      \"reconnects\": " << r.reconnects << ",\n"
+               << "      \"tls_handshakes\": " << r.handshakes << ",\n"
+               << "      \"tls_resumed\": " << r.resumed << ",\n"
+               << "      \"elapsed_s\": " << r.elapsed << ",\n"
+               << "      \"rps\": " << rps << ",\n"
+               << "      \"latency_us\": { \"p50\": " << percentile(r.latencies, 0.50)
+               << ", \"p99\": " << percentile(r.latencies, 0.99)
+               << ", \"p999\": " << percentile(r.latencies, 0.999)
+               << ", \"max\": " << (r.latencies.empty() ? 0 : r.latencies.back()) << " },\n"
+               << "      \"bytes_in\": " << r.bytesIn << ",\n"
+               << "      \"bytes_out\": " << r.bytesOut << ",\n"
+               << "      \"server\": { \"cpu_s\": " << r.serverCpu
+               << ", \"cpu_pct\": " << (r.elapsed > 0 ? 100.0 * r.serverCpu / r.elapsed : 0)
+               << ", \"rss_kb\": " << r.serverRssKb << ", \"rss_peak_kb\": " << r.serverHwmKb << " }\n"
+               << "    }";
+            std::cout << "  " << scenarios[i].name << ": " << static_cast<long>(rps) << " req/s, p50 "
+                      << percentile(r.latencies, 0.50) << "us, p99 " << percentile(r.latencies, 0.99)
+                      << "us, p999 " << percentile(r.latencies, 0.999) << "us, errors " << r.errors
+                      << ", server cpu " << static_cast<long>(r.elapsed > 0 ? 100.0 * r.serverCpu / r.elapsed : 0)
+                      << "% rss " << r.serverRssKb << "kB";
+            if (scenarios[i].tls)
+                std::cout << ", " << static_cast<long>(r.elapsed > 0 ? r.handshakes / r.elapsed : 0) << " handshakes/s ("
+                          << r.resumed << " of " << r.handshakes << " resumed)";
+            std::cout << std::endl;
+        }
+        js << "\n  ]\n}\n";
+        mkdirs(opt.output);
+        std::ofstream out(opt.output.c_str());
+        if (!out)
+            die("cannot write " + opt.output);
+        out << js.str();
+        std::cout << "Report written to " << opt.output << std::endl;
+    }
+
+    void usage()
+    {
+        std::cerr << "usage: loadgen [-c connections] [-d seconds] [-p port] [-h host]\n"
+                     "               [-s server -f config | -P pid] [-S scenario_dir] [-o report.json]\n"
+                     "               [-l server_log] [scenario.scn ...]\n";
+        std::exit(2);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Options opt;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.size() == 2 && arg[0] == '-' && i + 1 < argc) {
+            std::string value = argv[++i];
+            switch (arg[1]) {
+                case 'c': opt.connections = std::atoi(value.c_str()); break;
+                case 'd': opt.duration = std::atoi(value.c_str()); break;
+                case 'p': opt.port = std::atoi(value.c_str()); break;
+                case 'h': opt.host = value; break;
+                case 's': opt.server = value; break;
+                case 'f': opt.config = value; break;
+                case 'P': opt.attachPid = std::atoi(value.c_str()); break;
+                case 'S': opt.scenarioDir = value; break;
+                case 'o': opt.output = value; break;
+                case 'l': opt.serverLog = value; break;
+                default: usage();
+            }
+        }
+        else if (!arg.empty() && arg[0] != '-')
+            files.push_back(arg);
+        else
+            usage();
+    }
+    if (opt.connections <= 0 || opt.duration <= 0 || (!opt.server.empty() && opt.config.empty()))
+        usage();
+    signal(SIGPIPE, SIG_IGN);
+
+    if (files.empty())
+        files = listScenarios(opt.scenarioDir);
+    std::vector<Scenario> scenarios;
+    for (size_t i = 0; i < files.size(); ++i) {
+        scenarios.push_back(parseScenario(files[i]));
+        buildRequest(scenarios.back(), opt);
+        createFixtures(scenarios.back());
+    }
+
+    pid_t server = opt.attachPid;
+    if (!opt.server.empty())
+        server = launchServer(opt);
+
+    std::vector<Result> results(scenarios.size());
+    for (size_t i = 0; i < scenarios.size(); ++i) {
+        const Scenario& sc = scenarios[i];
+        int connections = sc.connections > 0 ? sc.connections : opt.connections;
+        int seconds = sc.duration > 0 ? sc.duration : opt.duration;
+        std::cout << "Running " << sc.name << " (" << connections << " connections, " << seconds << "s)" << std::endl;
+        double cpuBefore = server ? processCpu(server) : 0;
+        {
+            LoadRun run(opt, sc, results[i]);
+            run.run(connections, seconds);
+        }
+        if (server) {
+            results[i].serverCpu = processCpu(server) - cpuBefore;
+            results[i].serverRssKb = processStatusKb(server, "VmRSS:");
+            results[i].serverHwmKb = processStatusKb(server, "VmHWM:");
+        }
+    }
+
+    if (!opt.server.empty())
+        stopServer(server);
+    writeReport(opt, scenarios, results);
+    return 0;
+}
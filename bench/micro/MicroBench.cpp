@@ -0,0 +1,196 @@
+#include "MicroBench.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fcntl.h>
+#include <iostream>
+#include <new>
+#include <unistd.h>
+
+
+namespace
+{
+    size_t g_allocations = 0;
+    size_t g_allocatedBytes = 0;
+    volatile size_t g_sink = 0;
+
+    long long nowNs()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<long long>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+    }
+
+    // Server code logs to stdout; it is sent to /dev/null while a benchmark runs.
+    class QuietStdout {
+        private:
+            int _saved;
+        public:
+            QuietStdout() : _saved(dup(STDOUT_FILENO))
+            {
+                std::cout.flush();
+                int devnull = open("/dev/null", O_WRONLY);
+                dup2(devnull, STDOUT_FILENO);
+                close(devnull);
+            }
+            ~QuietStdout()
+            {
+                std::cout.flush();
+                dup2(_saved, STDOUT_FILENO);
+                close(_saved);
+            }
+    };
+
+    struct Sample {
+        double nsPerOp;
+        double allocsPerOp;
+        double bytesPerOp;
+    };
+
+    bool byNs(const Sample& a, const Sample& b) { return a.nsPerOp < b.nsPerOp; }
+
+    // Doubles the iteration count until one call lasts at least targetNs.
+    size_t calibrate(BenchFunction run, long long targetNs)
+    {
+        size_t iterations = 1;
+        for (;;) {
+            long long start = nowNs();
+            run(iterations);
+            long long elapsed = nowNs() - start;
+            if (elapsed >= targetNs || iterations >= (static_cast<size_t>(1) << 30))
+                return iterations;
+            if (elapsed < targetNs / 100)
+                iterations *= 10;
+            else
+                iterations = static_cast<size_t>(iterations * (static_cast<double>(targetNs) / elapsed) * 1.1) + 1;
+        }
+    }
+
+    Sample measure(BenchFunction run, size_t iterations)
+    {
+        AllocStats before = allocSnapshot();
+        long long start = nowNs();
+        run(iterations);
+        long long elapsed = nowNs() - start;
+        AllocStats after = allocSnapshot();
+        Sample s;
+        s.nsPerOp = static_cast<double>(elapsed) / iterations;
+        s.allocsPerOp = static_cast<double>(after.allocations - before.allocations) / iterations;
+        s.bytesPerOp = static_cast<double>(after.bytes - before.bytes) / iterations;
+        return s;
+    }
+
+    void usage()
+    {
+        std::cerr << "usage: microbench [-t sample_ms] [-n samples] [filter ...]" << std::endl;
+        std::exit(2);
+    }
+}
+
+
+void* operator new(size_t size) throw(std::bad_alloc)
+{
+    g_allocations++;
+    g_allocatedBytes += size;
+    void* p = std::malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+
+void* operator new[](size_t size) throw(std::bad_alloc)
+{
+    return operator new(size);
+}
+
+
+void operator delete(void* p) throw()
+{
+    std::free(p);
+}
+
+
+void operator delete[](void* p) throw()
+{
+    std::free(p);
+}
+
+
+BenchRegistrar::BenchRegistrar(const char* name, BenchFunction run)
+{
+    BenchCase bench;
+    bench.name = name;
+    bench.run = run;
+    benchRegistry().push_back(bench);
+}
+
+
+std::vector<BenchCase>& benchRegistry()
+{
+    static std::vector<BenchCase> registry;
+    return registry;
+}
+
+
+AllocStats allocSnapshot()
+{
+    AllocStats stats;
+    stats.allocations = g_allocations;
+    stats.bytes = g_allocatedBytes;
+    return stats;
+}
+
+
+void benchSink(size_t value)
+{
+    g_sink = g_sink + value;
+}
+
+
+int main(int argc, char** argv)
+{
+    long long sampleNs = 200LL * 1000000LL;
+    int samples = 5;
+    std::vector<std::string> filters;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-t" && i + 1 < argc)
+            sampleNs = std::atol(argv[++i]) * 1000000LL;
+        else if (arg == "-n" && i + 1 < argc)
+            samples = std::atoi(argv[++i]);
+        else if (!arg.empty() && arg[0] == '-')
+            usage();
+        else
+            filters.push_back(arg);
+    }
+    if (sampleNs <= 0 || samples <= 0)
+        usage();
+
+    std::printf("%-36s %12s %14s %12s %14s\n", "benchmark", "iterations", "ns/op", "allocs/op", "bytes/op");
+    std::vector<BenchCase>& registry = benchRegistry();
+    for (size_t i = 0; i < registry.size(); ++i) {
+        const BenchCase& bench = registry[i];
+        bool selected = filters.empty();
+        for (size_t f = 0; f < filters.size() && !selected; ++f)
+            selected = bench.name.find(filters[f]) != std::string::npos;
+        if (!selected)
+            continue;
+        std::vector<Sample> results;
+        size_t iterations;
+        {
+            QuietStdout quiet;
+            iterations = calibrate(bench.run, sampleNs);   // doubles as warm-up
+            for (int s = 0; s < samples; ++s)
+                results.push_back(measure(bench.run, iterations));
+        }
+        std::sort(results.begin(), results.end(), byNs);
+        const Sample& median = results[results.size() / 2];
+        std::printf("%-36s %12lu %14.1f %12.2f %14.1f\n", bench.name.c_str(),
+            static_cast<unsigned long>(iterations), median.nsPerOp, median.allocsPerOp, median.bytesPerOp);
+        std::fflush(stdout);
+    }
+    return 0;
+}
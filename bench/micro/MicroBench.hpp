@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Minimal timing harness for the hot-path microbenchmarks.
+// A benchmark runs `iterations` operations per call; the runner calibrates the
+// count during warm-up, then reports the median ns/op over several samples along
+// with heap allocations and bytes per op counted by the replaced operator new.
+typedef void (*BenchFunction)(size_t iterations);
+
+struct BenchCase {
+    std::string   name;
+    BenchFunction run;
+};
+
+struct AllocStats {
+    size_t allocations;
+    size_t bytes;
+};
+
+// Registers a benchmark from a static initializer.
+struct BenchRegistrar {
+    BenchRegistrar(const char* name, BenchFunction run);
+};
+
+#define MICRO_BENCH(name, fn) static BenchRegistrar fn##_registrar(name, fn)
+
+std::vector<BenchCase>& benchRegistry();
+AllocStats allocSnapshot();
+
+// Keeps a result observable so the optimiser cannot drop the measured work.
+void benchSink(size_t value);
@@ -0,0 +1,287 @@
+#include "MicroBench.hpp"
+#include "Webserv.hpp"
+#include "../../srcs/network/epollManager.hpp"
+#include "../../srcs/network/Cookie.hpp"
+#include "../../srcs/utils/Utils.hpp"
+
+#include <sys/stat.h>
+
+#define UPLOAD_DIR "/tmp/webserv/microbench"
+#define LOCATION_COUNT 300
+#define FAKE_FD -4242
+
+// Reaches the private epollManager helpers measured below.
+struct HotPathAccess {
+    static epollManager& manager()
+    {
+        static epollManager instance((std::vector<int>()), std::vector< std::vector<ServerConfig> >());
+        return instance;
+    }
+    static const LocationConfig* findLocation(const std::string& uri, const ServerConfig& config)
+    {
+        return manager().findLocationConfig(uri, config);
+    }
+    static std::string resolvePath(const std::string& uri, const ServerConfig& config)
+    {
+        return manager().resolveFilePath(uri, config);
+    }
+    static ClientConnection& connection()
+    {
+        return manager()._clientConnections[FAKE_FD];
+    }
+    static bool consumeChunked()
+    {
+        return manager().consumeChunkedBody(FAKE_FD);
+    }
+    static bool saveMultipart(const std::string& body, const std::string& boundary, size_t& saved)
+    {
+        bool created = false;
+        std::string last;
+        return manager().parseMultipartAndSave(body.data(), body.size(), boundary, UPLOAD_DIR, "/uploads/", saved, created, last);
+    }
+};
+
+
+namespace
+{
+    // A browser-like request: 40 headers, long cookies and client hints.
+    const std::string& headerBlock()
+    {
+        static std::string block;
+        if (block.empty()) {
+            block += "Host: www.example.com\r\n";
+            block += "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/124.0.0.0 Safari/537.36\r\n";
+            block += "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8\r\n";
+            block += "Accept-Language: en-US,en;q=0.9,fr;q=0.8\r\n";
+            block += "Accept-Encoding: gzip, deflate, br, zstd\r\n";
+            block += "Connection: keep-alive\r\n";
+            block += "Referer: https://www.example.com/catalog/items?page=3&sort=price\r\n";
+            block += "Cache-Control: max-age=0\r\n";
+            block += "Upgrade-Insecure-Requests: 1\r\n";
+            block += "Sec-Fetch-Dest: document\r\nSec-Fetch-Mode: navigate\r\nSec-Fetch-Site: same-origin\r\nSec-Fetch-User: ?1\r\n";
+            block += "Sec-CH-UA: \"Chromium\";v=\"124\", \"Google Chrome\";v=\"124\", \"Not-A.Brand\";v=\"99\"\r\n";
+            block += "Sec-CH-UA-Mobile: ?0\r\nSec-CH-UA-Platform: \"Linux\"\r\n";
+            block += "Cookie: session_id=8f14e45fceea167a5a36dedd4bea2543; theme=dark; lang=en; cart=3f2a91c0; "
+                     "_ga=GA1.2.1234567890.1700000000; _gid=GA1.2.987654321.1700000000; consent=analytics%2Cads\r\n";
+            for (int i = 0; i < 20; ++i)
+                block += "X-Trace-Header-" + toString(i) + ": 00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01\r\n";
+            block += "X-Forwarded-For: 203.0.113.7, 198.51.100.23, 192.0.2.1\r\n";
+            block += "If-None-Match: \"5d8c72a5edda8d6a\"\r\n";
+            block += "If-Modified-Since: Wed, 21 Oct 2026 07:28:00 GMT";
+        }
+        return block;
+    }
+
+    const std::string& rawRequest()
+    {
+        static std::string raw;
+        if (raw.empty())
+            raw = "POST /api/v1/service42/items?limit=50 HTTP/1.1\r\n" + headerBlock()
+                + "\r\nContent-Type: application/json\r\nContent-Length: 27\r\n\r\n{\"name\":\"widget\",\"qty\":12}";
+        return raw;
+    }
+
+    // A server with a few hundred prefix locations, as generated by large vhost configs.
+    const ServerConfig& manyLocations()
+    {
+        static ServerConfig config;
+        if (config.getLocations().empty()) {
+            config.setRoot("/var/www/html");
+            for (int i = 0; i < LOCATION_COUNT; ++i) {
+                LocationConfig loc;
+                if (i % 3 == 0)
+                    loc.setPath("/api/v1/service" + toString(i) + "/");
+                else if (i % 3 == 1)
+                    loc.setPath("/static/" + toString(i) + "/");
+                else
+                    loc.setPath("/app" + toString(i));
+                loc.setRoot("/var/www/site" + toString(i));
+                config.addLocation(loc);
+            }
+            LocationConfig root;
+            root.setPath("/");
+            config.addLocation(root);
+        }
+        return config;
+    }
+
+    std::string chunkedBody(size_t total, size_t chunk)
+    {
+        std::string out;
+        std::string data(chunk, 'c');
+        for (size_t sent = 0; sent < total; sent += chunk) {
+            std::ostringstream size;
+            size << std::hex << chunk;
+            out += size.str() + "\r\n" + data + "\r\n";
+        }
+        return out + "0\r\n\r\n";
+    }
+
+    // Two file parts totalling 4 MiB plus a form field.
+    const std::string& multipartBody()
+    {
+        static std::string body;
+        if (body.empty()) {
+            body += "--benchboundary\r\nContent-Disposition: form-data; name=\"title\"\r\n\r\nholiday photos\r\n";
+            body += "--benchboundary\r\nContent-Disposition: form-data; name=\"file\"; filename=\"a.jpg\"\r\n"
+                    "Content-Type: image/jpeg\r\n\r\n" + std::string(3 * 1024 * 1024, 'a') + "\r\n";
+            body += "--benchboundary\r\nContent-Disposition: form-data; name=\"file\"; filename=\"b.png\"\r\n"
+                    "Content-Type: image/png\r\n\r\n" + std::string(1024 * 1024, 'b') + "\r\n";
+            body += "--benchboundary--\r\n";
+        }
+        return body;
+    }
+
+
+    void benchParseHeaderBlock(size_t iterations)
+    {
+        const std::string& block = headerBlock();
+        for (size_t i = 0; i < iterations; ++i) {
+            HeaderTable headers;
+            headers.parse(block.data(), block.size());
+            benchSink(headers.size());
+        }
+    }
+
+    // Successive requests on one keep-alive connection reuse its table.
+    void benchParseHeaderBlockReused(size_t iterations)
+    {
+        const std::string& block = headerBlock();
+        HeaderTable headers;
+        for (size_t i = 0; i < iterations; ++i) {
+            headers.parse(block.data(), block.size());
+            benchSink(headers.size());
+        }
+    }
+
+    void benchParseRequest(size_t iterations)
+    {
+        const std::string& raw = rawRequest();
+        for (size_t i = 0; i < iterations; ++i) {
+            Request request(raw);
+            benchSink(request.getHeaders().size());
+        }
+    }
+
+    void benchFindLocation(size_t iterations)
+    {
+        const ServerConfig& config = manyLocations();
+        const char* uris[] = { "/api/v1/service297/orders/17", "/static/1/css/site.css", "/app2/dashboard", "/index.html" };
+        std::vector<std::string> paths(uris, uris + 4);
+        for (size_t i = 0; i < iterations; ++i)
+            benchSink(reinterpret_cast<size_t>(HotPathAccess::findLocation(paths[i & 3], config)));
+    }
+
+    void benchResolveFilePath(size_t iterations)
+    {
+        const ServerConfig& config = manyLocations();
+        const std::string uri = "/static/151/css/../js/./vendor/app.min.js?v=3#top";
+        for (size_t i = 0; i < iterations; ++i)
+            benchSink(HotPathAccess::resolvePath(uri, config).size());
+    }
+
+    void benchGetResponse(size_t iterations)
+    {
+        Response response;
+        response.setStatus(200, "OK");
+        response.setHeader("Content-Type", "text/html");
+        response.setHeader("Date", getCurrentDate());
+        response.setHeader("Server", "webserv");
+        response.setHeader("Last-Modified", "Wed, 21 Oct 2026 07:28:00 GMT");
+        response.setHeader("ETag", "\"5d8c72a5edda8d6a\"");
+        response.setHeader("Cache-Control", "public, max-age=3600");
+        response.setHeader("Set-Cookie", "session_id=8f14e45fceea167a5a36dedd4bea2543; Path=/; HttpOnly");
+        response.setHeader("Connection", "keep-alive");
+        response.setBody(std::string(16 * 1024, 'r'));
+        for (size_t i = 0; i < iterations; ++i)
+            benchSink(response.getResponse().size());
+    }
+
+    void benchConsumeChunked(size_t iterations)
+    {
+        static const std::string body = chunkedBody(1024 * 1024, 4096);
+        ClientConnection& conn = HotPathAccess::connection();
+        for (size_t i = 0; i < iterations; ++i) {
+            conn.body.clear();
+            conn.chunkBuffer = body;
+            conn.chunkState = CHUNK_READ_SIZE;
+            conn.state = READING_BODY;
+            benchSink(HotPathAccess::consumeChunked());
+        }
+    }
+
+    void benchMultipart(size_t iterations)
+    {
+        const std::string& body = multipartBody();
+        mkdir("/tmp/webserv", 0755);
+        mkdir(UPLOAD_DIR, 0755);
+        for (size_t i = 0; i < iterations; ++i) {
+            size_t saved = 0;
+            HotPathAccess::saveMultipart(body, "benchboundary", saved);
+            benchSink(saved);
+        }
+    }
+
+    void benchContentType(size_t iterations)
+    {
+        const char* files[] = { "/index.html", "/assets/app.JS", "/img/logo.png", "/docs/manual.pdf",
+                                "/fonts/inter.woff2", "/data/export.json", "/README", "/video/intro.mp4" };
+        std::vector<std::string> paths(files, files + 8);
+        for (size_t i = 0; i < iterations; ++i)
+            benchSink(getContentType(paths[i & 7]).size());
+    }
+
+    std::string cookieHeader()
+    {
+        std::string header = "theme=dark; lang=en";
+        for (int i = 0; i < 21; ++i)
+            header += "; pref_" + toString(i) + "=value" + toString(i * 7919);
+        return header + "; session_id=8f14e45fceea167a5a36dedd4bea2543";
+    }
+
+    void benchParseCookies(size_t iterations)
+    {
+        const std::string header = cookieHeader();
+        for (size_t i = 0; i < iterations; ++i)
+            benchSink(parseCookies(header).size());
+    }
+
+    void benchFindCookie(size_t iterations)
+    {
+        const std::string header = cookieHeader();
+        for (size_t i = 0; i < iterations; ++i)
+            benchSink(findCookie(header, "session_id").size());
+    }
+
+    // Resumes one of 10k live sessions per op, as a session-enabled location does on every hit.
+    void benchSessionTouch(size_t iterations)
+    {
+        static SessionStore store;
+        static std::vector<std::string> ids;
+        time_t now = time(NULL);
+        if (ids.empty()) {
+            store.configure(4 * 1024 * 1024, 3600, now);
+            for (int i = 0; i < 10000; ++i) {
+                std::string id;
+                if (store.create(id, now))
+                    ids.push_back(id);
+            }
+        }
+        for (size_t i = 0; i < iterations; ++i)
+            benchSink(store.touch(ids[i % ids.size()], now) != NULL);
+    }
+}
+
+
+MICRO_BENCH("HeaderTable::parse/40_headers", benchParseHeaderBlock);
+MICRO_BENCH("HeaderTable::parse/40_headers_keepalive", benchParseHeaderBlockReused);
+MICRO_BENCH("Request::parseRequest/40_headers", benchParseRequest);
+MICRO_BENCH("findLocationConfig/300_locations", benchFindLocation);
+MICRO_BENCH("resolveFilePath/300_locations", benchResolveFilePath);
+MICRO_BENCH("Response::getResponse/16KiB", benchGetResponse);
+MICRO_BENCH("consumeChunkedBody/1MiB_4KiB_chunks", benchConsumeChunked);
+MICRO_BENCH("parseMultipartAndSave/4MiB", benchMultipart);
+MICRO_BENCH("getContentType/mixed", benchContentType);
+MICRO_BENCH("parseCookies/24_cookies", benchParseCookies);
+MICRO_BENCH("findCookie/24_cookies", benchFindCookie);
+MICRO_BENCH("SessionStore::touch/10k_sessions", benchSessionTouch);
@@ -35,7 +35,9 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <netinet/in.h>
+#include <sys/un.h>
 #include <arpa/inet.h>
 #include <fcntl.h>
 #include <signal.h>
@@ -48,6 +50,7 @@
 //#define DEFAULT_PORT 8080
 //#define DEFAULT_HOST "127.0.0.1"
 #define BACKLOG 256 // connections waiting in queue
+#define ACCEPT_BATCH 32 // connections accepted per listener per loop iteration
 #define BUFFER_SIZE 1024
 #define MAX_EVENTS 64
 #define MAX_REQUEST_SIZE 524288000
@@ -55,10 +58,43 @@
 #define MAX_CGI_PROCESS 500
 #define CONNECTION_TIMEOUT 30
 #define READ_TIMEOUT 12
-#define KEEP_ALIVE_TIMEOUT 10 
+#define KEEP_ALIVE_TIMEOUT 5 // keepalive_timeout default (seconds)
+#define KEEP_ALIVE_REQUESTS 1000 // keepalive_requests default
+#define LINGERING_TIMEOUT 5 // lingering_timeout default (seconds)
+#define LINGERING_TIME 30 // cap on a whole lingering close (seconds)
 #define CLEANUP_INTERVAL 5
 #define CGI_TIMEOUT 10
 #define SESSION_MAX_IDLE 300
+#define SESSION_ZONE_SIZE 1048576 // session pool when no session_zone is configured
+#define PROXY_BUFFER_SIZE 16384
+#define PROXY_MAX_HEADER 65536
+#define PROXY_MAX_PENDING 262144 // client-side backlog before upstream reads pause
+#define PROXY_TIMEOUT 60
+#define UPSTREAM_IDLE_TIMEOUT 60
+#define SHUTDOWN_TIMEOUT 30 // seconds open connections get to finish on SIGTERM or after an upgrade
+#define TLS_SESSION_CACHE 20480 // sessions per certificate when ssl_session_cache is not set
+#define TLS_SESSION_TIMEOUT 300
+#define TLS_RECORD_SIZE 16384 // plaintext bytes per SSL_read / SSL_write call
+#define MEMORY_LIMIT_MIN 1048576 // smallest memory_limit accepted
+#define MEMORY_PRESSURE_PERCENT 80 // of memory_limit: bodies go to disk, large requests get 503, paused reads resume below
+#define MEMORY_LARGE_REQUEST 1048576 // bodies above this (or chunked) are refused under memory pressure
+#define MEMORY_RETRY_AFTER 5 // seconds announced in Retry-After when a request is refused for memory
+#define BUFFER_KEEP_SIZE 65536 // larger buffers are freed between keep-alive requests
+#define BODY_TEMP_PATH "/tmp/webserv-body-XXXXXX" // mkstemp template of spilled request bodies
+#define ADMISSION_INTERVAL_MS 100 // period at which admission_control adjusts its limits
+#define ADMISSION_LAG_TARGET 50 // ms of event loop work per iteration before the request limit shrinks
+#define ADMISSION_CGI_TARGET 2000 // ms of average CGI run time before the CGI limit shrinks
+#define ADMISSION_MIN_REQUESTS 8 // in-flight requests the adaptive limit never goes under
+#define ADMISSION_MIN_CGI 2
+#define ADMISSION_INCREASE 4 // additive step per interval while the loop keeps up
+#define ADMISSION_LOW_SHARE 75 // percent of the limit open to priority low requests
+#define ADMISSION_RESERVE 16 // connections past MAX_CLIENTS kept for priority critical locations
+#define ADMISSION_RETRY_AFTER 1 // seconds announced in Retry-After when a request is shed
+#define AIO_THREADS 4 // workers of the aio threads pool when no thread_pool is configured
+#define AIO_MAX_THREADS 64
+#define AIO_MAX_QUEUE 1024 // jobs waiting for a worker before requests run on the event loop instead
+#define READAHEAD_MIN_SIZE 262144 // files from this size are read with a sequential access hint
+#define URING_ENTRIES 1024 // submission queue of event_backend io_uring; flushed early when full
 
 template <typename T>
 std::string toString(const T &value) 
@@ -78,3 +114,18 @@ inline void ERROR_SYS(const std::string& msg)
 {
     std::cerr << RED << "[ERR]" << RESET << " " << msg << " (" << strerror(errno) << ")" << std::endl;
 }
+
+// Monotonic clock for durations, unaffected by wall-clock changes.
+inline long long monotonicUs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<long long>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+inline long long currentTimeMs()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return static_cast<long long>(tv.tv_sec) * 1000 + tv.tv_usec / 1000;
+}
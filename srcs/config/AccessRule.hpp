@@ -0,0 +1,12 @@
+#pragma once
+
+#include "Webserv.hpp"
+
+// One allow/deny directive; rules are kept in declaration order (first match wins).
+struct AccessRule {
+	bool        allow;
+	std::string source;  // address, CIDR or "all"; a file of those for allow_file/deny_file
+	bool        isFile;
+
+	AccessRule(bool allowRule, const std::string& src, bool file) : allow(allowRule), source(src), isFile(file) {}
+};
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "Webserv.hpp"
+
+// cgi_cache_path <dir> zone=<name> [mem_size=] [max_size=] [inactive=]
+struct CacheZoneConfig {
+	std::string name;
+	std::string path;      // on-disk spill directory
+	size_t      memSize;   // bytes kept in memory before spilling to disk
+	size_t      maxSize;   // bytes allowed on disk
+	time_t      inactive;  // entries unused for this long are dropped
+
+	CacheZoneConfig() : memSize(16 * 1024 * 1024), maxSize(256 * 1024 * 1024), inactive(600) {}
+};
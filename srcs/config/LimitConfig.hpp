@@ -0,0 +1,43 @@
+#pragma once
+
+#include "Webserv.hpp"
+
+// limit_req_zone / limit_conn_zone <key> zone=<name>:<size> [rate=<n>r/s|r/m]
+struct LimitZoneConfig {
+	std::string name;
+	std::string key;      // expanded with the request variables, e.g. $binary_remote_addr
+	size_t      size;     // shared memory budget, turned into a fixed number of entries
+	bool        isRequest;
+	long        rate;     // limit_req only: requests per 1000 seconds (1r/s == 1000)
+
+	LimitZoneConfig() : size(1024 * 1024), isRequest(false), rate(0) {}
+};
+
+// limit_req zone=<name> [burst=<n>] [nodelay]
+struct LimitReqRule {
+	std::string zone;
+	long        burst;
+	bool        nodelay;
+
+	LimitReqRule() : burst(0), nodelay(false) {}
+};
+
+// limit_conn <zone> <n>
+struct LimitConnRule {
+	std::string zone;
+	int         max;
+
+	LimitConnRule() : max(0) {}
+};
+
+// admission_control on [lag=<time>] [cgi_latency=<time>]
+struct AdmissionConfig {
+	bool enabled;
+	long lagMs;          // event loop work per iteration above which the request limit shrinks
+	long cgiLatencyMs;   // average CGI run time above which the CGI limit shrinks
+
+	AdmissionConfig() : enabled(false), lagMs(ADMISSION_LAG_TARGET), cgiLatencyMs(ADMISSION_CGI_TARGET) {}
+};
+
+// priority low | normal | critical: the order requests are shed in under load
+enum RequestPriority { PRIORITY_LOW, PRIORITY_NORMAL, PRIORITY_CRITICAL, PRIORITY_LEVELS };
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "Webserv.hpp"
+
+// listen <addr> [backlog=] [deferred] [fastopen=] [reuseport] [rcvbuf=] [sndbuf=]
+// Socket-level options, so they may be given on one listen of a host:port only.
+struct ListenOptions {
+	int    backlog;    // listen() queue length
+	bool   deferred;   // TCP_DEFER_ACCEPT: accept() once the first data arrived
+	int    fastopen;   // TCP_FASTOPEN queue length, 0: off
+	bool   reuseport;  // SO_REUSEPORT, only applied when the socket is bound
+	size_t rcvbuf;     // SO_RCVBUF / SO_SNDBUF, 0: system default
+	size_t sndbuf;
+
+	ListenOptions() : backlog(BACKLOG), deferred(false), fastopen(0), reuseport(false), rcvbuf(0), sndbuf(0) {}
+
+	bool operator==(const ListenOptions& o) const
+	{
+		return backlog == o.backlog && deferred == o.deferred && fastopen == o.fastopen
+			&& reuseport == o.reuseport && rcvbuf == o.rcvbuf && sndbuf == o.sndbuf;
+	}
+	bool operator!=(const ListenOptions& o) const { return !(*this == o); }
+};
+
+// lingering_close off | on | always: whether a closing connection first drains what the client still sends
+enum LingeringMode { LINGERING_OFF, LINGERING_ON, LINGERING_ALWAYS };
+
+// keepalive_timeout <time>, keepalive_requests <n>, lingering_close, lingering_timeout <time>
+struct KeepAliveConfig {
+	long          timeoutMs;          // idle time between requests, 0: no keep-alive
+	unsigned long requests;           // responses per connection, the last one closes it
+	LingeringMode lingering;
+	long          lingeringTimeoutMs; // longest wait for more client data while lingering
+
+	KeepAliveConfig()
+		: timeoutMs(KEEP_ALIVE_TIMEOUT * 1000L), requests(KEEP_ALIVE_REQUESTS), lingering(LINGERING_ON),
+		  lingeringTimeoutMs(LINGERING_TIMEOUT * 1000L) {}
+};
@@ -7,9 +7,22 @@
 LocationConfig::LocationConfig()
     : _clientMax(0)
     , _autoindex(false)
+    , _autoindexFormat(AUTOINDEX_HTML)
+    , _autoindexPageSize(0)
+    , _allowedMethodMask(0)
     , _uploadCreateDirs(false)
     , _hasReturn(false)
     , _returnCode(0)
+    , _hasProxyPass(false)
+    , _cgiCacheKey("$request_method$host$request_uri")
+    , _cgiCacheValid(0)
+    , _cgiCacheRevalidate(0)
+    , _cgiCacheStaleError(0)
+    , _priority(PRIORITY_NORMAL)
+    , _statusHandler(STATUS_NONE)
+    , _session(false)
+    , _aioThreads(false)
+    , _internal(false)
 {}
 
 LocationConfig::~LocationConfig(){}
@@ -40,6 +53,9 @@ void LocationConfig::setClientMax(const size_t clientMax){
 
 void LocationConfig::setAllowedMethods(std::vector<std::string>& allowedMethods){
 	_allowedMethods = allowedMethods;
+	_allowedMethodMask = 0;
+	for (size_t i = 0; i < allowedMethods.size(); ++i)
+		_allowedMethodMask |= METHOD_BIT(methodId(allowedMethods[i]));
 }
 
 void LocationConfig::setCgiParams(const std::map<std::string, std::string>& cgiParams){
@@ -52,6 +68,7 @@ void LocationConfig::addCgiPass(const std::string& extension, const std::string&
 
 void LocationConfig::addAllowedMethod(const std::string& method) {
 	_allowedMethods.push_back(method);
+	_allowedMethodMask |= METHOD_BIT(methodId(method));
 }
 
 void LocationConfig::addCgiParam(const std::string& key, const std::string& value) {
@@ -68,11 +85,15 @@ void LocationConfig::setAutoindex(const std::string& autoindex){
 }
 
 void LocationConfig::addAllow(const std::string& ip) {
-	_IPallow.push_back(ip);
+	_accessRules.push_back(AccessRule(true, ip, false));
 }
 
 void LocationConfig::addDeny(const std::string& ip) {
-	_IPdeny.push_back(ip);
+	_accessRules.push_back(AccessRule(false, ip, false));
+}
+
+void LocationConfig::addAccessFile(bool allow, const std::string& path) {
+	_accessRules.push_back(AccessRule(allow, path, true));
 }
 
 const std::string& LocationConfig::getPath()const{
@@ -107,10 +128,31 @@ bool LocationConfig::getAutoindex()const{
 	return _autoindex;
 }
 
+void LocationConfig::setAutoindexFormat(AutoindexFormat format){
+	_autoindexFormat = format;
+}
+
+AutoindexFormat LocationConfig::getAutoindexFormat()const{
+	return _autoindexFormat;
+}
+
+void LocationConfig::setAutoindexPageSize(size_t entries){
+	_autoindexPageSize = entries;
+}
+
+size_t LocationConfig::getAutoindexPageSize()const{
+	return _autoindexPageSize;
+}
+
 const std::vector<std::string>& LocationConfig::getAllowedMethods()const{
 	return _allowedMethods;
 }
 
+// No limit_except allows every method.
+bool LocationConfig::allowsMethod(MethodId method)const{
+	return _allowedMethods.empty() || (_allowedMethodMask & METHOD_BIT(method));
+}
+
 const std::map<std::string, std::string>& LocationConfig::getCgiParams()const{
 	return _cgiParams;
 }
@@ -119,12 +161,8 @@ const std::map<std::string, std::string> &LocationConfig::getCgiPass()const{
 	return _cgiPass;
 }
 
-const std::vector<std::string>& LocationConfig::getIPallow()const{
-	return _IPallow;
-}
-
-const std::vector<std::string>& LocationConfig::getIPdeny()const{
-	return _IPdeny;
+const std::vector<AccessRule>& LocationConfig::getAccessRules()const{
+	return _accessRules;
 }
 
 std::string LocationConfig::getCgiInterpreter(const std::string& extension) const {
@@ -163,7 +201,11 @@ void LocationConfig::printConfigLocation() const {
 	}
 	std::cout << std::endl;
 	std::cout << "  Client Max Body Size: " << _clientMax << std::endl;
-	std::cout << "  Autoindex: " << (_autoindex ? "on" : "off") << std::endl;
+	std::cout << "  Autoindex: " << (_autoindex ? "on" : "off");
+	if (_autoindex)
+		std::cout << " (" << (_autoindexFormat == AUTOINDEX_JSON ? "json" : "html")
+		          << (_autoindexPageSize ? ", " + toString(_autoindexPageSize) + " per page" : "") << ")";
+	std::cout << std::endl;
 	
 	if (!_cgiParams.empty()) {
 		std::cout << "  CGI Params:" << std::endl;
@@ -172,27 +214,36 @@ void LocationConfig::printConfigLocation() const {
 		}
 	}
 	
-	if (!_IPallow.empty()) {
-		std::cout << "  Allow: ";
-		for (size_t i = 0; i < _IPallow.size(); ++i) {
-			std::cout << _IPallow[i];
-			if (i < _IPallow.size() - 1) std::cout << ", ";
-		}
-		std::cout << std::endl;
-	}
-	
-	if (!_IPdeny.empty()) {
-		std::cout << "  Deny: ";
-		for (size_t i = 0; i < _IPdeny.size(); ++i) {
-			std::cout << _IPdeny[i];
-			if (i < _IPdeny.size() - 1) std::cout << ", ";
-		}
-		std::cout << std::endl;
+	for (size_t i = 0; i < _accessRules.size(); ++i) {
+		std::cout << "  " << (_accessRules[i].allow ? "Allow" : "Deny") << (_accessRules[i].isFile ? " file: " : ": ")
+		          << _accessRules[i].source << std::endl;
 	}
 
 	if (_hasReturn) {
 		std::cout << "  Return: " << _returnCode << " " << _returnUrl << std::endl;
 	}
+	if (_hasProxyPass) {
+		std::cout << "  Proxy pass: " << _proxyUpstream.getName() << _proxyUri << std::endl;
+	}
+	if (!_cgiCacheZone.empty()) {
+		std::cout << "  CGI cache: " << _cgiCacheZone << " key=" << _cgiCacheKey << " valid=" << _cgiCacheValid
+		          << "s stale_while_revalidate=" << _cgiCacheRevalidate << "s stale_if_error=" << _cgiCacheStaleError << "s" << std::endl;
+	}
+	if (_session)
+		std::cout << "  Session: on" << std::endl;
+	if (_aioThreads)
+		std::cout << "  Aio: threads" << std::endl;
+	if (_internal)
+		std::cout << "  Internal: on" << std::endl;
+	if (_statusHandler != STATUS_NONE)
+		std::cout << "  Status: " << (_statusHandler == STATUS_STUB ? "stub_status" : "metrics") << std::endl;
+	for (size_t i = 0; i < _limitReq.size(); ++i)
+		std::cout << "  Limit req: " << _limitReq[i].zone << " burst=" << _limitReq[i].burst
+		          << (_limitReq[i].nodelay ? " nodelay" : "") << std::endl;
+	for (size_t i = 0; i < _limitConn.size(); ++i)
+		std::cout << "  Limit conn: " << _limitConn[i].zone << " " << _limitConn[i].max << std::endl;
+	if (_priority != PRIORITY_NORMAL)
+		std::cout << "  Priority: " << (_priority == PRIORITY_LOW ? "low" : "critical") << std::endl;
 	if (!_uploadStore.empty()) {
 		std::cout << "  Upload store: " << _uploadStore << std::endl;
 		std::cout << "  Upload create dirs: " << (_uploadCreateDirs?"on":"off") << std::endl;
@@ -208,3 +259,43 @@ const std::string& LocationConfig::getReturnUrl() const { return _returnUrl; }
 void LocationConfig::setUploadStore(const std::string& path) { _uploadStore = path; }
 void LocationConfig::setUploadCreateDirs(const std::string& onoff) { _uploadCreateDirs = (onoff == "on"); }
 const std::string& LocationConfig::getUploadStore() const { return _uploadStore; }
+
+void LocationConfig::setProxyPass(const UpstreamConfig& upstream, const std::string& uri) {
+	_hasProxyPass = true;
+	_proxyUpstream = upstream;
+	_proxyUri = uri;
+}
+bool LocationConfig::hasProxyPass() const { return _hasProxyPass; }
+const UpstreamConfig& LocationConfig::getProxyUpstream() const { return _proxyUpstream; }
+const std::string& LocationConfig::getProxyUri() const { return _proxyUri; }
+
+void LocationConfig::setCgiCache(const std::string& zone) { _cgiCacheZone = (zone == "off") ? "" : zone; }
+void LocationConfig::setCgiCacheKey(const std::string& key) { _cgiCacheKey = key; }
+void LocationConfig::setCgiCacheValid(time_t seconds) { _cgiCacheValid = seconds; }
+void LocationConfig::setCgiCacheRevalidate(time_t seconds) { _cgiCacheRevalidate = seconds; }
+void LocationConfig::setCgiCacheStaleError(time_t seconds) { _cgiCacheStaleError = seconds; }
+bool LocationConfig::hasCgiCache() const { return !_cgiCacheZone.empty(); }
+const std::string& LocationConfig::getCgiCacheZone() const { return _cgiCacheZone; }
+const std::string& LocationConfig::getCgiCacheKey() const { return _cgiCacheKey; }
+time_t LocationConfig::getCgiCacheValid() const { return _cgiCacheValid; }
+time_t LocationConfig::getCgiCacheRevalidate() const { return _cgiCacheRevalidate; }
+time_t LocationConfig::getCgiCacheStaleError() const { return _cgiCacheStaleError; }
+
+void LocationConfig::addLimitReq(const LimitReqRule& rule) { _limitReq.push_back(rule); }
+void LocationConfig::addLimitConn(const LimitConnRule& rule) { _limitConn.push_back(rule); }
+const std::vector<LimitReqRule>& LocationConfig::getLimitReq() const { return _limitReq; }
+const std::vector<LimitConnRule>& LocationConfig::getLimitConn() const { return _limitConn; }
+void LocationConfig::setPriority(RequestPriority priority) { _priority = priority; }
+RequestPriority LocationConfig::getPriority() const { return _priority; }
+
+void LocationConfig::setStatusHandler(StatusHandler handler) { _statusHandler = handler; }
+StatusHandler LocationConfig::getStatusHandler() const { return _statusHandler; }
+
+void LocationConfig::setSession(const std::string& onoff) { _session = (onoff == "on"); }
+bool LocationConfig::hasSession() const { return _session; }
+
+void LocationConfig::setAio(const std::string& mode) { _aioThreads = (mode == "threads"); }
+bool LocationConfig::hasAioThreads() const { return _aioThreads; }
+
+void LocationConfig::setInternal(bool internal) { _internal = internal; }
+bool LocationConfig::isInternal() const { return _internal; }
@@ -1,6 +1,16 @@
 #pragma once
 
 #include "Webserv.hpp"
+#include "UpstreamConfig.hpp"
+#include "AccessRule.hpp"
+#include "LimitConfig.hpp"
+#include "../http/HttpTokens.hpp"
+
+// Built-in status handlers (stub_status / metrics directives)
+enum StatusHandler { STATUS_NONE, STATUS_STUB, STATUS_PROMETHEUS };
+
+// Directory listing output (autoindex_format directive)
+enum AutoindexFormat { AUTOINDEX_HTML, AUTOINDEX_JSON };
 
 class LocationConfig {
 	private:
@@ -10,11 +20,13 @@ class LocationConfig {
 			std::string	_upload;
 			size_t		_clientMax;
 			bool		_autoindex;
+			AutoindexFormat	_autoindexFormat;
+			size_t		_autoindexPageSize;  // entries per listing page, 0 = single page
 
 			std::string					_limit_except;
 			std::vector<std::string>	_allowedMethods;
-			std::vector<std::string> 	_IPallow;
-			std::vector<std::string> 	_IPdeny;
+			unsigned					_allowedMethodMask;  // METHOD_BIT of each limit_except method
+			std::vector<AccessRule>		_accessRules;
 
 			std::map<std::string, std::string>	_cgiParams;
 			std::map<std::string, std::string>	_cgiPass;
@@ -28,6 +40,31 @@ class LocationConfig {
 			int  _returnCode;
 			std::string _returnUrl;
 
+			// Reverse proxy (proxy_pass http://<upstream>[/uri])
+			bool           _hasProxyPass;
+			UpstreamConfig _proxyUpstream;
+			std::string    _proxyUri;
+
+			// Response cache (cgi_cache <zone>)
+			std::string _cgiCacheZone;
+			std::string _cgiCacheKey;
+			time_t      _cgiCacheValid;       // TTL when the script sends no freshness headers
+			time_t      _cgiCacheRevalidate;  // stale-while-revalidate window
+			time_t      _cgiCacheStaleError;  // stale-if-error window
+
+			// Rate limiting (limit_req / limit_conn)
+			std::vector<LimitReqRule>  _limitReq;
+			std::vector<LimitConnRule> _limitConn;  // counted per in-flight request
+			RequestPriority _priority;              // admission_control shedding order
+
+			StatusHandler _statusHandler;
+
+			bool _session;  // track sessions (session_id cookie) for this location
+
+			bool _aioThreads;  // aio threads: file work of this location runs on the thread pool
+
+			bool _internal;    // reachable only through a CGI X-Accel-Redirect / X-Sendfile handoff
+
 	public:
 			int lineOffset;
 			LocationConfig();
@@ -46,6 +83,7 @@ class LocationConfig {
 			void addAllowedMethod(const std::string& method);
 			void addAllow(const std::string& ip);
 			void addDeny(const std::string& ip);
+			void addAccessFile(bool allow, const std::string& path);
 			const std::string& getPath()const;
 			const std::string& getRoot()const;
 			const std::string& getIndex()const;
@@ -53,11 +91,15 @@ class LocationConfig {
 			const std::string& getLimitExcept()const;
 			size_t getClientMax()const;
 			bool getAutoindex()const;
+			void setAutoindexFormat(AutoindexFormat format);
+			AutoindexFormat getAutoindexFormat()const;
+			void setAutoindexPageSize(size_t entries);
+			size_t getAutoindexPageSize()const;
 			const std::vector<std::string>& getAllowedMethods()const;
+			bool allowsMethod(MethodId method)const;
 			const std::map<std::string, std::string>& getCgiParams()const;
 			const std::map<std::string, std::string>& getCgiPass()const;
-			const std::vector<std::string>& getIPallow()const;
-			const std::vector<std::string>& getIPdeny()const;
+			const std::vector<AccessRule>& getAccessRules()const;
 			std::string getCgiInterpreter(const std::string& extension) const;
    			bool isCgiRequest(const std::string& uri) const;
 			bool hasUploadPath() const;
@@ -73,4 +115,47 @@ class LocationConfig {
 			bool hasReturn() const;
 			int  getReturnCode() const;
 			const std::string& getReturnUrl() const;
+
+			// Reverse proxy API
+			void setProxyPass(const UpstreamConfig& upstream, const std::string& uri);
+			bool hasProxyPass() const;
+			const UpstreamConfig& getProxyUpstream() const;
+			const std::string& getProxyUri() const;
+
+			// Response cache API
+			void setCgiCache(const std::string& zone);
+			void setCgiCacheKey(const std::string& key);
+			void setCgiCacheValid(time_t seconds);
+			void setCgiCacheRevalidate(time_t seconds);
+			void setCgiCacheStaleError(time_t seconds);
+			bool hasCgiCache() const;
+			const std::string& getCgiCacheZone() const;
+			const std::string& getCgiCacheKey() const;
+			time_t getCgiCacheValid() const;
+			time_t getCgiCacheRevalidate() const;
+			time_t getCgiCacheStaleError() const;
+
+			// Rate limiting API
+			void addLimitReq(const LimitReqRule& rule);
+			void addLimitConn(const LimitConnRule& rule);
+			const std::vector<LimitReqRule>& getLimitReq() const;
+			const std::vector<LimitConnRule>& getLimitConn() const;
+			void setPriority(RequestPriority priority);
+			RequestPriority getPriority() const;
+
+			// Status API
+			void setStatusHandler(StatusHandler handler);
+			StatusHandler getStatusHandler() const;
+
+			// Sessions API
+			void setSession(const std::string& onoff);
+			bool hasSession() const;
+
+			// aio threads
+			void setAio(const std::string& mode);
+			bool hasAioThreads() const;
+
+			// internal
+			void setInternal(bool internal);
+			bool isInternal() const;
 };
@@ -2,6 +2,7 @@
 #include "ParseConfig.hpp"
 #include "LocationConfig.hpp"
 #include "../utils/ParserUtils.hpp"
+#include "../utils/Utils.hpp"
 
 // Tracks listen directives already seen to prevent duplicate host:port bindings.
 std::set<std::string> g_usedEndpoints;
@@ -37,15 +38,25 @@ void ParseConfig::validateServerConfig(const ServerConfig& server) {
 	// check listen
 	if (server.getListen().empty())
 		throw ParseConfigException("Missing required directive 'listen' in server block", "server");
+	// check server_name
+	if (server.getServerName().empty())
+		throw ParseConfigException("Missing required directive 'server_name' in server block", "server");
+	// several servers may share a listen (virtual hosts) but not a name or the default_server flag on it
 	const std::vector<std::string>& listens = server.getListen();
+	const std::vector<std::string>& names = server.getServerNames();
 	for (size_t i = 0; i < listens.size(); ++i) {
 		const std::string& listenValue = listens[i];
-		if (!g_usedEndpoints.insert(listenValue).second)
-			throw ParseConfigException("Duplicate listen directive");
+		for (size_t j = 0; j < names.size(); ++j) {
+			if (!g_usedEndpoints.insert(listenValue + " " + toLowerCase(names[j])).second)
+				throw ParseConfigException("Conflicting server_name '" + names[j] + "' on " + listenValue, "server_name");
+		}
+		if (server.isDefaultFor(listenValue) && !g_usedEndpoints.insert(listenValue + " default_server").second)
+			throw ParseConfigException("Duplicate default_server on " + listenValue, "listen");
+		if (server.hasListenOptions(listenValue) && !g_usedEndpoints.insert(listenValue + " options").second)
+			throw ParseConfigException("Socket options given twice for " + listenValue, "listen");
 	}
-	// check server_name
-	if (server.getServerName().empty())
-		throw ParseConfigException("Missing required directive 'server_name' in server block", "server");
+	if (server.hasSslListen() && (server.getTls().certificate.empty() || server.getTls().certificateKey.empty()))
+		throw ParseConfigException("A server listening with ssl requires ssl_certificate and ssl_certificate_key", "listen");
 	// check root (server / location)
 	bool hasRoot = !server.getRoot().empty();
 	if (!hasRoot) {
@@ -60,6 +71,31 @@ void ParseConfig::validateServerConfig(const ServerConfig& server) {
 	if (!hasRoot) {
 		throw ParseConfigException("Missing required directive 'root' in server block or locations", "server");
 	}
+	// check cgi_cache zones
+	const std::vector<LocationConfig>& locations = server.getLocations();
+	for (size_t i = 0; i < locations.size(); ++i) {
+		if (locations[i].hasCgiCache() && !server.getCacheZones().count(locations[i].getCgiCacheZone()))
+			throw ParseConfigException("Unknown cgi_cache zone '" + locations[i].getCgiCacheZone()
+				+ "' (declare it with cgi_cache_path)", "cgi_cache", locations[i].getPath());
+	}
+	// check access_log format
+	if (!server.getAccessLog().empty() && server.getLogFormat(server.getAccessLogFormat()).empty())
+		throw ParseConfigException("Unknown log_format '" + server.getAccessLogFormat() + "'", "access_log");
+	// check limit_req / limit_conn zones (server level first, then every location)
+	for (size_t i = 0; i <= locations.size(); ++i) {
+		const std::vector<LimitReqRule>& reqs = (i == 0) ? server.getLimitReq() : locations[i - 1].getLimitReq();
+		const std::vector<LimitConnRule>& conns = (i == 0) ? server.getLimitConn() : locations[i - 1].getLimitConn();
+		for (size_t j = 0; j < reqs.size(); ++j) {
+			std::map<std::string, LimitZoneConfig>::const_iterator zone = server.getLimitZones().find(reqs[j].zone);
+			if (zone == server.getLimitZones().end() || !zone->second.isRequest)
+				throw ParseConfigException("Unknown limit_req zone '" + reqs[j].zone + "' (declare it with limit_req_zone)", "limit_req");
+		}
+		for (size_t j = 0; j < conns.size(); ++j) {
+			std::map<std::string, LimitZoneConfig>::const_iterator zone = server.getLimitZones().find(conns[j].zone);
+			if (zone == server.getLimitZones().end() || zone->second.isRequest)
+				throw ParseConfigException("Unknown limit_conn zone '" + conns[j].zone + "' (declare it with limit_conn_zone)", "limit_conn");
+		}
+	}
 }
 
 
@@ -108,6 +144,165 @@ bool parseBodySize(const std::string& sizeStr, size_t& result, std::string& erro
 }
 
 
+// Removes the socket options (backlog=, deferred, fastopen=, reuseport, rcvbuf=, sndbuf=)
+// and the ssl flag from a listen value and returns the address part.
+static std::string takeListenOptions(const std::string& value, ListenOptions& options, bool& hasOptions, bool& ssl)
+{
+	std::vector<std::string> tokens = ParserUtils::split(value, ' ');
+	std::string rest;
+	for (size_t i = 0; i < tokens.size(); ++i) {
+		const std::string& token = tokens[i];
+		std::string errorDetail;
+		char* end = NULL;
+		if (token == "ssl") {
+			// not a socket option: every server sharing the address may repeat it
+			ssl = true;
+			continue;
+		}
+		if (token == "deferred")
+			options.deferred = true;
+		else if (token == "reuseport")
+			options.reuseport = true;
+		else if (token.compare(0, 8, "backlog=") == 0) {
+			long backlog = std::strtol(token.c_str() + 8, &end, 10);
+			if (token.size() == 8 || *end != '\0' || backlog <= 0 || backlog > 65535)
+				throw ParseConfigException("Invalid listen backlog (1-65535)", "listen", token);
+			options.backlog = static_cast<int>(backlog);
+		}
+		else if (token.compare(0, 9, "fastopen=") == 0) {
+			long queue = std::strtol(token.c_str() + 9, &end, 10);
+			if (token.size() == 9 || *end != '\0' || queue < 0 || queue > 65535)
+				throw ParseConfigException("Invalid listen fastopen queue (0-65535)", "listen", token);
+			options.fastopen = static_cast<int>(queue);
+		}
+		else if (token.compare(0, 7, "rcvbuf=") == 0 || token.compare(0, 7, "sndbuf=") == 0) {
+			size_t size;
+			if (!parseBodySize(token.substr(7), size, errorDetail) || size == 0)
+				throw ParseConfigException("Invalid listen buffer size" + errorDetail, "listen", token);
+			(token[0] == 'r' ? options.rcvbuf : options.sndbuf) = size;
+		}
+		else {
+			rest += (rest.empty() ? "" : " ") + token;
+			continue;
+		}
+		hasOptions = true;
+	}
+	return rest;
+}
+
+
+// Parses a duration such as "500ms", "10s", "5m" or "1h" (bare numbers are seconds) into milliseconds.
+bool parseDuration(const std::string& str, long& result, std::string& errorDetail) {
+	errorDetail = "";
+	if (str.empty()) {
+		errorDetail = "\nValue cannot be empty";
+		return false;
+	}
+	size_t unitPos = 0;
+	while (unitPos < str.size() && isdigit(str[unitPos]))
+		unitPos++;
+	if (unitPos == 0) {
+		errorDetail = "\nMissing numeric value";
+		return false;
+	}
+	std::string unit = str.substr(unitPos);
+	long value = std::strtol(str.substr(0, unitPos).c_str(), NULL, 10);
+	long multiplier = 1000;
+	if (unit == "ms") multiplier = 1;
+	else if (unit.empty() || unit == "s") multiplier = 1000;
+	else if (unit == "m") multiplier = 60L * 1000L;
+	else if (unit == "h") multiplier = 3600L * 1000L;
+	else if (unit == "d") multiplier = 86400L * 1000L;
+	else {
+		errorDetail = "\nInvalid unit";
+		return false;
+	}
+	result = value * multiplier;
+	return true;
+}
+
+
+// Accepts the operand of allow/deny: "all", an IPv4/IPv6 address or a CIDR prefix.
+bool isValidAccessSource(const std::string& value) {
+	return value == "all" || ValidationUtils::isValidIP(value) || ValidationUtils::isValidIPv6(value)
+		|| ValidationUtils::isValidCIDR(value);
+}
+
+
+// Joins the quoted pieces of a log_format pattern ('...' or "..."), keeping unquoted text as is.
+std::string unquoteLogFormat(const std::string& value) {
+	std::string out;
+	size_t i = 0;
+	while (i < value.size()) {
+		char quote = value[i];
+		if (quote != '\'' && quote != '"') {
+			out += value[i++];
+			continue;
+		}
+		size_t end = value.find(quote, i + 1);
+		if (end == std::string::npos)
+			end = value.size();
+		out += value.substr(i + 1, end - i - 1);
+		i = end + 1;
+		while (i < value.size() && (value[i] == ' ' || value[i] == '\t'))
+			++i;
+	}
+	return out;
+}
+
+
+// limit_req zone=<name> [burst=<n>] [nodelay]
+bool parseLimitReqRule(const std::string& value, LimitReqRule& rule, std::string& errorDetail) {
+	std::vector<std::string> parts = ParserUtils::split(value, ' ');
+	for (size_t i = 0; i < parts.size(); ++i) {
+		if (parts[i].compare(0, 5, "zone=") == 0 && parts[i].size() > 5)
+			rule.zone = parts[i].substr(5);
+		else if (parts[i].compare(0, 6, "burst=") == 0 && ValidationUtils::isNumber(parts[i].substr(6)))
+			rule.burst = std::atol(parts[i].c_str() + 6);
+		else if (parts[i] == "nodelay")
+			rule.nodelay = true;
+		else {
+			errorDetail = "unknown parameter " + parts[i];
+			return false;
+		}
+	}
+	if (rule.zone.empty()) {
+		errorDetail = "zone=<name> is required";
+		return false;
+	}
+	return true;
+}
+
+
+// limit_conn <zone> <n>
+bool parseLimitConnRule(const std::string& value, LimitConnRule& rule, std::string& errorDetail) {
+	std::vector<std::string> parts = ParserUtils::split(value, ' ');
+	if (parts.size() != 2 || !ValidationUtils::isNumber(parts[1]) || std::atoi(parts[1].c_str()) <= 0) {
+		errorDetail = "expects <zone> <number>";
+		return false;
+	}
+	rule.zone = parts[0];
+	rule.max = std::atoi(parts[1].c_str());
+	return true;
+}
+
+
+// Splits "host[:port]" into an upstream server entry (port defaults to 80).
+bool parseUpstreamAddress(const std::string& entry, UpstreamServer& server) {
+	size_t colon = entry.rfind(':');
+	server.host = entry.substr(0, colon);
+	server.port = 80;
+	if (colon != std::string::npos) {
+		char *endptr = NULL;
+		long portVal = std::strtol(entry.substr(colon + 1).c_str(), &endptr, 10);
+		if (*endptr != '\0' || !ValidationUtils::isValidPort(static_cast<int>(portVal)))
+			return false;
+		server.port = static_cast<int>(portVal);
+	}
+	return !server.host.empty();
+}
+
+
 void parseCgiPass(std::string &value, LocationConfig& location){
     std::vector<std::string> cgitoken = ParserUtils::split(value, ' ');
     
@@ -306,16 +501,34 @@ void ParseConfig::parseLocationDirectives(const std::string& blockContent, Locat
 					throw ParseConfigException("' - Autoindex must be 'on' or 'off'", "autoindex", directives[i]);
 				location.setAutoindex(directive.value);
 			}
+			else if (directive.name == "autoindex_format") {
+				if (directive.value != "html" && directive.value != "json")
+					throw ParseConfigException("' - autoindex_format must be 'html' or 'json'", "autoindex_format", directives[i]);
+				location.setAutoindexFormat(directive.value == "json" ? AUTOINDEX_JSON : AUTOINDEX_HTML);
+			}
+			else if (directive.name == "autoindex_page_size") {
+				std::string value = ParserUtils::trim(directive.value);
+				if (value.empty() || value.size() > 7 || value.find_first_not_of("0123456789") != std::string::npos)
+					throw ParseConfigException("' - autoindex_page_size must be a number of entries", "autoindex_page_size", directives[i]);
+				location.setAutoindexPageSize(std::strtoul(value.c_str(), NULL, 10));
+			}
 			else if (directive.name == "allow") {
-				if (directive.value != "all" && !ValidationUtils::isValidIP(directive.value) && !ValidationUtils::isValidCIDR(directive.value))
+				if (!isValidAccessSource(directive.value))
 					throw ParseConfigException("' - Invalid IP address or CIDR", "allow", directives[i]);
 				location.addAllow(directive.value);
 			}
 			else if (directive.name == "deny") {
-				if (directive.value != "all" && !ValidationUtils::isValidIP(directive.value) && !ValidationUtils::isValidCIDR(directive.value))
+				if (!isValidAccessSource(directive.value))
 					throw ParseConfigException("' - Invalid IP address or CIDR", "deny", directives[i]);
 				location.addDeny(directive.value);
 			}
+			else if (directive.name == "allow_file" || directive.name == "deny_file") {
+				if (!ValidationUtils::isValidPath(directive.value))
+					throw ParseConfigException("' - Invalid access list file", directive.name, directives[i]);
+				if (access(directive.value.c_str(), R_OK) != 0)
+					throw ParseConfigException("' - Cannot read access list file", directive.name, directives[i]);
+				location.addAccessFile(directive.name == "allow_file", directive.value);
+			}
 			else if (directive.name == "limit_except") {
 				std::vector<std::string> methods = ParserUtils::split(directive.value, ' ');
 				if (methods.empty())
@@ -332,11 +545,81 @@ void ParseConfig::parseLocationDirectives(const std::string& blockContent, Locat
 					throw ParseConfigException("Invalid upload_store path: only absolute paths are allowed", "upload_store");
 				location.setUploadStore(p);
 			}
+			else if (directive.name == "session") {
+				if (directive.value != "on" && directive.value != "off")
+					throw ParseConfigException("' - session must be 'on' or 'off'", "session", directives[i]);
+				location.setSession(directive.value);
+			}
+			else if (directive.name == "internal") {
+				if (!directive.value.empty())
+					throw ParseConfigException("' - internal takes no arguments", "internal", directives[i]);
+				location.setInternal(true);
+			}
+			else if (directive.name == "aio") {
+				if (directive.value != "threads" && directive.value != "off")
+					throw ParseConfigException("' - aio must be 'threads' or 'off'", "aio", directives[i]);
+				location.setAio(directive.value);
+			}
 			else if (directive.name == "upload_create_dirs") {
 				if (directive.value != "on" && directive.value != "off")
 					throw ParseConfigException("' - upload_create_dirs must be 'on' or 'off'", "upload_create_dirs", directives[i]);
 				location.setUploadCreateDirs(ParserUtils::trim(directive.value));
 			}
+			else if (directive.name == "proxy_pass") {
+				parseProxyPass(directive.value, location);
+			}
+			else if (directive.name == "cgi_cache") {
+				if (directive.value.empty() || directive.value.find(' ') != std::string::npos)
+					throw ParseConfigException("' - cgi_cache expects a zone name or 'off'", "cgi_cache", directives[i]);
+				location.setCgiCache(directive.value);
+			}
+			else if (directive.name == "cgi_cache_key") {
+				if (directive.value.empty())
+					throw ParseConfigException("' - cgi_cache_key cannot be empty", "cgi_cache_key", directives[i]);
+				location.setCgiCacheKey(directive.value);
+			}
+			else if (directive.name == "cgi_cache_valid" || directive.name == "cgi_cache_stale_while_revalidate"
+				|| directive.name == "cgi_cache_stale_if_error") {
+				long ms;
+				std::string errorDetail;
+				if (!parseDuration(directive.value, ms, errorDetail))
+					throw ParseConfigException("' - Invalid duration: " + errorDetail, directive.name, directives[i]);
+				if (directive.name == "cgi_cache_valid")
+					location.setCgiCacheValid(ms / 1000);
+				else if (directive.name == "cgi_cache_stale_while_revalidate")
+					location.setCgiCacheRevalidate(ms / 1000);
+				else
+					location.setCgiCacheStaleError(ms / 1000);
+			}
+			else if (directive.name == "stub_status" || directive.name == "metrics") {
+				if (!directive.value.empty() && directive.value != "on")
+					throw ParseConfigException("' - " + directive.name + " takes no arguments", directive.name, directives[i]);
+				location.setStatusHandler(directive.name == "stub_status" ? STATUS_STUB : STATUS_PROMETHEUS);
+			}
+			else if (directive.name == "limit_req") {
+				LimitReqRule rule;
+				std::string errorDetail;
+				if (!parseLimitReqRule(directive.value, rule, errorDetail))
+					throw ParseConfigException("' - " + errorDetail, "limit_req", directives[i]);
+				location.addLimitReq(rule);
+			}
+			else if (directive.name == "limit_conn") {
+				LimitConnRule rule;
+				std::string errorDetail;
+				if (!parseLimitConnRule(directive.value, rule, errorDetail))
+					throw ParseConfigException("' - " + errorDetail, "limit_conn", directives[i]);
+				location.addLimitConn(rule);
+			}
+			else if (directive.name == "priority") {
+				if (directive.value == "low")
+					location.setPriority(PRIORITY_LOW);
+				else if (directive.value == "normal")
+					location.setPriority(PRIORITY_NORMAL);
+				else if (directive.value == "critical")
+					location.setPriority(PRIORITY_CRITICAL);
+				else
+					throw ParseConfigException("' - priority must be 'low', 'normal' or 'critical'", "priority", directives[i]);
+			}
 			else if (directive.name == "return") {
 				// Syntaxe: return <code> <url>;
 				std::vector<std::string> parts = ParserUtils::split(directive.value, ' ');
@@ -398,7 +681,6 @@ void ParseConfig::parseLocationBlock(const std::string& locationBlock, ServerCon
 void ParseConfig::parseServerDirectives(const std::string& blockContent, ServerConfig& server) {
 	std::vector<std::string> lines = ParserUtils::split(blockContent, '\n');
 	Directive directive;
-	bool hasListenDirective = false;
 	bool hasServerBlock = false;
 
 	for (size_t i = 0; i < lines.size(); ++i) {
@@ -443,8 +725,17 @@ void ParseConfig::parseServerDirectives(const std::string& blockContent, ServerC
 			if (listenValue.empty()) {
 				throw ParseConfigException("listen directive cannot be empty", "listen");
 			}
-			server.setListen(listenValue);
-			hasListenDirective = true;
+			ListenOptions options;
+			bool hasOptions = false;
+			bool ssl = false;
+			size_t firstNew = server.getListen().size();
+			server.setListen(takeListenOptions(listenValue, options, hasOptions, ssl));
+			for (size_t j = firstNew; j < server.getListen().size(); ++j) {
+				if (hasOptions)
+					server.setListenOptions(server.getListen()[j], options);
+				if (ssl)
+					server.setListenSsl(server.getListen()[j]);
+			}
 		}
 		else if (ParserUtils::startsWith(line,"autoindex")){
 			directive.value = ParserUtils::getInBetween(line, "autoindex", ";");
@@ -484,6 +775,196 @@ void ParseConfig::parseServerDirectives(const std::string& blockContent, ServerC
 				}
 			}
 		}
+		else if (ParserUtils::startsWith(line, "allow_file") || ParserUtils::startsWith(line, "deny_file")) {
+			bool allow = ParserUtils::startsWith(line, "allow_file");
+			std::string value = ParserUtils::trim(ParserUtils::getInBetween(line, allow ? "allow_file" : "deny_file", ";"));
+			if (!ValidationUtils::isValidPath(value))
+				throw ParseConfigException("Invalid access list file", allow ? "allow_file" : "deny_file", value);
+			if (access(value.c_str(), R_OK) != 0)
+				throw ParseConfigException("Cannot read access list file", allow ? "allow_file" : "deny_file", value);
+			server.addAccessRule(AccessRule(allow, value, true));
+		}
+		else if (ParserUtils::startsWith(line, "allow") || ParserUtils::startsWith(line, "deny")) {
+			bool allow = ParserUtils::startsWith(line, "allow");
+			std::string value = ParserUtils::trim(ParserUtils::getInBetween(line, allow ? "allow" : "deny", ";"));
+			if (!isValidAccessSource(value))
+				throw ParseConfigException("Invalid IP address or CIDR", allow ? "allow" : "deny", value);
+			server.addAccessRule(AccessRule(allow, value, false));
+		}
+		else if (ParserUtils::startsWith(line, "cgi_cache_path")) {
+			std::string value = ParserUtils::trim(ParserUtils::getInBetween(line, "cgi_cache_path", ";"));
+			parseCacheZone(value, server);
+		}
+		else if (ParserUtils::startsWith(line, "log_format")) {
+			// long patterns are usually split over several quoted lines
+			while (line.find(';') == std::string::npos && i + 1 < lines.size())
+				line += " " + ParserUtils::trim(lines[++i]);
+			std::string value = ParserUtils::trim(ParserUtils::getInBetween(line, "log_format", ";"));
+			size_t space = value.find(' ');
+			if (space == std::string::npos)
+				throw ParseConfigException("log_format requires <name> <pattern>", "log_format", value);
+			server.addLogFormat(value.substr(0, space), unquoteLogFormat(ParserUtils::trim(value.substr(space + 1))));
+		}
+		else if (ParserUtils::startsWith(line, "access_log")) {
+			std::vector<std::string> parts = ParserUtils::split(ParserUtils::trim(ParserUtils::getInBetween(line, "access_log", ";")), ' ');
+			if (parts.empty() || parts.size() > 2)
+				throw ParseConfigException("access_log requires <path> [format] or 'off'", "access_log");
+			if (parts[0] != "off" && (parts[0][0] != '/' || !ValidationUtils::isValidPath(dirnameOf(parts[0]))))
+				throw ParseConfigException("Invalid access_log path: the directory must exist", "access_log", parts[0]);
+			server.setAccessLog(parts[0] == "off" ? "" : parts[0], parts.size() == 2 ? parts[1] : "combined");
+		}
+		else if (ParserUtils::startsWith(line, "slow_request_log")) {
+			std::vector<std::string> parts = ParserUtils::split(ParserUtils::trim(ParserUtils::getInBetween(line, "slow_request_log", ";")), ' ');
+			long ms;
+			std::string errorDetail;
+			if (parts.empty() || parts.size() > 2 || !parseDuration(parts[0], ms, errorDetail))
+				throw ParseConfigException("slow_request_log requires <threshold> [path]" + errorDetail, "slow_request_log");
+			if (parts.size() == 2 && (parts[1][0] != '/' || !ValidationUtils::isValidPath(dirnameOf(parts[1]))))
+				throw ParseConfigException("Invalid slow_request_log path: the directory must exist", "slow_request_log", parts[1]);
+			server.setSlowRequestLog(ms, parts.size() == 2 ? parts[1] : "");
+		}
+		else if (ParserUtils::startsWith(line, "shutdown_timeout")) {
+			std::string value = ParserUtils::trim(ParserUtils::getInBetween(line, "shutdown_timeout", ";"));
+			long ms;
+			std::string errorDetail;
+			if (!parseDuration(value, ms, errorDetail))
+				throw ParseConfigException("Invalid shutdown_timeout" + errorDetail, "shutdown_timeout", value);
+			server.setShutdownTimeout(ms);
+		}
+		else if (ParserUtils::startsWith(line, "memory_limit")) {
+			std::string value = ParserUtils::trim(ParserUtils::getInBetween(line, "memory_limit", ";"));
+			size_t bytes = 0;
+			std::string errorDetail;
+			if (value != "off" && (!parseBodySize(value, bytes, errorDetail) || bytes < MEMORY_LIMIT_MIN))
+				throw ParseConfigException("Invalid memory_limit (off, or at least 1m)" + errorDetail, "memory_limit", value);
+			server.setMemoryLimit(bytes);
+		}
+		else if (ParserUtils::startsWith(line, "admission_control")) {
+			std::vector<std::string> parts = ParserUtils::split(ParserUtils::trim(ParserUtils::getInBetween(line, "admission_control", ";")), ' ');
+			AdmissionConfig admission;
+			if (parts.empty() || (parts[0] != "on" && parts[0] != "off"))
+				throw ParseConfigException("admission_control requires 'on' or 'off'", "admission_control");
+			admission.enabled = (parts[0] == "on");
+			for (size_t i = 1; i < parts.size(); ++i) {
+				std::string errorDetail;
+				if (parts[i].compare(0, 4, "lag=") == 0) {
+					if (!parseDuration(parts[i].substr(4), admission.lagMs, errorDetail) || admission.lagMs < 1)
+						throw ParseConfigException("Invalid admission_control lag (at least 1ms)" + errorDetail, "admission_control", parts[i]);
+				}
+				else if (parts[i].compare(0, 12, "cgi_latency=") == 0) {
+					if (!parseDuration(parts[i].substr(12), admission.cgiLatencyMs, errorDetail) || admission.cgiLatencyMs < 1)
+						throw ParseConfigException("Invalid admission_control cgi_latency (at least 1ms)" + errorDetail, "admission_control", parts[i]);
+				}
+				else if (!parts[i].empty())
+					throw ParseConfigException("Unknown admission_control parameter: " + parts[i], "admission_control");
+			}
+			server.setAdmission(admission);
+		}
+		else if (ParserUtils::startsWith(line, "keepalive_timeout") || ParserUtils::startsWith(line, "lingering_timeout")) {
+			std::string name = line.substr(0, line.find_first_of(" \t"));
+			std::string value = ParserUtils::trim(ParserUtils::getInBetween(line, name, ";"));
+			KeepAliveConfig keepAlive = server.getKeepAlive();
+			long ms;
+			std::string errorDetail;
+			if (!parseDuration(value, ms, errorDetail) || (name == "lingering_timeout" && ms < 1))
+				throw ParseConfigException("Invalid " + name + errorDetail, name, value);
+			(name == "keepalive_timeout" ? keepAlive.timeoutMs : keepAlive.lingeringTimeoutMs) = ms;
+			server.setKeepAlive(keepAlive);
+		}
+		else if (ParserUtils::startsWith(line, "keepalive_requests")) {
+			std::string value = ParserUtils::trim(ParserUtils::getInBetween(line, "keepalive_requests", ";"));
+			if (!ValidationUtils::isNumber(value) || std::atol(value.c_str()) <= 0)
+				throw ParseConfigException("Invalid keepalive_requests (at least 1)", "keepalive_requests", value);
+			KeepAliveConfig keepAlive = server.getKeepAlive();
+			keepAlive.requests = std::strtoul(value.c_str(), NULL, 10);
+			server.setKeepAlive(keepAlive);
+		}
+		else if (ParserUtils::startsWith(line, "lingering_close")) {
+			std::string value = ParserUtils::trim(ParserUtils::getInBetween(line, "lingering_close", ";"));
+			KeepAliveConfig keepAlive = server.getKeepAlive();
+			if (value == "off")
+				keepAlive.lingering = LINGERING_OFF;
+			else if (value == "on")
+				keepAlive.lingering = LINGERING_ON;
+			else if (value == "always")
+				keepAlive.lingering = LINGERING_ALWAYS;
+			else
+				throw ParseConfigException("lingering_close requires 'off', 'on' or 'always'", "lingering_close", value);
+			server.setKeepAlive(keepAlive);
+		}
+		else if (ParserUtils::startsWith(line, "event_backend")) {
+			std::string value = ParserUtils::trim(ParserUtils::getInBetween(line, "event_backend", ";"));
+			if (value != "epoll" && value != "io_uring")
+				throw ParseConfigException("event_backend requires 'epoll' or 'io_uring'", "event_backend", value);
+			server.setEventBackend(value);
+		}
+		else if (ParserUtils::startsWith(line, "thread_pool")) {
+			std::vector<std::string> parts = ParserUtils::split(ParserUtils::trim(ParserUtils::getInBetween(line, "thread_pool", ";")), ' ');
+			size_t threads = 0;
+			size_t maxQueue = AIO_MAX_QUEUE;
+			for (size_t i = 0; i < parts.size(); ++i) {
+				std::string number = parts[i].substr(parts[i].find('=') + 1);
+				bool valid = ValidationUtils::isNumber(number) && std::atol(number.c_str()) > 0;
+				if (parts[i].compare(0, 8, "threads=") == 0) {
+					if (!valid || std::atol(number.c_str()) > AIO_MAX_THREADS)
+						throw ParseConfigException("Invalid thread_pool threads (1 to " + toString(AIO_MAX_THREADS) + ")", "thread_pool", parts[i]);
+					threads = std::strtoul(number.c_str(), NULL, 10);
+				}
+				else if (parts[i].compare(0, 10, "max_queue=") == 0) {
+					if (!valid)
+						throw ParseConfigException("Invalid thread_pool max_queue (at least 1)", "thread_pool", parts[i]);
+					maxQueue = std::strtoul(number.c_str(), NULL, 10);
+				}
+				else if (!parts[i].empty())
+					throw ParseConfigException("Unknown thread_pool parameter: " + parts[i], "thread_pool");
+			}
+			if (!threads)
+				throw ParseConfigException("thread_pool requires threads=N", "thread_pool");
+			server.setThreadPool(threads, maxQueue);
+		}
+		else if (ParserUtils::startsWith(line, "ssl_")) {
+			parseTlsDirective(line, server);
+		}
+		else if (ParserUtils::startsWith(line, "session_zone")) {
+			std::vector<std::string> parts = ParserUtils::split(ParserUtils::trim(ParserUtils::getInBetween(line, "session_zone", ";")), ' ');
+			size_t size = SESSION_ZONE_SIZE;
+			long idleMs = SESSION_MAX_IDLE * 1000L;
+			for (size_t i = 0; i < parts.size(); ++i) {
+				std::string errorDetail;
+				if (parts[i].compare(0, 5, "size=") == 0) {
+					if (!parseBodySize(parts[i].substr(5), size, errorDetail))
+						throw ParseConfigException("Invalid session_zone size" + errorDetail, "session_zone", parts[i]);
+				}
+				else if (parts[i].compare(0, 5, "idle=") == 0) {
+					if (!parseDuration(parts[i].substr(5), idleMs, errorDetail) || idleMs < 1000)
+						throw ParseConfigException("Invalid session_zone idle timeout (at least 1s)" + errorDetail, "session_zone", parts[i]);
+				}
+				else if (!parts[i].empty())
+					throw ParseConfigException("Unknown session_zone parameter: " + parts[i], "session_zone");
+			}
+			server.setSessionZone(size, idleMs / 1000);
+		}
+		else if (ParserUtils::startsWith(line, "limit_req_zone") || ParserUtils::startsWith(line, "limit_conn_zone")) {
+			bool isRequest = ParserUtils::startsWith(line, "limit_req_zone");
+			std::string value = ParserUtils::trim(ParserUtils::getInBetween(line, isRequest ? "limit_req_zone" : "limit_conn_zone", ";"));
+			parseLimitZone(value, server, isRequest);
+		}
+		else if (ParserUtils::startsWith(line, "limit_req")) {
+			std::string value = ParserUtils::trim(ParserUtils::getInBetween(line, "limit_req", ";"));
+			LimitReqRule rule;
+			std::string errorDetail;
+			if (!parseLimitReqRule(value, rule, errorDetail))
+				throw ParseConfigException("Invalid limit_req: " + errorDetail, "limit_req", value);
+			server.addLimitReq(rule);
+		}
+		else if (ParserUtils::startsWith(line, "limit_conn")) {
+			std::string value = ParserUtils::trim(ParserUtils::getInBetween(line, "limit_conn", ";"));
+			LimitConnRule rule;
+			std::string errorDetail;
+			if (!parseLimitConnRule(value, rule, errorDetail))
+				throw ParseConfigException("Invalid limit_conn: " + errorDetail, "limit_conn", value);
+			server.addLimitConn(rule);
+		}
 		else
 			std::cerr << "Unknown directive: " << line << std::endl;
 	}
@@ -511,6 +992,8 @@ std::vector<ServerConfig> ParseConfig::parse(const std::string& configPath){
 		} else {
 			_configDir = configPath.substr(0, slash);
 		}
+	_upstreams.clear();
+	parseUpstreamBlocks();
 	std::vector<ServerConfig> servers;
 	std::vector<std::string> serverBlock = parseBlock("server");
 	if (serverBlock.empty()) {
@@ -526,3 +1009,251 @@ std::vector<ServerConfig> ParseConfig::parse(const std::string& configPath){
 	return servers;
 }
 
+
+
+// Collects every top-level "upstream <name> { ... }" block before server blocks are parsed.
+void ParseConfig::parseUpstreamBlocks()
+{
+	size_t pos = 0;
+	while ((pos = _configContent.find("upstream", pos)) != std::string::npos)
+	{
+		size_t lineStart = _configContent.rfind('\n', pos);
+		lineStart = (lineStart == std::string::npos) ? 0 : lineStart + 1;
+		std::string before = ParserUtils::trim(_configContent.substr(lineStart, pos - lineStart));
+		size_t braceStart = _configContent.find('{', pos);
+		size_t lineEnd = _configContent.find('\n', pos);
+		if (!before.empty() || isCommentedLine(_configContent, pos) || braceStart == std::string::npos
+			|| (lineEnd != std::string::npos && lineEnd < braceStart))
+		{
+			pos += 8;
+			continue;
+		}
+		std::string name = ParserUtils::trim(_configContent.substr(pos + 8, braceStart - (pos + 8)));
+		size_t braceEnd = _configContent.find('}', braceStart);
+		if (name.empty() || name.find(' ') != std::string::npos || braceEnd == std::string::npos)
+			throw ParseConfigException("Invalid upstream block", "upstream");
+		if (_upstreams.find(name) != _upstreams.end())
+			throw ParseConfigException("Duplicate upstream block: " + name, "upstream");
+
+		UpstreamConfig upstream;
+		upstream.setName(name);
+		parseUpstreamDirectives(_configContent.substr(braceStart + 1, braceEnd - braceStart - 1), upstream);
+		_upstreams[name] = upstream;
+		pos = braceEnd + 1;
+	}
+}
+
+
+// Parses server/least_conn/hash/keepalive directives inside an upstream block.
+void ParseConfig::parseUpstreamDirectives(const std::string& blockContent, UpstreamConfig& upstream)
+{
+	std::vector<std::string> directives = ParserUtils::split(blockContent, ';');
+	for (size_t i = 0; i < directives.size(); ++i)
+	{
+		Directive directive = parseDirectiveLine(directives[i]);
+		if (directive.name.empty())
+			continue;
+		std::vector<std::string> parts = ParserUtils::split(directive.value, ' ');
+		if (directive.name == "server") {
+			UpstreamServer server;
+			if (parts.empty() || !parseUpstreamAddress(parts[0], server))
+				throw ParseConfigException("' - Invalid upstream server address", "server", directives[i]);
+			for (size_t j = 1; j < parts.size(); ++j) {
+				size_t eq = parts[j].find('=');
+				std::string key = parts[j].substr(0, eq);
+				std::string val = (eq == std::string::npos) ? "" : parts[j].substr(eq + 1);
+				long duration = 0;
+				std::string errorDetail;
+				if (key == "weight" && std::atoi(val.c_str()) > 0)
+					server.weight = std::atoi(val.c_str());
+				else if (key == "max_fails" && !val.empty())
+					server.maxFails = std::atoi(val.c_str());
+				else if (key == "fail_timeout" && parseDuration(val, duration, errorDetail))
+					server.failTimeout = static_cast<time_t>(duration / 1000);
+				else
+					throw ParseConfigException("' - Invalid upstream server parameter: " + parts[j], "server", directives[i]);
+			}
+			upstream.addServer(server);
+		}
+		else if (directive.name == "least_conn")
+			upstream.setBalance(BALANCE_LEAST_CONN);
+		else if (directive.name == "round_robin")
+			upstream.setBalance(BALANCE_ROUND_ROBIN);
+		else if (directive.name == "hash") {
+			if (parts.empty())
+				throw ParseConfigException("' - hash requires a key", "hash", directives[i]);
+			upstream.setBalance(BALANCE_HASH);
+			upstream.setHashKey(parts[0]);
+		}
+		else if (directive.name == "keepalive") {
+			char *endptr = NULL;
+			long count = std::strtol(directive.value.c_str(), &endptr, 10);
+			if (directive.value.empty() || *endptr != '\0' || count < 0)
+				throw ParseConfigException("' - keepalive requires a connection count", "keepalive", directives[i]);
+			upstream.setKeepalive(static_cast<size_t>(count));
+		}
+		else
+			throw ParseConfigException("Unknown upstream directive: " + directive.name, directives[i]);
+	}
+	if (upstream.getServers().empty())
+		throw ParseConfigException("upstream block requires at least one server", "upstream");
+}
+
+
+// Resolves "proxy_pass http://<upstream|host[:port]>[/uri]" against the parsed upstream blocks.
+void ParseConfig::parseProxyPass(const std::string& value, LocationConfig& location)
+{
+	std::string target = ParserUtils::trim(value);
+	if (!ParserUtils::startsWith(target, "http://"))
+		throw ParseConfigException("proxy_pass only supports http:// targets", "proxy_pass");
+	target = target.substr(7);
+	std::string uri;
+	size_t slash = target.find('/');
+	if (slash != std::string::npos) {
+		uri = target.substr(slash);
+		target = target.substr(0, slash);
+	}
+	std::map<std::string, UpstreamConfig>::const_iterator it = _upstreams.find(target);
+	if (it != _upstreams.end()) {
+		location.setProxyPass(it->second, uri);
+		return;
+	}
+	UpstreamServer server;
+	if (!parseUpstreamAddress(target, server))
+		throw ParseConfigException("Invalid proxy_pass address: " + target, "proxy_pass");
+	UpstreamConfig implicit;
+	implicit.setName(server.host + ":" + toString(server.port));
+	implicit.addServer(server);
+	location.setProxyPass(implicit, uri);
+}
+
+
+// cgi_cache_path <dir> zone=<name> [mem_size=<size>] [max_size=<size>] [inactive=<duration>]
+void ParseConfig::parseCacheZone(const std::string& value, ServerConfig& server)
+{
+	std::vector<std::string> parts = ParserUtils::split(value, ' ');
+	if (parts.size() < 2)
+		throw ParseConfigException("cgi_cache_path requires <dir> zone=<name>", "cgi_cache_path", value);
+	CacheZoneConfig zone;
+	zone.path = parts[0];
+	if (!ValidationUtils::isValidPath(zone.path))
+		throw ParseConfigException("Invalid cgi_cache_path: must be an existing absolute directory", "cgi_cache_path", value);
+	for (size_t i = 1; i < parts.size(); ++i) {
+		size_t eq = parts[i].find('=');
+		std::string key = parts[i].substr(0, eq);
+		std::string param = (eq == std::string::npos) ? "" : parts[i].substr(eq + 1);
+		std::string errorDetail;
+		if (key == "zone" && !param.empty())
+			zone.name = param;
+		else if (key == "mem_size") {
+			if (!parseBodySize(param, zone.memSize, errorDetail))
+				throw ParseConfigException("Invalid mem_size: " + errorDetail, "cgi_cache_path", value);
+		}
+		else if (key == "max_size") {
+			if (!parseBodySize(param, zone.maxSize, errorDetail))
+				throw ParseConfigException("Invalid max_size: " + errorDetail, "cgi_cache_path", value);
+		}
+		else if (key == "inactive") {
+			long ms;
+			if (!parseDuration(param, ms, errorDetail))
+				throw ParseConfigException("Invalid inactive: " + errorDetail, "cgi_cache_path", value);
+			zone.inactive = ms / 1000;
+		}
+		else
+			throw ParseConfigException("Unknown cgi_cache_path parameter: " + parts[i], "cgi_cache_path", value);
+	}
+	if (zone.name.empty())
+		throw ParseConfigException("cgi_cache_path requires zone=<name>", "cgi_cache_path", value);
+	server.addCacheZone(zone);
+}
+
+
+// limit_req_zone <key> zone=<name>:<size> rate=<n>r/s|r/m  /  limit_conn_zone <key> zone=<name>:<size>
+void ParseConfig::parseLimitZone(const std::string& value, ServerConfig& server, bool isRequest)
+{
+	const std::string directive = isRequest ? "limit_req_zone" : "limit_conn_zone";
+	std::vector<std::string> parts = ParserUtils::split(value, ' ');
+	if (parts.size() < 2 || parts[0].empty() || parts[0][0] != '$')
+		throw ParseConfigException(directive + " requires <$key> zone=<name>:<size>", directive, value);
+	LimitZoneConfig zone;
+	zone.key = parts[0];
+	zone.isRequest = isRequest;
+	for (size_t i = 1; i < parts.size(); ++i) {
+		std::string errorDetail;
+		if (parts[i].compare(0, 5, "zone=") == 0) {
+			std::string spec = parts[i].substr(5);
+			size_t colon = spec.find(':');
+			zone.name = spec.substr(0, colon);
+			if (colon != std::string::npos && !parseBodySize(spec.substr(colon + 1), zone.size, errorDetail))
+				throw ParseConfigException("Invalid zone size: " + errorDetail, directive, value);
+		}
+		else if (isRequest && parts[i].compare(0, 5, "rate=") == 0) {
+			std::string rate = parts[i].substr(5);
+			size_t unit = rate.find("r/");
+			std::string count = rate.substr(0, unit);
+			if (unit == std::string::npos || !ValidationUtils::isNumber(count) || std::atol(count.c_str()) <= 0
+				|| (rate.substr(unit) != "r/s" && rate.substr(unit) != "r/m"))
+				throw ParseConfigException("Invalid rate: expected <n>r/s or <n>r/m", directive, value);
+			zone.rate = std::atol(count.c_str()) * 1000;
+			if (rate.substr(unit) == "r/m")
+				zone.rate /= 60;
+		}
+		else
+			throw ParseConfigException("Unknown " + directive + " parameter: " + parts[i], directive, value);
+	}
+	if (zone.name.empty())
+		throw ParseConfigException(directive + " requires zone=<name>:<size>", directive, value);
+	if (isRequest && zone.rate <= 0)
+		throw ParseConfigException("limit_req_zone requires rate=<n>r/s", directive, value);
+	server.addLimitZone(zone);
+}
+
+// ssl_certificate <pem> / ssl_certificate_key <pem> (relative to the configuration file),
+// ssl_session_cache off|builtin[:<sessions>], ssl_session_timeout <duration>,
+// ssl_session_tickets on|off, ssl_ktls on|off
+void ParseConfig::parseTlsDirective(const std::string& line, ServerConfig& server)
+{
+	size_t space = line.find_first_of(" \t");
+	std::string name = line.substr(0, space);
+	std::string value = ParserUtils::trim(ParserUtils::getInBetween(line, name, ";"));
+	TlsConfig tls = server.getTls();
+	if (name == "ssl_certificate" || name == "ssl_certificate_key") {
+		if (value.empty())
+			throw ParseConfigException(name + " requires a file path", name);
+		std::string path = (value[0] == '/') ? value : _configDir + "/" + value;
+		if (access(path.c_str(), R_OK) != 0)
+			throw ParseConfigException("Cannot read " + name + " file", name, path);
+		(name == "ssl_certificate" ? tls.certificate : tls.certificateKey) = path;
+	}
+	else if (name == "ssl_session_cache") {
+		if (value == "off")
+			tls.sessionCache = 0;
+		else if (value == "builtin")
+			tls.sessionCache = TLS_SESSION_CACHE;
+		else if (value.compare(0, 8, "builtin:") == 0 && ValidationUtils::isNumber(value.substr(8))
+			&& std::atol(value.c_str() + 8) > 0)
+			tls.sessionCache = std::atol(value.c_str() + 8);
+		else
+			throw ParseConfigException("ssl_session_cache expects 'off', 'builtin' or 'builtin:<sessions>'", name, value);
+	}
+	else if (name == "ssl_session_timeout") {
+		long ms;
+		std::string errorDetail;
+		if (!parseDuration(value, ms, errorDetail) || ms < 1000)
+			throw ParseConfigException("Invalid ssl_session_timeout (at least 1s)" + errorDetail, name, value);
+		tls.sessionTimeout = ms / 1000;
+	}
+	else if (name == "ssl_session_tickets" || name == "ssl_ktls") {
+		if (value != "on" && value != "off")
+			throw ParseConfigException(name + " must be 'on' or 'off'", name, value);
+		(name == "ssl_ktls" ? tls.ktls : tls.sessionTickets) = (value == "on");
+	}
+	else
+		throw ParseConfigException("Unknown directive", name, value);
+	server.setTls(tls);
+}
+
+const std::map<std::string, UpstreamConfig>& ParseConfig::getUpstreams() const
+{
+	return _upstreams;
+}
@@ -3,6 +3,7 @@
 #include "Webserv.hpp"
 #include "ServerConfig.hpp"
 #include "LocationConfig.hpp"
+#include "UpstreamConfig.hpp"
 #include "../utils/ValidationUtils.hpp"
 #include "ParseConfigException.hpp"
 
@@ -25,6 +26,7 @@ class ParseConfig {
 					std::string _configContent;
 					size_t 		_pos;
 					std::string _configDir; // directory of the loaded config file
+					std::map<std::string, UpstreamConfig> _upstreams; // named upstream blocks
 
 		public:
 			ServerConfig server;
@@ -38,4 +40,11 @@ class ParseConfig {
 			std::vector<std::string> extractLocationBlocks(const std::string& serverContent);
 			void parseLocationBlock(const std::string& locationBlock, ServerConfig& server);
 			Directive parseDirectiveLine(const std::string &rawLine);
+			void parseUpstreamBlocks();
+			void parseUpstreamDirectives(const std::string& blockContent, UpstreamConfig& upstream);
+			void parseProxyPass(const std::string& value, LocationConfig& location);
+			void parseCacheZone(const std::string& value, ServerConfig& server);
+			void parseLimitZone(const std::string& value, ServerConfig& server, bool isRequest);
+			void parseTlsDirective(const std::string& line, ServerConfig& server);
+			const std::map<std::string, UpstreamConfig>& getUpstreams() const;
 };
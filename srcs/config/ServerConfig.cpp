@@ -8,6 +8,14 @@ ServerConfig::ServerConfig()
     , _clientMax(0)
     , _autoindex(false)
     , _errorPageDirectory("")
+    , _accessLogFormat("combined")
+    , _slowRequestMs(-1)
+    , _sessionZoneSize(0)
+    , _sessionIdle(SESSION_MAX_IDLE)
+    , _shutdownTimeoutMs(-1)
+    , _memoryLimit(0)
+    , _threadPoolThreads(0)
+    , _threadPoolQueue(0)
 {
 }
 ServerConfig::~ServerConfig(){}
@@ -22,11 +30,34 @@ ServerConfig ServerConfig::operator=(const ServerConfig& src)
         this->_root = src._root;
         this->_index = src._index;
         this->_listen = src._listen;
+        this->_defaultListens = src._defaultListens;
+        this->_listenOptions = src._listenOptions;
+        this->_sslListens = src._sslListens;
+        this->_tls = src._tls;
         this->_clientMax = src._clientMax;
         this->_autoindex = src._autoindex;
         this->_errorPages = src._errorPages;
         this->_errorPageDirectory = src._errorPageDirectory;
         this->_locations = src._locations;
+        this->_cacheZones = src._cacheZones;
+        this->_accessRules = src._accessRules;
+        this->_limitZones = src._limitZones;
+        this->_limitReq = src._limitReq;
+        this->_limitConn = src._limitConn;
+        this->_logFormats = src._logFormats;
+        this->_accessLog = src._accessLog;
+        this->_accessLogFormat = src._accessLogFormat;
+        this->_slowRequestMs = src._slowRequestMs;
+        this->_slowRequestLog = src._slowRequestLog;
+        this->_sessionZoneSize = src._sessionZoneSize;
+        this->_sessionIdle = src._sessionIdle;
+        this->_shutdownTimeoutMs = src._shutdownTimeoutMs;
+        this->_memoryLimit = src._memoryLimit;
+        this->_admission = src._admission;
+        this->_eventBackend = src._eventBackend;
+        this->_threadPoolThreads = src._threadPoolThreads;
+        this->_threadPoolQueue = src._threadPoolQueue;
+        this->_keepAlive = src._keepAlive;
     }
     return *this;
 }
@@ -65,18 +96,46 @@ void ServerConfig::setListen(const std::string& listenStr) {
     if (tokens.empty())
         throw ParseConfigException("listen directive requires a parameter (ip:port, ip or port)", "listen");
 
+    bool isDefault = false;
+    size_t firstNew = _listen.size();
     for (size_t i = 0; i < tokens.size(); ++i) {
         std::string entry = ParserUtils::trim(tokens[i]);
         if (entry.empty())
             continue;
-        if (entry == "default_server")
+        if (entry == "default_server") {
+            isDefault = true;
             continue;
+        }
 
         std::string hostCandidate;
         int portCandidate = -1;
 
         size_t colon = entry.find(':');
-        if (colon != std::string::npos) {
+        if (entry.compare(0, 5, "unix:") == 0) {
+            // format: unix:/path, the path is the whole address
+            if (entry.size() < 7 || entry[5] != '/' || entry.size() - 5 >= sizeof(((struct sockaddr_un*)0)->sun_path))
+                throw ParseConfigException("listen unix: requires an absolute socket path (at most 107 bytes)", "listen", entry);
+            hostCandidate = entry;
+            portCandidate = 0;
+        } else if (entry[0] == '[') {
+            // format: [ipv6]:port or [ipv6]
+            size_t close = entry.find(']');
+            if (close == std::string::npos || !ValidationUtils::isValidIPv6(entry.substr(1, close - 1)))
+                throw ParseConfigException("Invalid IPv6 address in listen directive", "listen", entry);
+            hostCandidate = entry.substr(0, close + 1);
+            if (close + 1 == entry.size()) {
+                if (_port <= 0)
+                    throw ParseConfigException("listen directive with host requires a port", "listen");
+                portCandidate = _port;
+            } else {
+                char *endptr = NULL;
+                long portVal = std::strtol(entry.c_str() + close + 2, &endptr, 10);
+                if (entry[close + 1] != ':' || close + 2 == entry.size() || *endptr != '\0'
+                    || !ValidationUtils::isValidPort(static_cast<int>(portVal)))
+                    throw ParseConfigException("Invalid port number in listen directive", "listen");
+                portCandidate = static_cast<int>(portVal);
+            }
+        } else if (colon != std::string::npos) {
             // format: host:port
             hostCandidate = entry.substr(0, colon);
             std::string portPart = entry.substr(colon + 1);
@@ -112,7 +171,7 @@ void ServerConfig::setListen(const std::string& listenStr) {
         if (portCandidate == -1)
             throw ParseConfigException("listen directive requires a valid port", "listen");
 
-        std::string normalized = hostCandidate + ":" + toString(portCandidate);
+        std::string normalized = listenKey(hostCandidate, portCandidate);
         if (std::find(_listen.begin(), _listen.end(), normalized) != _listen.end())
             throw ParseConfigException("Duplicate listen directive");
         _listen.push_back(normalized);
@@ -123,6 +182,12 @@ void ServerConfig::setListen(const std::string& listenStr) {
             _port = portCandidate;
         }
     }
+    if (isDefault)
+        _defaultListens.insert(_defaultListens.end(), _listen.begin() + firstNew, _listen.end());
+}
+
+bool ServerConfig::isDefaultFor(const std::string& listen) const {
+    return std::find(_defaultListens.begin(), _defaultListens.end(), listen) != _defaultListens.end();
 }
 
 
@@ -182,6 +247,207 @@ void ServerConfig::addLocation(const LocationConfig& location)
 	_locations.push_back(location);
 }
 
+void ServerConfig::setListenOptions(const std::string& listen, const ListenOptions& options)
+{
+	_listenOptions[listen] = options;
+}
+
+bool ServerConfig::hasListenOptions(const std::string& listen) const {
+	return _listenOptions.count(listen) != 0;
+}
+
+ListenOptions ServerConfig::getListenOptions(const std::string& listen) const {
+	std::map<std::string, ListenOptions>::const_iterator it = _listenOptions.find(listen);
+	return it == _listenOptions.end() ? ListenOptions() : it->second;
+}
+
+void ServerConfig::setListenSsl(const std::string& listen)
+{
+	if (!isSslListen(listen))
+		_sslListens.push_back(listen);
+}
+
+bool ServerConfig::isSslListen(const std::string& listen) const {
+	return std::find(_sslListens.begin(), _sslListens.end(), listen) != _sslListens.end();
+}
+
+bool ServerConfig::hasSslListen() const {
+	return !_sslListens.empty();
+}
+
+void ServerConfig::setTls(const TlsConfig& tls)
+{
+	_tls = tls;
+}
+
+const TlsConfig& ServerConfig::getTls() const {
+	return _tls;
+}
+
+void ServerConfig::addCacheZone(const CacheZoneConfig& zone)
+{
+	_cacheZones[zone.name] = zone;
+}
+
+const std::map<std::string, CacheZoneConfig>& ServerConfig::getCacheZones() const {
+	return _cacheZones;
+}
+
+void ServerConfig::addAccessRule(const AccessRule& rule)
+{
+	_accessRules.push_back(rule);
+}
+
+const std::vector<AccessRule>& ServerConfig::getAccessRules() const {
+	return _accessRules;
+}
+
+void ServerConfig::addLimitZone(const LimitZoneConfig& zone)
+{
+	_limitZones[zone.name] = zone;
+}
+
+const std::map<std::string, LimitZoneConfig>& ServerConfig::getLimitZones() const {
+	return _limitZones;
+}
+
+void ServerConfig::addLimitReq(const LimitReqRule& rule)
+{
+	_limitReq.push_back(rule);
+}
+
+const std::vector<LimitReqRule>& ServerConfig::getLimitReq() const {
+	return _limitReq;
+}
+
+void ServerConfig::addLimitConn(const LimitConnRule& rule)
+{
+	_limitConn.push_back(rule);
+}
+
+const std::vector<LimitConnRule>& ServerConfig::getLimitConn() const {
+	return _limitConn;
+}
+
+void ServerConfig::addLogFormat(const std::string& name, const std::string& pattern)
+{
+	_logFormats[name] = pattern;
+}
+
+// Declared formats first, then the built-in "combined" and "timing"; empty when unknown.
+std::string ServerConfig::getLogFormat(const std::string& name) const {
+	std::map<std::string, std::string>::const_iterator it = _logFormats.find(name);
+	if (it != _logFormats.end())
+		return it->second;
+	if (name == "combined")
+		return "$remote_addr - - [$time_local] \"$request\" $status $body_bytes_sent \"$http_referer\" \"$http_user_agent\"";
+	if (name == "timing")
+		return "$remote_addr [$time_local] \"$request\" $status $bytes_sent rt=$request_time wait=$wait_time"
+			" hdr=$header_time body=$body_time queue=$queue_time ut=$upstream_time ttfb=$first_byte_time send=$send_time";
+	return "";
+}
+
+void ServerConfig::setAccessLog(const std::string& path, const std::string& format)
+{
+	_accessLog = path;
+	_accessLogFormat = format;
+}
+
+const std::string& ServerConfig::getAccessLog() const {
+	return _accessLog;
+}
+
+const std::string& ServerConfig::getAccessLogFormat() const {
+	return _accessLogFormat;
+}
+
+void ServerConfig::setSlowRequestLog(long thresholdMs, const std::string& path)
+{
+	_slowRequestMs = thresholdMs;
+	_slowRequestLog = path;
+}
+
+long ServerConfig::getSlowRequestMs() const {
+	return _slowRequestMs;
+}
+
+const std::string& ServerConfig::getSlowRequestLog() const {
+	return _slowRequestLog;
+}
+
+void ServerConfig::setSessionZone(size_t size, time_t idle)
+{
+	_sessionZoneSize = size;
+	_sessionIdle = idle;
+}
+
+size_t ServerConfig::getSessionZoneSize() const {
+	return _sessionZoneSize;
+}
+
+time_t ServerConfig::getSessionIdle() const {
+	return _sessionIdle;
+}
+
+void ServerConfig::setShutdownTimeout(long ms)
+{
+	_shutdownTimeoutMs = ms;
+}
+
+long ServerConfig::getShutdownTimeout() const {
+	return _shutdownTimeoutMs;
+}
+
+void ServerConfig::setMemoryLimit(size_t bytes)
+{
+	_memoryLimit = bytes;
+}
+
+size_t ServerConfig::getMemoryLimit() const {
+	return _memoryLimit;
+}
+
+void ServerConfig::setAdmission(const AdmissionConfig& admission)
+{
+	_admission = admission;
+}
+
+const AdmissionConfig& ServerConfig::getAdmission() const {
+	return _admission;
+}
+
+void ServerConfig::setEventBackend(const std::string& backend)
+{
+	_eventBackend = backend;
+}
+
+const std::string& ServerConfig::getEventBackend() const {
+	return _eventBackend;
+}
+
+void ServerConfig::setThreadPool(size_t threads, size_t maxQueue)
+{
+	_threadPoolThreads = threads;
+	_threadPoolQueue = maxQueue;
+}
+
+size_t ServerConfig::getThreadPoolThreads() const {
+	return _threadPoolThreads;
+}
+
+size_t ServerConfig::getThreadPoolQueue() const {
+	return _threadPoolQueue;
+}
+
+void ServerConfig::setKeepAlive(const KeepAliveConfig& keepAlive)
+{
+	_keepAlive = keepAlive;
+}
+
+const KeepAliveConfig& ServerConfig::getKeepAlive() const {
+	return _keepAlive;
+}
+
 void ServerConfig::addErrorPage(int errorCode, const std::string& path) {
 	_errorPages[errorCode] = path;
 }
@@ -233,9 +499,49 @@ void ServerConfig::printConfig() const {
 		if (i < _listen.size() - 1) std::cout << ", ";
 	}
 	std::cout << std::endl;
+	for (size_t i = 0; i < _accessRules.size(); ++i)
+		std::cout << (_accessRules[i].allow ? "Allow" : "Deny") << (_accessRules[i].isFile ? " file: " : ": ")
+		          << _accessRules[i].source << std::endl;
+	for (std::map<std::string, CacheZoneConfig>::const_iterator it = _cacheZones.begin(); it != _cacheZones.end(); ++it)
+		std::cout << "Cache zone: " << it->first << " path=" << it->second.path << " mem_size=" << it->second.memSize
+		          << " max_size=" << it->second.maxSize << " inactive=" << it->second.inactive << "s" << std::endl;
+	if (!_accessLog.empty())
+		std::cout << "Access log: " << _accessLog << " format=" << _accessLogFormat << std::endl;
+	if (!_sslListens.empty())
+		std::cout << "TLS: certificate=" << _tls.certificate << " key=" << _tls.certificateKey << " session_cache="
+		          << _tls.sessionCache << " session_timeout=" << _tls.sessionTimeout << "s tickets="
+		          << (_tls.sessionTickets ? "on" : "off") << " ktls=" << (_tls.ktls ? "on" : "off") << std::endl;
+	if (_sessionZoneSize)
+		std::cout << "Session zone: " << _sessionZoneSize << " bytes, idle " << _sessionIdle << "s" << std::endl;
+	if (_shutdownTimeoutMs >= 0)
+		std::cout << "Shutdown timeout: " << _shutdownTimeoutMs << "ms" << std::endl;
+	if (_memoryLimit)
+		std::cout << "Memory limit: " << _memoryLimit << " bytes" << std::endl;
+	if (_admission.enabled)
+		std::cout << "Admission control: lag=" << _admission.lagMs << "ms cgi_latency=" << _admission.cgiLatencyMs << "ms" << std::endl;
+	if (!_eventBackend.empty())
+		std::cout << "Event backend: " << _eventBackend << std::endl;
+	if (_threadPoolThreads)
+		std::cout << "Thread pool: threads=" << _threadPoolThreads << " max_queue=" << _threadPoolQueue << std::endl;
+	static const char* lingeringNames[] = { "off", "on", "always" };
+	std::cout << "Keep-alive: timeout=" << _keepAlive.timeoutMs << "ms requests=" << _keepAlive.requests
+	          << " lingering_close=" << lingeringNames[_keepAlive.lingering] << " lingering_timeout=" << _keepAlive.lingeringTimeoutMs << "ms" << std::endl;
+	if (_slowRequestMs >= 0)
+		std::cout << "Slow request log: >= " << _slowRequestMs << "ms " << (_slowRequestLog.empty() ? "(error output)" : _slowRequestLog) << std::endl;
+	for (std::map<std::string, LimitZoneConfig>::const_iterator it = _limitZones.begin(); it != _limitZones.end(); ++it)
+		std::cout << (it->second.isRequest ? "Limit req zone: " : "Limit conn zone: ") << it->first << " key=" << it->second.key
+		          << " size=" << it->second.size << (it->second.isRequest ? " rate=" + toString(it->second.rate / 1000.0) + "r/s" : "") << std::endl;
 	std::cout << "============================" << std::endl;
 	for (size_t i = 0; i < _locations.size(); ++i) {
 		const LocationConfig &loc = _locations[i];
 		loc.printConfigLocation();
 	}
 }
+
+// host:port, or the unix:/path alone for Unix-domain listeners.
+std::string listenKey(const std::string& host, int port)
+{
+	if (host.compare(0, 5, "unix:") == 0)
+		return host;
+	return host + ":" + toString(port);
+}
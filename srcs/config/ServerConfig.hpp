@@ -4,6 +4,10 @@
 #include "../utils/ParserUtils.hpp"
 
 #include "LocationConfig.hpp"
+#include "CacheConfig.hpp"
+#include "LimitConfig.hpp"
+#include "ListenConfig.hpp"
+#include "TlsConfig.hpp"
 class ServerConfig {
 	private:
 			std::vector<std::string> _serverNames;
@@ -12,11 +16,34 @@ class ServerConfig {
 			std::string	_root;
 			std::string _index;
 			std::vector<std::string> _listen;
+			std::vector<std::string> _defaultListens;  // listens flagged default_server
+			std::map<std::string, ListenOptions> _listenOptions;  // host:port -> socket options, when given
+			std::vector<std::string> _sslListens;      // listens flagged ssl
+			TlsConfig   _tls;
 			size_t _clientMax;
 			bool _autoindex;
 			std::map<int, std::string> _errorPages;
 			std::string _errorPageDirectory;
 			std::vector<LocationConfig> _locations;
+			std::map<std::string, CacheZoneConfig> _cacheZones;
+			std::vector<AccessRule> _accessRules;  // server-level allow/deny, checked at accept
+			std::map<std::string, LimitZoneConfig> _limitZones;
+			std::vector<LimitReqRule> _limitReq;    // inherited by locations without their own limit_req
+			std::vector<LimitConnRule> _limitConn;  // counted per connection, from accept to close
+			std::map<std::string, std::string> _logFormats;
+			std::string _accessLog;        // empty: no access log
+			std::string _accessLogFormat;
+			long        _slowRequestMs;    // -1: slow request log disabled
+			std::string _slowRequestLog;   // empty: error output
+			size_t      _sessionZoneSize;  // 0: SESSION_ZONE_SIZE
+			time_t      _sessionIdle;
+			long        _shutdownTimeoutMs; // -1: SHUTDOWN_TIMEOUT
+			size_t      _memoryLimit;       // 0: no memory_limit
+			AdmissionConfig _admission;
+			std::string _eventBackend;      // empty: epoll
+			size_t      _threadPoolThreads; // 0: AIO_THREADS
+			size_t      _threadPoolQueue;   // 0: AIO_MAX_QUEUE
+			KeepAliveConfig _keepAlive;
 
 	public:
 			LocationConfig serverlocation;
@@ -34,6 +61,48 @@ class ServerConfig {
 			void addErrorPage(int errorCode, const std::string& path);
 			void setErrorPageDirectory(const std::string& directory);
 			void addLocation(const LocationConfig& location);
+			void setListenOptions(const std::string& listen, const ListenOptions& options);
+			bool hasListenOptions(const std::string& listen) const;
+			ListenOptions getListenOptions(const std::string& listen) const;
+			void setListenSsl(const std::string& listen);
+			bool isSslListen(const std::string& listen) const;
+			bool hasSslListen() const;
+			void setTls(const TlsConfig& tls);
+			const TlsConfig& getTls() const;
+			void addCacheZone(const CacheZoneConfig& zone);
+			const std::map<std::string, CacheZoneConfig>& getCacheZones() const;
+			void addAccessRule(const AccessRule& rule);
+			const std::vector<AccessRule>& getAccessRules() const;
+			void addLimitZone(const LimitZoneConfig& zone);
+			const std::map<std::string, LimitZoneConfig>& getLimitZones() const;
+			void addLimitReq(const LimitReqRule& rule);
+			const std::vector<LimitReqRule>& getLimitReq() const;
+			void addLimitConn(const LimitConnRule& rule);
+			const std::vector<LimitConnRule>& getLimitConn() const;
+			void addLogFormat(const std::string& name, const std::string& pattern);
+			std::string getLogFormat(const std::string& name) const;
+			void setAccessLog(const std::string& path, const std::string& format);
+			const std::string& getAccessLog() const;
+			const std::string& getAccessLogFormat() const;
+			void setSlowRequestLog(long thresholdMs, const std::string& path);
+			long getSlowRequestMs() const;
+			const std::string& getSlowRequestLog() const;
+			void setSessionZone(size_t size, time_t idle);
+			size_t getSessionZoneSize() const;
+			time_t getSessionIdle() const;
+			void setShutdownTimeout(long ms);
+			long getShutdownTimeout() const;
+			void setMemoryLimit(size_t bytes);
+			size_t getMemoryLimit() const;
+			void setAdmission(const AdmissionConfig& admission);
+			const AdmissionConfig& getAdmission() const;
+			void setEventBackend(const std::string& backend);
+			const std::string& getEventBackend() const;
+			void setThreadPool(size_t threads, size_t maxQueue);
+			size_t getThreadPoolThreads() const;
+			size_t getThreadPoolQueue() const;
+			void setKeepAlive(const KeepAliveConfig& keepAlive);
+			const KeepAliveConfig& getKeepAlive() const;
 			const std::vector<LocationConfig>& getLocations() const;
 			const std::map<int, std::string>& getErrorPages() const;
 			std::string getErrorPagePath(int code) const;
@@ -45,9 +114,12 @@ class ServerConfig {
 			const std::string& getRoot() const;
 			const std::string& getIndex() const;
 			const std::vector<std::string>& getListen() const;
+			bool isDefaultFor(const std::string& listen) const;
 			size_t getClientMax() const;
 			bool getAutoindex() const;
 			const std::string& getLocation() const;
 			void printConfig() const;
 
 };
+
+std::string listenKey(const std::string& host, int port);
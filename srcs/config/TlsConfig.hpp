@@ -0,0 +1,16 @@
+#pragma once
+
+#include "Webserv.hpp"
+
+// ssl_certificate / ssl_certificate_key / ssl_session_cache / ssl_session_timeout /
+// ssl_session_tickets / ssl_ktls, used by the server's "listen ... ssl" sockets
+struct TlsConfig {
+	std::string certificate;     // PEM chain, leaf first
+	std::string certificateKey;
+	size_t      sessionCache;    // sessions kept for resumption by id, 0: off
+	long        sessionTimeout;  // seconds a session (id or ticket) can be resumed
+	bool        sessionTickets;  // stateless resumption (RFC 5077 / TLS 1.3 tickets)
+	bool        ktls;            // let the kernel encrypt once the handshake is done
+
+	TlsConfig() : sessionCache(TLS_SESSION_CACHE), sessionTimeout(TLS_SESSION_TIMEOUT), sessionTickets(true), ktls(true) {}
+};
@@ -0,0 +1,37 @@
+#include "Webserv.hpp"
+#include "UpstreamConfig.hpp"
+
+UpstreamConfig::UpstreamConfig()
+    : _balance(BALANCE_ROUND_ROBIN)
+    , _keepalive(16)
+{}
+
+UpstreamConfig::~UpstreamConfig() {}
+
+void UpstreamConfig::setName(const std::string& name) { _name = name; }
+void UpstreamConfig::addServer(const UpstreamServer& server) { _servers.push_back(server); }
+void UpstreamConfig::setBalance(UpstreamBalance balance) { _balance = balance; }
+void UpstreamConfig::setHashKey(const std::string& key) { _hashKey = key; }
+void UpstreamConfig::setKeepalive(size_t keepalive) { _keepalive = keepalive; }
+
+const std::string& UpstreamConfig::getName() const { return _name; }
+const std::vector<UpstreamServer>& UpstreamConfig::getServers() const { return _servers; }
+UpstreamBalance UpstreamConfig::getBalance() const { return _balance; }
+const std::string& UpstreamConfig::getHashKey() const { return _hashKey; }
+size_t UpstreamConfig::getKeepalive() const { return _keepalive; }
+
+void UpstreamConfig::printConfig() const {
+	std::cout << "=== Upstream: " << _name << " ===" << std::endl;
+	std::cout << "Balance: ";
+	if (_balance == BALANCE_LEAST_CONN) std::cout << "least_conn";
+	else if (_balance == BALANCE_HASH) std::cout << "hash " << _hashKey;
+	else std::cout << "round_robin";
+	std::cout << std::endl;
+	std::cout << "Keepalive: " << _keepalive << std::endl;
+	for (size_t i = 0; i < _servers.size(); ++i) {
+		const UpstreamServer& s = _servers[i];
+		std::cout << "  server " << s.host << ":" << s.port << " weight=" << s.weight
+		          << " max_fails=" << s.maxFails << " fail_timeout=" << s.failTimeout << "s" << std::endl;
+	}
+	std::cout << "============================" << std::endl;
+}
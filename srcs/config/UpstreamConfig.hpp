@@ -0,0 +1,39 @@
+#pragma once
+
+#include "Webserv.hpp"
+
+enum UpstreamBalance { BALANCE_ROUND_ROBIN, BALANCE_LEAST_CONN, BALANCE_HASH };
+
+struct UpstreamServer {
+	std::string host;
+	int         port;
+	int         weight;
+	int         maxFails;     // failures before the peer is considered down
+	time_t      failTimeout;  // window for maxFails and time the peer stays down
+
+	UpstreamServer() : port(80), weight(1), maxFails(1), failTimeout(10) {}
+};
+
+class UpstreamConfig {
+	private:
+			std::string                 _name;
+			std::vector<UpstreamServer> _servers;
+			UpstreamBalance             _balance;
+			std::string                 _hashKey;
+			size_t                      _keepalive;   // idle connections cached per peer
+
+	public:
+			UpstreamConfig();
+			~UpstreamConfig();
+			void setName(const std::string& name);
+			void addServer(const UpstreamServer& server);
+			void setBalance(UpstreamBalance balance);
+			void setHashKey(const std::string& key);
+			void setKeepalive(size_t keepalive);
+			const std::string& getName() const;
+			const std::vector<UpstreamServer>& getServers() const;
+			UpstreamBalance getBalance() const;
+			const std::string& getHashKey() const;
+			size_t getKeepalive() const;
+			void printConfig() const;
+};
@@ -0,0 +1,311 @@
+#include "Webserv.hpp"
+#include "DirectoryListing.hpp"
+
+
+AutoindexCache::AutoindexCache() : _entries(0), _tick(0)
+{
+    pthread_mutex_init(&_lock, NULL);
+}
+
+
+AutoindexCache::~AutoindexCache()
+{
+    for (std::map<std::string, DirectoryListing*>::iterator it = _dirs.begin(); it != _dirs.end(); ++it)
+        delete it->second;
+    _dirs.clear();
+    pthread_mutex_destroy(&_lock);
+}
+
+
+// Directories first, then byte order of the names.
+static bool entryBefore(const DirEntry& a, const DirEntry& b)
+{
+    if (a.isDir != b.isDir)
+        return a.isDir;
+    return a.name < b.name;
+}
+
+
+// Reads every entry once; only files and unknown d_types cost an fstatat().
+DirectoryListing* AutoindexCache::readDirectory(const std::string& path, const struct stat& st)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1)
+        return NULL;
+    DIR* dir = fdopendir(fd);
+    if (!dir) {
+        close(fd);
+        return NULL;
+    }
+    DirectoryListing* listing = new DirectoryListing();
+    listing->path = path;
+    listing->dev = st.st_dev;
+    listing->ino = st.st_ino;
+    listing->mtime = st.st_mtim;
+    listing->size = st.st_size;
+
+    struct dirent* ent;
+    while ((ent = readdir(dir)) != NULL) {
+        const char* name = ent->d_name;
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+            continue;
+        DirEntry entry;
+        entry.name = name;
+        if (ent->d_type == DT_DIR)
+            entry.isDir = true;
+        else {
+            struct stat est;
+            if (fstatat(dirfd(dir), name, &est, 0) == 0) {
+                entry.isDir = S_ISDIR(est.st_mode);
+                if (!entry.isDir) {
+                    entry.size = est.st_size;
+                    entry.mtime = est.st_mtime;
+                }
+            }
+        }
+        listing->entries.push_back(entry);
+    }
+    closedir(dir);
+    std::sort(listing->entries.begin(), listing->entries.end(), entryBefore);
+    return listing;
+}
+
+
+// Detaches a listing from the cache; it is freed now or when its last stream ends.
+void AutoindexCache::drop(DirectoryListing* listing)
+{
+    _dirs.erase(listing->path);
+    _entries -= listing->entries.size();
+    listing->cached = false;
+    if (listing->refs == 0)
+        delete listing;
+}
+
+
+// Drops least recently used listings until `incoming` entries fit in the budget.
+void AutoindexCache::evict(size_t incoming)
+{
+    while (!_dirs.empty() && _entries + incoming > AUTOINDEX_CACHE_ENTRIES) {
+        std::map<std::string, DirectoryListing*>::iterator oldest = _dirs.begin();
+        for (std::map<std::string, DirectoryListing*>::iterator it = _dirs.begin(); it != _dirs.end(); ++it) {
+            if (it->second->lastUsed < oldest->second->lastUsed)
+                oldest = it;
+        }
+        drop(oldest->second);
+    }
+}
+
+
+// Returns the listing of a directory with a reference held for the caller, NULL if unreadable.
+DirectoryListing* AutoindexCache::acquire(const std::string& path)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))
+        return NULL;
+    pthread_mutex_lock(&_lock);
+    std::map<std::string, DirectoryListing*>::iterator it = _dirs.find(path);
+    if (it != _dirs.end()) {
+        DirectoryListing* cached = it->second;
+        if (cached->dev == st.st_dev && cached->ino == st.st_ino && cached->size == st.st_size
+            && cached->mtime.tv_sec == st.st_mtim.tv_sec && cached->mtime.tv_nsec == st.st_mtim.tv_nsec) {
+            cached->lastUsed = ++_tick;
+            cached->refs++;
+            pthread_mutex_unlock(&_lock);
+            return cached;
+        }
+        drop(cached);
+    }
+    pthread_mutex_unlock(&_lock);
+    DirectoryListing* listing = readDirectory(path, st);
+    if (!listing)
+        return NULL;
+    pthread_mutex_lock(&_lock);
+    listing->refs = 1;
+    listing->lastUsed = ++_tick;
+    // a directory changed within the last second may change again under the same mtime
+    if (st.st_mtime < time(NULL) - 1 && listing->entries.size() <= AUTOINDEX_CACHE_ENTRIES) {
+        it = _dirs.find(path);
+        if (it != _dirs.end())
+            drop(it->second);   // read by another thread meanwhile
+        evict(listing->entries.size());
+        listing->cached = true;
+        _dirs[path] = listing;
+        _entries += listing->entries.size();
+    }
+    pthread_mutex_unlock(&_lock);
+    return listing;
+}
+
+
+void AutoindexCache::release(DirectoryListing* listing)
+{
+    if (!listing)
+        return;
+    pthread_mutex_lock(&_lock);
+    listing->refs--;
+    bool unused = (listing->refs == 0 && !listing->cached);
+    pthread_mutex_unlock(&_lock);
+    if (unused)
+        delete listing;
+}
+
+
+static std::string htmlEscape(const std::string& s)
+{
+    std::string out;
+    out.reserve(s.size());
+    for (size_t i = 0; i < s.size(); ++i) {
+        switch (s[i]) {
+            case '&': out += "&amp;"; break;
+            case '<': out += "&lt;"; break;
+            case '>': out += "&gt;"; break;
+            case '"': out += "&quot;"; break;
+            default: out += s[i];
+        }
+    }
+    return out;
+}
+
+
+static std::string jsonEscape(const std::string& s)
+{
+    static const char hex[] = "0123456789abcdef";
+    std::string out;
+    out.reserve(s.size());
+    for (size_t i = 0; i < s.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>(s[i]);
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += s[i];
+        }
+        else if (c < 0x20) {
+            out += "\\u00";
+            out += hex[c >> 4];
+            out += hex[c & 0x0f];
+        }
+        else
+            out += s[i];
+    }
+    return out;
+}
+
+
+// Percent-encodes everything but RFC 3986 unreserved characters.
+static void appendUrlEncoded(std::string& out, const std::string& s)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    for (size_t i = 0; i < s.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>(s[i]);
+        if (std::isalnum(c) || c == '-' || c == '.' || c == '_' || c == '~')
+            out += static_cast<char>(c);
+        else {
+            out += '%';
+            out += hex[c >> 4];
+            out += hex[c & 0x0f];
+        }
+    }
+}
+
+
+static std::string httpDate(time_t t)
+{
+    char buf[64];
+    struct tm tm;
+    strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", gmtime_r(&t, &tm));
+    return buf;
+}
+
+
+static std::string pageUri(const std::string& uri, size_t page)
+{
+    return uri + "?page=" + toString(page);
+}
+
+
+bool selectListingPage(const DirectoryListing& listing, const std::string& query, size_t pageSize,
+                       size_t& first, size_t& last, size_t& page, size_t& pages)
+{
+    size_t count = listing.entries.size();
+    page = 1;
+    pages = (pageSize && count) ? (count + pageSize - 1) / pageSize : 1;
+    size_t pos = query.find("page=");
+    while (pos != std::string::npos && pos != 0 && query[pos - 1] != '&')
+        pos = query.find("page=", pos + 1);
+    if (pos != std::string::npos) {
+        std::string value = query.substr(pos + 5, query.find('&', pos) - pos - 5);
+        if (value.empty() || value.size() > 9 || value.find_first_not_of("0123456789") != std::string::npos)
+            return false;
+        page = std::strtoul(value.c_str(), NULL, 10);
+    }
+    if (page < 1 || page > pages)
+        return false;
+    first = pageSize ? (page - 1) * pageSize : 0;
+    last = pageSize ? std::min(count, first + pageSize) : count;
+    return true;
+}
+
+
+std::string renderListingHead(const std::string& uri, AutoindexFormat format, size_t page, size_t pages)
+{
+    if (format == AUTOINDEX_JSON)
+        return "[";
+    std::string title = "Index of " + htmlEscape(uri);
+    std::string head = "<!DOCTYPE html><html><head><meta charset=\"utf-8\"><title>" + title + "</title></head><body>";
+    head += "<h1>" + title + "</h1>";
+    if (pages > 1)
+        head += "<p>Page " + toString(page) + " of " + toString(pages) + "</p>";
+    return head + "<hr><ul>";
+}
+
+
+// Appends entries [from, to) of a page starting at entry `first`.
+void renderListingEntries(std::string& out, const DirectoryListing& listing, const std::string& uri,
+                          AutoindexFormat format, size_t first, size_t from, size_t to)
+{
+    std::string base = uri;
+    if (base.empty() || base[base.size() - 1] != '/')
+        base += "/";
+    for (size_t i = from; i < to; ++i) {
+        const DirEntry& entry = listing.entries[i];
+        if (format == AUTOINDEX_JSON) {
+            out += (i == first) ? "\n" : ",\n";
+            out += "{ \"name\":\"" + jsonEscape(entry.name) + "\", \"type\":\"" + (entry.isDir ? "directory" : "file") + "\"";
+            if (!entry.isDir && entry.size >= 0)
+                out += ", \"mtime\":\"" + httpDate(entry.mtime) + "\", \"size\":" + toString(entry.size);
+            out += " }";
+            continue;
+        }
+        out += "<li><a href=\"";
+        out += base;
+        appendUrlEncoded(out, entry.name);
+        if (entry.isDir)
+            out += "/\">" + htmlEscape(entry.name) + "/</a></li>";
+        else
+            out += "\">" + htmlEscape(entry.name) + "</a> (" + (entry.size >= 0 ? toString(entry.size) : "-") + " bytes)</li>";
+    }
+}
+
+
+std::string renderListingTail(const std::string& uri, AutoindexFormat format, size_t page, size_t pages)
+{
+    if (format == AUTOINDEX_JSON)
+        return "\n]\n";
+    std::string tail = "</ul><hr>";
+    if (page > 1)
+        tail += "<a href=\"" + htmlEscape(pageUri(uri, page - 1)) + "\">&laquo; previous</a> ";
+    if (page < pages)
+        tail += "<a href=\"" + htmlEscape(pageUri(uri, page + 1)) + "\">next &raquo;</a>";
+    return tail + "</body></html>";
+}
+
+
+// Link header advertising the neighbouring pages, empty for a single page.
+std::string listingPageLinks(const std::string& uri, size_t page, size_t pages)
+{
+    std::string links;
+    if (page > 1)
+        links += "<" + pageUri(uri, page - 1) + ">; rel=\"prev\"";
+    if (page < pages)
+        links += std::string(links.empty() ? "" : ", ") + "<" + pageUri(uri, page + 1) + ">; rel=\"next\"";
+    return links;
+}
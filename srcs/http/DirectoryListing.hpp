@@ -0,0 +1,87 @@
+#pragma once
+
+#include "Webserv.hpp"
+#include "../config/LocationConfig.hpp"
+#include <pthread.h>
+
+#define AUTOINDEX_CACHE_ENTRIES 262144  // directory entries kept across all cached listings
+#define AUTOINDEX_CHUNK_BYTES 16384     // listing bytes rendered per refill of a streamed response
+
+struct DirEntry {
+	std::string name;
+	bool        isDir;
+	off_t       size;    // -1 for directories (not stat'ed)
+	time_t      mtime;   // 0 for directories
+
+	DirEntry() : isDir(false), size(-1), mtime(0) {}
+};
+
+// One directory read: sorted entries plus the directory identity they were read under.
+// Streams hold a reference, so a listing replaced or evicted mid-response stays valid.
+struct DirectoryListing {
+	std::string           path;
+	dev_t                 dev;
+	ino_t                 ino;
+	struct timespec       mtime;
+	off_t                 size;
+	std::vector<DirEntry> entries;
+	int                   refs;
+	bool                  cached;     // still owned by the cache
+	unsigned long         lastUsed;
+
+	DirectoryListing() : dev(0), ino(0), size(0), refs(0), cached(false), lastUsed(0)
+	{
+		mtime.tv_sec = 0;
+		mtime.tv_nsec = 0;
+	}
+};
+
+// Listings by directory path, reused while the directory's mtime (and inode / size)
+// is unchanged: a hit costs one stat(). Entries come from readdir's d_type, with an
+// fstatat() relative to the directory fd only for files (size, mtime) and unknown types.
+// aio threads workers render listings too: the map and reference counts are guarded by a
+// mutex, the stat() and directory reads run outside it.
+class AutoindexCache {
+	private:
+			std::map<std::string, DirectoryListing*> _dirs;
+			size_t                                   _entries;
+			unsigned long                            _tick;
+			pthread_mutex_t                          _lock;
+
+			static DirectoryListing* readDirectory(const std::string& path, const struct stat& st);
+			void evict(size_t incoming);
+			void drop(DirectoryListing* listing);
+
+			AutoindexCache(const AutoindexCache&);
+			AutoindexCache& operator=(const AutoindexCache&);
+
+	public:
+			AutoindexCache();
+			~AutoindexCache();
+
+			DirectoryListing* acquire(const std::string& path);
+			void release(DirectoryListing* listing);
+};
+
+// Streamed listing state kept on the connection.
+struct ListingStream {
+	DirectoryListing* listing;
+	size_t            first;     // first entry of the page
+	size_t            next;      // next entry to render
+	size_t            end;       // one past the last entry of the page
+	std::string       uri;       // directory URI, without the query string
+	AutoindexFormat   format;
+	size_t            page;
+	size_t            pages;
+
+	ListingStream() : listing(NULL), first(0), next(0), end(0), format(AUTOINDEX_HTML), page(1), pages(1) {}
+};
+
+// Page of a listing selected by ?page=N; false when the page does not exist.
+bool selectListingPage(const DirectoryListing& listing, const std::string& query, size_t pageSize,
+                       size_t& first, size_t& last, size_t& page, size_t& pages);
+std::string renderListingHead(const std::string& uri, AutoindexFormat format, size_t page, size_t pages);
+void renderListingEntries(std::string& out, const DirectoryListing& listing, const std::string& uri,
+                          AutoindexFormat format, size_t first, size_t from, size_t to);
+std::string renderListingTail(const std::string& uri, AutoindexFormat format, size_t page, size_t pages);
+std::string listingPageLinks(const std::string& uri, size_t page, size_t pages);
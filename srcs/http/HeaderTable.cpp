@@ -0,0 +1,242 @@
+#include "Webserv.hpp"
+#include "HeaderTable.hpp"
+#include <strings.h>
+
+
+HeaderTable::HeaderTable() : _count(0), _known(0) {}
+
+
+const HeaderTable::Field& HeaderTable::field(size_t i) const
+{
+    return i < HEADER_INLINE ? _inline[i] : _overflow[i - HEADER_INLINE];
+}
+
+
+void HeaderTable::push(const Field& f)
+{
+    if (_count < HEADER_INLINE)
+        _inline[_count] = f;
+    else
+        _overflow.push_back(f);
+    ++_count;
+    if (f.id != HEADER_UNKNOWN)
+        _known |= HEADER_BIT(f.id);
+}
+
+
+// Removes field i keeping the order of the others; the bytes stay in _text until clear().
+void HeaderTable::erase(size_t i)
+{
+    for (; i + 1 < _count; ++i) {
+        Field& to = i < HEADER_INLINE ? _inline[i] : _overflow[i - HEADER_INLINE];
+        to = field(i + 1);
+    }
+    if (_count > HEADER_INLINE)
+        _overflow.pop_back();
+    --_count;
+}
+
+
+// First field named name[0, len); id is headerId() of the name, matched without comparing bytes.
+int HeaderTable::indexOf(HeaderId id, const char* name, size_t len) const
+{
+    if (id != HEADER_UNKNOWN && !(_known & HEADER_BIT(id)))
+        return -1;
+    for (size_t i = 0; i < _count; ++i) {
+        const Field& f = field(i);
+        if (f.id != id)
+            continue;
+        if (id != HEADER_UNKNOWN)
+            return static_cast<int>(i);
+        if (f.nameLength == len && strncasecmp(_text.data() + f.name, name, len) == 0)
+            return static_cast<int>(i);
+    }
+    return -1;
+}
+
+
+void HeaderTable::append(const char* name, size_t nameLength, const char* value, size_t valueLength)
+{
+    Field f;
+    f.id = headerId(name, nameLength);
+    f.name = static_cast<unsigned int>(_text.size());
+    f.nameLength = static_cast<unsigned int>(nameLength);
+    _text.append(name, nameLength);
+    f.value = static_cast<unsigned int>(_text.size());
+    f.valueLength = static_cast<unsigned int>(valueLength);
+    _text.append(value, valueLength);
+    push(f);
+}
+
+
+void HeaderTable::clear()
+{
+    _text.clear();
+    _overflow.clear();
+    _count = 0;
+    _known = 0;
+}
+
+
+// Takes "Name: value" lines separated by CRLF (the block stops before the final CRLF).
+// Whitespace around values and before the colon is dropped, lines without a name are ignored.
+void HeaderTable::parse(const char* block, size_t len)
+{
+    clear();
+    _text.assign(block, len);
+    const char* text = _text.data();
+    size_t lineStart = 0;
+    while (lineStart < len) {
+        const char* eol = static_cast<const char*>(memmem(text + lineStart, len - lineStart, "\r\n", 2));
+        size_t lineEnd = eol ? static_cast<size_t>(eol - text) : len;
+        const char* colon = static_cast<const char*>(memchr(text + lineStart, ':', lineEnd - lineStart));
+        if (colon) {
+            size_t nameEnd = colon - text;
+            while (nameEnd > lineStart && (text[nameEnd - 1] == ' ' || text[nameEnd - 1] == '\t'))
+                --nameEnd;
+            size_t valueStart = colon - text + 1;
+            size_t valueEnd = lineEnd;
+            while (valueStart < valueEnd && (text[valueStart] == ' ' || text[valueStart] == '\t'))
+                ++valueStart;
+            while (valueEnd > valueStart && (text[valueEnd - 1] == ' ' || text[valueEnd - 1] == '\t'))
+                --valueEnd;
+            if (nameEnd > lineStart) {
+                Field f;
+                f.id = headerId(text + lineStart, nameEnd - lineStart);
+                f.name = static_cast<unsigned int>(lineStart);
+                f.nameLength = static_cast<unsigned int>(nameEnd - lineStart);
+                f.value = static_cast<unsigned int>(valueStart);
+                f.valueLength = static_cast<unsigned int>(valueEnd - valueStart);
+                push(f);
+            }
+        }
+        lineStart = lineEnd + 2;
+    }
+}
+
+
+void HeaderTable::add(const std::string& name, const std::string& value)
+{
+    append(name.data(), name.size(), value.data(), value.size());
+}
+
+
+// Replaces every field with this name by a single one.
+void HeaderTable::set(const std::string& name, const std::string& value)
+{
+    remove(name);
+    add(name, value);
+}
+
+
+void HeaderTable::remove(const std::string& name)
+{
+    HeaderId id = headerId(name.data(), name.size());
+    int i;
+    while ((i = indexOf(id, name.data(), name.size())) != -1)
+        erase(i);
+    if (id != HEADER_UNKNOWN)
+        _known &= ~HEADER_BIT(id);
+}
+
+
+size_t HeaderTable::size() const { return _count; }
+
+
+// Heap bytes held: the text buffer and the fields past HEADER_INLINE.
+size_t HeaderTable::capacity() const
+{
+    return _text.capacity() + _overflow.capacity() * sizeof(Field);
+}
+
+
+HeaderId HeaderTable::id(size_t i) const { return field(i).id; }
+
+
+HeaderView HeaderTable::name(size_t i) const
+{
+    const Field& f = field(i);
+    return HeaderView(_text.data() + f.name, f.nameLength);
+}
+
+
+HeaderView HeaderTable::value(size_t i) const
+{
+    const Field& f = field(i);
+    return HeaderView(_text.data() + f.value, f.valueLength);
+}
+
+
+bool HeaderTable::has(HeaderId id) const
+{
+    return (_known & HEADER_BIT(id)) != 0;
+}
+
+
+// First value of a known header; false when it is absent.
+bool HeaderTable::find(HeaderId id, HeaderView& value) const
+{
+    int i = (id == HEADER_UNKNOWN) ? -1 : indexOf(id, NULL, 0);
+    if (i == -1)
+        return false;
+    value = this->value(i);
+    return true;
+}
+
+
+bool HeaderTable::find(const std::string& name, HeaderView& value) const
+{
+    int i = indexOf(headerId(name.data(), name.size()), name.data(), name.size());
+    if (i == -1)
+        return false;
+    value = this->value(i);
+    return true;
+}
+
+
+std::string HeaderTable::get(HeaderId id) const
+{
+    HeaderView value;
+    return find(id, value) ? value.str() : std::string();
+}
+
+
+std::string HeaderTable::get(const std::string& name) const
+{
+    HeaderView value;
+    return find(name, value) ? value.str() : std::string();
+}
+
+
+// Values of every field of a list header (Connection, ...), joined with ", " as RFC 9110 allows.
+std::string HeaderTable::join(HeaderId id) const
+{
+    std::string joined;
+    if (id == HEADER_UNKNOWN || !has(id))
+        return joined;
+    for (size_t i = 0; i < _count; ++i) {
+        const Field& f = field(i);
+        if (f.id != id)
+            continue;
+        if (!joined.empty())
+            joined += ", ";
+        joined.append(_text.data() + f.value, f.valueLength);
+    }
+    return joined;
+}
+
+
+// True when a singleton header (Host, Content-Length) appears more than once with different values.
+bool HeaderTable::conflicting(HeaderId id) const
+{
+    int first = (id == HEADER_UNKNOWN) ? -1 : indexOf(id, NULL, 0);
+    if (first == -1)
+        return false;
+    HeaderView expected = value(first);
+    for (size_t i = first + 1; i < _count; ++i) {
+        const Field& f = field(i);
+        if (f.id == id && (f.valueLength != expected.size || memcmp(_text.data() + f.value, expected.data, expected.size) != 0))
+            return true;
+    }
+    return false;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "Webserv.hpp"
+#include "HttpTokens.hpp"
+
+#define HEADER_INLINE 16
+
+// Bytes of a header name or value inside a HeaderTable, valid until the table is modified.
+struct HeaderView {
+	const char*	data;
+	size_t		size;
+
+	HeaderView() : data(""), size(0) {}
+	HeaderView(const char* bytes, size_t length) : data(bytes), size(length) {}
+	std::string	str() const { return std::string(data, size); }
+};
+
+// Header fields of a request or a response, in arrival order with duplicates kept.
+// Names and values are spans into one text buffer: a request's header block is copied there
+// once, fields set later are appended. The first HEADER_INLINE fields live in the object and
+// clear() keeps every capacity, so a keep-alive connection stops allocating for headers after
+// its first request. Lookups are case-insensitive; known names go through their HeaderId.
+class HeaderTable {
+	private:
+			struct Field {
+				HeaderId		id;
+				unsigned int	name;         // offsets into _text
+				unsigned int	nameLength;
+				unsigned int	value;
+				unsigned int	valueLength;
+			};
+
+			std::string			_text;
+			Field				_inline[HEADER_INLINE];
+			std::vector<Field>	_overflow;   // fields past HEADER_INLINE
+			size_t				_count;
+			unsigned long long	_known;      // HEADER_BIT of each known header present
+
+			const Field&	field(size_t i) const;
+			void			push(const Field& f);
+			void			erase(size_t i);
+			int				indexOf(HeaderId id, const char* name, size_t len) const;
+			void			append(const char* name, size_t nameLength, const char* value, size_t valueLength);
+
+	public:
+			HeaderTable();
+
+			void		clear();
+			void		parse(const char* block, size_t len);
+			void		add(const std::string& name, const std::string& value);
+			void		set(const std::string& name, const std::string& value);
+			void		remove(const std::string& name);
+
+			size_t		size() const;
+			size_t		capacity() const;
+			HeaderId	id(size_t i) const;
+			HeaderView	name(size_t i) const;
+			HeaderView	value(size_t i) const;
+
+			bool		has(HeaderId id) const;
+			bool		find(HeaderId id, HeaderView& value) const;
+			bool		find(const std::string& name, HeaderView& value) const;
+			std::string	get(HeaderId id) const;
+			std::string	get(const std::string& name) const;
+			std::string	join(HeaderId id) const;
+			bool		conflicting(HeaderId id) const;
+};
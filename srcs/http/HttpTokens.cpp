@@ -0,0 +1,90 @@
+#include "Webserv.hpp"
+#include "HttpTokens.hpp"
+
+
+// Same order as MethodId, starting after METHOD_UNKNOWN. Methods are case-sensitive.
+static const char* const methodKeys[] = {
+    "GET", "HEAD", "POST", "PUT", "DELETE", "OPTIONS", "TRACE", "CONNECT", "PATCH"
+};
+
+// Same order as HeaderId, starting after HEADER_UNKNOWN.
+static const char* const headerKeys[] = {
+    "host", "connection", "content-length", "content-type", "transfer-encoding", "cookie",
+    "user-agent", "accept", "accept-encoding", "accept-language", "authorization", "cache-control",
+    "pragma", "referer", "origin", "range", "if-range", "if-none-match", "if-modified-since",
+    "expect", "upgrade", "keep-alive", "te", "x-forwarded-for", "x-forwarded-proto", "x-real-ip",
+    "x-priority", "proxy-connection", "trailer", "set-cookie", "location", "expires", "vary", "etag",
+    "last-modified", "server", "date", "allow", "retry-after", "status", "x-accel-redirect", "x-sendfile"
+};
+
+static const char* const extensionKeys[] = {
+    "html", "htm", "css", "js", "json", "jpg", "jpeg", "png", "gif", "bmp", "ico", "txt",
+    "pdf", "zip", "xml"
+};
+
+static const char* const extensionTypes[] = {
+    "text/html", "text/html", "text/css", "application/javascript", "application/json",
+    "image/jpeg", "image/jpeg", "image/png", "image/gif", "image/bmp", "image/x-icon", "text/plain",
+    "application/pdf", "application/zip", "application/xml"
+};
+
+#define COUNT_OF(array) (sizeof(array) / sizeof(array[0]))
+
+// Fails to compile when a key list and its enum drift apart.
+typedef char methodKeysMatchEnum[COUNT_OF(methodKeys) == METHOD_COUNT - 1 ? 1 : -1];
+typedef char headerKeysMatchEnum[COUNT_OF(headerKeys) == HEADER_COUNT - 1 ? 1 : -1];
+typedef char extensionTypesMatchKeys[COUNT_OF(extensionTypes) == COUNT_OF(extensionKeys) ? 1 : -1];
+
+
+MethodId methodId(const char* name, size_t len)
+{
+    static const PerfectHash<32> table(methodKeys, COUNT_OF(methodKeys), false);
+    return static_cast<MethodId>(table.find(name, len) + 1);
+}
+
+
+MethodId methodId(const std::string& name)
+{
+    return methodId(name.data(), name.size());
+}
+
+
+const char* methodName(MethodId id)
+{
+    return (id > METHOD_UNKNOWN && id < METHOD_COUNT) ? methodKeys[id - 1] : "";
+}
+
+
+// Case-insensitive; HEADER_UNKNOWN for names outside the table.
+HeaderId headerId(const char* name, size_t len)
+{
+    static const PerfectHash<256> table(headerKeys, COUNT_OF(headerKeys), true);
+    return static_cast<HeaderId>(table.find(name, len) + 1);
+}
+
+
+static const std::string* buildHeaderNames()
+{
+    static std::string names[HEADER_COUNT];
+    for (size_t i = 0; i < COUNT_OF(headerKeys); ++i)
+        names[i + 1] = headerKeys[i];
+    return names;
+}
+
+
+// Lowercase name of a known header, for the callers that need it as a string.
+// Filled by a guarded static initialization, so aio threads workers may call it as well.
+const std::string& headerName(HeaderId id)
+{
+    static const std::string* names = buildHeaderNames();
+    return names[id];
+}
+
+
+// Content type of a file extension (case-insensitive), NULL when it is not known.
+const char* mimeTypeForExtension(const char* ext, size_t len)
+{
+    static const PerfectHash<64> table(extensionKeys, COUNT_OF(extensionKeys), true);
+    int index = table.find(ext, len);
+    return index < 0 ? NULL : extensionTypes[index];
+}
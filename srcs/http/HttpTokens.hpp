@@ -0,0 +1,91 @@
+#pragma once
+
+#include "Webserv.hpp"
+
+// Small integer ids for the request methods, header names and file extensions the hot path
+// inspects, so routing checks become integer compares and bitmasks instead of string work.
+
+enum MethodId {
+	METHOD_UNKNOWN, METHOD_GET, METHOD_HEAD, METHOD_POST, METHOD_PUT, METHOD_DELETE,
+	METHOD_OPTIONS, METHOD_TRACE, METHOD_CONNECT, METHOD_PATCH, METHOD_COUNT
+};
+
+#define METHOD_BIT(id) (1u << (id))
+
+enum HeaderId {
+	HEADER_UNKNOWN, HEADER_HOST, HEADER_CONNECTION, HEADER_CONTENT_LENGTH, HEADER_CONTENT_TYPE,
+	HEADER_TRANSFER_ENCODING, HEADER_COOKIE, HEADER_USER_AGENT, HEADER_ACCEPT, HEADER_ACCEPT_ENCODING,
+	HEADER_ACCEPT_LANGUAGE, HEADER_AUTHORIZATION, HEADER_CACHE_CONTROL, HEADER_PRAGMA, HEADER_REFERER,
+	HEADER_ORIGIN, HEADER_RANGE, HEADER_IF_RANGE, HEADER_IF_NONE_MATCH, HEADER_IF_MODIFIED_SINCE,
+	HEADER_EXPECT, HEADER_UPGRADE, HEADER_KEEP_ALIVE, HEADER_TE, HEADER_X_FORWARDED_FOR,
+	HEADER_X_FORWARDED_PROTO, HEADER_X_REAL_IP, HEADER_X_PRIORITY, HEADER_PROXY_CONNECTION, HEADER_TRAILER,
+	HEADER_SET_COOKIE, HEADER_LOCATION, HEADER_EXPIRES, HEADER_VARY, HEADER_ETAG, HEADER_LAST_MODIFIED,
+	HEADER_SERVER, HEADER_DATE, HEADER_ALLOW, HEADER_RETRY_AFTER, HEADER_STATUS, HEADER_X_ACCEL_REDIRECT,
+	HEADER_X_SENDFILE, HEADER_COUNT
+};
+
+#define HEADER_BIT(id) (1ull << (id))
+
+// Collision-free table over a fixed key set: the seed is searched once so that every key
+// lands in its own slot, after which a lookup is one hash and at most one comparison.
+// Keys are stored lowercase; foldCase hashes and compares the probe lowercased on the fly.
+template <unsigned SIZE>
+class PerfectHash {
+	private:
+			const char* const*	_keys;
+			unsigned char		_length[SIZE];
+			unsigned char		_slot[SIZE];	// key index + 1, 0 marks an empty slot
+			unsigned int		_seed;
+			bool				_foldCase;
+
+			static unsigned char fold(unsigned char c) { return (c >= 'A' && c <= 'Z') ? c | 0x20 : c; }
+
+			unsigned int position(const char* data, size_t len, unsigned int seed) const {
+				unsigned int h = seed;
+				for (size_t i = 0; i < len; ++i) {
+					h ^= _foldCase ? fold(data[i]) : static_cast<unsigned char>(data[i]);
+					h *= 16777619u;
+				}
+				h ^= h >> 15;
+				return h & (SIZE - 1);
+			}
+
+	public:
+			PerfectHash(const char* const* keys, unsigned count, bool foldCase)
+				: _keys(keys), _seed(2166136261u), _foldCase(foldCase) {
+				for (;; ++_seed) {
+					std::memset(_slot, 0, sizeof(_slot));
+					unsigned i = 0;
+					for (; i < count; ++i) {
+						unsigned int pos = position(keys[i], std::strlen(keys[i]), _seed);
+						if (_slot[pos])
+							break;
+						_slot[pos] = static_cast<unsigned char>(i + 1);
+						_length[pos] = static_cast<unsigned char>(std::strlen(keys[i]));
+					}
+					if (i == count)
+						return;
+				}
+			}
+
+			// Index of the key equal to data[0, len), -1 when it is not part of the set.
+			int find(const char* data, size_t len) const {
+				unsigned int pos = position(data, len, _seed);
+				if (!_slot[pos] || _length[pos] != len)
+					return -1;
+				const char* key = _keys[_slot[pos] - 1];
+				for (size_t i = 0; i < len; ++i) {
+					unsigned char c = static_cast<unsigned char>(data[i]);
+					if ((_foldCase ? fold(c) : c) != static_cast<unsigned char>(key[i]))
+						return -1;
+				}
+				return _slot[pos] - 1;
+			}
+};
+
+MethodId			methodId(const char* name, size_t len);
+MethodId			methodId(const std::string& name);
+const char*			methodName(MethodId id);
+HeaderId			headerId(const char* name, size_t len);
+const std::string&	headerName(HeaderId id);
+const char*			mimeTypeForExtension(const char* ext, size_t len);
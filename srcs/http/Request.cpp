@@ -3,15 +3,41 @@
 
 #define PARSE_ERROR() do { _isComplete = false; return; } while (0)
 
-Request::Request() : _isComplete(false) {}
+Request::Request() : _methodId(METHOD_UNKNOWN), _connHeaders(NULL), _bodyFd(-1), _bodySize(0), _isComplete(false) {}
 
-Request::Request(const std::string& rawRequest) : _rawRequest(rawRequest), _isComplete(false)
+Request::Request(const std::string& rawRequest) : _rawRequest(rawRequest), _methodId(METHOD_UNKNOWN), _connHeaders(NULL), _bodyFd(-1), _bodySize(0),
+	_isComplete(false)
 {
 	parseRequest();
 }
 
+// A request the connection already parsed: its header table is used in place, not copied.
+Request::Request(const std::string& method, const std::string& uri, const std::string& version,
+	const HeaderTable& headers, const std::string& body)
+	: _method(method), _methodId(methodId(method)), _uri(uri), _version(version), _connHeaders(&headers), _body(body),
+	_bodyFd(-1), _bodySize(0), _isComplete(!method.empty() && !version.empty())
+{}
+
 Request::~Request() {}
 
+// Copies borrowed connection headers into the request, for one that outlives the connection state.
+void Request::detachHeaders()
+{
+	if (!_connHeaders)
+		return;
+	_headers = *_connHeaders;
+	_connHeaders = NULL;
+}
+
+
+// A body the connection spilled to a file: handlers read it from fd instead of getBody().
+// The descriptor stays owned by whoever set it.
+void Request::setBodyFile(int fd, size_t size)
+{
+	_bodyFd = fd;
+	_bodySize = size;
+}
+
 
 void    Request::parseError()
 {
@@ -25,10 +51,14 @@ void Request::parseRequest()
 	// Réinitialise l'état
 	_isComplete = false;
 	_method.clear();
+	_methodId = METHOD_UNKNOWN;
 	_uri.clear();
 	_version.clear();
 	_headers.clear();
+	_connHeaders = NULL;
 	_body.clear();
+	_bodyFd = -1;
+	_bodySize = 0;
 
 	if (_rawRequest.empty()) parseError();
 
@@ -58,41 +88,13 @@ void Request::parseRequest()
 	if (secondSpace + 1 >= firstLine.length()) parseError();
 
 	_method = firstLine.substr(0, firstSpace);
+	_methodId = methodId(_method);
 	_uri = firstLine.substr(firstSpace + 1, secondSpace - firstSpace - 1);
 	_version = firstLine.substr(secondSpace + 1);
 
-	// parse headers
-	size_t lineStart = endOfFirstLine + 2; // after first \r\n
-	while (lineStart < headersPart.length()) 
-	{
-		size_t lineEnd = headersPart.find("\r\n", lineStart);
-		if (lineEnd == std::string::npos) break;
-
-		std::string headerLine = headersPart.substr(lineStart, lineEnd - lineStart);
-		
-		// separates name & headers's value
-		size_t colonPos = headerLine.find(':');
-		if (colonPos != std::string::npos) 
-		{
-			std::string headerName = headerLine.substr(0, colonPos);
-			std::string headerValue = headerLine.substr(colonPos + 1);
-			
-			// trim spaces
-			headerName.erase(0, headerName.find_first_not_of(" \t"));
-			headerName.erase(headerName.find_last_not_of(" \t") + 1);
-			
-			headerValue.erase(0, headerValue.find_first_not_of(" \t"));
-			headerValue.erase(headerValue.find_last_not_of(" \t") + 1);
-			
-			// stores in the map (lowercse for case insensitivity)
-			for (size_t i = 0; i < headerName.length(); ++i) 
-				headerName[i] = std::tolower(headerName[i]);
-			
-			_headers[headerName] = headerValue;
-		}
-		
-		lineStart = lineEnd + 2;
-	}
+	// parse headers (after first \r\n)
+	if (endOfFirstLine + 2 < headersPart.length())
+		_headers.parse(headersPart.data() + endOfFirstLine + 2, headersPart.length() - endOfFirstLine - 2);
 
 	_isComplete = true;
 }
@@ -101,27 +103,21 @@ void Request::parseRequest()
 // getters
 std::string	Request::getRawRequest() const { return _rawRequest; }
 std::string Request::getMethod() const { return _method; }
+MethodId	Request::getMethodId() const { return _methodId; }
 std::string Request::getUri() const { return _uri; }
 std::string Request::getVersion() const { return _version; }
-std::string Request::getBody() const { return _body; }
+const std::string& Request::getBody() const { return _body; }
+int Request::getBodyFd() const { return _bodyFd; }
+size_t Request::getBodySize() const { return _bodyFd != -1 ? _bodySize : _body.size(); }
 bool 		Request::isComplete() const { return _isComplete; }
 
 std::string	Request::getHeader(const std::string &name) const
 {
-	std::string	lowerName = name;
-
-	for (size_t i = 0; i < lowerName.length(); ++i)
-		lowerName[i] = std::tolower(lowerName[i]);
-
-	std::map<std::string, std::string>::const_iterator it = _headers.find(lowerName);
-	if (it != _headers.end())
-		return it->second;
-
-	return "";
+	return getHeaders().get(name);
 }
 
-const std::map<std::string, std::string>& Request::getHeaders() const {
-        return _headers;
+const HeaderTable& Request::getHeaders() const {
+        return _connHeaders ? *_connHeaders : _headers;
     }
 
 void Request::print() const 
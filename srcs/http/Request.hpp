@@ -1,34 +1,46 @@
 #pragma once
 
 #include "Webserv.hpp"
+#include "HeaderTable.hpp"
 
 class	Request
 {
 	private:
 		std::string	_rawRequest;
 		std::string	_method;
+		MethodId	_methodId;
 		std::string	_uri;			// index.html..
 		std::string	_version;		// HTTP/1.1..
-		std::map<std::string, std::string>	_headers;
+		HeaderTable	_headers;
+		const HeaderTable*	_connHeaders;	// used instead of _headers when not NULL
 		std::string	_body;
+		int			_bodyFd;		// spilled body file of the connection, -1 when _body holds it
+		size_t		_bodySize;
 		bool		_isComplete;	// if request fully received
 
 
 	public:
 		Request();
 		Request(const std::string &rawRequest);
+		Request(const std::string &method, const std::string &uri, const std::string &version,
+			const HeaderTable &headers, const std::string &body);
 		~Request();
 
 		void		parseRequest();
+		void		detachHeaders();
+		void		setBodyFile(int fd, size_t size);
 
 		// getters
-		const std::map<std::string, std::string>& getHeaders() const;
+		const HeaderTable& getHeaders() const;
 		std::string	getRawRequest() const;
 		std::string	getMethod() const;
+		MethodId	getMethodId() const;
 		std::string	getUri() const;
 		std::string	getVersion() const;
 		std::string getHeader(const std::string& name) const;
-		std::string	getBody() const;
+		const std::string&	getBody() const;
+		int			getBodyFd() const;
+		size_t		getBodySize() const;
 		bool		isComplete() const;
 
 		// debug
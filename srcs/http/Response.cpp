@@ -5,7 +5,7 @@
 Response::Response() {}
 Response::~Response() {}
 
-const std::map<std::string, std::string>& Response::getHeaders() const {
+const HeaderTable& Response::getHeaders() const {
 		return _headers;
 }
 
@@ -27,16 +27,23 @@ void	Response::setStatus(int code, const std::string &message)
 
 void	Response::setHeader(const std::string &name, const std::string &value)
 {
-	 _headers[name] = value;
+	 _headers.set(name, value);
 	//_response += name + ": " + value + "\r\n";
 }
 
 
+// Keeps earlier fields with the same name (Set-Cookie from a CGI script).
+void	Response::addHeader(const std::string &name, const std::string &value)
+{
+	_headers.add(name, value);
+}
+
+
 void Response::setBody(const std::string& body) 
 {
 	_body = body;
 	// dynamic content length
-	if (_headers.find("Content-Length") == _headers.end())
+	if (!_headers.has(HEADER_CONTENT_LENGTH))
         setHeader("Content-Length", toString(_body.length()));
 	//_response += "\r\n" + _body;
 }
@@ -49,9 +56,10 @@ std::string	Response::getResponse() const
 {
 	std::string response = _statusLine;
 	// add all headers
-		for (std::map<std::string, std::string>::const_iterator it = _headers.begin();
-			 it != _headers.end(); ++it) {
-			response += it->first + ": " + it->second + "\r\n";
+		for (size_t i = 0; i < _headers.size(); ++i) {
+			HeaderView name = _headers.name(i);
+			HeaderView value = _headers.value(i);
+			response.append(name.data, name.size).append(": ", 2).append(value.data, value.size).append("\r\n", 2);
 		}
 		
 		response += "\r\n" + _body;
@@ -1,22 +1,24 @@
 #pragma once
 
 #include "Webserv.hpp"
+#include "HeaderTable.hpp"
 
 class	Response
 {
 	private:
 		std::string	_response;
 		std::string	_body;
-		std::map<std::string, std::string> _headers;
+		HeaderTable	_headers;
 		std::string _statusLine;
 		int _statusCode;
 	public:
-		const std::map<std::string, std::string>& getHeaders() const;
+		const HeaderTable& getHeaders() const;
 		Response();
 		~Response();
 
 		void	setStatus(int code, const std::string &message);
 		void	setHeader(const std::string &name, const std::string &value);
+		void	addHeader(const std::string &name, const std::string &value);
 		void	setBody(const std::string &body);
 		size_t  getBodyLength() const;
 
@@ -0,0 +1,374 @@
+#include "Webserv.hpp"
+#include "ResponseCache.hpp"
+#include "../utils/Utils.hpp"
+#include "../utils/ParserUtils.hpp"
+
+#define CACHE_MEMORY_ENTRY_DIVISOR 4 // entries above mem_size / 4 are served straight from disk
+
+
+ResponseCache::ResponseCache() : _tick(0), _memBytes(0), _diskBytes(0) {}
+
+
+ResponseCache::~ResponseCache() {}
+
+
+// Empties the <x>/<yy>/ levels left by a previous run: the index only lives in memory.
+static void purgeCacheLevels(const std::string& dir, int depth)
+{
+    DIR* d = opendir(dir.c_str());
+    if (!d)
+        return;
+    struct dirent* ent;
+    while ((ent = readdir(d)) != NULL) {
+        std::string name = ent->d_name;
+        if (name == "." || name == "..")
+            continue;
+        std::string path = dir + "/" + name;
+        if (depth < 2 && isDirectory(path)) {
+            purgeCacheLevels(path, depth + 1);
+            rmdir(path.c_str());
+        } else if (depth == 2)
+            unlink(path.c_str());
+    }
+    closedir(d);
+}
+
+
+void ResponseCache::configure(const CacheZoneConfig& config)
+{
+    _config = config;
+    mkdir(_config.path.c_str(), 0755);
+    purgeCacheLevels(_config.path, 0);
+}
+
+
+const CacheZoneConfig& ResponseCache::getConfig() const { return _config; }
+size_t ResponseCache::entryCount() const { return _entries.size(); }
+size_t ResponseCache::memoryBytes() const { return _memBytes; }
+size_t ResponseCache::diskBytes() const { return _diskBytes; }
+
+
+// <path>/<last hex digit>/<two previous digits>/<64-bit FNV-1a of the key>, as in levels=1:2.
+std::string ResponseCache::diskPathFor(const std::string& key) const
+{
+    unsigned long long h = 14695981039346656037ULL;
+    for (size_t i = 0; i < key.size(); ++i) {
+        h ^= static_cast<unsigned char>(key[i]);
+        h *= 1099511628211ULL;
+    }
+    static const char hex[] = "0123456789abcdef";
+    std::string name(16, '0');
+    for (int i = 15; i >= 0; --i) {
+        name[i] = hex[h & 0xf];
+        h >>= 4;
+    }
+    return _config.path + "/" + name.substr(15, 1) + "/" + name.substr(13, 2) + "/" + name;
+}
+
+
+// Writes "<head length>\n<head><body>" through a temporary file so readers never see partial entries.
+bool ResponseCache::writeToDisk(CacheEntry& entry, const std::string& key)
+{
+    std::string path = diskPathFor(key);
+    std::string level1 = path.substr(0, path.rfind('/'));
+    mkdir(level1.substr(0, level1.rfind('/')).c_str(), 0755);
+    mkdir(level1.c_str(), 0755);
+
+    std::string tmp = path + ".tmp";
+    std::ofstream out(tmp.c_str(), std::ios::binary | std::ios::trunc);
+    if (!out)
+        return false;
+    out << entry.head.size() << "\n";
+    out.write(entry.head.data(), entry.head.size());
+    out.write(entry.body.data(), entry.body.size());
+    out.close();
+    if (!out || rename(tmp.c_str(), path.c_str()) == -1) {
+        unlink(tmp.c_str());
+        return false;
+    }
+    entry.diskPath = path;
+    entry.diskTick = ++_tick;
+    _diskLru[entry.diskTick] = key;
+    _diskBytes += entry.size;
+    return true;
+}
+
+
+bool ResponseCache::readFromDisk(const CacheEntry& entry, std::string& head, std::string& body) const
+{
+    std::ifstream in(entry.diskPath.c_str(), std::ios::binary);
+    if (!in)
+        return false;
+    size_t headLen = 0;
+    in >> headLen;
+    if (!in || in.get() != '\n' || headLen > entry.size)
+        return false;
+    head.resize(headLen);
+    body.resize(entry.size - headLen);
+    in.read(&head[0], headLen);
+    if (!body.empty())
+        in.read(&body[0], body.size());
+    return !in.fail();
+}
+
+
+void ResponseCache::touchMemory(CacheEntry& entry, const std::string& key)
+{
+    _memLru.erase(entry.memTick);
+    entry.memTick = ++_tick;
+    _memLru[entry.memTick] = key;
+}
+
+
+void ResponseCache::dropFromMemory(CacheEntry& entry)
+{
+    if (!entry.inMemory)
+        return;
+    _memLru.erase(entry.memTick);
+    _memBytes -= entry.size;
+    std::string().swap(entry.head);
+    std::string().swap(entry.body);
+    entry.inMemory = false;
+}
+
+
+void ResponseCache::removeEntry(std::map<std::string, CacheEntry>::iterator it)
+{
+    CacheEntry& entry = it->second;
+    dropFromMemory(entry);
+    if (!entry.diskPath.empty()) {
+        unlink(entry.diskPath.c_str());
+        _diskLru.erase(entry.diskTick);
+        _diskBytes -= entry.size;
+    }
+    _entries.erase(it);
+}
+
+
+// Spills the least recently used entries to disk, then evicts from disk past max_size.
+void ResponseCache::enforceLimits()
+{
+    while (_memBytes > _config.memSize && !_memLru.empty()) {
+        std::map<std::string, CacheEntry>::iterator it = _entries.find(_memLru.begin()->second);
+        if (it == _entries.end()) {
+            _memLru.erase(_memLru.begin());
+            continue;
+        }
+        if (it->second.diskPath.empty() && !writeToDisk(it->second, it->first)) {
+            removeEntry(it);
+            continue;
+        }
+        dropFromMemory(it->second);
+    }
+    while (_diskBytes > _config.maxSize && !_diskLru.empty()) {
+        std::map<std::string, CacheEntry>::iterator it = _entries.find(_diskLru.begin()->second);
+        if (it == _entries.end()) {
+            _diskLru.erase(_diskLru.begin());
+            continue;
+        }
+        removeEntry(it);
+    }
+}
+
+
+// Finds the entry for key, loading it back from disk when it was spilled.
+CacheStatus ResponseCache::lookup(const std::string& key, time_t now, const CacheEntry*& entry)
+{
+    entry = NULL;
+    std::map<std::string, CacheEntry>::iterator it = _entries.find(key);
+    if (it == _entries.end())
+        return CACHE_MISS;
+    CacheEntry& e = it->second;
+    if (!e.diskPath.empty()) {
+        _diskLru.erase(e.diskTick);
+        e.diskTick = ++_tick;
+        _diskLru[e.diskTick] = key;
+    }
+    e.lastAccess = now;
+    if (e.inMemory) {
+        touchMemory(e, key);
+        entry = &e;
+    } else if (e.size > _config.memSize / CACHE_MEMORY_ENTRY_DIVISOR) {
+        _scratch = e;
+        if (!readFromDisk(e, _scratch.head, _scratch.body)) {
+            removeEntry(it);
+            return CACHE_MISS;
+        }
+        entry = &_scratch;
+    } else {
+        if (!readFromDisk(e, e.head, e.body)) {
+            removeEntry(it);
+            return CACHE_MISS;
+        }
+        e.inMemory = true;
+        _memBytes += e.size;
+        touchMemory(e, key);
+        enforceLimits();
+        entry = &e;
+    }
+    if (now < entry->freshUntil)
+        return CACHE_HIT;
+    if (now < entry->revalidateUntil)
+        return CACHE_STALE;
+    return CACHE_EXPIRED;
+}
+
+
+// Returns a copy that may still be served because the refresh failed, or NULL.
+const CacheEntry* ResponseCache::staleForError(const std::string& key, time_t now)
+{
+    const CacheEntry* entry = NULL;
+    if (lookup(key, now, entry) == CACHE_MISS)
+        return NULL;
+    if (now < entry->freshUntil || now < entry->errorUntil)
+        return entry;
+    return NULL;
+}
+
+
+// Claims the single refresh slot of an entry; false when another refresh already runs.
+bool ResponseCache::beginRefresh(const std::string& key)
+{
+    std::map<std::string, CacheEntry>::iterator it = _entries.find(key);
+    if (it == _entries.end() || it->second.updating)
+        return false;
+    it->second.updating = true;
+    return true;
+}
+
+
+void ResponseCache::endRefresh(const std::string& key)
+{
+    std::map<std::string, CacheEntry>::iterator it = _entries.find(key);
+    if (it != _entries.end())
+        it->second.updating = false;
+}
+
+
+// Replaces the entry for key; oversized responses go straight to disk.
+void ResponseCache::store(const std::string& key, const std::string& head, const std::string& body,
+                          const CacheFreshness& freshness, time_t now)
+{
+    std::map<std::string, CacheEntry>::iterator old = _entries.find(key);
+    if (old != _entries.end())
+        removeEntry(old);
+    size_t size = head.size() + body.size();
+    if (!freshness.cacheable || size > _config.maxSize)
+        return;
+
+    CacheEntry& entry = _entries[key];
+    entry.head = head;
+    entry.body = body;
+    entry.size = size;
+    entry.storedAt = now;
+    entry.lastAccess = now;
+    entry.freshUntil = now + freshness.ttl;
+    entry.revalidateUntil = entry.freshUntil + freshness.staleWhileRevalidate;
+    entry.errorUntil = entry.freshUntil + freshness.staleIfError;
+
+    if (size > _config.memSize / CACHE_MEMORY_ENTRY_DIVISOR) {
+        bool written = writeToDisk(entry, key);
+        std::string().swap(entry.head);
+        std::string().swap(entry.body);
+        if (!written)
+            _entries.erase(key);
+    } else {
+        entry.inMemory = true;
+        _memBytes += size;
+        touchMemory(entry, key);
+    }
+    enforceLimits();
+}
+
+
+// Drops entries past every stale window or unused for longer than the zone's inactive time.
+void ResponseCache::expire(time_t now)
+{
+    std::map<std::string, CacheEntry>::iterator it = _entries.begin();
+    while (it != _entries.end()) {
+        const CacheEntry& e = it->second;
+        time_t usableUntil = std::max(e.revalidateUntil, e.errorUntil);
+        std::map<std::string, CacheEntry>::iterator next = it;
+        ++next;
+        if (!e.updating && (now >= usableUntil || difftime(now, e.lastAccess) > _config.inactive))
+            removeEntry(it);
+        it = next;
+    }
+}
+
+
+static bool isCacheableStatus(int status)
+{
+    return status == 200 || status == 203 || status == 300 || status == 301 || status == 404 || status == 410;
+}
+
+
+// Reads "name=<seconds>" out of a Cache-Control token, -1 when absent or malformed.
+static long cacheControlSeconds(const std::string& token, const std::string& name)
+{
+    if (token.compare(0, name.size() + 1, name + "=") != 0)
+        return -1;
+    std::string value = token.substr(name.size() + 1);
+    if (!value.empty() && value[0] == '"')
+        value = value.substr(1, value.size() - 2);
+    char* end = NULL;
+    long seconds = std::strtol(value.c_str(), &end, 10);
+    if (value.empty() || *end != '\0' || seconds < 0)
+        return -1;
+    return seconds;
+}
+
+
+// Applies Cache-Control (s-maxage, max-age, no-store, stale-*) and Expires over the location defaults.
+CacheFreshness computeCacheFreshness(int status, const HeaderTable& headers,
+                                     time_t defaultTtl, time_t defaultRevalidate, time_t defaultError, time_t now)
+{
+    CacheFreshness fresh;
+    if (!isCacheableStatus(status))
+        return fresh;
+    std::string cacheControl, expires;
+    for (size_t i = 0; i < headers.size(); ++i) {
+        HeaderId id = headers.id(i);
+        if (id == HEADER_SET_COOKIE || (id == HEADER_VARY && ParserUtils::trim(headers.value(i).str()) == "*"))
+            return fresh;
+        if (id == HEADER_CACHE_CONTROL)
+            cacheControl = toLowerCase(headers.value(i).str());
+        else if (id == HEADER_EXPIRES)
+            expires = headers.value(i).str();
+    }
+
+    long maxAge = -1, sharedMaxAge = -1;
+    fresh.staleWhileRevalidate = defaultRevalidate;
+    fresh.staleIfError = defaultError;
+    std::vector<std::string> tokens = ParserUtils::split(cacheControl, ',');
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        std::string token = ParserUtils::trim(tokens[i]);
+        if (token == "no-store" || token == "no-cache" || token == "private")
+            return fresh;
+        long seconds;
+        if ((seconds = cacheControlSeconds(token, "s-maxage")) >= 0)
+            sharedMaxAge = seconds;
+        else if ((seconds = cacheControlSeconds(token, "max-age")) >= 0)
+            maxAge = seconds;
+        else if ((seconds = cacheControlSeconds(token, "stale-while-revalidate")) >= 0)
+            fresh.staleWhileRevalidate = seconds;
+        else if ((seconds = cacheControlSeconds(token, "stale-if-error")) >= 0)
+            fresh.staleIfError = seconds;
+    }
+
+    if (sharedMaxAge >= 0)
+        fresh.ttl = sharedMaxAge;
+    else if (maxAge >= 0)
+        fresh.ttl = maxAge;
+    else if (!expires.empty()) {
+        struct tm tm;
+        std::memset(&tm, 0, sizeof(tm));
+        if (!strptime(expires.c_str(), "%a, %d %b %Y %H:%M:%S", &tm))
+            return fresh;
+        time_t expiresAt = timegm(&tm);
+        fresh.ttl = expiresAt > now ? expiresAt - now : 0;
+    } else
+        fresh.ttl = defaultTtl;
+    fresh.cacheable = fresh.ttl > 0;
+    return fresh;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "Webserv.hpp"
+#include "../config/CacheConfig.hpp"
+#include "HeaderTable.hpp"
+
+enum CacheStatus { CACHE_MISS, CACHE_HIT, CACHE_STALE, CACHE_EXPIRED };
+
+// Freshness lifetimes (seconds) derived from the script headers and the location defaults.
+struct CacheFreshness {
+	bool   cacheable;
+	time_t ttl;
+	time_t staleWhileRevalidate;
+	time_t staleIfError;
+
+	CacheFreshness() : cacheable(false), ttl(0), staleWhileRevalidate(0), staleIfError(0) {}
+};
+
+struct CacheEntry {
+	std::string   head;        // status line + header lines, each CRLF terminated
+	std::string   body;
+	size_t        size;        // head + body bytes
+	time_t        storedAt;
+	time_t        freshUntil;
+	time_t        revalidateUntil; // served stale while one refresh runs
+	time_t        errorUntil;      // served stale when the refresh fails
+	time_t        lastAccess;
+	bool          inMemory;
+	std::string   diskPath;    // set once the entry has been written to disk
+	bool          updating;    // a background refresh is in flight
+	unsigned long memTick;     // position in the memory LRU
+	unsigned long diskTick;    // position in the disk LRU
+
+	CacheEntry() : size(0), storedAt(0), freshUntil(0), revalidateUntil(0), errorUntil(0), lastAccess(0),
+	               inMemory(false), updating(false), memTick(0), diskTick(0) {}
+};
+
+// One cgi_cache zone: an LRU memory tier spilling to a hashed directory layout on disk.
+class ResponseCache {
+	private:
+			CacheZoneConfig                    _config;
+			std::map<std::string, CacheEntry>  _entries;
+			std::map<unsigned long, std::string> _memLru;   // tick -> key, oldest first
+			std::map<unsigned long, std::string> _diskLru;
+			unsigned long                      _tick;
+			size_t                             _memBytes;
+			size_t                             _diskBytes;
+			CacheEntry                         _scratch;    // oversized entry loaded for a single response
+
+			std::string diskPathFor(const std::string& key) const;
+			bool writeToDisk(CacheEntry& entry, const std::string& key);
+			bool readFromDisk(const CacheEntry& entry, std::string& head, std::string& body) const;
+			void touchMemory(CacheEntry& entry, const std::string& key);
+			void dropFromMemory(CacheEntry& entry);
+			void removeEntry(std::map<std::string, CacheEntry>::iterator it);
+			void enforceLimits();
+
+	public:
+			ResponseCache();
+			~ResponseCache();
+
+			void configure(const CacheZoneConfig& config);
+			const CacheZoneConfig& getConfig() const;
+
+			CacheStatus lookup(const std::string& key, time_t now, const CacheEntry*& entry);
+			const CacheEntry* staleForError(const std::string& key, time_t now);
+			bool beginRefresh(const std::string& key);
+			void endRefresh(const std::string& key);
+			void store(const std::string& key, const std::string& head, const std::string& body,
+			           const CacheFreshness& freshness, time_t now);
+			void expire(time_t now);
+
+			size_t entryCount() const;
+			size_t memoryBytes() const;
+			size_t diskBytes() const;
+};
+
+CacheFreshness computeCacheFreshness(int status, const HeaderTable& headers,
+                                     time_t defaultTtl, time_t defaultRevalidate, time_t defaultError, time_t now);
@@ -13,6 +13,63 @@ namespace
             g_activeLoop->requestStop();
     }
 
+    void handleShutdownSignal(int)
+    {
+        if (g_activeLoop)
+            g_activeLoop->requestShutdown();
+    }
+
+    void handleReloadSignal(int)
+    {
+        if (g_activeLoop)
+            g_activeLoop->requestReload();
+    }
+
+    void handleUpgradeSignal(int)
+    {
+        if (g_activeLoop)
+            g_activeLoop->requestUpgrade();
+    }
+
+    // Parses the listening sockets handed over by a binary upgrade ("host:port=fd;...").
+    std::map<std::string, int> takeInheritedListeners()
+    {
+        std::map<std::string, int> inherited;
+        const char* env = std::getenv(UPGRADE_LISTEN_ENV);
+        if (!env)
+            return inherited;
+        std::string list(env);
+        unsetenv(UPGRADE_LISTEN_ENV);
+        size_t pos = 0;
+        while (pos < list.size()) {
+            size_t end = list.find(';', pos);
+            if (end == std::string::npos)
+                end = list.size();
+            std::string item = list.substr(pos, end - pos);
+            size_t eq = item.rfind('=');
+            if (eq != std::string::npos && eq + 1 < item.size())
+                inherited[item.substr(0, eq)] = std::atoi(item.c_str() + eq + 1);
+            pos = end + 1;
+        }
+        return inherited;
+    }
+
+    // Tells the process that started us that our listeners are in place.
+    void notifyUpgradeParent()
+    {
+        const char* env = std::getenv(UPGRADE_READY_ENV);
+        if (!env)
+            return;
+        int fd = std::atoi(env);
+        unsetenv(UPGRADE_READY_ENV);
+        if (fd <= 2)
+            return;
+        if (write(fd, "R", 1) != 1)
+            ERROR_SYS("upgrade ready notification");
+        close(fd);
+        LOG("Upgrade complete, previous process is draining");
+    }
+
     void destroyServers(std::vector<Server*>& servers)
     {
         for (size_t i = 0; i < servers.size(); ++i) 
@@ -47,35 +104,10 @@ namespace
     }
 }
 
-void groupHostPort(std::vector<ServerConfig> &serverConfigs, std::map<std::string, std::vector<ServerConfig> > &groups) {
-    for (size_t i = 0; i < serverConfigs.size(); ++i) {
-            const std::vector<std::string>& listens = serverConfigs[i].getListen();
-            if (!listens.empty()) 
-            {
-                for (size_t j = 0; j < listens.size(); ++j) {
-                    // listens[j] is normalized in the form host:port
-                    std::string key = listens[j];
-                    // Clone the configuration and force host/port for this specific listen
-                    ServerConfig clone = serverConfigs[i];
-                    size_t colon = key.find(':');
-                    std::string host = key.substr(0, colon);
-                    int port = std::atoi(key.substr(colon + 1).c_str());
-                    clone.setHost(host);
-                    clone.setPort(port);
-                    groups[key].push_back(clone);
-                }
-            } 
-            else 
-            {
-                std::string key = serverConfigs[i].getHost() + std::string(":") + toString(serverConfigs[i].getPort());
-                groups[key].push_back(serverConfigs[i]);
-            }
-        }
-}
-
 int createGroupSocket(std::vector<Server*> &servers, std::map<std::string, std::vector<ServerConfig> > &groups,
     std::vector< std::vector<ServerConfig> > &serverGroups, std::vector<int> &listenFds) 
     {
+        std::map<std::string, int> inherited = takeInheritedListeners();
         servers.reserve(groups.size());
         listenFds.reserve(groups.size());
         serverGroups.reserve(groups.size());
@@ -87,8 +119,17 @@ int createGroupSocket(std::vector<Server*> &servers, std::map<std::string, std::
                 continue;
             try 
             {
-                // Create a server only for the first one (bind + listen)
-                Server* srv = new Server(group[0]);
+                // Create a server only for the first one (bind + listen), or adopt
+                // the socket the upgraded process was already listening on
+                Server* srv;
+                std::map<std::string, int>::iterator fd = inherited.find(it->first);
+                if (fd != inherited.end()) {
+                    int inheritedFd = fd->second;
+                    inherited.erase(fd);
+                    srv = new Server(group[0], inheritedFd);
+                    LOG("Adopted listening socket for " + it->first + " (fd " + toString(inheritedFd) + ")");
+                } else
+                    srv = new Server(group[0]);
                 servers.push_back(srv);
                 listenFds.push_back(srv->getListeningSocket());
                 serverGroups.push_back(group);
@@ -97,6 +138,9 @@ int createGroupSocket(std::vector<Server*> &servers, std::map<std::string, std::
                 ERROR("Failed to create socket for " + it->first + ": " + std::string(e.what()));
             }
         }
+        // the new configuration no longer listens there
+        for (std::map<std::string, int>::iterator it = inherited.begin(); it != inherited.end(); ++it)
+            close(it->second);
         if (listenFds.empty()) 
         {
             ERROR("No listening socket created");
@@ -134,12 +178,22 @@ int main(int argc, char** argv)
             return 1;
         // single epoll loop
         epollManager loop(listenFds, serverGroups);
+        loop.adoptListeners(servers, configPath);
+        loop.setUpgradeCommand(argc, argv);
         g_activeLoop = &loop;
         std::signal(SIGINT, handleSignal);
-        std::signal(SIGTERM, handleSignal);
+        std::signal(SIGTERM, handleShutdownSignal);
+        std::signal(SIGHUP, handleReloadSignal);
+        std::signal(SIGUSR2, handleUpgradeSignal);
+        // a peer gone mid-write must surface as EPIPE (OpenSSL writes without MSG_NOSIGNAL)
+        std::signal(SIGPIPE, SIG_IGN);
+        notifyUpgradeParent();
         loop.run();
         std::signal(SIGINT, SIG_DFL);
         std::signal(SIGTERM, SIG_DFL);
+        std::signal(SIGHUP, SIG_DFL);
+        std::signal(SIGUSR2, SIG_DFL);
+        std::signal(SIGPIPE, SIG_DFL);
         g_activeLoop = NULL;
 
         destroyServers(servers);
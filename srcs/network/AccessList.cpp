@@ -0,0 +1,167 @@
+#include "Webserv.hpp"
+#include "AccessList.hpp"
+#include "../utils/ParserUtils.hpp"
+
+
+AccessList::AccessList() : _prefixes(0)
+{
+    _v4.push_back(Node());
+    _v6.push_back(Node());
+}
+
+
+AccessList::~AccessList() {}
+
+
+size_t AccessList::prefixCount() const { return _prefixes; }
+
+
+// Adds the first `bits` bits of addr; an existing prefix keeps its earlier rule.
+void AccessList::insert(std::vector<Node>& trie, const unsigned char* addr, int bits, int rule)
+{
+    int node = 0;
+    for (int i = 0; i < bits; ++i) {
+        int bit = (addr[i >> 3] >> (7 - (i & 7))) & 1;
+        if (trie[node].child[bit] == -1) {
+            trie[node].child[bit] = static_cast<int>(trie.size());
+            trie.push_back(Node());
+        }
+        node = trie[node].child[bit];
+    }
+    if (trie[node].rule == -1 || rule < trie[node].rule)
+        trie[node].rule = rule;
+}
+
+
+// Lowest rule index among all prefixes of addr, -1 when none matches.
+int AccessList::match(const std::vector<Node>& trie, const unsigned char* addr, int bits)
+{
+    int node = 0;
+    int best = trie[0].rule;
+    for (int i = 0; i < bits; ++i) {
+        node = trie[node].child[(addr[i >> 3] >> (7 - (i & 7))) & 1];
+        if (node == -1)
+            break;
+        if (trie[node].rule != -1 && (best == -1 || trie[node].rule < best))
+            best = trie[node].rule;
+    }
+    return best;
+}
+
+
+// Parses "all", "localhost", an address or a CIDR prefix and inserts it.
+bool AccessList::addSource(const std::string& source, int rule)
+{
+    if (source == "all") {
+        insert(_v4, NULL, 0, rule);
+        insert(_v6, NULL, 0, rule);
+        return true;
+    }
+    if (source == "localhost")
+        return addSource("127.0.0.1", rule) && addSource("::1", rule);
+
+    size_t slash = source.find('/');
+    std::string ip = source.substr(0, slash);
+    bool v6 = ip.find(':') != std::string::npos;
+    int maxBits = v6 ? 128 : 32;
+    int bits = maxBits;
+    if (slash != std::string::npos) {
+        std::string mask = source.substr(slash + 1);
+        if (mask.empty() || mask.size() > 3 || mask.find_first_not_of("0123456789") != std::string::npos)
+            return false;
+        bits = std::atoi(mask.c_str());
+        if (bits > maxBits)
+            return false;
+    }
+    unsigned char addr[16];
+    if (inet_pton(v6 ? AF_INET6 : AF_INET, ip.c_str(), addr) != 1)
+        return false;
+    insert(v6 ? _v6 : _v4, addr, bits, rule);
+    _prefixes++;
+    return true;
+}
+
+
+// Loads one address or CIDR per line ('#' starts a comment); every line shares the directive's rule.
+// The parser already refused unreadable files; one that vanished since then fails closed: a
+// deny_file denies everyone, an allow_file allows no one.
+void AccessList::addFile(const std::string& path, int rule)
+{
+    std::ifstream in(path.c_str());
+    if (!in) {
+        ERROR("Cannot open access list " + path + (_ruleAllow[rule] ? "" : ", denying all"));
+        if (!_ruleAllow[rule])
+            addSource("all", rule);
+        return;
+    }
+    std::string line;
+    size_t loaded = 0, invalid = 0;
+    while (std::getline(in, line)) {
+        size_t hash = line.find('#');
+        if (hash != std::string::npos)
+            line.erase(hash);
+        line = ParserUtils::trim(line);
+        if (!line.empty() && line[line.size() - 1] == ';')
+            line = ParserUtils::trim(line.substr(0, line.size() - 1));
+        if (line.empty())
+            continue;
+        if (addSource(line, rule))
+            loaded++;
+        else
+            invalid++;
+    }
+    LOG("Access list " + path + ": " + toString(loaded) + " prefixes loaded"
+        + (invalid ? ", " + toString(invalid) + " invalid lines skipped" : ""));
+}
+
+
+void AccessList::compile(const std::vector<AccessRule>& rules)
+{
+    for (size_t i = 0; i < rules.size(); ++i) {
+        int index = static_cast<int>(_ruleAllow.size());
+        _ruleAllow.push_back(rules[i].allow);
+        if (rules[i].isFile)
+            addFile(rules[i].source, index);
+        else if (!addSource(rules[i].source, index))
+            ERROR("Invalid access rule " + rules[i].source);
+    }
+}
+
+
+bool AccessList::decide(int rule) const
+{
+    return rule == -1 || _ruleAllow[rule];
+}
+
+
+bool AccessList::allows(const struct sockaddr* addr) const
+{
+    if (addr->sa_family == AF_INET) {
+        const struct sockaddr_in* in4 = reinterpret_cast<const struct sockaddr_in*>(addr);
+        return decide(match(_v4, reinterpret_cast<const unsigned char*>(&in4->sin_addr), 32));
+    }
+    if (addr->sa_family == AF_INET6) {
+        const struct sockaddr_in6* in6 = reinterpret_cast<const struct sockaddr_in6*>(addr);
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&in6->sin6_addr);
+        if (IN6_IS_ADDR_V4MAPPED(&in6->sin6_addr))
+            return decide(match(_v4, bytes + 12, 32));
+        return decide(match(_v6, bytes, 128));
+    }
+    return true;
+}
+
+
+bool AccessList::allows(const std::string& ip) const
+{
+    struct sockaddr_storage ss;
+    std::memset(&ss, 0, sizeof(ss));
+    struct sockaddr_in* in4 = reinterpret_cast<struct sockaddr_in*>(&ss);
+    struct sockaddr_in6* in6 = reinterpret_cast<struct sockaddr_in6*>(&ss);
+    if (inet_pton(AF_INET, ip.c_str(), &in4->sin_addr) == 1)
+        ss.ss_family = AF_INET;
+    else if (inet_pton(AF_INET6, ip.c_str(), &in6->sin6_addr) == 1)
+        ss.ss_family = AF_INET6;
+    else
+        return true;
+    return allows(reinterpret_cast<const struct sockaddr*>(&ss));
+}
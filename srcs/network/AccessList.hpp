@@ -0,0 +1,38 @@
+#pragma once
+
+#include "Webserv.hpp"
+#include "../config/AccessRule.hpp"
+
+// allow/deny rules compiled into binary radix tries (one per address family).
+// Every prefix node keeps the index of the first rule covering it, so a lookup
+// walks at most 32 / 128 bits and picks the lowest index seen: first match wins.
+// Addresses matching no rule are allowed.
+class AccessList {
+	private:
+			struct Node {
+				int child[2];
+				int rule;   // first rule ending on this prefix, -1 if none
+
+				Node() : rule(-1) { child[0] = -1; child[1] = -1; }
+			};
+
+			std::vector<Node> _v4;
+			std::vector<Node> _v6;
+			std::vector<bool> _ruleAllow;  // action of each rule index
+			size_t            _prefixes;
+
+			static void insert(std::vector<Node>& trie, const unsigned char* addr, int bits, int rule);
+			static int  match(const std::vector<Node>& trie, const unsigned char* addr, int bits);
+			bool addSource(const std::string& source, int rule);
+			void addFile(const std::string& path, int rule);
+			bool decide(int rule) const;
+
+	public:
+			AccessList();
+			~AccessList();
+
+			void compile(const std::vector<AccessRule>& rules);
+			bool allows(const struct sockaddr* addr) const;
+			bool allows(const std::string& ip) const;
+			size_t prefixCount() const;
+};
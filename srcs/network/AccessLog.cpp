@@ -0,0 +1,56 @@
+#include "Webserv.hpp"
+#include "AccessLog.hpp"
+
+
+AccessLog::AccessLog() : _fd(-1) {}
+
+
+AccessLog::~AccessLog()
+{
+    flush();
+    if (_fd != -1)
+        close(_fd);
+}
+
+
+const std::string& AccessLog::path() const { return _path; }
+
+
+bool AccessLog::open(const std::string& path)
+{
+    _path = path;
+    _fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (_fd == -1) {
+        ERROR_SYS("Cannot open log " + path);
+        return false;
+    }
+    return true;
+}
+
+
+void AccessLog::write(const std::string& line)
+{
+    _buffer += line;
+    _buffer += '\n';
+    if (_buffer.size() >= ACCESS_LOG_BUFFER)
+        flush();
+}
+
+
+void AccessLog::flush()
+{
+    if (_fd == -1 || _buffer.empty())
+        return;
+    size_t offset = 0;
+    while (offset < _buffer.size()) {
+        ssize_t n = ::write(_fd, _buffer.data() + offset, _buffer.size() - offset);
+        if (n <= 0) {
+            if (n == -1 && errno == EINTR)
+                continue;
+            ERROR_SYS("write log " + _path);
+            break;
+        }
+        offset += static_cast<size_t>(n);
+    }
+    _buffer.clear();
+}
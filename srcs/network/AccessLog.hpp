@@ -0,0 +1,37 @@
+#pragma once
+
+#include "Webserv.hpp"
+
+#define ACCESS_LOG_BUFFER 32768  // bytes kept before a write(2)
+
+// Append-only log file shared by every server that names the same path.
+// Lines are buffered and written when the buffer fills or on flush(), so a busy
+// server does not pay one syscall per request.
+class AccessLog {
+	private:
+			std::string _path;
+			int         _fd;
+			std::string _buffer;
+
+			AccessLog(const AccessLog&);
+			AccessLog& operator=(const AccessLog&);
+
+	public:
+			AccessLog();
+			~AccessLog();
+
+			bool open(const std::string& path);
+			void write(const std::string& line);
+			void flush();
+			const std::string& path() const;
+};
+
+// Log destinations of one server, resolved once at startup.
+struct ServerLogTargets {
+	AccessLog*  access;
+	std::string format;
+	AccessLog*  slow;      // NULL: slow requests go to the error output
+	long long   slowUs;    // -1: disabled
+
+	ServerLogTargets() : access(NULL), slow(NULL), slowUs(-1) {}
+};
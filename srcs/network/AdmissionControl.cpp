@@ -0,0 +1,121 @@
+#include "Webserv.hpp"
+#include "AdmissionControl.hpp"
+
+
+AdmissionControl::AdmissionControl()
+    : _limit(MAX_CLIENTS), _cgiLimit(MAX_CGI_PROCESS), _lagUs(0), _cgiUs(0), _cgiSampled(false),
+      _overloaded(false), _cgiOverloaded(false), _peakRequests(0), _peakCgi(0), _nextUpdateUs(0) {}
+
+
+// Takes new targets; limits learned so far are kept across reloads, and start wide open otherwise.
+void AdmissionControl::configure(const AdmissionConfig& config)
+{
+    if (!_config.enabled) {
+        _limit = MAX_CLIENTS;
+        _cgiLimit = MAX_CGI_PROCESS;
+        _overloaded = _cgiOverloaded = false;
+    }
+    _config = config;
+}
+
+
+bool AdmissionControl::enabled() const { return _config.enabled; }
+
+
+size_t AdmissionControl::limit() const { return _limit; }
+
+
+size_t AdmissionControl::cgiLimit() const { return _cgiLimit; }
+
+
+long long AdmissionControl::lagUs() const { return _lagUs; }
+
+
+long long AdmissionControl::cgiLatencyUs() const { return _cgiUs; }
+
+
+bool AdmissionControl::overloaded() const { return _overloaded || _cgiOverloaded; }
+
+
+// Time the loop spent handling one batch of events: what the last event of the batch waited.
+void AdmissionControl::sampleLoop(long long busyUs)
+{
+    _lagUs += (busyUs - _lagUs) / 8;
+}
+
+
+void AdmissionControl::sampleCgi(long long runUs)
+{
+    _cgiUs += (runUs - _cgiUs) / 4;
+    _cgiSampled = true;
+}
+
+
+void AdmissionControl::observe(size_t requests, size_t cgi)
+{
+    _peakRequests = std::max(_peakRequests, requests);
+    _peakCgi = std::max(_peakCgi, cgi);
+}
+
+
+// Cuts from what was actually in use when that is below the limit, so the first
+// overloaded interval already lands near the sustainable concurrency.
+size_t AdmissionControl::shrink(size_t limit, size_t peak, size_t floor)
+{
+    limit = std::min(limit, std::max(peak, floor));
+    return std::max(limit * 3 / 4, floor);
+}
+
+
+// Only grows a limit the interval actually came close to; an idle server keeps what it learned.
+size_t AdmissionControl::grow(size_t limit, size_t peak, size_t ceiling)
+{
+    if (peak * 2 < limit)
+        return limit;
+    return std::min(limit + ADMISSION_INCREASE, ceiling);
+}
+
+
+// Runs one control step when the interval elapsed; returns true when a limit moved.
+bool AdmissionControl::update(long long nowUs)
+{
+    if (!_config.enabled || nowUs < _nextUpdateUs)
+        return false;
+    _nextUpdateUs = nowUs + ADMISSION_INTERVAL_MS * 1000LL;
+    size_t limit = _limit;
+    size_t cgiLimit = _cgiLimit;
+
+    _overloaded = _lagUs > _config.lagMs * 1000LL;
+    _limit = _overloaded ? shrink(_limit, _peakRequests, ADMISSION_MIN_REQUESTS) : grow(_limit, _peakRequests, MAX_CLIENTS);
+
+    if (!_cgiSampled && _peakCgi == 0)
+        _cgiUs /= 2; // no CGI ran: the last latency fades out instead of holding the limit down
+    _cgiOverloaded = _cgiUs > _config.cgiLatencyMs * 1000LL;
+    _cgiLimit = _cgiOverloaded ? shrink(_cgiLimit, _peakCgi, ADMISSION_MIN_CGI) : grow(_cgiLimit, _peakCgi, MAX_CGI_PROCESS);
+
+    _cgiSampled = false;
+    _peakRequests = _peakCgi = 0;
+    return limit != _limit || cgiLimit != _cgiLimit;
+}
+
+
+bool AdmissionControl::admitWithin(RequestPriority priority, size_t active, size_t limit, bool overloaded)
+{
+    if (priority == PRIORITY_CRITICAL)
+        return true;
+    if (priority == PRIORITY_LOW)
+        return !overloaded && active < limit * ADMISSION_LOW_SHARE / 100;
+    return active < limit;
+}
+
+
+bool AdmissionControl::admit(RequestPriority priority, size_t requests) const
+{
+    return !_config.enabled || admitWithin(priority, requests, _limit, _overloaded);
+}
+
+
+bool AdmissionControl::admitCgi(RequestPriority priority, size_t cgi) const
+{
+    return !_config.enabled || admitWithin(priority, cgi, _cgiLimit, _cgiOverloaded);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "Webserv.hpp"
+#include "../config/LimitConfig.hpp"
+
+// Adaptive concurrency limits behind admission_control. The event loop reports how long
+// each iteration worked and how long each CGI ran; every ADMISSION_INTERVAL_MS the limits
+// grow by ADMISSION_INCREASE while the loop keeps up and the in-flight work reaches half
+// of them, and drop to three quarters of what was in use when the smoothed lag or CGI
+// latency passes its target (additive increase, multiplicative decrease). Priority low is
+// shed first: it only gets ADMISSION_LOW_SHARE of the limit and nothing while overloaded;
+// critical always passes.
+class AdmissionControl {
+	private:
+			AdmissionConfig _config;
+			size_t    _limit;          // in-flight requests
+			size_t    _cgiLimit;       // running CGI processes
+			long long _lagUs;          // moving average of the work per loop iteration
+			long long _cgiUs;          // moving average of the CGI run time
+			bool      _cgiSampled;     // a CGI finished during the interval
+			bool      _overloaded;
+			bool      _cgiOverloaded;
+			size_t    _peakRequests;   // highest in-flight count during the interval
+			size_t    _peakCgi;
+			long long _nextUpdateUs;
+
+			static size_t shrink(size_t limit, size_t peak, size_t floor);
+			static size_t grow(size_t limit, size_t peak, size_t ceiling);
+			static bool admitWithin(RequestPriority priority, size_t active, size_t limit, bool overloaded);
+
+	public:
+			AdmissionControl();
+
+			void configure(const AdmissionConfig& config);
+			bool enabled() const;
+			void sampleLoop(long long busyUs);
+			void sampleCgi(long long runUs);
+			void observe(size_t requests, size_t cgi);
+			bool update(long long nowUs);
+			bool admit(RequestPriority priority, size_t requests) const;
+			bool admitCgi(RequestPriority priority, size_t cgi) const;
+
+			size_t limit() const;
+			size_t cgiLimit() const;
+			long long lagUs() const;
+			long long cgiLatencyUs() const;
+			bool overloaded() const;
+};
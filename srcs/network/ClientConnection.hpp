@@ -1,10 +1,67 @@
+#pragma once
+
 #include "Webserv.hpp"
+#include "../http/DirectoryListing.hpp"
+#include "../http/HeaderTable.hpp"
+#include <openssl/ssl.h>
 
 class ServerConfig; // forward declaration
+class LimitZone;
+struct LatencyHistogram;
+
+typedef std::vector<std::pair<LimitZone*, std::string> > LimitHolds; // zone + key: limit_conn slots, limit_req charges
 
 enum ConnState { READING_HEADERS, READING_BODY, READY };
 enum BodyType { BODY_NONE, BODY_FIXED, BODY_CHUNKED };
 enum ChunkState { CHUNK_READ_SIZE, CHUNK_READ_DATA, CHUNK_READ_CRLF, CHUNK_COMPLETE };
+enum UpstreamFraming { UPSTREAM_NO_BODY, UPSTREAM_LENGTH, UPSTREAM_CHUNKED, UPSTREAM_UNTIL_CLOSE };
+
+// Reverse proxy context (one upstream exchange per client request)
+struct ProxyState {
+    bool        active;
+    int         fd;              // upstream socket
+    int         peer;            // index inside the upstream group
+    std::string group;           // upstream group name
+    std::string request;         // serialized request head sent before conn.body
+    size_t      sent;            // bytes of head + body already written
+    bool        connected;
+    bool        reused;          // connection came from the keep-alive pool
+    bool        headersDone;
+    std::string head;            // response header staging until parsed
+    UpstreamFraming framing;
+    size_t      remaining;       // body bytes left (UPSTREAM_LENGTH) or in current chunk
+    ChunkState  chunkState;      // chunked framing scanner
+    std::string chunkLine;       // partial chunk-size / trailer line
+    bool        reusable;        // upstream allows keep-alive
+    bool        paused;          // reading stopped because the client is slow
+    std::vector<int> tried;      // peers already attempted for this request
+    time_t      lastActivity;
+
+    ProxyState()
+        : active(false), fd(-1), peer(-1), sent(0), connected(false), reused(false), headersDone(false),
+          framing(UPSTREAM_NO_BODY), remaining(0), chunkState(CHUNK_READ_SIZE), reusable(false),
+          paused(false), lastActivity(0) {}
+};
+
+// Monotonic timestamps (us) of the current request's phases, 0 when a phase did not happen.
+struct RequestTimings {
+    long long idleSince;       // accept, or the end of the previous response on keep-alive
+    long long firstByte;
+    long long headersDone;
+    long long bodyDone;
+    long long dispatched;      // handler chosen, after access rules and limits
+    long long cgiSpawn;
+    long long cgiExit;
+    long long upstreamStart;
+    long long upstreamHeader;
+    long long upstreamDone;
+    long long firstSent;
+    long long lastSent;
+
+    RequestTimings()
+        : idleSince(0), firstByte(0), headersDone(0), bodyDone(0), dispatched(0), cgiSpawn(0), cgiExit(0),
+          upstreamStart(0), upstreamHeader(0), upstreamDone(0), firstSent(0), lastSent(0) {}
+};
 
 class ClientConnection {
 public:
@@ -13,19 +70,23 @@ public:
     std::string buffer;       // raw incoming buffer
     time_t lastActivity;      // last activity timestamp
     bool isReading;           // connection state flag (unused for now)
+    SSL* tls;                 // session of an ssl listener's client, owned; NULL for plain HTTP
+    bool tlsReady;            // handshake finished, application data flows
 
     // Parsed request state
     ConnState state;
     bool headersParsed;
     std::string method;
+    MethodId methodId;
     std::string uri;
     std::string version;
-    std::map<std::string, std::string> headers;
+    HeaderTable headers;
 
     BodyType bodyType;
     size_t contentLength;
-    size_t bodyReceived;
+    size_t bodyReceived;      // body bytes so far, in memory or in the spill file
     std::string body;
+    int bodyFd;               // unlinked temporary file holding the body under memory pressure, -1 otherwise
 
 
     // Chunked decoding state
@@ -38,6 +99,10 @@ public:
     size_t outOffset;         // bytes already sent
     bool hasResponse;         // whether a response is ready to write
     bool keepAlive;           // whether to keep connection open after response
+    bool streamPending;       // more response bytes will be appended to outBuffer
+    unsigned long requestCount; // responses completed on this connection
+    long long idleDeadline;   // keep-alive wait or lingering close ends (ms), 0 while a request is active
+    long long lingerUntil;    // lingering close gives up at this time (ms), 0 unless lingering
 
     // Session management
     bool sessionAssigned;
@@ -57,10 +122,51 @@ public:
     std::string cgiOutBuffer; // raw CGI output
     time_t cgiStart;
 
+    ProxyState proxy;
+
+    // Directory listing streamed by autoindex
+    ListingStream listing;
+
+    // Response cache context (cgi_cache)
+    std::string cacheZone;
+    std::string cacheKey;
+    bool        backgroundRefresh; // pseudo-connection refreshing a stale entry, no socket
+
+    // limit_req / limit_conn
+    bool        limitReqPassed;   // limit_req already applied to this request (it was delayed)
+    long long   limitDelayUntil;  // request parked by limit_req until this time (ms), 0 otherwise
+    LimitHolds  limitReqCharges;  // limit_req buckets this request was counted in, until it is admitted
+    LimitHolds  connLimits;       // server-level slots, released on close
+    LimitHolds  requestLimits;    // location-level slots, released once the response is sent
+
+    // admission_control
+    bool        admitted;         // counted in the requests in flight until its response is sent
+    bool        reserved;         // accepted past MAX_CLIENTS: only priority critical requests are served
+
+    // aio threads
+    unsigned long aioJob;         // id of the FileJob building the response, 0 when none
+
+    // Metrics and access log of the current request
+    RequestTimings    timing;
+    int               responseStatus;   // parsed from the first bytes sent, 0 before
+    size_t            responseHeadSize;
+    size_t            bytesSent;
+    LatencyHistogram* serverLatency;
+    LatencyHistogram* locationLatency;
+
+    size_t            memoryUsed;       // buffer capacity charged to the memory budget
+
     ClientConnection()
-        : fd(-1), listenFd(-1), lastActivity(0), isReading(true), state(READING_HEADERS), headersParsed(false),
-          bodyType(BODY_NONE), contentLength(0), bodyReceived(0), chunkState(CHUNK_READ_SIZE),
-            currentChunkSize(0), outOffset(0), hasResponse(false), keepAlive(false),
+        : fd(-1), listenFd(-1), lastActivity(0), isReading(true), tls(NULL), tlsReady(false), state(READING_HEADERS), headersParsed(false),
+          methodId(METHOD_UNKNOWN), bodyType(BODY_NONE), contentLength(0), bodyReceived(0), bodyFd(-1), chunkState(CHUNK_READ_SIZE),
+            currentChunkSize(0), outOffset(0), hasResponse(false), keepAlive(false), streamPending(false), requestCount(0),
+            idleDeadline(0), lingerUntil(0),
             sessionAssigned(false), sessionShouldSetCookie(false),
-            remotePort(0), cgiRunning(false), cgiPid(-1), cgiInFd(-1), cgiOutFd(-1), cgiInOffset(0), cgiStart(0) {}
+            remotePort(0), cgiRunning(false), cgiPid(-1), cgiInFd(-1), cgiOutFd(-1), cgiInOffset(0), cgiStart(0),
+            backgroundRefresh(false), limitReqPassed(false), limitDelayUntil(0), admitted(false), reserved(false), aioJob(0),
+            responseStatus(0), responseHeadSize(0), bytesSent(0), serverLatency(NULL), locationLatency(NULL),
+            memoryUsed(0) {}
 };
+
+// Clears the per-request fields for the next request on the connection (epollManager.cpp).
+void resetClientState(ClientConnection& conn);
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "Webserv.hpp"
+#include "../config/ServerConfig.hpp"
+#include "ServerNameTable.hpp"
+#include "AccessList.hpp"
+#include "Tls.hpp"
+
+// One loaded configuration: the servers behind each listen socket and the tables
+// compiled from them. Never modified once built; a reload builds a new snapshot,
+// new requests select their server from it, and requests already running keep
+// their ServerConfig pointer into the old one until they finish.
+struct ConfigSnapshot {
+	unsigned long                                  generation;
+	std::map<int, std::vector<ServerConfig> >      serverGroups;   // listen fd -> group (first is default)
+	std::map<int, ServerNameTable>                 serverNames;    // listen fd -> compiled server_name lookup
+	std::map<std::string, AccessList*>             accessLists;    // compiled allow/deny lists by rule signature
+	std::map<int, std::vector<const AccessList*> > listenAccess;   // empty when some server has no rules
+	std::map<std::string, SSL_CTX*>                tlsContexts;    // by tlsContextKey(), one reference each
+	std::map<int, std::vector<SSL_CTX*> >          listenTls;      // ssl listen fd -> context of each server (SNI)
+
+	explicit ConfigSnapshot(unsigned long gen) : generation(gen) {}
+	~ConfigSnapshot()
+	{
+		for (std::map<std::string, AccessList*>::iterator it = accessLists.begin(); it != accessLists.end(); ++it)
+			delete it->second;
+		// sessions still running keep their context alive through their own reference
+		for (std::map<std::string, SSL_CTX*>::iterator it = tlsContexts.begin(); it != tlsContexts.end(); ++it)
+			SSL_CTX_free(it->second);
+	}
+
+	private:
+		ConfigSnapshot(const ConfigSnapshot&);
+		ConfigSnapshot& operator=(const ConfigSnapshot&);
+};
@@ -27,126 +27,82 @@ std::map<std::string, std::string> parseCookies(const std::string& header)
 }
 
 
-// Extracts the session identifier from the Cookie header if present.
-std::string extractSessionId(const Request& request)
+// Returns the value of one cookie straight from the header, without building the whole map.
+std::string findCookie(const std::string& header, const std::string& name)
 {
-    const std::string cookieHeader = request.getHeader("Cookie");
-    if (cookieHeader.empty())
-        return std::string();
-    const std::map<std::string, std::string> cookies = parseCookies(cookieHeader);
-    std::map<std::string, std::string>::const_iterator it = cookies.find("session_id");
-    if (it == cookies.end())
-        return std::string();
-    return it->second;
-}
-
-
-// Attempts to locate an existing session by identifier.
-SessionData* findSession(std::map<std::string, SessionData>& sessions, const std::string& sessionId)
-{
-    if (sessionId.empty())
-        return NULL;
-    std::map<std::string, SessionData>::iterator it = sessions.find(sessionId);
-    if (it == sessions.end())
-        return NULL;
-    return &it->second;
-}
-
-
-// Inserts a session entry and reports whether it was newly created.
-SessionData& createSession(std::map<std::string, SessionData>& sessions, const std::string& sessionId, time_t now, bool& created)
-{
-    SessionData data;
-    data.lastSeen = now;
-    data.requestCount = 1;
-    std::pair<std::map<std::string, SessionData>::iterator, bool> inserted =
-        sessions.insert(std::make_pair(sessionId, data));
-    created = inserted.second;
-    return inserted.first->second;
-}
-
-
-// Updates the usage statistics of an existing session.
-void touchSession(SessionData& session, time_t now)
-{
-    session.lastSeen = now;
-    session.requestCount += 1;
+    size_t pos = 0;
+    while (pos < header.size()) {
+        while (pos < header.size() && (header[pos] == ' ' || header[pos] == '\t' || header[pos] == ';'))
+            ++pos;
+        size_t end = header.find(';', pos);
+        if (end == std::string::npos)
+            end = header.size();
+        if (header.compare(pos, name.size(), name) == 0 && pos + name.size() < end && header[pos + name.size()] == '=') {
+            size_t valueEnd = end;
+            while (valueEnd > pos && (header[valueEnd - 1] == ' ' || header[valueEnd - 1] == '\t'))
+                --valueEnd;
+            return header.substr(pos + name.size() + 1, valueEnd - pos - name.size() - 1);
+        }
+        pos = end;
+    }
+    return std::string();
 }
 
 
-// Returns the global in-memory session storage.
-std::map<std::string, SessionData>& sessionStore()
+// Returns the global session storage, sized by epollManager from session_zone.
+SessionStore& sessionStore()
 {
-    static std::map<std::string, SessionData> store;
+    static SessionStore store;
     return store;
 }
 
 
-// Removes sessions that have been idle longer than SESSION_MAX_IDLE seconds.
+// Frees sessions whose idle timeout passed since the last cleanup tick.
 void removeExpiredSessions(time_t now)
 {
-    std::map<std::string, SessionData>& sessions = sessionStore();
-    for (std::map<std::string, SessionData>::iterator it = sessions.begin(); it != sessions.end();) 
-    {
-        double idle = difftime(now, it->second.lastSeen);
-
-        if (idle > SESSION_MAX_IDLE) 
-        {
-            std::map<std::string, SessionData>::iterator eraseIt = it++;
-            sessions.erase(eraseIt);
-        } 
-        else 
-            ++it;
-    }
-}
-
-
-// Generates a new random session identifier.
-std::string generateSessionId(int clientFd)
-{
-    static bool seeded = false;
-    if (!seeded) {
-        std::srand(static_cast<unsigned int>(time(NULL)));
-        seeded = true;
-    }
-    std::ostringstream oss;
-    oss << std::hex << time(NULL) << "-" << std::rand() << "-" << clientFd;
-    return oss.str();
+    sessionStore().expire(now);
 }
 
 
-// Ensures that the connection has an associated session state.
-void ensureConnectionSession(ClientConnection& conn, const Request& request)
+// Resumes the client's session or starts one; only called for locations with `session on`.
+void ensureConnectionSession(ClientConnection& conn)
 {
-    std::map<std::string, SessionData>& sessions = sessionStore();
-    std::string sessionId = extractSessionId(request);
-    SessionData* session = findSession(sessions, sessionId);
+    SessionStore& sessions = sessionStore();
     const time_t now = time(NULL);
-    bool created = false;
+    std::string sessionId;
+    HeaderView cookie;
+    if (conn.headers.find(HEADER_COOKIE, cookie))
+        sessionId = findCookie(cookie.str(), "session_id");
 
-    if (!session) {
-        if (sessionId.empty())
-            sessionId = generateSessionId(conn.fd);
-        session = &createSession(sessions, sessionId, now, created);
+    bool created = false;
+    if (!sessions.touch(sessionId, now)) {
+        // unknown or forged IDs are never adopted: the client gets a new random one
+        created = sessions.create(sessionId, now);
         if (!created)
-            touchSession(*session, now);
-    } else {
-        touchSession(*session, now);
+            sessionId.clear();
     }
-
     conn.sessionId = sessionId;
-    conn.sessionAssigned = true;
+    conn.sessionAssigned = !sessionId.empty();
     conn.sessionShouldSetCookie = created;
 }
 
 
-// Attaches the Set-Cookie header when the session is new.
-void attachSessionCookie(Response& response, ClientConnection& conn)
+// Returns the Set-Cookie value once when the session is new, empty otherwise.
+std::string takeSessionCookie(ClientConnection& conn)
 {
     if (conn.sessionId.empty())
-        return;
+        return std::string();
     if (!conn.sessionShouldSetCookie)
-        return;
-    response.setHeader("Set-Cookie", "session_id=" + conn.sessionId + "; Path=/; SameSite=Lax");
+        return std::string();
     conn.sessionShouldSetCookie = false;
+    return "session_id=" + conn.sessionId + "; Path=/; SameSite=Lax";
+}
+
+
+// Attaches the Set-Cookie header when the session is new.
+void attachSessionCookie(Response& response, ClientConnection& conn)
+{
+    std::string cookie = takeSessionCookie(conn);
+    if (!cookie.empty())
+        response.addHeader("Set-Cookie", cookie);
 }
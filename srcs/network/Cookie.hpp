@@ -1,18 +1,15 @@
 #pragma once
 
 #include "Webserv.hpp"
-#include "../http/Request.hpp"
-
-struct SessionData {
-	time_t lastSeen;
-	size_t requestCount;
-};
+#include "SessionStore.hpp"
 
 class ClientConnection;
 class Response;
 
-std::string generateSessionId(int clientFd);
-void ensureConnectionSession(ClientConnection& conn, const Request& request);
+std::map<std::string, std::string> parseCookies(const std::string& header);
+std::string findCookie(const std::string& header, const std::string& name);
+void ensureConnectionSession(ClientConnection& conn);
 void attachSessionCookie(Response& response, ClientConnection& conn);
-std::map<std::string, SessionData>& sessionStore();
+std::string takeSessionCookie(ClientConnection& conn);
+SessionStore& sessionStore();
 void removeExpiredSessions(time_t now);
@@ -0,0 +1,74 @@
+#include "Webserv.hpp"
+#include "EventBackend.hpp"
+
+
+// "io_uring" when the kernel allows it, epoll otherwise.
+EventBackend* EventBackend::create(const std::string& kind)
+{
+    if (kind == "io_uring") {
+        UringBackend* uring = new UringBackend();
+        if (uring->open(URING_ENTRIES)) {
+            INFO("Event backend: io_uring");
+            return uring;
+        }
+        delete uring;
+        ERROR("io_uring unavailable, falling back to epoll");
+    }
+    EpollBackend* epoll = new EpollBackend();
+    if (!epoll->open()) {
+        delete epoll;
+        return NULL;
+    }
+    INFO("Event backend: epoll");
+    return epoll;
+}
+
+
+EpollBackend::EpollBackend() : _epollFd(-1) {}
+
+
+EpollBackend::~EpollBackend()
+{
+    if (_epollFd != -1)
+        close(_epollFd);
+}
+
+
+bool EpollBackend::open()
+{
+    _epollFd = epoll_create1(EPOLL_CLOEXEC);
+    return _epollFd != -1;
+}
+
+
+const char* EpollBackend::name() const { return "epoll"; }
+
+
+bool EpollBackend::add(int fd, uint32_t events)
+{
+    struct epoll_event ev;
+    ev.data.fd = fd;
+    ev.events = events;
+    return epoll_ctl(_epollFd, EPOLL_CTL_ADD, fd, &ev) == 0;
+}
+
+
+bool EpollBackend::modify(int fd, uint32_t events)
+{
+    struct epoll_event ev;
+    ev.data.fd = fd;
+    ev.events = events;
+    return epoll_ctl(_epollFd, EPOLL_CTL_MOD, fd, &ev) == 0;
+}
+
+
+void EpollBackend::remove(int fd)
+{
+    epoll_ctl(_epollFd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+
+int EpollBackend::wait(struct epoll_event* events, int maxEvents, int timeoutMs)
+{
+    return epoll_wait(_epollFd, events, maxEvents, timeoutMs);
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "Webserv.hpp"
+
+// Readiness notification behind the event loop (event_backend). Masks use the epoll bits
+// (EPOLLIN, EPOLLOUT, EPOLLERR, EPOLLHUP), events are level-triggered with either backend,
+// and errors and hangups are reported even with an empty interest mask. A watched fd must
+// be removed before it is closed.
+class EventBackend {
+	public:
+			virtual ~EventBackend() {}
+
+			virtual const char* name() const = 0;
+			virtual bool add(int fd, uint32_t events) = 0;
+			virtual bool modify(int fd, uint32_t events) = 0;
+			virtual void remove(int fd) = 0;
+			// Fills up to maxEvents entries (data.fd and events); -1 with errno EINTR on a signal.
+			virtual int wait(struct epoll_event* events, int maxEvents, int timeoutMs) = 0;
+
+			static EventBackend* create(const std::string& kind);
+};
+
+class EpollBackend : public EventBackend {
+	private:
+			int _epollFd;
+
+			EpollBackend(const EpollBackend&);
+			EpollBackend& operator=(const EpollBackend&);
+
+	public:
+			EpollBackend();
+			~EpollBackend();
+
+			bool open();
+			const char* name() const;
+			bool add(int fd, uint32_t events);
+			bool modify(int fd, uint32_t events);
+			void remove(int fd);
+			int wait(struct epoll_event* events, int maxEvents, int timeoutMs);
+};
+
+// io_uring without liburing: every watched fd has one one-shot IORING_OP_POLL_ADD in
+// flight. Interest changes update that poll in place, completed polls are re-armed, and
+// all of it is queued in the submission ring and handed to the kernel together with the
+// wait, in a single io_uring_enter() per loop iteration instead of one epoll_ctl() each.
+// Completions carry the fd and a per-fd generation, so a poll that completes after its fd
+// was removed (and possibly reused) is recognised and dropped. io_uring polls always wake
+// on EPOLLRDHUP, which would make a half-closed peer without EPOLLIN interest complete
+// every poll at once; such fds move to a private epoll set that the ring polls instead.
+// Readiness only: accept/recv/send stay plain syscalls on the loop. Polls are one-shot, not
+// IORING_POLL_ADD_MULTI, because a multishot poll only fires on new wakeups and the loop
+// relies on level-triggered readiness (accept batch limits, reads paused and resumed).
+class UringBackend : public EventBackend {
+	private:
+			struct Watch {
+				uint32_t interest;
+				uint32_t generation;
+				bool     registered;
+				bool     armed;      // a poll is in flight in the kernel
+				bool     halfClosed; // watched through _epollFd
+
+				Watch() : interest(0), generation(0), registered(false), armed(false), halfClosed(false) {}
+			};
+
+			int       _ringFd;
+			int       _epollFd;      // half-closed peers
+			bool      _epollArmed;
+			void*     _sqRing;
+			void*     _cqRing;
+			void*     _sqes;
+			size_t    _sqRingSize;
+			size_t    _cqRingSize;
+			size_t    _sqesSize;
+			unsigned* _sqHead;
+			unsigned* _sqTail;
+			unsigned* _sqMask;
+			unsigned* _sqArray;
+			unsigned* _cqHead;
+			unsigned* _cqTail;
+			unsigned* _cqMask;
+			void*     _cqes;
+			unsigned  _sqEntries;
+			std::vector<Watch> _watches;  // by fd
+			std::vector<int>   _rearm;    // fds whose poll completed, armed again before the next wait
+
+			UringBackend(const UringBackend&);
+			UringBackend& operator=(const UringBackend&);
+
+			Watch* find(int fd);
+			struct io_uring_sqe* nextSqe();
+			bool queuePoll(uint64_t tag, int fd, uint32_t events);
+			int enter(bool wait, int timeoutMs);
+			void moveToEpoll(int fd, Watch& w);
+			int collectEpoll(struct epoll_event* events, int maxEvents);
+
+	public:
+			UringBackend();
+			~UringBackend();
+
+			bool open(unsigned entries);
+			const char* name() const;
+			bool add(int fd, uint32_t events);
+			bool modify(int fd, uint32_t events);
+			void remove(int fd);
+			int wait(struct epoll_event* events, int maxEvents, int timeoutMs);
+};
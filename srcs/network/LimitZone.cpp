@@ -0,0 +1,212 @@
+#include "Webserv.hpp"
+#include "LimitZone.hpp"
+#include "../utils/Utils.hpp"
+
+
+LimitZone::LimitZone() : _rate(0), _free(-1), _newest(-1), _oldest(-1), _used(0) {}
+
+
+LimitZone::~LimitZone() {}
+
+
+const std::string& LimitZone::name() const { return _name; }
+
+
+const std::string& LimitZone::keyPattern() const { return _keyPattern; }
+
+
+size_t LimitZone::used() const { return _used; }
+
+
+size_t LimitZone::capacity() const { return _nodes.size(); }
+
+
+static size_t nodeCount(size_t zoneSize)
+{
+    return std::max(zoneSize / LIMIT_NODE_BYTES, static_cast<size_t>(16));
+}
+
+
+// Allocates every node up front and threads them on the free list.
+void LimitZone::configure(const LimitZoneConfig& config)
+{
+    _name = config.name;
+    _keyPattern = config.key;
+    _rate = config.rate;
+    size_t count = nodeCount(config.size);
+    size_t buckets = 1;
+    while (buckets < count)
+        buckets <<= 1;
+    _nodes.assign(count, Node());
+    _buckets.assign(buckets, -1);
+    for (size_t i = 0; i < count; ++i)
+        _nodes[i].next = (i + 1 < count) ? static_cast<int>(i + 1) : -1;
+    _free = 0;
+    _newest = _oldest = -1;
+    _used = 0;
+    LOG("Limit zone " + _name + ": " + toString(count) + " entries");
+}
+
+
+// True when a reloaded definition can keep this zone and its state.
+bool LimitZone::matches(const LimitZoneConfig& config) const
+{
+    return config.key == _keyPattern && config.rate == _rate && nodeCount(config.size) == _nodes.size();
+}
+
+
+int LimitZone::find(const std::string& key, unsigned int hash) const
+{
+    for (int i = _buckets[hash & (_buckets.size() - 1)]; i != -1; i = _nodes[i].next) {
+        if (_nodes[i].hash == hash && _nodes[i].key == key)
+            return i;
+    }
+    return -1;
+}
+
+
+void LimitZone::unlinkLru(int index)
+{
+    Node& node = _nodes[index];
+    if (node.newer != -1)
+        _nodes[node.newer].older = node.older;
+    else
+        _newest = node.older;
+    if (node.older != -1)
+        _nodes[node.older].newer = node.newer;
+    else
+        _oldest = node.newer;
+    node.newer = node.older = -1;
+}
+
+
+void LimitZone::pushNewest(int index)
+{
+    Node& node = _nodes[index];
+    node.newer = -1;
+    node.older = _newest;
+    if (_newest != -1)
+        _nodes[_newest].newer = index;
+    _newest = index;
+    if (_oldest == -1)
+        _oldest = index;
+}
+
+
+// Unlinks a node from its bucket and the LRU list and returns it to the free list.
+void LimitZone::remove(int index)
+{
+    Node& node = _nodes[index];
+    int* link = &_buckets[node.hash & (_buckets.size() - 1)];
+    while (*link != index)
+        link = &_nodes[*link].next;
+    *link = node.next;
+    unlinkLru(index);
+    node.key.clear();
+    node.next = _free;
+    _free = index;
+    _used--;
+}
+
+
+// Takes a free node or recycles the oldest one; keepBusy spares nodes still holding connections.
+int LimitZone::insert(const std::string& key, unsigned int hash, bool keepBusy)
+{
+    if (_free == -1) {
+        int victim = _oldest;
+        for (int scanned = 0; victim != -1 && keepBusy && _nodes[victim].conns > 0; ++scanned)
+            victim = (scanned + 1 < LIMIT_EVICT_SCAN) ? _nodes[victim].newer : -1;
+        if (victim == -1)
+            return -1;
+        remove(victim);
+    }
+    int index = _free;
+    Node& node = _nodes[index];
+    _free = node.next;
+    node.hash = hash;
+    node.key = key;
+    node.excess = 0;
+    node.last = 0;
+    node.conns = 0;
+    int& bucket = _buckets[hash & (_buckets.size() - 1)];
+    node.next = bucket;
+    bucket = index;
+    pushNewest(index);
+    _used++;
+    return index;
+}
+
+
+// Leaky bucket: the key drains at the zone rate and may queue up to `burst` requests.
+// Queued requests are delayed by excess / rate unless nodelay lets them through at once.
+LimitResult LimitZone::checkRequest(const std::string& rawKey, long long nowMs, long burst, bool nodelay, long& delayMs)
+{
+    delayMs = 0;
+    std::string key = rawKey.substr(0, LIMIT_KEY_MAX);
+    unsigned int hash = hashKey32(key);
+    int index = find(key, hash);
+    if (index == -1) {
+        index = insert(key, hash, false);
+        _nodes[index].last = nowMs;
+        return LIMIT_PASS;
+    }
+    Node& node = _nodes[index];
+    unlinkLru(index);
+    pushNewest(index);
+    long long elapsed = nowMs - node.last;
+    if (elapsed < 0)
+        elapsed = 0;
+    long long excess = node.excess - _rate * elapsed / 1000 + 1000;
+    if (excess < 0)
+        excess = 0;
+    if (excess > burst * 1000)
+        return LIMIT_REJECT;
+    node.excess = static_cast<long>(excess);
+    node.last = nowMs;
+    if (excess == 0 || nodelay)
+        return LIMIT_PASS;
+    delayMs = static_cast<long>(excess * 1000 / _rate);
+    return LIMIT_DELAY;
+}
+
+
+// Takes back the request checkRequest() last counted for key, when a later rule rejected it.
+void LimitZone::refundRequest(const std::string& rawKey)
+{
+    std::string key = rawKey.substr(0, LIMIT_KEY_MAX);
+    int index = find(key, hashKey32(key));
+    if (index == -1)
+        return;
+    _nodes[index].excess = std::max(_nodes[index].excess - 1000, 0L);
+}
+
+
+// Takes one limit_conn slot for key; false when max slots are held or the zone is exhausted.
+bool LimitZone::acquire(const std::string& rawKey, int max)
+{
+    std::string key = rawKey.substr(0, LIMIT_KEY_MAX);
+    unsigned int hash = hashKey32(key);
+    int index = find(key, hash);
+    if (index == -1 && (index = insert(key, hash, true)) == -1) {
+        LOG("Limit zone " + _name + " is full");
+        return false;
+    }
+    Node& node = _nodes[index];
+    if (node.conns >= max)
+        return false;
+    node.conns++;
+    unlinkLru(index);
+    pushNewest(index);
+    return true;
+}
+
+
+void LimitZone::release(const std::string& rawKey)
+{
+    std::string key = rawKey.substr(0, LIMIT_KEY_MAX);
+    int index = find(key, hashKey32(key));
+    if (index == -1)
+        return;
+    if (--_nodes[index].conns <= 0)
+        remove(index);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "Webserv.hpp"
+#include "../config/LimitConfig.hpp"
+
+#define LIMIT_NODE_BYTES 128  // zone size accounted per tracked key
+#define LIMIT_KEY_MAX 256     // longer keys are truncated
+#define LIMIT_EVICT_SCAN 8    // LRU entries examined when a conn zone is full
+
+enum LimitResult { LIMIT_PASS, LIMIT_DELAY, LIMIT_REJECT };
+
+// State behind one limit_req_zone / limit_conn_zone. The node array is sized from the
+// zone size once at startup; keys hash into chained buckets and an intrusive LRU list
+// recycles the least recently seen key when the table is full, so every lookup is O(1)
+// and a flood of spoofed sources cannot grow memory.
+class LimitZone {
+	private:
+			struct Node {
+				unsigned int hash;
+				int          next;      // bucket chain, or free list when unused
+				int          newer;     // LRU neighbours, -1 at the ends
+				int          older;
+				long         excess;    // limit_req: queued requests * 1000
+				long long    last;      // limit_req: time of the last accepted request (ms)
+				int          conns;     // limit_conn: slots held
+				std::string  key;
+
+				Node() : hash(0), next(-1), newer(-1), older(-1), excess(0), last(0), conns(0) {}
+			};
+
+			std::string       _name;
+			std::string       _keyPattern;
+			long              _rate;
+			std::vector<Node> _nodes;
+			std::vector<int>  _buckets;
+			int               _free;
+			int               _newest;
+			int               _oldest;
+			size_t            _used;
+
+			int  find(const std::string& key, unsigned int hash) const;
+			int  insert(const std::string& key, unsigned int hash, bool keepBusy);
+			void remove(int index);
+			void unlinkLru(int index);
+			void pushNewest(int index);
+
+	public:
+			LimitZone();
+			~LimitZone();
+
+			void configure(const LimitZoneConfig& config);
+			bool matches(const LimitZoneConfig& config) const;
+			const std::string& name() const;
+			const std::string& keyPattern() const;
+			LimitResult checkRequest(const std::string& key, long long nowMs, long burst, bool nodelay, long& delayMs);
+			void refundRequest(const std::string& key);
+			bool acquire(const std::string& key, int max);
+			void release(const std::string& key);
+			size_t used() const;
+			size_t capacity() const;
+};
@@ -0,0 +1,257 @@
+#include "Webserv.hpp"
+#include "Metrics.hpp"
+
+
+// Bucket upper bounds in microseconds, 1ms .. 10s.
+static const long long g_latencyBounds[LATENCY_BUCKETS] = {
+    1000, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000
+};
+
+static const char* g_timeoutNames[TIMEOUT_KINDS] = { "idle", "read", "cgi", "upstream", "keepalive", "lingering" };
+static const char* g_memoryNames[MEMORY_KINDS] = { "connection", "request", "body", "response", "cgi", "upstream" };
+static const char* g_priorityNames[PRIORITY_LEVELS] = { "low", "normal", "critical" };
+
+
+LatencyHistogram::LatencyHistogram() : count(0), sumUs(0)
+{
+    std::memset(buckets, 0, sizeof(buckets));
+}
+
+
+void LatencyHistogram::observe(long long us)
+{
+    if (us < 0)
+        us = 0;
+    size_t i = 0;
+    while (i < LATENCY_BUCKETS && us > g_latencyBounds[i])
+        ++i;
+    buckets[i]++;
+    count++;
+    sumUs += static_cast<unsigned long long>(us);
+}
+
+
+Metrics::Metrics() : accepted(0), handled(0), requests(0), bytesIn(0), bytesOut(0), cgiSpawned(0),
+    tlsHandshakes(0), tlsResumed(0), tlsOffloaded(0), tlsFailed(0),
+    memoryPauses(0), bodiesSpilled(0), memoryRefused(0), connectionsRejected(0),
+    connectionsReclaimed(0), lingeringCloses(0), aioTasks(0), aioQueueFull(0)
+{
+    std::memset(admissionShed, 0, sizeof(admissionShed));
+    std::memset(responses, 0, sizeof(responses));
+    std::memset(timeouts, 0, sizeof(timeouts));
+}
+
+
+Metrics::~Metrics() {}
+
+
+// Prometheus label values escape backslash, quote and newline.
+static std::string labelValue(const std::string& value)
+{
+    std::string out;
+    for (size_t i = 0; i < value.size(); ++i) {
+        if (value[i] == '\\' || value[i] == '"')
+            out += '\\';
+        if (value[i] == '\n')
+            out += "\\n";
+        else
+            out += value[i];
+    }
+    return out;
+}
+
+
+// Histograms are created on the first request of a server / location; the pointer stays valid.
+// Configs with the same labels (a server on several listens, a reloaded server) share one.
+LatencyHistogram* Metrics::serverHistogram(const void* server, const std::string& name)
+{
+    std::map<const void*, LatencyHistogram*>::iterator it = _byConfig.find(server);
+    if (it != _byConfig.end())
+        return it->second;
+    std::string labels = "server=\"" + labelValue(name) + "\"";
+    LatencyHistogram& histogram = _servers[labels];
+    histogram.labels = labels;
+    _byConfig[server] = &histogram;
+    return &histogram;
+}
+
+
+LatencyHistogram* Metrics::locationHistogram(const void* location, const std::string& server, const std::string& path)
+{
+    std::map<const void*, LatencyHistogram*>::iterator it = _byConfig.find(location);
+    if (it != _byConfig.end())
+        return it->second;
+    std::string labels = "server=\"" + labelValue(server) + "\",location=\"" + labelValue(path) + "\"";
+    LatencyHistogram& histogram = _locations[labels];
+    histogram.labels = labels;
+    _byConfig[location] = &histogram;
+    return &histogram;
+}
+
+
+// Drops the lookup entry of a config freed by a reload; its histogram keeps counting for its successor.
+void Metrics::forgetConfig(const void* config)
+{
+    _byConfig.erase(config);
+}
+
+
+void Metrics::countResponse(int status)
+{
+    int statusClass = status / 100;
+    if (statusClass >= 1 && statusClass <= 5)
+        responses[statusClass]++;
+}
+
+
+// nginx stub_status layout, understood by existing monitoring plugins.
+std::string Metrics::renderStubStatus(const ConnectionGauges& gauges) const
+{
+    std::ostringstream out;
+    out << "Active connections: " << gauges.active << " \n"
+        << "server accepts handled requests\n"
+        << " " << accepted << " " << handled << " " << requests << " \n"
+        << "Reading: " << gauges.reading << " Writing: " << gauges.writing << " Waiting: " << gauges.idle << " \n"
+        << "Memory: " << gauges.memoryUsed << " limit " << gauges.memoryLimit << " peak " << gauges.memoryPeak
+        << " spilled " << gauges.bodySpilled << " paused " << gauges.memoryPaused << " \n"
+        << "Admission: " << gauges.requestsInFlight << " limit " << gauges.admissionLimit << " cgi " << gauges.cgiActive
+        << " limit " << gauges.admissionCgiLimit << " shed " << admissionShed[PRIORITY_LOW] + admissionShed[PRIORITY_NORMAL]
+        << " rejected " << connectionsRejected << " \n";
+    return out.str();
+}
+
+
+void Metrics::renderHistograms(std::ostringstream& out, const std::string& name, const std::string& help,
+    const std::map<std::string, LatencyHistogram>& histograms)
+{
+    out << "# HELP " << name << " " << help << "\n# TYPE " << name << " histogram\n";
+    for (std::map<std::string, LatencyHistogram>::const_iterator it = histograms.begin(); it != histograms.end(); ++it) {
+        const LatencyHistogram& h = it->second;
+        unsigned long long cumulative = 0;
+        for (size_t i = 0; i <= LATENCY_BUCKETS; ++i) {
+            cumulative += h.buckets[i];
+            out << name << "_bucket{" << h.labels << ",le=\"";
+            if (i < LATENCY_BUCKETS)
+                out << g_latencyBounds[i] / 1000000.0;
+            else
+                out << "+Inf";
+            out << "\"} " << cumulative << "\n";
+        }
+        out << name << "_sum{" << h.labels << "} " << h.sumUs / 1000000.0 << "\n";
+        out << name << "_count{" << h.labels << "} " << h.count << "\n";
+    }
+}
+
+
+// Prometheus text exposition format 0.0.4.
+std::string Metrics::renderPrometheus(const ConnectionGauges& gauges) const
+{
+    std::ostringstream out;
+    out << "# HELP webserv_connections_accepted_total Client connections accepted.\n"
+        << "# TYPE webserv_connections_accepted_total counter\n"
+        << "webserv_connections_accepted_total " << accepted << "\n"
+        << "# HELP webserv_connections_handled_total Accepted connections not dropped by access rules or limits.\n"
+        << "# TYPE webserv_connections_handled_total counter\n"
+        << "webserv_connections_handled_total " << handled << "\n"
+        << "# HELP webserv_connections Open client connections by state.\n"
+        << "# TYPE webserv_connections gauge\n"
+        << "webserv_connections{state=\"active\"} " << gauges.active << "\n"
+        << "webserv_connections{state=\"reading\"} " << gauges.reading << "\n"
+        << "webserv_connections{state=\"writing\"} " << gauges.writing << "\n"
+        << "webserv_connections{state=\"idle\"} " << gauges.idle << "\n"
+        << "# HELP webserv_requests_total Requests whose headers were received.\n"
+        << "# TYPE webserv_requests_total counter\n"
+        << "webserv_requests_total " << requests << "\n"
+        << "# HELP webserv_responses_total Responses sent, by status class.\n"
+        << "# TYPE webserv_responses_total counter\n";
+    for (int i = 1; i <= 5; ++i)
+        out << "webserv_responses_total{class=\"" << i << "xx\"} " << responses[i] << "\n";
+    out << "# HELP webserv_received_bytes_total Bytes read from clients.\n"
+        << "# TYPE webserv_received_bytes_total counter\n"
+        << "webserv_received_bytes_total " << bytesIn << "\n"
+        << "# HELP webserv_sent_bytes_total Bytes written to clients.\n"
+        << "# TYPE webserv_sent_bytes_total counter\n"
+        << "webserv_sent_bytes_total " << bytesOut << "\n"
+        << "# HELP webserv_cgi_active CGI processes currently running.\n"
+        << "# TYPE webserv_cgi_active gauge\n"
+        << "webserv_cgi_active " << gauges.cgiActive << "\n"
+        << "# HELP webserv_cgi_max Maximum concurrent CGI processes.\n"
+        << "# TYPE webserv_cgi_max gauge\n"
+        << "webserv_cgi_max " << gauges.cgiMax << "\n"
+        << "# HELP webserv_cgi_spawned_total CGI processes started.\n"
+        << "# TYPE webserv_cgi_spawned_total counter\n"
+        << "webserv_cgi_spawned_total " << cgiSpawned << "\n"
+        << "# HELP webserv_timeouts_total Timeouts fired, by kind.\n"
+        << "# TYPE webserv_timeouts_total counter\n";
+    for (int i = 0; i < TIMEOUT_KINDS; ++i)
+        out << "webserv_timeouts_total{kind=\"" << g_timeoutNames[i] << "\"} " << timeouts[i] << "\n";
+    out << "# HELP webserv_tls_handshakes_total TLS handshakes, by outcome.\n"
+        << "# TYPE webserv_tls_handshakes_total counter\n"
+        << "webserv_tls_handshakes_total{result=\"full\"} " << tlsHandshakes - tlsResumed << "\n"
+        << "webserv_tls_handshakes_total{result=\"resumed\"} " << tlsResumed << "\n"
+        << "webserv_tls_handshakes_total{result=\"failed\"} " << tlsFailed << "\n"
+        << "# HELP webserv_tls_ktls_total TLS connections whose records the kernel encrypts.\n"
+        << "# TYPE webserv_tls_ktls_total counter\n"
+        << "webserv_tls_ktls_total " << tlsOffloaded << "\n"
+        << "# HELP webserv_memory_bytes Buffer memory held by connections, by buffer.\n"
+        << "# TYPE webserv_memory_bytes gauge\n";
+    for (int i = 0; i < MEMORY_KINDS; ++i)
+        out << "webserv_memory_bytes{buffer=\"" << g_memoryNames[i] << "\"} " << gauges.memory[i] << "\n";
+    out << "# HELP webserv_memory_limit_bytes memory_limit of the running configuration, 0 when unlimited.\n"
+        << "# TYPE webserv_memory_limit_bytes gauge\n"
+        << "webserv_memory_limit_bytes " << gauges.memoryLimit << "\n"
+        << "# HELP webserv_memory_peak_bytes Highest buffer memory accounted since start.\n"
+        << "# TYPE webserv_memory_peak_bytes gauge\n"
+        << "webserv_memory_peak_bytes " << gauges.memoryPeak << "\n"
+        << "# HELP webserv_memory_paused Connections whose reads wait for memory.\n"
+        << "# TYPE webserv_memory_paused gauge\n"
+        << "webserv_memory_paused " << gauges.memoryPaused << "\n"
+        << "# HELP webserv_request_body_spilled_bytes Request body bytes held in temporary files.\n"
+        << "# TYPE webserv_request_body_spilled_bytes gauge\n"
+        << "webserv_request_body_spilled_bytes " << gauges.bodySpilled << "\n"
+        << "# HELP webserv_memory_pressure_total Actions taken to stay within memory_limit.\n"
+        << "# TYPE webserv_memory_pressure_total counter\n"
+        << "webserv_memory_pressure_total{action=\"paused\"} " << memoryPauses << "\n"
+        << "webserv_memory_pressure_total{action=\"spilled\"} " << bodiesSpilled << "\n"
+        << "webserv_memory_pressure_total{action=\"refused\"} " << memoryRefused << "\n"
+        << "# HELP webserv_requests_in_flight Requests admitted whose response is not sent yet.\n"
+        << "# TYPE webserv_requests_in_flight gauge\n"
+        << "webserv_requests_in_flight " << gauges.requestsInFlight << "\n";
+    if (gauges.admissionEnabled) {
+        out << "# HELP webserv_admission_limit Adaptive concurrency limits of admission_control.\n"
+            << "# TYPE webserv_admission_limit gauge\n"
+            << "webserv_admission_limit{kind=\"requests\"} " << gauges.admissionLimit << "\n"
+            << "webserv_admission_limit{kind=\"cgi\"} " << gauges.admissionCgiLimit << "\n"
+            << "# HELP webserv_admission_overloaded 1 while the loop lag or CGI latency is above its target.\n"
+            << "# TYPE webserv_admission_overloaded gauge\n"
+            << "webserv_admission_overloaded " << (gauges.admissionOverloaded ? 1 : 0) << "\n"
+            << "# HELP webserv_event_loop_lag_seconds Moving average of the work done per event loop iteration.\n"
+            << "# TYPE webserv_event_loop_lag_seconds gauge\n"
+            << "webserv_event_loop_lag_seconds " << gauges.loopLagUs / 1000000.0 << "\n"
+            << "# HELP webserv_cgi_latency_seconds Moving average of the CGI run time.\n"
+            << "# TYPE webserv_cgi_latency_seconds gauge\n"
+            << "webserv_cgi_latency_seconds " << gauges.cgiLatencyUs / 1000000.0 << "\n";
+    }
+    out << "# HELP webserv_admission_shed_total Requests answered 503 by admission_control, by priority.\n"
+        << "# TYPE webserv_admission_shed_total counter\n";
+    for (int i = 0; i < PRIORITY_CRITICAL; ++i) // critical requests are never shed
+        out << "webserv_admission_shed_total{priority=\"" << g_priorityNames[i] << "\"} " << admissionShed[i] << "\n";
+    out << "# HELP webserv_connections_rejected_total Connections closed at accept past the MAX_CLIENTS reserve.\n"
+        << "# TYPE webserv_connections_rejected_total counter\n"
+        << "webserv_connections_rejected_total " << connectionsRejected << "\n";
+    out << "# HELP webserv_connections_reclaimed_total Idle keep-alive or lingering connections closed to make room for new ones.\n"
+        << "# TYPE webserv_connections_reclaimed_total counter\n"
+        << "webserv_connections_reclaimed_total " << connectionsReclaimed << "\n"
+        << "# HELP webserv_lingering_closes_total Connections half-closed by lingering_close while the client was still sending.\n"
+        << "# TYPE webserv_lingering_closes_total counter\n"
+        << "webserv_lingering_closes_total " << lingeringCloses << "\n";
+    out << "# HELP webserv_aio_tasks_total Responses of aio threads locations built on the thread pool.\n"
+        << "# TYPE webserv_aio_tasks_total counter\n"
+        << "webserv_aio_tasks_total " << aioTasks << "\n"
+        << "# HELP webserv_aio_queue_full_total Requests of aio threads locations run on the event loop because the pool queue was full.\n"
+        << "# TYPE webserv_aio_queue_full_total counter\n"
+        << "webserv_aio_queue_full_total " << aioQueueFull << "\n";
+    renderHistograms(out, "webserv_request_duration_seconds", "Time from the first request byte to the last response byte, per server.", _servers);
+    renderHistograms(out, "webserv_location_request_duration_seconds", "Time from the first request byte to the last response byte, per location.", _locations);
+    return out.str();
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "Webserv.hpp"
+#include "../config/LimitConfig.hpp"
+
+#define LATENCY_BUCKETS 12
+
+// Request latency with fixed upper bounds (see Metrics.cpp); the last bucket is +Inf.
+struct LatencyHistogram {
+	std::string        labels;   // rendered Prometheus labels, e.g. server="a",location="/api"
+	unsigned long long buckets[LATENCY_BUCKETS + 1];
+	unsigned long long count;
+	unsigned long long sumUs;
+
+	LatencyHistogram();
+	void observe(long long us);
+};
+
+enum TimeoutKind { TIMEOUT_IDLE, TIMEOUT_READ, TIMEOUT_CGI, TIMEOUT_UPSTREAM, TIMEOUT_KEEPALIVE, TIMEOUT_LINGERING, TIMEOUT_KINDS };
+enum MemoryKind { MEMORY_CONNECTION, MEMORY_REQUEST, MEMORY_BODY, MEMORY_RESPONSE, MEMORY_CGI, MEMORY_UPSTREAM, MEMORY_KINDS };
+
+// Point-in-time values computed from the connection table at scrape time.
+struct ConnectionGauges {
+	size_t active;
+	size_t reading;
+	size_t writing;
+	size_t idle;
+	size_t cgiActive;
+	size_t cgiMax;
+	size_t memory[MEMORY_KINDS];  // buffer capacity by buffer kind
+	size_t memoryUsed;            // running total the budget is checked against
+	size_t memoryLimit;           // 0: no memory_limit
+	size_t memoryPeak;
+	size_t memoryPaused;          // connections whose reads wait for the budget
+	size_t bodySpilled;           // request body bytes held in temporary files
+	size_t requestsInFlight;      // admitted, response not sent yet
+	bool   admissionEnabled;
+	bool   admissionOverloaded;   // lag or CGI latency above its target
+	size_t admissionLimit;        // adaptive limits of admission_control
+	size_t admissionCgiLimit;
+	long long loopLagUs;          // moving averages the limits follow
+	long long cgiLatencyUs;
+
+	ConnectionGauges()
+		: active(0), reading(0), writing(0), idle(0), cgiActive(0), cgiMax(0),
+		  memoryUsed(0), memoryLimit(0), memoryPeak(0), memoryPaused(0), bodySpilled(0),
+		  requestsInFlight(0), admissionEnabled(false), admissionOverloaded(false), admissionLimit(0),
+		  admissionCgiLimit(0), loopLagUs(0), cgiLatencyUs(0)
+	{
+		std::memset(memory, 0, sizeof(memory));
+	}
+};
+
+// Server counters. The event loop is single-threaded, so the hot path is a plain
+// increment with no locking; text is only produced when a status location is scraped.
+class Metrics {
+	private:
+			std::map<std::string, LatencyHistogram> _servers;     // by label set, so reloads keep the series
+			std::map<std::string, LatencyHistogram> _locations;
+			std::map<const void*, LatencyHistogram*> _byConfig;   // server / location config -> its histogram
+
+			static void renderHistograms(std::ostringstream& out, const std::string& name, const std::string& help,
+				const std::map<std::string, LatencyHistogram>& histograms);
+
+	public:
+			unsigned long long accepted;
+			unsigned long long handled;
+			unsigned long long requests;
+			unsigned long long responses[6];  // by status class, index 1..5
+			unsigned long long bytesIn;
+			unsigned long long bytesOut;
+			unsigned long long cgiSpawned;
+			unsigned long long timeouts[TIMEOUT_KINDS];
+			unsigned long long tlsHandshakes;  // completed, of which resumed / with kernel TLS
+			unsigned long long tlsResumed;
+			unsigned long long tlsOffloaded;
+			unsigned long long tlsFailed;
+			unsigned long long memoryPauses;   // reads stopped at memory_limit
+			unsigned long long bodiesSpilled;  // request bodies moved to a temporary file
+			unsigned long long memoryRefused;  // requests answered 503 under memory pressure
+			unsigned long long admissionShed[PRIORITY_LEVELS];  // requests answered 503 by admission_control
+			unsigned long long connectionsRejected;  // closed at accept, past the reserve of MAX_CLIENTS
+			unsigned long long connectionsReclaimed; // idle keep-alive / lingering connections closed to make room
+			unsigned long long lingeringCloses;      // connections half-closed by lingering_close
+			unsigned long long aioTasks;             // responses built on the aio threads pool
+			unsigned long long aioQueueFull;         // aio requests run on the event loop, the pool queue being full
+
+			Metrics();
+			~Metrics();
+
+			LatencyHistogram* serverHistogram(const void* server, const std::string& name);
+			LatencyHistogram* locationHistogram(const void* location, const std::string& server, const std::string& path);
+			void forgetConfig(const void* config);
+			void countResponse(int status);
+			std::string renderStubStatus(const ConnectionGauges& gauges) const;
+			std::string renderPrometheus(const ConnectionGauges& gauges) const;
+};
@@ -0,0 +1,148 @@
+#include "Webserv.hpp"
+#include "RequestVariables.hpp"
+#include "../utils/Utils.hpp"
+
+
+// Returns the value of a header stored on the connection (names match case-insensitively).
+static std::string connectionHeader(const ClientConnection& conn, const std::string& name)
+{
+    return conn.headers.get(name);
+}
+
+
+// Seconds with millisecond resolution between two phase timestamps, "-" when either is missing.
+std::string formatPhase(long long from, long long to)
+{
+    if (!from || !to || to < from)
+        return "-";
+    long long ms = (to - from) / 1000;
+    std::string frac = toString(ms % 1000);
+    return toString(ms / 1000) + "." + std::string(3 - frac.size(), '0') + frac;
+}
+
+
+// Timing variables ($request_time, $upstream_time, ...); false when name is not one of them.
+static bool lookupTimingVariable(const std::string& name, const ClientConnection& conn, std::string& value)
+{
+    const RequestTimings& t = conn.timing;
+    if (name == "request_time")
+        value = formatPhase(t.firstByte, t.lastSent ? t.lastSent : monotonicUs());
+    else if (name == "wait_time")
+        value = formatPhase(t.idleSince, t.firstByte);
+    else if (name == "header_time")
+        value = formatPhase(t.firstByte, t.headersDone);
+    else if (name == "body_time")
+        value = formatPhase(t.headersDone, t.bodyDone);
+    else if (name == "queue_time")
+        value = formatPhase(t.bodyDone, t.dispatched);
+    else if (name == "first_byte_time")
+        value = formatPhase(t.firstByte, t.firstSent);
+    else if (name == "send_time")
+        value = formatPhase(t.firstSent, t.lastSent);
+    else if (name == "cgi_spawn_time")
+        value = formatPhase(t.dispatched, t.cgiSpawn);
+    else if (name == "upstream_time" || name == "upstream_response_time")
+        value = t.upstreamStart ? formatPhase(t.upstreamStart, t.upstreamDone) : formatPhase(t.cgiSpawn, t.cgiExit);
+    else if (name == "upstream_header_time")
+        value = t.upstreamStart ? formatPhase(t.upstreamStart, t.upstreamHeader) : formatPhase(t.cgiSpawn, t.cgiExit);
+    else
+        return false;
+    return true;
+}
+
+
+std::string lookupRequestVariable(const std::string& name, const ClientConnection& conn)
+{
+    std::string timing;
+    if (name.size() > 5 && name.compare(name.size() - 5, 5, "_time") == 0 && lookupTimingVariable(name, conn, timing))
+        return timing;
+    if (name == "remote_addr")
+        return conn.remoteAddr;
+    if (name == "binary_remote_addr") {
+        // 4 or 16 raw bytes: the compact per-client key used by limit zones
+        unsigned char addr[16];
+        if (inet_pton(AF_INET, conn.remoteAddr.c_str(), addr) == 1)
+            return std::string(reinterpret_cast<char*>(addr), 4);
+        if (inet_pton(AF_INET6, conn.remoteAddr.c_str(), addr) == 1)
+            return std::string(reinterpret_cast<char*>(addr), 16);
+        return conn.remoteAddr;
+    }
+    if (name == "remote_port")
+        return toString(conn.remotePort);
+    if (name == "request_method")
+        return conn.method;
+    if (name == "request_uri")
+        return conn.uri;
+    if (name == "uri") {
+        size_t q = conn.uri.find('?');
+        return (q == std::string::npos) ? conn.uri : conn.uri.substr(0, q);
+    }
+    if (name == "args" || name == "query_string") {
+        size_t q = conn.uri.find('?');
+        return (q == std::string::npos) ? std::string() : conn.uri.substr(q + 1);
+    }
+    if (name == "host") {
+        std::string host = toLowerCase(connectionHeader(conn, "host"));
+        size_t colon = host.rfind(':');
+        if (colon != std::string::npos && host.find(']', colon) == std::string::npos)
+            host.erase(colon);
+        return host;
+    }
+    if (name == "scheme")
+        return conn.tls ? "https" : "http";
+    if (name == "https")
+        return conn.tls ? "on" : "";
+    if (name == "ssl_protocol")
+        return conn.tlsReady ? SSL_get_version(conn.tls) : "";
+    if (name == "ssl_cipher")
+        return conn.tlsReady ? SSL_get_cipher_name(conn.tls) : "";
+    if (name == "ssl_session_reused")
+        return conn.tlsReady && SSL_session_reused(conn.tls) ? "r" : ".";
+    if (name == "ssl_server_name") {
+        const char* sni = conn.tls ? SSL_get_servername(conn.tls, TLSEXT_NAMETYPE_host_name) : NULL;
+        return sni ? sni : "";
+    }
+    if (name == "request")
+        return conn.method + " " + conn.uri + " " + conn.version;
+    if (name == "status")
+        return conn.responseStatus ? toString(conn.responseStatus) : "-";
+    if (name == "bytes_sent")
+        return toString(conn.bytesSent);
+    if (name == "body_bytes_sent")
+        return toString(conn.bytesSent > conn.responseHeadSize ? conn.bytesSent - conn.responseHeadSize : 0);
+    if (name == "time_local") {
+        char buf[64];
+        time_t now = time(NULL);
+        struct tm tm = *localtime(&now);
+        strftime(buf, sizeof(buf), "%d/%b/%Y:%H:%M:%S %z", &tm);
+        return buf;
+    }
+    if (name.compare(0, 5, "http_") == 0) {
+        std::string header = name.substr(5);
+        for (size_t i = 0; i < header.size(); ++i)
+            if (header[i] == '_')
+                header[i] = '-';
+        return connectionHeader(conn, toLowerCase(header));
+    }
+    return std::string();
+}
+
+
+// Expands every $name occurrence of pattern, copying the surrounding text verbatim.
+std::string expandRequestVariables(const std::string& pattern, const ClientConnection& conn)
+{
+    std::string out;
+    size_t i = 0;
+    while (i < pattern.size()) {
+        if (pattern[i] != '$') {
+            out += pattern[i++];
+            continue;
+        }
+        size_t end = i + 1;
+        while (end < pattern.size() && (std::isalnum(static_cast<unsigned char>(pattern[end])) || pattern[end] == '_'))
+            ++end;
+        out += lookupRequestVariable(pattern.substr(i + 1, end - i - 1), conn);
+        i = end;
+    }
+    return out;
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include "Webserv.hpp"
+#include "ClientConnection.hpp"
+
+// Resolves nginx-style request variables ($remote_addr, $request_uri, $http_<name>, ...)
+// against a parsed connection. Unknown variables expand to an empty string.
+std::string lookupRequestVariable(const std::string& name, const ClientConnection& conn);
+std::string expandRequestVariables(const std::string& pattern, const ClientConnection& conn);
+std::string formatPhase(long long from, long long to);
@@ -1,8 +1,18 @@
 #include "Webserv.hpp"
 #include "Server.hpp"
+#include <netinet/tcp.h>
+
+static int familyOf(const std::string& host)
+{
+    if (host.compare(0, 5, "unix:") == 0)
+        return AF_UNIX;
+    return (!host.empty() && host[0] == '[') ? AF_INET6 : AF_INET;
+}
+
 
 // Initializes the listening socket according to the provided configuration.
-Server::Server(const ServerConfig& config) : _listeningSocket(-1), _port(config.getPort()), _host(config.getHost()), _config(config)
+Server::Server(const ServerConfig& config) : _listeningSocket(-1), _port(config.getPort()), _host(config.getHost()), _config(config),
+    _options(config.getListenOptions(listenKey(_host, _port))), _family(familyOf(_host)), _ownsPath(false)
 {
     createSocket();
     setSocketOptions();
@@ -11,6 +21,27 @@ Server::Server(const ServerConfig& config) : _listeningSocket(-1), _port(config.
 }
 
 
+// Adopts a listening socket inherited from the process being upgraded. A unix socket
+// file is left in place on close (the next bind replaces it once nobody listens).
+Server::Server(const ServerConfig& config, int inheritedFd) : _listeningSocket(inheritedFd), _port(config.getPort()), _host(config.getHost()), _config(config),
+    _family(familyOf(_host)), _ownsPath(false)
+{
+    int listening = 0;
+    socklen_t len = sizeof(listening);
+    if (getsockopt(_listeningSocket, SOL_SOCKET, SO_ACCEPTCONN, &listening, &len) < 0 || !listening)
+        throwSocketError("Inherited fd " + toString(inheritedFd) + " is not a listening socket");
+    int flags = fcntl(_listeningSocket, F_GETFL, 0);
+    if (flags != -1)
+        fcntl(_listeningSocket, F_SETFL, flags | O_NONBLOCK);
+    fcntl(_listeningSocket, F_SETFD, FD_CLOEXEC);
+    int reuseport = 0;
+    len = sizeof(reuseport);
+    getsockopt(_listeningSocket, SOL_SOCKET, SO_REUSEPORT, &reuseport, &len);
+    _options.reuseport = reuseport != 0;
+    applyOptions(config.getListenOptions(listenKey(_host, _port)));
+}
+
+
 // Closes the listening socket when the server instance is destroyed.
 Server::~Server()
 {
@@ -18,13 +49,23 @@ Server::~Server()
         closeSocketIfOpen();
         LOG("Server socket closed");
     }
+    if (_ownsPath)
+        unlink(_host.c_str() + 5);
+}
+
+
+// The socket now belongs to another process (binary upgrade): closing our copy
+// must leave its unix socket file in place.
+void Server::handOver()
+{
+    _ownsPath = false;
 }
 
 
 // Creates the listening socket file descriptor.
 void Server::createSocket()
 {
-    _listeningSocket = socket(AF_INET, SOCK_STREAM, 0);
+    _listeningSocket = socket(_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
     if (_listeningSocket == -1) {
         throw std::runtime_error("Failed to create socket");
     }
@@ -35,22 +76,39 @@ void Server::createSocket()
 void Server::setSocketOptions()
 {
     int opt = 1;
-    if (setsockopt(_listeningSocket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
+    if (_family != AF_UNIX && setsockopt(_listeningSocket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
         throwSocketError("Failed to set socket options (SO_REUSEADDR)");
     }
+    // [::] only takes IPv6 clients, so it can share its port with 0.0.0.0
+    if (_family == AF_INET6 && setsockopt(_listeningSocket, IPPROTO_IPV6, IPV6_V6ONLY, &opt, sizeof(opt)) < 0)
+        throwSocketError("Failed to set socket options (IPV6_V6ONLY)");
+    if (_family != AF_UNIX && _options.reuseport && setsockopt(_listeningSocket, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0)
+        throwSocketError("Failed to set socket options (SO_REUSEPORT)");
+    // set before listen() so the window scale offered to clients matches the buffer
+    int size = static_cast<int>(_options.rcvbuf);
+    if (size && setsockopt(_listeningSocket, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)) < 0)
+        throwSocketError("Failed to set socket options (SO_RCVBUF)");
+    size = static_cast<int>(_options.sndbuf);
+    if (size && setsockopt(_listeningSocket, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size)) < 0)
+        throwSocketError("Failed to set socket options (SO_SNDBUF)");
 }
 
 
 // Resolves the configured host and binds the listening socket.
 void Server::bindSocket()
 {
+    if (_family == AF_UNIX) {
+        bindUnixSocket();
+        return;
+    }
     struct addrinfo hints;
     std::memset(&hints, 0, sizeof(hints));
-    hints.ai_family = AF_INET;
+    hints.ai_family = _family;
     hints.ai_socktype = SOCK_STREAM;
     hints.ai_flags = AI_PASSIVE;
 
-    const char* hostPtr = _host.empty() ? NULL : _host.c_str();
+    std::string host = (_family == AF_INET6) ? _host.substr(1, _host.size() - 2) : _host;
+    const char* hostPtr = host.empty() ? NULL : host.c_str();
     std::string service = toString(_port);
     struct addrinfo* results = NULL;
 
@@ -77,17 +135,83 @@ void Server::bindSocket()
 }
 
 
-// Places the listening socket in non-blocking mode and starts listening.
-void Server::startListening()
+// Binds a unix:/path listener, replacing a socket file left behind by a dead process.
+void Server::bindUnixSocket()
 {
-    int flags = fcntl(_listeningSocket, F_GETFL, 0);
-    if (flags != -1) {
-        fcntl(_listeningSocket, F_SETFL, flags | O_NONBLOCK);
-    }
+    std::string path = _host.substr(5);
+    struct sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    removeStaleSocket(path);
+    if (bind(_listeningSocket, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0)
+        throwSocketError("Bind failed on " + path + ": " + std::string(std::strerror(errno)));
+    _ownsPath = true;
+}
+
 
-    if (listen(_listeningSocket, BACKLOG) < 0) {
+// Unlinks path if it is a socket nobody accepts on; a live server keeps it.
+void Server::removeStaleSocket(const std::string& path)
+{
+    struct stat st;
+    if (lstat(path.c_str(), &st) != 0 || !S_ISSOCK(st.st_mode))
+        return;
+    int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (probe == -1)
+        return;
+    struct sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    bool live = connect(probe, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == 0 || errno != ECONNREFUSED;
+    close(probe);
+    if (!live)
+        unlink(path.c_str());
+}
+
+
+// Starts listening (the socket is created non-blocking) with the configured queue length.
+void Server::startListening()
+{
+    if (listen(_listeningSocket, _options.backlog) < 0) {
         throwSocketError("Listen failed");
     }
+    applyTcpOptions();
+}
+
+
+// TCP_DEFER_ACCEPT / TCP_FASTOPEN; a kernel without them only costs the feature.
+void Server::applyTcpOptions()
+{
+    if (_family == AF_UNIX)
+        return;
+    int value = _options.deferred ? 1 : 0;
+    if (setsockopt(_listeningSocket, IPPROTO_TCP, TCP_DEFER_ACCEPT, &value, sizeof(value)) < 0)
+        ERROR_SYS("setsockopt TCP_DEFER_ACCEPT on " + _host + ":" + toString(_port));
+    value = _options.fastopen;
+    if (value && setsockopt(_listeningSocket, IPPROTO_TCP, TCP_FASTOPEN, &value, sizeof(value)) < 0)
+        ERROR_SYS("setsockopt TCP_FASTOPEN on " + _host + ":" + toString(_port));
+}
+
+
+// Applies new options to the bound socket (reload, upgrade). The backlog is changed by
+// calling listen() again; reuseport only takes effect on a newly bound socket.
+void Server::applyOptions(const ListenOptions& options)
+{
+    if (options.reuseport != _options.reuseport)
+        ERROR("reuseport on " + _host + ":" + toString(_port) + " only changes when the socket is bound again");
+    bool reuseport = _options.reuseport;
+    _options = options;
+    _options.reuseport = reuseport;
+    int size = static_cast<int>(_options.rcvbuf);
+    if (size && setsockopt(_listeningSocket, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)) < 0)
+        ERROR_SYS("setsockopt SO_RCVBUF on " + _host + ":" + toString(_port));
+    size = static_cast<int>(_options.sndbuf);
+    if (size && setsockopt(_listeningSocket, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size)) < 0)
+        ERROR_SYS("setsockopt SO_SNDBUF on " + _host + ":" + toString(_port));
+    if (listen(_listeningSocket, _options.backlog) < 0)
+        ERROR_SYS("listen on " + _host + ":" + toString(_port));
+    applyTcpOptions();
 }
 
 
@@ -111,6 +235,13 @@ const std::string& Server::getHost() const
 }
 
 
+// Returns the socket options the listener was set up with.
+const ListenOptions& Server::getOptions() const
+{
+    return _options;
+}
+
+
 // Closes the listening socket without logging if it is currently open.
 void Server::closeSocketIfOpen()
 {
@@ -127,3 +258,41 @@ void Server::throwSocketError(const std::string& message)
     closeSocketIfOpen();
     throw std::runtime_error(message);
 }
+
+
+// Groups server blocks by host:port, cloning a server once per listen directive.
+void groupHostPort(std::vector<ServerConfig> &serverConfigs, std::map<std::string, std::vector<ServerConfig> > &groups) {
+    for (size_t i = 0; i < serverConfigs.size(); ++i) {
+            const std::vector<std::string>& listens = serverConfigs[i].getListen();
+            if (!listens.empty()) 
+            {
+                for (size_t j = 0; j < listens.size(); ++j) {
+                    // listens[j] is normalized in the form host:port, [ipv6]:port or unix:/path
+                    std::string key = listens[j];
+                    // Clone the configuration and force host/port for this specific listen
+                    ServerConfig clone = serverConfigs[i];
+                    bool isUnix = key.compare(0, 5, "unix:") == 0;
+                    size_t colon = key.rfind(':');
+                    std::string host = isUnix ? key : key.substr(0, colon);
+                    int port = isUnix ? 0 : std::atoi(key.substr(colon + 1).c_str());
+                    clone.setHost(host);
+                    clone.setPort(port);
+                    groups[key].push_back(clone);
+                }
+            } 
+            else 
+            {
+                std::string key = listenKey(serverConfigs[i].getHost(), serverConfigs[i].getPort());
+                groups[key].push_back(serverConfigs[i]);
+            }
+        }
+    // socket options may come from any server of the group; the listener is built from the first
+    for (std::map<std::string, std::vector<ServerConfig> >::iterator it = groups.begin(); it != groups.end(); ++it) {
+        for (size_t i = 1; i < it->second.size(); ++i) {
+            if (it->second[i].hasListenOptions(it->first)) {
+                it->second[0].setListenOptions(it->first, it->second[i].getListenOptions(it->first));
+                break;
+            }
+        }
+    }
+}
@@ -3,6 +3,12 @@
 #include "Webserv.hpp"
 #include "../config/ServerConfig.hpp"
 
+// Binary upgrade (SIGUSR2): the old process passes its listening sockets as
+// "host:port=fd;..." and waits for one byte on the ready pipe before draining.
+#define UPGRADE_LISTEN_ENV "WEBSERV_LISTEN_FDS"
+#define UPGRADE_READY_ENV "WEBSERV_UPGRADE_READY"
+#define UPGRADE_READY_TIMEOUT 5000 // ms the old process waits for the new one
+
 class	Server
 {
 	private:
@@ -10,20 +16,32 @@ class	Server
 		int				_port;
 		std::string		_host;
 		const ServerConfig	_config;
+		ListenOptions	_options;
+		int				_family;     // AF_INET, AF_INET6 ([addr] hosts) or AF_UNIX (unix:/path hosts)
+		bool			_ownsPath;   // unix socket file to remove when the listener is closed
 
 		void		createSocket();
 		void		setSocketOptions();
 		void		bindSocket();
+		void		bindUnixSocket();
+		void		removeStaleSocket(const std::string& path);
 		void		startListening();
+		void		applyTcpOptions();
 		void		closeSocketIfOpen();
 		void		throwSocketError(const std::string& message);
 
 
 	public:
 		Server(const ServerConfig& config);
+		Server(const ServerConfig& config, int inheritedFd);
 		~Server();
 
 		int			getListeningSocket() const;
 		int			getPort() const;
 		const std::string&	getHost() const;
+		const ListenOptions&	getOptions() const;
+		void		applyOptions(const ListenOptions& options);
+		void		handOver();
 };
+
+void	groupHostPort(std::vector<ServerConfig>& serverConfigs, std::map<std::string, std::vector<ServerConfig> >& groups);
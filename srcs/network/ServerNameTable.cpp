@@ -0,0 +1,118 @@
+#include "Webserv.hpp"
+#include "ServerNameTable.hpp"
+#include "../utils/Utils.hpp"
+
+
+ServerNameTable::ServerNameTable() : _default(0) {}
+
+
+ServerNameTable::~ServerNameTable() {}
+
+
+int ServerNameTable::defaultServer() const { return _default; }
+
+
+// Open addressing with linear probing; the table is kept at most half full.
+std::vector<ServerNameTable::Slot> ServerNameTable::compile(const std::vector<std::pair<std::string, int> >& names)
+{
+    size_t capacity = 1;
+    while (capacity < names.size() * 2)
+        capacity <<= 1;
+    std::vector<Slot> table(names.empty() ? 0 : capacity);
+    for (size_t i = 0; i < names.size(); ++i) {
+        const std::string& name = names[i].first;
+        if (find(table, name.data(), name.size()) != -1) {
+            LOG("Conflicting server name \"" + name + "\", ignored");
+            continue;
+        }
+        unsigned int hash = hashKey32(name);
+        size_t pos = hash & (capacity - 1);
+        while (table[pos].server != -1)
+            pos = (pos + 1) & (capacity - 1);
+        table[pos].hash = hash;
+        table[pos].server = names[i].second;
+        table[pos].name = name;
+    }
+    return table;
+}
+
+
+int ServerNameTable::find(const std::vector<Slot>& table, const char* name, size_t len)
+{
+    if (table.empty())
+        return -1;
+    unsigned int hash = hashBytes32(name, len);
+    size_t mask = table.size() - 1;
+    for (size_t pos = hash & mask; table[pos].server != -1; pos = (pos + 1) & mask) {
+        const Slot& slot = table[pos];
+        if (slot.hash == hash && slot.name.size() == len && slot.name.compare(0, len, name, len) == 0)
+            return slot.server;
+    }
+    return -1;
+}
+
+
+// Sorts every server_name of the group into the exact / wildcard tables.
+void ServerNameTable::build(const std::vector<ServerConfig>& group, const std::string& listen)
+{
+    std::vector<std::pair<std::string, int> > exact, head, tail;
+    _default = 0;
+    bool explicitDefault = false;
+    for (size_t i = 0; i < group.size(); ++i) {
+        int index = static_cast<int>(i);
+        if (!explicitDefault && group[i].isDefaultFor(listen)) {
+            _default = index;
+            explicitDefault = true;
+        }
+        const std::vector<std::string>& names = group[i].getServerNames();
+        for (size_t j = 0; j < names.size(); ++j) {
+            std::string name = toLowerCase(names[j]);
+            if (name.compare(0, 2, "*.") == 0)
+                head.push_back(std::make_pair(name.substr(1), index));
+            else if (!name.empty() && name[0] == '.') {
+                // ".example.com" matches the domain itself and every subdomain
+                head.push_back(std::make_pair(name, index));
+                exact.push_back(std::make_pair(name.substr(1), index));
+            }
+            else if (name.size() > 2 && name.compare(name.size() - 2, 2, ".*") == 0)
+                tail.push_back(std::make_pair(name.substr(0, name.size() - 1), index));
+            else if (!name.empty())
+                exact.push_back(std::make_pair(name, index));
+        }
+    }
+    _exact = compile(exact);
+    _wildcardHead = compile(head);
+    _wildcardTail = compile(tail);
+}
+
+
+// Returns the server index for a Host header value, or the default server.
+int ServerNameTable::lookup(const std::string& hostHeader) const
+{
+    char host[256];
+    size_t len = 0;
+    size_t end = hostHeader.size();
+    if (!hostHeader.empty() && hostHeader[0] == '[')
+        end = hostHeader.find(']') == std::string::npos ? end : hostHeader.find(']') + 1;
+    else if (hostHeader.find(':') != std::string::npos)
+        end = hostHeader.find(':');
+    if (end > 0 && hostHeader[end - 1] == '.')
+        --end;
+    if (end == 0 || end >= sizeof(host))
+        return _default;
+    for (; len < end; ++len)
+        host[len] = static_cast<char>(std::tolower(static_cast<unsigned char>(hostHeader[len])));
+
+    int server = find(_exact, host, len);
+    if (server != -1)
+        return server;
+    for (size_t i = 0; i < len && !_wildcardHead.empty(); ++i) {
+        if (host[i] == '.' && (server = find(_wildcardHead, host + i, len - i)) != -1)
+            return server;
+    }
+    for (size_t i = len; i > 0 && !_wildcardTail.empty(); --i) {
+        if (host[i - 1] == '.' && (server = find(_wildcardTail, host, i)) != -1)
+            return server;
+    }
+    return _default;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "Webserv.hpp"
+#include "../config/ServerConfig.hpp"
+
+// Host header -> server index for one listen group, compiled once at startup.
+// Exact names resolve with a single hash probe; "*.example.com" / ".example.com"
+// are probed once per label of the Host and "www.example.*" once per dot, longest match first.
+class ServerNameTable {
+	private:
+			struct Slot {
+				unsigned int hash;
+				int          server;  // -1 marks an empty slot
+				std::string  name;
+
+				Slot() : hash(0), server(-1) {}
+			};
+
+			std::vector<Slot> _exact;
+			std::vector<Slot> _wildcardHead;  // stored as ".example.com"
+			std::vector<Slot> _wildcardTail;  // stored as "www.example."
+			int               _default;
+
+			static std::vector<Slot> compile(const std::vector<std::pair<std::string, int> >& names);
+			static int find(const std::vector<Slot>& table, const char* name, size_t len);
+
+	public:
+			ServerNameTable();
+			~ServerNameTable();
+
+			void build(const std::vector<ServerConfig>& group, const std::string& listen);
+			int  lookup(const std::string& hostHeader) const;
+			int  defaultServer() const;
+};
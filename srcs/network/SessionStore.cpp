@@ -0,0 +1,273 @@
+#include "Webserv.hpp"
+#include "SessionStore.hpp"
+#include "../utils/Utils.hpp"
+
+
+SessionStore::SessionStore()
+    : _free(-1), _newest(-1), _oldest(-1), _used(0), _evictions(0), _idle(SESSION_MAX_IDLE), _wheelTime(0) {}
+
+
+SessionStore::~SessionStore() {}
+
+
+bool SessionStore::enabled() const { return !_entries.empty(); }
+
+
+size_t SessionStore::used() const { return _used; }
+
+
+size_t SessionStore::capacity() const { return _entries.size(); }
+
+
+size_t SessionStore::evictions() const { return _evictions; }
+
+
+// Allocates the pool for `bytes` of session state; the probe table stays at most half full.
+void SessionStore::configure(size_t bytes, time_t idle, time_t now)
+{
+    size_t count = bytes / (sizeof(Entry) + 2 * sizeof(int));
+    if (count < 16)
+        count = 16;
+    size_t slots = 1;
+    while (slots < count * 2)
+        slots <<= 1;
+    _entries.assign(count, Entry());
+    _table.assign(slots, -1);
+    _wheel.assign(SESSION_WHEEL_SLOTS, -1);
+    for (size_t i = 0; i < count; ++i)
+        _entries[i].wheelNext = (i + 1 < count) ? static_cast<int>(i + 1) : -1;
+    _free = 0;
+    _newest = _oldest = -1;
+    _used = 0;
+    _evictions = 0;
+    _idle = idle > 0 ? idle : 1;
+    _wheelTime = now;
+    LOG("Session store: " + toString(count) + " sessions, idle timeout " + toString(_idle) + "s");
+}
+
+
+void SessionStore::clear()
+{
+    _entries.clear();
+    _table.clear();
+    _wheel.clear();
+    _free = _newest = _oldest = -1;
+    _used = 0;
+}
+
+
+// 32 lowercase hex characters, the only form create() hands out.
+bool SessionStore::isValidId(const std::string& id)
+{
+    if (id.size() != SESSION_ID_LEN)
+        return false;
+    for (size_t i = 0; i < id.size(); ++i) {
+        if (!std::isdigit(static_cast<unsigned char>(id[i])) && (id[i] < 'a' || id[i] > 'f'))
+            return false;
+    }
+    return true;
+}
+
+
+int SessionStore::find(const char* id, unsigned int hash) const
+{
+    size_t mask = _table.size() - 1;
+    for (size_t pos = hash & mask; _table[pos] != -1; pos = (pos + 1) & mask) {
+        const Entry& entry = _entries[_table[pos]];
+        if (entry.hash == hash && std::memcmp(entry.id, id, SESSION_ID_LEN) == 0)
+            return _table[pos];
+    }
+    return -1;
+}
+
+
+void SessionStore::tableInsert(int index)
+{
+    size_t mask = _table.size() - 1;
+    size_t pos = _entries[index].hash & mask;
+    while (_table[pos] != -1)
+        pos = (pos + 1) & mask;
+    _table[pos] = index;
+}
+
+
+// Backward-shift deletion: later entries of the probe run move up so no tombstone is left.
+void SessionStore::tableRemove(int index)
+{
+    size_t mask = _table.size() - 1;
+    size_t hole = _entries[index].hash & mask;
+    while (_table[hole] != index)
+        hole = (hole + 1) & mask;
+    _table[hole] = -1;
+    for (size_t pos = (hole + 1) & mask; _table[pos] != -1; pos = (pos + 1) & mask) {
+        size_t home = _entries[_table[pos]].hash & mask;
+        // move the entry back unless its home lies cyclically in (hole, pos]
+        bool stays = (hole <= pos) ? (home > hole && home <= pos) : (home > hole || home <= pos);
+        if (!stays) {
+            _table[hole] = _table[pos];
+            _table[pos] = -1;
+            hole = pos;
+        }
+    }
+}
+
+
+void SessionStore::unlinkLru(int index)
+{
+    Entry& entry = _entries[index];
+    if (entry.newer != -1)
+        _entries[entry.newer].older = entry.older;
+    else
+        _newest = entry.older;
+    if (entry.older != -1)
+        _entries[entry.older].newer = entry.newer;
+    else
+        _oldest = entry.newer;
+    entry.newer = entry.older = -1;
+}
+
+
+void SessionStore::pushNewest(int index)
+{
+    Entry& entry = _entries[index];
+    entry.newer = -1;
+    entry.older = _newest;
+    if (_newest != -1)
+        _entries[_newest].newer = index;
+    _newest = index;
+    if (_oldest == -1)
+        _oldest = index;
+}
+
+
+void SessionStore::schedule(int index, time_t deadline)
+{
+    Entry& entry = _entries[index];
+    int slot = static_cast<int>(deadline % SESSION_WHEEL_SLOTS);
+    entry.slot = slot;
+    entry.wheelPrev = -1;
+    entry.wheelNext = _wheel[slot];
+    if (_wheel[slot] != -1)
+        _entries[_wheel[slot]].wheelPrev = index;
+    _wheel[slot] = index;
+}
+
+
+void SessionStore::unschedule(int index)
+{
+    Entry& entry = _entries[index];
+    if (entry.slot == -1)
+        return;
+    if (entry.wheelPrev != -1)
+        _entries[entry.wheelPrev].wheelNext = entry.wheelNext;
+    else
+        _wheel[entry.slot] = entry.wheelNext;
+    if (entry.wheelNext != -1)
+        _entries[entry.wheelNext].wheelPrev = entry.wheelPrev;
+    entry.slot = -1;
+    entry.wheelNext = entry.wheelPrev = -1;
+}
+
+
+// Returns the entry to the free list.
+void SessionStore::remove(int index)
+{
+    tableRemove(index);
+    unlinkLru(index);
+    unschedule(index);
+    Entry& entry = _entries[index];
+    entry.id[0] = '\0';
+    entry.wheelNext = _free;
+    _free = index;
+    _used--;
+}
+
+
+// Refreshes a known session; NULL when the ID is unknown, expired or malformed.
+SessionData* SessionStore::touch(const std::string& id, time_t now)
+{
+    if (_entries.empty() || !isValidId(id))
+        return NULL;
+    int index = find(id.data(), hashBytes32(id.data(), id.size()));
+    if (index == -1)
+        return NULL;
+    Entry& entry = _entries[index];
+    if (now - entry.data.lastSeen > _idle) {
+        remove(index);
+        return NULL;
+    }
+    entry.data.lastSeen = now;
+    entry.data.requestCount++;
+    unlinkLru(index);
+    pushNewest(index);
+    return &entry.data;
+}
+
+
+// Starts a session under a fresh random ID, evicting the least recently used one when full.
+bool SessionStore::create(std::string& id, time_t now)
+{
+    if (_entries.empty())
+        return false;
+    unsigned char raw[SESSION_ID_BYTES];
+    if (!secureRandomBytes(raw, sizeof(raw))) {
+        ERROR("Cannot read /dev/urandom, session not created");
+        return false;
+    }
+    static const char hex[] = "0123456789abcdef";
+    char buf[SESSION_ID_LEN];
+    for (size_t i = 0; i < SESSION_ID_BYTES; ++i) {
+        buf[2 * i] = hex[raw[i] >> 4];
+        buf[2 * i + 1] = hex[raw[i] & 0x0f];
+    }
+    unsigned int hash = hashBytes32(buf, SESSION_ID_LEN);
+    if (find(buf, hash) != -1)
+        return false;
+    if (_free == -1) {
+        remove(_oldest);
+        _evictions++;
+    }
+    int index = _free;
+    Entry& entry = _entries[index];
+    _free = entry.wheelNext;
+    std::memcpy(entry.id, buf, SESSION_ID_LEN);
+    entry.id[SESSION_ID_LEN] = '\0';
+    entry.hash = hash;
+    entry.data.lastSeen = now;
+    entry.data.requestCount = 1;
+    tableInsert(index);
+    pushNewest(index);
+    schedule(index, now + _idle);
+    _used++;
+    id.assign(buf, SESSION_ID_LEN);
+    return true;
+}
+
+
+// Advances the wheel to `now`: idle sessions are freed, touched ones move to their new deadline.
+void SessionStore::expire(time_t now)
+{
+    if (_entries.empty() || now <= _wheelTime)
+        return;
+    time_t from = _wheelTime + 1;
+    if (now - _wheelTime > SESSION_WHEEL_SLOTS)
+        from = now - SESSION_WHEEL_SLOTS + 1;   // every slot is visited once after a long pause
+    _wheelTime = now;
+    for (time_t t = from; t <= now; ++t) {
+        int slot = static_cast<int>(t % SESSION_WHEEL_SLOTS);
+        int index = _wheel[slot];
+        _wheel[slot] = -1;
+        while (index != -1) {
+            Entry& entry = _entries[index];
+            int next = entry.wheelNext;
+            entry.slot = -1;
+            entry.wheelNext = entry.wheelPrev = -1;
+            time_t deadline = entry.data.lastSeen + _idle;
+            if (deadline <= now)
+                remove(index);
+            else
+                schedule(index, deadline);
+            index = next;
+        }
+    }
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "Webserv.hpp"
+
+#define SESSION_ID_BYTES 16     // 128 random bits, sent as 32 hex characters
+#define SESSION_ID_LEN (SESSION_ID_BYTES * 2)
+#define SESSION_WHEEL_SLOTS 512 // one slot per second; longer idle times take extra laps
+
+struct SessionData {
+	time_t lastSeen;
+	size_t requestCount;
+};
+
+// Sessions of every server, in a fixed pool sized from session_zone at startup.
+// IDs are found through an open-addressing table (linear probing, backward-shift
+// deletion), an intrusive LRU list picks the victim when the pool is full, and a
+// timer wheel expires idle sessions: an entry stays in the slot of the deadline it
+// had when scheduled and is moved on lazily when that slot fires, so a hit is O(1)
+// and a cleanup tick only visits the slots whose second has passed.
+class SessionStore {
+	private:
+			struct Entry {
+				char         id[SESSION_ID_LEN + 1];
+				unsigned int hash;
+				SessionData  data;
+				int          newer;      // LRU neighbours, -1 at the ends
+				int          older;
+				int          wheelNext;  // timer wheel slot list, or free list when unused
+				int          wheelPrev;
+				int          slot;       // -1 when not scheduled
+
+				Entry() : hash(0), newer(-1), older(-1), wheelNext(-1), wheelPrev(-1), slot(-1)
+				{
+					id[0] = '\0';
+					data.lastSeen = 0;
+					data.requestCount = 0;
+				}
+			};
+
+			std::vector<Entry> _entries;
+			std::vector<int>   _table;      // entry index per probe position, -1 when empty
+			std::vector<int>   _wheel;      // first entry of each slot
+			int                _free;
+			int                _newest;
+			int                _oldest;
+			size_t             _used;
+			size_t             _evictions;
+			time_t             _idle;
+			time_t             _wheelTime;  // last second processed by expire()
+
+			int  find(const char* id, unsigned int hash) const;
+			void tableInsert(int index);
+			void tableRemove(int index);
+			void unlinkLru(int index);
+			void pushNewest(int index);
+			void schedule(int index, time_t deadline);
+			void unschedule(int index);
+			void remove(int index);
+
+	public:
+			SessionStore();
+			~SessionStore();
+
+			void configure(size_t bytes, time_t idle, time_t now);
+			bool enabled() const;
+			SessionData* touch(const std::string& id, time_t now);
+			bool create(std::string& id, time_t now);
+			void expire(time_t now);
+			void clear();
+			size_t used() const;
+			size_t capacity() const;
+			size_t evictions() const;
+
+			static bool isValidId(const std::string& id);
+};
@@ -0,0 +1,141 @@
+#include "Webserv.hpp"
+#include "ThreadPool.hpp"
+#include <sys/eventfd.h>
+
+
+ThreadPool::ThreadPool() : _maxQueue(0), _eventFd(-1), _stopping(false)
+{
+    pthread_mutex_init(&_lock, NULL);
+    pthread_cond_init(&_ready, NULL);
+}
+
+
+ThreadPool::~ThreadPool()
+{
+    stop();
+    pthread_cond_destroy(&_ready);
+    pthread_mutex_destroy(&_lock);
+}
+
+
+bool ThreadPool::running() const { return !_threads.empty(); }
+
+
+int ThreadPool::eventFd() const { return _eventFd; }
+
+
+size_t ThreadPool::threads() const { return _threads.size(); }
+
+
+// Workers are started with every signal blocked, so SIGHUP / SIGTERM / SIGCHLD keep
+// interrupting the event loop thread only.
+bool ThreadPool::start(size_t threads, size_t maxQueue)
+{
+    if (running())
+        return true;
+    _eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (_eventFd == -1) {
+        ERROR_SYS("eventfd");
+        return false;
+    }
+    _maxQueue = maxQueue;
+    _stopping = false;
+    sigset_t all, previous;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &previous);
+    for (size_t i = 0; i < threads; ++i) {
+        pthread_t thread;
+        int err = pthread_create(&thread, NULL, &ThreadPool::worker, this);
+        if (err != 0) {
+            errno = err;
+            ERROR_SYS("pthread_create");
+            break;
+        }
+        _threads.push_back(thread);
+    }
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    if (_threads.empty()) {
+        close(_eventFd);
+        _eventFd = -1;
+        return false;
+    }
+    return true;
+}
+
+
+// Joins the workers once they finish the job in hand. Queued and finished jobs are
+// dropped without being run or deleted: they belong to whoever submitted them.
+void ThreadPool::stop()
+{
+    if (!running())
+        return;
+    pthread_mutex_lock(&_lock);
+    _stopping = true;
+    pthread_cond_broadcast(&_ready);
+    pthread_mutex_unlock(&_lock);
+    for (size_t i = 0; i < _threads.size(); ++i)
+        pthread_join(_threads[i], NULL);
+    _threads.clear();
+    _queue.clear();
+    _done.clear();
+    close(_eventFd);
+    _eventFd = -1;
+}
+
+
+// Queues a job; false when max_queue jobs are already waiting.
+bool ThreadPool::submit(ThreadJob* job)
+{
+    pthread_mutex_lock(&_lock);
+    bool accepted = _queue.size() < _maxQueue;
+    if (accepted) {
+        _queue.push_back(job);
+        pthread_cond_signal(&_ready);
+    }
+    pthread_mutex_unlock(&_lock);
+    return accepted;
+}
+
+
+// Hands the finished jobs back to the event loop and clears the eventfd.
+void ThreadPool::collect(std::vector<ThreadJob*>& finished)
+{
+    uint64_t count;
+    while (read(_eventFd, &count, sizeof(count)) == -1 && errno == EINTR)
+        ;
+    pthread_mutex_lock(&_lock);
+    finished.insert(finished.end(), _done.begin(), _done.end());
+    _done.clear();
+    pthread_mutex_unlock(&_lock);
+}
+
+
+void* ThreadPool::worker(void* arg)
+{
+    static_cast<ThreadPool*>(arg)->work();
+    return NULL;
+}
+
+
+void ThreadPool::work()
+{
+    pthread_mutex_lock(&_lock);
+    while (true) {
+        while (!_stopping && _queue.empty())
+            pthread_cond_wait(&_ready, &_lock);
+        if (_stopping)
+            break;
+        ThreadJob* job = _queue.front();
+        _queue.pop_front();
+        pthread_mutex_unlock(&_lock);
+        job->run();
+        pthread_mutex_lock(&_lock);
+        if (_stopping)
+            break;
+        _done.push_back(job);
+        uint64_t one = 1;
+        if (write(_eventFd, &one, sizeof(one)) == -1 && errno != EAGAIN)
+            ERROR_SYS("eventfd write");
+    }
+    pthread_mutex_unlock(&_lock);
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "Webserv.hpp"
+#include <pthread.h>
+
+// Work handed to a ThreadPool. run() executes on a worker thread: it may block on the disk
+// but must not touch the event loop state.
+class ThreadJob {
+	public:
+			virtual ~ThreadJob() {}
+			virtual void run() = 0;
+};
+
+// Fixed set of worker threads for blocking filesystem calls (aio threads). Jobs wait in a
+// bounded queue; a finished job goes to a done list and the eventfd becomes readable, so the
+// event loop collects completions like any other event and owns the job again from there.
+class ThreadPool {
+	private:
+			std::vector<pthread_t>	_threads;
+			std::deque<ThreadJob*>	_queue;
+			std::vector<ThreadJob*>	_done;
+			size_t					_maxQueue;
+			int						_eventFd;
+			bool					_stopping;
+			pthread_mutex_t			_lock;
+			pthread_cond_t			_ready;
+
+			static void*	worker(void* arg);
+			void			work();
+
+			ThreadPool(const ThreadPool&);
+			ThreadPool& operator=(const ThreadPool&);
+
+	public:
+			ThreadPool();
+			~ThreadPool();
+
+			bool	start(size_t threads, size_t maxQueue);
+			void	stop();
+			bool	running() const;
+			int		eventFd() const;
+			size_t	threads() const;
+			bool	submit(ThreadJob* job);
+			void	collect(std::vector<ThreadJob*>& finished);
+};
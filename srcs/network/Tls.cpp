@@ -0,0 +1,148 @@
+#include "Webserv.hpp"
+#include "Tls.hpp"
+#include <openssl/err.h>
+
+
+// Drains OpenSSL's error queue into one message.
+std::string tlsErrorString()
+{
+    std::string message;
+    char text[256];
+    for (unsigned long code = ERR_get_error(); code != 0; code = ERR_get_error()) {
+        ERR_error_string_n(code, text, sizeof(text));
+        if (!message.empty())
+            message += "; ";
+        message += text;
+    }
+    return message.empty() ? "unknown error" : message;
+}
+
+
+static std::string fileStamp(const std::string& path)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+        return "-";
+    return toString(st.st_mtime) + "." + toString(st.st_size);
+}
+
+
+// Servers with the same files (unchanged on disk) and session settings share one SSL_CTX,
+// so its session cache and ticket keys survive a reload; a renewed certificate gets a new one.
+std::string tlsContextKey(const TlsConfig& config)
+{
+    return config.certificate + "@" + fileStamp(config.certificate) + "|" + config.certificateKey + "@"
+        + fileStamp(config.certificateKey) + "|" + toString(config.sessionCache) + "|" + toString(config.sessionTimeout)
+        + (config.sessionTickets ? "|tickets" : "|-") + (config.ktls ? "|ktls" : "|-");
+}
+
+
+// Loads the certificate chain and key and applies the session settings; NULL and error on failure.
+SSL_CTX* createTlsContext(const TlsConfig& config, std::string& error)
+{
+    ERR_clear_error();
+    SSL_CTX* ctx = SSL_CTX_new(TLS_server_method());
+    if (!ctx) {
+        error = "SSL_CTX_new: " + tlsErrorString();
+        return NULL;
+    }
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+    // a client closing without close_notify is a normal end of connection for HTTP
+    long options = SSL_OP_NO_RENEGOTIATION | SSL_OP_CIPHER_SERVER_PREFERENCE | SSL_OP_IGNORE_UNEXPECTED_EOF;
+    if (!config.sessionTickets)
+        options |= SSL_OP_NO_TICKET;
+    if (config.ktls)
+        options |= SSL_OP_ENABLE_KTLS;
+    SSL_CTX_set_options(ctx, options);
+    // the out buffer grows and moves between retries; idle keep-alive connections hand their buffers back
+    SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER | SSL_MODE_RELEASE_BUFFERS);
+    if (SSL_CTX_use_certificate_chain_file(ctx, config.certificate.c_str()) != 1
+        || SSL_CTX_use_PrivateKey_file(ctx, config.certificateKey.c_str(), SSL_FILETYPE_PEM) != 1
+        || SSL_CTX_check_private_key(ctx) != 1) {
+        error = config.certificate + ": " + tlsErrorString();
+        SSL_CTX_free(ctx);
+        return NULL;
+    }
+    if (config.sessionCache) {
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+        SSL_CTX_sess_set_cache_size(ctx, static_cast<long>(config.sessionCache));
+    } else
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+    SSL_CTX_set_timeout(ctx, config.sessionTimeout);
+    static const unsigned char sessionContext[] = "webserv";
+    SSL_CTX_set_session_id_context(ctx, sessionContext, sizeof(sessionContext) - 1);
+    return ctx;
+}
+
+
+// One SSL_do_handshake step.
+TlsStatus tlsHandshake(SSL* ssl)
+{
+    ERR_clear_error();
+    int ret = SSL_do_handshake(ssl);
+    if (ret == 1)
+        return TLS_DONE;
+    switch (SSL_get_error(ssl, ret)) {
+        case SSL_ERROR_WANT_READ:
+            return TLS_WANT_READ;
+        case SSL_ERROR_WANT_WRITE:
+            return TLS_WANT_WRITE;
+        default:
+            return TLS_FAILED;
+    }
+}
+
+
+// Maps an SSL_read / SSL_write result to the recv / send convention.
+static ssize_t tlsResult(SSL* ssl, int ret)
+{
+    if (ret > 0)
+        return ret;
+    int err = SSL_get_error(ssl, ret);
+    if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) {
+        errno = EAGAIN;
+        return -1;
+    }
+    if (err == SSL_ERROR_ZERO_RETURN)
+        return 0;
+    if (err != SSL_ERROR_SYSCALL || errno == 0)
+        errno = ECONNRESET;
+    return -1;
+}
+
+
+ssize_t tlsRecv(SSL* ssl, char* buffer, size_t len)
+{
+    ERR_clear_error();
+    return tlsResult(ssl, SSL_read(ssl, buffer, static_cast<int>(len)));
+}
+
+
+ssize_t tlsSend(SSL* ssl, const char* data, size_t len)
+{
+    ERR_clear_error();
+    return tlsResult(ssl, SSL_write(ssl, data, static_cast<int>(len)));
+}
+
+
+// Sends close_notify without waiting for the client's (one try, the socket is closed next).
+void tlsShutdown(SSL* ssl)
+{
+    if (SSL_is_init_finished(ssl) && !(SSL_get_shutdown(ssl) & SSL_SENT_SHUTDOWN)) {
+        ERR_clear_error();
+        SSL_shutdown(ssl);
+    }
+    ERR_clear_error();
+}
+
+
+// True when the kernel encrypts what this connection sends (kTLS).
+bool tlsKernelOffload(SSL* ssl)
+{
+#ifndef OPENSSL_NO_KTLS
+    return BIO_get_ktls_send(SSL_get_wbio(ssl));
+#else
+    (void)ssl;
+    return false;
+#endif
+}
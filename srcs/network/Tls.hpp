@@ -0,0 +1,20 @@
+#pragma once
+
+#include "Webserv.hpp"
+#include "../config/TlsConfig.hpp"
+#include <openssl/ssl.h>
+
+// Outcome of one non-blocking handshake step on a client socket.
+enum TlsStatus { TLS_DONE, TLS_WANT_READ, TLS_WANT_WRITE, TLS_FAILED };
+
+// Thin layer over OpenSSL for the event loop. tlsRecv / tlsSend behave like recv / send
+// on a non-blocking socket: -1 with errno EAGAIN while a record is incomplete or the
+// socket is full, 0 once the client closed the session.
+std::string tlsContextKey(const TlsConfig& config);
+SSL_CTX*    createTlsContext(const TlsConfig& config, std::string& error);
+TlsStatus   tlsHandshake(SSL* ssl);
+ssize_t     tlsRecv(SSL* ssl, char* buffer, size_t len);
+ssize_t     tlsSend(SSL* ssl, const char* data, size_t len);
+void        tlsShutdown(SSL* ssl);
+bool        tlsKernelOffload(SSL* ssl);
+std::string tlsErrorString();
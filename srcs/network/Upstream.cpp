@@ -0,0 +1,231 @@
+#include "Webserv.hpp"
+#include "Upstream.hpp"
+#include "../utils/Utils.hpp"
+
+#define UPSTREAM_RING_POINTS 160 // virtual nodes per unit of weight on the consistent-hash ring
+
+
+UpstreamPeer::UpstreamPeer()
+    : addrLen(0), resolved(false), weight(1), currentWeight(0), maxFails(1), failTimeout(10),
+      fails(0), checkedAt(0), active(0)
+{
+    std::memset(&addr, 0, sizeof(addr));
+}
+
+
+UpstreamGroup::UpstreamGroup() : _balance(BALANCE_ROUND_ROBIN), _keepalive(0) {}
+
+
+UpstreamGroup::~UpstreamGroup() {}
+
+
+// Resolves every configured server once and prepares the balancing state.
+void UpstreamGroup::configure(const UpstreamConfig& config)
+{
+    closeAll();
+    _name = config.getName();
+    _balance = config.getBalance();
+    _hashKey = config.getHashKey();
+    _keepalive = config.getKeepalive();
+    _peers.clear();
+
+    const std::vector<UpstreamServer>& servers = config.getServers();
+    for (size_t i = 0; i < servers.size(); ++i) {
+        UpstreamPeer peer;
+        peer.label = servers[i].host + ":" + toString(servers[i].port);
+        peer.weight = servers[i].weight;
+        peer.maxFails = servers[i].maxFails;
+        peer.failTimeout = servers[i].failTimeout;
+
+        struct addrinfo hints;
+        std::memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        struct addrinfo* results = NULL;
+        std::string service = toString(servers[i].port);
+        int ret = getaddrinfo(servers[i].host.c_str(), service.c_str(), &hints, &results);
+        if (ret == 0 && results != NULL) {
+            std::memcpy(&peer.addr, results->ai_addr, results->ai_addrlen);
+            peer.addrLen = results->ai_addrlen;
+            peer.resolved = true;
+        } else
+            ERROR("Upstream " + _name + ": cannot resolve " + peer.label + " (" + gai_strerror(ret) + ")");
+        if (results)
+            freeaddrinfo(results);
+        _peers.push_back(peer);
+    }
+    if (_balance == BALANCE_HASH)
+        buildRing();
+}
+
+
+const std::string& UpstreamGroup::getName() const { return _name; }
+const std::string& UpstreamGroup::getHashKey() const { return _hashKey; }
+size_t UpstreamGroup::size() const { return _peers.size(); }
+UpstreamPeer& UpstreamGroup::peer(int index) { return _peers[index]; }
+
+
+// A peer is usable unless it reached max_fails within the current fail_timeout window.
+bool UpstreamGroup::isAvailable(const UpstreamPeer& peer, time_t now) const
+{
+    if (!peer.resolved)
+        return false;
+    if (peer.maxFails == 0 || peer.fails < peer.maxFails)
+        return true;
+    return difftime(now, peer.checkedAt) > peer.failTimeout;
+}
+
+
+bool UpstreamGroup::wasTried(int index, const std::vector<int>& tried)
+{
+    return std::find(tried.begin(), tried.end(), index) != tried.end();
+}
+
+
+// Smooth weighted round-robin (each pick raises every weight, the winner pays the total back).
+int UpstreamGroup::selectRoundRobin(const std::vector<int>& tried, time_t now)
+{
+    int best = -1;
+    int total = 0;
+    for (size_t i = 0; i < _peers.size(); ++i) {
+        UpstreamPeer& p = _peers[i];
+        if (wasTried(static_cast<int>(i), tried) || !isAvailable(p, now))
+            continue;
+        p.currentWeight += p.weight;
+        total += p.weight;
+        if (best == -1 || p.currentWeight > _peers[best].currentWeight)
+            best = static_cast<int>(i);
+    }
+    if (best != -1)
+        _peers[best].currentWeight -= total;
+    return best;
+}
+
+
+// Picks the peer with the fewest active requests relative to its weight.
+int UpstreamGroup::selectLeastConn(const std::vector<int>& tried, time_t now)
+{
+    int best = -1;
+    for (size_t i = 0; i < _peers.size(); ++i) {
+        const UpstreamPeer& p = _peers[i];
+        if (wasTried(static_cast<int>(i), tried) || !isAvailable(p, now))
+            continue;
+        if (best == -1 || p.active * _peers[best].weight < _peers[best].active * p.weight)
+            best = static_cast<int>(i);
+    }
+    return best;
+}
+
+
+// Walks the ring clockwise from the key's point to the first usable peer.
+int UpstreamGroup::selectHash(const std::string& key, const std::vector<int>& tried, time_t now)
+{
+    if (_ring.empty())
+        return -1;
+    std::pair<unsigned int, int> probe(hashKey32(key), -1);
+    size_t start = std::lower_bound(_ring.begin(), _ring.end(), probe) - _ring.begin();
+    for (size_t n = 0; n < _ring.size(); ++n) {
+        int index = _ring[(start + n) % _ring.size()].second;
+        if (!wasTried(index, tried) && isAvailable(_peers[index], now))
+            return index;
+    }
+    return -1;
+}
+
+
+void UpstreamGroup::buildRing()
+{
+    _ring.clear();
+    for (size_t i = 0; i < _peers.size(); ++i) {
+        int points = UPSTREAM_RING_POINTS * _peers[i].weight;
+        for (int n = 0; n < points; ++n)
+            _ring.push_back(std::make_pair(hashKey32(_peers[i].label + "-" + toString(n)), static_cast<int>(i)));
+    }
+    std::sort(_ring.begin(), _ring.end());
+}
+
+
+// Returns the next peer to try, skipping peers already attempted for this request, or -1.
+int UpstreamGroup::selectPeer(const std::string& hashKey, const std::vector<int>& tried, time_t now)
+{
+    if (_balance == BALANCE_LEAST_CONN)
+        return selectLeastConn(tried, now);
+    if (_balance == BALANCE_HASH)
+        return selectHash(hashKey, tried, now);
+    return selectRoundRobin(tried, now);
+}
+
+
+// Records a failed attempt; the peer is skipped once max_fails is reached within fail_timeout.
+void UpstreamGroup::markFailure(int index, time_t now)
+{
+    UpstreamPeer& p = _peers[index];
+    if (difftime(now, p.checkedAt) > p.failTimeout)
+        p.fails = 0;
+    p.fails++;
+    p.checkedAt = now;
+    if (p.maxFails > 0 && p.fails >= p.maxFails)
+        ERROR("Upstream " + _name + ": peer " + p.label + " marked down for " + toString(p.failTimeout) + "s");
+}
+
+
+void UpstreamGroup::markSuccess(int index)
+{
+    _peers[index].fails = 0;
+}
+
+
+// Pops a pooled keep-alive connection that the backend has not closed meanwhile, or -1.
+int UpstreamGroup::acquireConnection(int index)
+{
+    UpstreamPeer& p = _peers[index];
+    while (!p.idle.empty()) {
+        int fd = p.idle.back().first;
+        p.idle.pop_back();
+        char probe;
+        ssize_t n = recv(fd, &probe, 1, MSG_PEEK | MSG_DONTWAIT);
+        if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return fd;
+        close(fd);
+    }
+    return -1;
+}
+
+
+// Keeps the connection for reuse when the pool has room; closes it otherwise.
+bool UpstreamGroup::releaseConnection(int index, int fd, time_t now)
+{
+    UpstreamPeer& p = _peers[index];
+    if (p.idle.size() >= _keepalive) {
+        close(fd);
+        return false;
+    }
+    p.idle.push_back(std::make_pair(fd, now));
+    return true;
+}
+
+
+// Closes pooled connections that stayed idle longer than maxIdle seconds.
+void UpstreamGroup::expireIdle(time_t now, time_t maxIdle)
+{
+    for (size_t i = 0; i < _peers.size(); ++i) {
+        std::vector<std::pair<int, time_t> >& idle = _peers[i].idle;
+        for (size_t j = 0; j < idle.size(); ) {
+            if (difftime(now, idle[j].second) > maxIdle) {
+                close(idle[j].first);
+                idle.erase(idle.begin() + j);
+            } else
+                ++j;
+        }
+    }
+}
+
+
+void UpstreamGroup::closeAll()
+{
+    for (size_t i = 0; i < _peers.size(); ++i) {
+        for (size_t j = 0; j < _peers[i].idle.size(); ++j)
+            close(_peers[i].idle[j].first);
+        _peers[i].idle.clear();
+    }
+}
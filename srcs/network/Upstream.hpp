@@ -0,0 +1,57 @@
+#pragma once
+
+#include "Webserv.hpp"
+#include "../config/UpstreamConfig.hpp"
+
+// Runtime state of one backend server inside an upstream group.
+struct UpstreamPeer {
+	std::string             label;         // host:port, used in logs
+	struct sockaddr_storage addr;
+	socklen_t               addrLen;
+	bool                    resolved;
+	int                     weight;
+	int                     currentWeight; // smooth weighted round-robin state
+	int                     maxFails;
+	time_t                  failTimeout;
+	int                     fails;
+	time_t                  checkedAt;     // last failure timestamp
+	size_t                  active;        // requests currently using this peer
+	std::vector<std::pair<int, time_t> > idle; // pooled keep-alive fds with their idle start
+
+	UpstreamPeer();
+};
+
+class UpstreamGroup {
+	private:
+			std::string                 _name;
+			std::vector<UpstreamPeer>   _peers;
+			UpstreamBalance             _balance;
+			std::string                 _hashKey;
+			size_t                      _keepalive;
+			std::vector<std::pair<unsigned int, int> > _ring; // consistent-hash points -> peer index
+
+			bool isAvailable(const UpstreamPeer& peer, time_t now) const;
+			static bool wasTried(int index, const std::vector<int>& tried);
+			int selectRoundRobin(const std::vector<int>& tried, time_t now);
+			int selectLeastConn(const std::vector<int>& tried, time_t now);
+			int selectHash(const std::string& key, const std::vector<int>& tried, time_t now);
+			void buildRing();
+
+	public:
+			UpstreamGroup();
+			~UpstreamGroup();
+
+			void configure(const UpstreamConfig& config);
+			const std::string& getName() const;
+			const std::string& getHashKey() const;
+			size_t size() const;
+			UpstreamPeer& peer(int index);
+
+			int  selectPeer(const std::string& hashKey, const std::vector<int>& tried, time_t now);
+			void markFailure(int index, time_t now);
+			void markSuccess(int index);
+			int  acquireConnection(int index);
+			bool releaseConnection(int index, int fd, time_t now);
+			void expireIdle(time_t now, time_t maxIdle);
+			void closeAll();
+};
@@ -0,0 +1,350 @@
+#include "Webserv.hpp"
+#include "EventBackend.hpp"
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+// Poll updates and the extended wait argument are 5.11 material; older headers build epoll only.
+#if defined(__NR_io_uring_setup) && defined(IORING_FEAT_EXT_ARG) && defined(IORING_POLL_UPDATE_EVENTS)
+# define URING_SUPPORTED 1
+#else
+# define URING_SUPPORTED 0
+#endif
+
+UringBackend::UringBackend()
+    : _ringFd(-1), _epollFd(-1), _epollArmed(false), _sqRing(MAP_FAILED), _cqRing(MAP_FAILED), _sqes(MAP_FAILED),
+      _sqRingSize(0), _cqRingSize(0), _sqesSize(0), _sqHead(NULL), _sqTail(NULL), _sqMask(NULL), _sqArray(NULL),
+      _cqHead(NULL), _cqTail(NULL), _cqMask(NULL), _cqes(NULL), _sqEntries(0) {}
+
+
+UringBackend::~UringBackend()
+{
+    if (_sqes != MAP_FAILED)
+        munmap(_sqes, _sqesSize);
+    if (_cqRing != MAP_FAILED && _cqRing != _sqRing)
+        munmap(_cqRing, _cqRingSize);
+    if (_sqRing != MAP_FAILED)
+        munmap(_sqRing, _sqRingSize);
+    if (_ringFd != -1)
+        close(_ringFd);
+    if (_epollFd != -1)
+        close(_epollFd);
+}
+
+
+const char* UringBackend::name() const { return "io_uring"; }
+
+
+#if URING_SUPPORTED
+
+#define URING_CONTROL (1ULL << 63) // updates and removals, whose completions are ignored
+#define URING_EPOLL   (1ULL << 62) // the poll on the private epoll set
+
+
+// user_data of a poll: the fd and the generation it was registered under.
+static uint64_t pollTag(int fd, uint32_t generation)
+{
+    return (static_cast<uint64_t>(generation & 0x3fffffff) << 32) | static_cast<uint32_t>(fd);
+}
+
+
+// Sets the ring up with the cheapest task-running mode the kernel accepts and maps it.
+bool UringBackend::open(unsigned entries)
+{
+    unsigned modes[3] = {0, 0, 0};
+#if defined(IORING_SETUP_SINGLE_ISSUER) && defined(IORING_SETUP_DEFER_TASKRUN)
+    modes[0] = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+#endif
+#ifdef IORING_SETUP_COOP_TASKRUN
+    modes[1] = IORING_SETUP_COOP_TASKRUN;
+#endif
+    struct io_uring_params params;
+    for (size_t i = 0; i < 3 && _ringFd == -1; ++i) {
+        if (i < 2 && modes[i] == 0)
+            continue;
+        std::memset(&params, 0, sizeof(params));
+        params.flags = modes[i];
+#ifdef IORING_SETUP_SUBMIT_ALL
+        params.flags |= IORING_SETUP_SUBMIT_ALL;
+#endif
+        _ringFd = syscall(__NR_io_uring_setup, entries, &params);
+        if (_ringFd == -1 && errno != EINVAL)
+            break;
+    }
+    if (_ringFd == -1)
+        return false;
+    fcntl(_ringFd, F_SETFD, FD_CLOEXEC);
+    if (!(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_NODROP))
+        return false;
+
+    _sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    _cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+        _sqRingSize = _cqRingSize = std::max(_sqRingSize, _cqRingSize);
+    _sqRing = mmap(NULL, _sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ringFd, IORING_OFF_SQ_RING);
+    if (_sqRing == MAP_FAILED)
+        return false;
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+        _cqRing = _sqRing;
+    else
+        _cqRing = mmap(NULL, _cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ringFd, IORING_OFF_CQ_RING);
+    _sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    if (_cqRing != MAP_FAILED)
+        _sqes = mmap(NULL, _sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ringFd, IORING_OFF_SQES);
+    if (_cqRing == MAP_FAILED || _sqes == MAP_FAILED)
+        return false;
+
+    char* sq = static_cast<char*>(_sqRing);
+    char* cq = static_cast<char*>(_cqRing);
+    _sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    _sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    _sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    _sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    _cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    _cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    _cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    _cqes = cq + params.cq_off.cqes;
+    _sqEntries = params.sq_entries;
+
+    _epollFd = epoll_create1(EPOLL_CLOEXEC);
+    return _epollFd != -1;
+}
+
+
+UringBackend::Watch* UringBackend::find(int fd)
+{
+    if (fd < 0 || static_cast<size_t>(fd) >= _watches.size() || !_watches[fd].registered)
+        return NULL;
+    return &_watches[fd];
+}
+
+
+// Next free submission entry, zeroed. Without SQPOLL the kernel only reads the ring inside
+// io_uring_enter(), so the tail can move before the entry is filled in.
+struct io_uring_sqe* UringBackend::nextSqe()
+{
+    unsigned head = __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE);
+    unsigned tail = *_sqTail;
+    if (tail - head >= _sqEntries) {
+        enter(false, 0); // ring full: submit what is queued first
+        head = __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE);
+        if (tail - head >= _sqEntries)
+            return NULL;
+    }
+    unsigned index = tail & *_sqMask;
+    struct io_uring_sqe* sqe = static_cast<struct io_uring_sqe*>(_sqes) + index;
+    std::memset(sqe, 0, sizeof(*sqe));
+    _sqArray[index] = index;
+    __atomic_store_n(_sqTail, tail + 1, __ATOMIC_RELEASE);
+    return sqe;
+}
+
+
+bool UringBackend::queuePoll(uint64_t tag, int fd, uint32_t events)
+{
+    struct io_uring_sqe* sqe = nextSqe();
+    if (!sqe)
+        return false;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = events;
+    sqe->user_data = tag;
+    return true;
+}
+
+
+// Submits everything queued and, with wait, blocks for the first completion or the timeout.
+int UringBackend::enter(bool wait, int timeoutMs)
+{
+    unsigned toSubmit = *_sqTail - __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE);
+    unsigned flags = 0;
+    unsigned minComplete = 0;
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    void* argp = NULL;
+    size_t argSize = 0;
+    if (wait) {
+        flags |= IORING_ENTER_GETEVENTS;
+        if (timeoutMs != 0)
+            minComplete = 1;
+        if (timeoutMs > 0) {
+            ts.tv_sec = timeoutMs / 1000;
+            ts.tv_nsec = (timeoutMs % 1000) * 1000000LL;
+            std::memset(&arg, 0, sizeof(arg));
+            arg.ts = reinterpret_cast<uintptr_t>(&ts);
+            flags |= IORING_ENTER_EXT_ARG;
+            argp = &arg;
+            argSize = sizeof(arg);
+        }
+    }
+    if (!toSubmit && !wait)
+        return 0;
+    return syscall(__NR_io_uring_enter, _ringFd, toSubmit, minComplete, flags, argp, argSize);
+}
+
+
+bool UringBackend::add(int fd, uint32_t events)
+{
+    if (fd < 0)
+        return false;
+    if (static_cast<size_t>(fd) >= _watches.size())
+        _watches.resize(fd + 1);
+    Watch& w = _watches[fd];
+    if (w.registered) {
+        errno = EEXIST;
+        return false;
+    }
+    w.registered = true;
+    w.generation++;
+    w.interest = events;
+    w.halfClosed = false;
+    w.armed = queuePoll(pollTag(fd, w.generation), fd, events);
+    return w.armed;
+}
+
+
+// Updates the poll in flight; a poll that already completed is re-armed with the new mask anyway.
+bool UringBackend::modify(int fd, uint32_t events)
+{
+    Watch* w = find(fd);
+    if (!w) {
+        errno = ENOENT;
+        return false;
+    }
+    if (w->interest == events)
+        return true;
+    w->interest = events;
+    if (w->halfClosed) {
+        struct epoll_event ev;
+        ev.data.fd = fd;
+        ev.events = events;
+        return epoll_ctl(_epollFd, EPOLL_CTL_MOD, fd, &ev) == 0;
+    }
+    if (!w->armed) {
+        _rearm.push_back(fd);
+        return true;
+    }
+    struct io_uring_sqe* sqe = nextSqe();
+    if (!sqe)
+        return false;
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->len = IORING_POLL_UPDATE_EVENTS;
+    sqe->addr = pollTag(fd, w->generation);
+    sqe->poll32_events = events;
+    sqe->user_data = URING_CONTROL;
+    return true;
+}
+
+
+void UringBackend::remove(int fd)
+{
+    Watch* w = find(fd);
+    if (!w)
+        return;
+    if (w->halfClosed)
+        epoll_ctl(_epollFd, EPOLL_CTL_DEL, fd, NULL);
+    else if (w->armed) {
+        struct io_uring_sqe* sqe = nextSqe();
+        if (sqe) {
+            sqe->opcode = IORING_OP_POLL_REMOVE;
+            sqe->fd = -1;
+            sqe->addr = pollTag(fd, w->generation);
+            sqe->user_data = URING_CONTROL;
+        }
+    }
+    w->registered = false;
+    w->armed = false;
+    w->halfClosed = false;
+    w->generation++; // whatever still completes for the old registration is stale
+}
+
+
+// The peer shut its side down while nothing reads the fd: the ring would report EPOLLRDHUP
+// on every poll, while epoll only wakes for what was asked.
+void UringBackend::moveToEpoll(int fd, Watch& w)
+{
+    struct epoll_event ev;
+    ev.data.fd = fd;
+    ev.events = w.interest;
+    if (epoll_ctl(_epollFd, EPOLL_CTL_ADD, fd, &ev) == 0)
+        w.halfClosed = true;
+}
+
+
+int UringBackend::collectEpoll(struct epoll_event* events, int maxEvents)
+{
+    _epollArmed = false;
+    if (maxEvents <= 0)
+        return 0;
+    int n = epoll_wait(_epollFd, events, maxEvents, 0);
+    return n < 0 ? 0 : n;
+}
+
+
+// Re-arms last round's polls, submits them with the wait and reaps the completions.
+int UringBackend::wait(struct epoll_event* events, int maxEvents, int timeoutMs)
+{
+    for (size_t i = 0; i < _rearm.size(); ++i) {
+        Watch* w = find(_rearm[i]);
+        if (w && !w->armed && !w->halfClosed)
+            w->armed = queuePoll(pollTag(_rearm[i], w->generation), _rearm[i], w->interest);
+    }
+    _rearm.clear();
+    if (!_epollArmed)
+        _epollArmed = queuePoll(URING_EPOLL, _epollFd, EPOLLIN);
+
+    if (enter(true, timeoutMs) == -1 && errno != ETIME && errno != EBUSY && errno != EAGAIN)
+        return -1;
+
+    unsigned head = *_cqHead;
+    unsigned tail = __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE);
+    bool epollReady = false;
+    int n = 0;
+    for (; head != tail && n < maxEvents; ++head) {
+        const struct io_uring_cqe* cqe = static_cast<const struct io_uring_cqe*>(_cqes) + (head & *_cqMask);
+        uint64_t tag = cqe->user_data;
+        if (tag & URING_CONTROL)
+            continue;
+        if (tag & URING_EPOLL) {
+            epollReady = true;
+            continue;
+        }
+        int fd = static_cast<int>(tag & 0xffffffff);
+        Watch* w = find(fd);
+        if (!w || pollTag(fd, w->generation) != tag || !w->armed)
+            continue;
+        w->armed = false;
+        if (cqe->res == -ECANCELED) {
+            _rearm.push_back(fd);
+            continue;
+        }
+        uint32_t mask = cqe->res < 0 ? EPOLLERR : cqe->res & (w->interest | EPOLLERR | EPOLLHUP);
+        if (!mask && (cqe->res & EPOLLRDHUP)) {
+            moveToEpoll(fd, *w);
+            if (w->halfClosed)
+                continue;
+        }
+        _rearm.push_back(fd);
+        if (!mask)
+            continue; // completed for a mask that was changed meanwhile
+        events[n].data.fd = fd;
+        events[n].events = mask;
+        n++;
+    }
+    __atomic_store_n(_cqHead, head, __ATOMIC_RELEASE);
+    if (epollReady)
+        n += collectEpoll(events + n, maxEvents - n);
+    return n;
+}
+
+#else
+
+bool UringBackend::open(unsigned) { return false; }
+bool UringBackend::add(int, uint32_t) { return false; }
+bool UringBackend::modify(int, uint32_t) { return false; }
+void UringBackend::remove(int) {}
+int UringBackend::wait(struct epoll_event*, int, int) { return -1; }
+
+#endif
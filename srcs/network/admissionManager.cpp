@@ -0,0 +1,106 @@
+#include "Webserv.hpp"
+#include "epollManager.hpp"
+
+
+// First server enabling admission_control sets the targets; the loop, and so the limits, are shared.
+void epollManager::configureAdmission()
+{
+    AdmissionConfig config;
+    for (std::map<int, std::vector<ServerConfig> >::const_iterator it = _config->serverGroups.begin(); it != _config->serverGroups.end() && !config.enabled; ++it) {
+        for (size_t i = 0; i < it->second.size() && !config.enabled; ++i)
+            config = it->second[i].getAdmission();
+    }
+    if (config.enabled && !_admission.enabled())
+        INFO("Admission control: lag target " + toString(config.lagMs) + "ms, CGI latency target " + toString(config.cgiLatencyMs) + "ms");
+    _admission.configure(config);
+}
+
+
+// One control step per ADMISSION_INTERVAL_MS, fed with the load seen since the last one.
+void epollManager::updateAdmission()
+{
+    _admission.observe(_requestsInFlight, _activeCgiCount);
+    if (_admission.update(monotonicUs()))
+        LOG("Admission limits " + toString(_admission.limit()) + " requests, " + toString(_admission.cgiLimit())
+            + " CGI (loop lag " + toString(_admission.lagUs()) + "us, CGI latency " + toString(_admission.cgiLatencyUs() / 1000) + "ms)");
+}
+
+
+// Status pages are always critical so the server can be observed while it sheds load.
+RequestPriority epollManager::requestPriority(const LocationConfig* location) const
+{
+    if (!location)
+        return PRIORITY_NORMAL;
+    if (location->getStatusHandler() != STATUS_NONE)
+        return PRIORITY_CRITICAL;
+    return location->getPriority();
+}
+
+
+// Counts the request in flight, or answers 503 when the limit of its priority is reached.
+// Connections of the reserve past MAX_CLIENTS only serve critical locations.
+bool epollManager::admitUnderLoad(int clientFd, const LocationConfig* location)
+{
+    ClientConnection& conn = _clientConnections[clientFd];
+    RequestPriority priority = requestPriority(location);
+    bool reserve = conn.reserved && priority != PRIORITY_CRITICAL;
+    if (reserve || !_admission.admit(priority, _requestsInFlight)) {
+        _metrics.admissionShed[priority]++;
+        LOG("Shedding " + conn.uri + " from " + conn.remoteAddr + (reserve ? std::string(" on a reserve connection")
+            : " at " + toString(_requestsInFlight) + " requests in flight, limit " + toString(_admission.limit())));
+        queueErrorResponse(clientFd, 503, "Service Unavailable", ADMISSION_RETRY_AFTER);
+        return false;
+    }
+    conn.admitted = true;
+    _requestsInFlight++;
+    _admission.observe(_requestsInFlight, _activeCgiCount);
+    return true;
+}
+
+
+bool epollManager::admitCgiUnderLoad(int clientFd, const LocationConfig* location)
+{
+    RequestPriority priority = requestPriority(location);
+    if (_admission.admitCgi(priority, _activeCgiCount))
+        return true;
+    _metrics.admissionShed[priority]++;
+    LOG("Shedding CGI " + _clientConnections[clientFd].uri + " at " + toString(_activeCgiCount) + " running, limit "
+        + toString(_admission.cgiLimit()));
+    queueErrorResponse(clientFd, 503, "Service Unavailable", ADMISSION_RETRY_AFTER);
+    return false;
+}
+
+
+void epollManager::releaseAdmission(ClientConnection& conn)
+{
+    if (!conn.admitted)
+        return;
+    conn.admitted = false;
+    if (_requestsInFlight > 0)
+        _requestsInFlight--;
+}
+
+
+// Past the reserve the connection is closed right away; plain HTTP clients still get a 503 first.
+void epollManager::rejectConnection(int clientSocket, int listenFd)
+{
+    _metrics.connectionsRejected++;
+    if (_config->listenTls.find(listenFd) == _config->listenTls.end()) {
+        std::string reply = "HTTP/1.1 503 Service Unavailable\r\nRetry-After: " + toString(ADMISSION_RETRY_AFTER)
+            + "\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        send(clientSocket, reply.data(), reply.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+    }
+    close(clientSocket);
+}
+
+
+void epollManager::collectAdmissionGauges(ConnectionGauges& gauges) const
+{
+    gauges.requestsInFlight = _requestsInFlight;
+    gauges.admissionEnabled = _admission.enabled();
+    gauges.admissionOverloaded = _admission.overloaded();
+    gauges.admissionLimit = _admission.limit();
+    gauges.admissionCgiLimit = _admission.cgiLimit();
+    gauges.loopLagUs = _admission.lagUs();
+    gauges.cgiLatencyUs = _admission.cgiLatencyUs();
+}
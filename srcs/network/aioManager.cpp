@@ -0,0 +1,165 @@
+#include "Webserv.hpp"
+#include "epollManager.hpp"
+
+
+// A request of an `aio threads` location whose response is built on a pool worker:
+// the file reads, upload writes, unlink() and directory reads of buildResponseForRequest
+// block that worker instead of the event loop.
+struct FileJob : public ThreadJob {
+    epollManager&       manager;
+    unsigned long       id;
+    int                 clientFd;
+    Request             request;   // owns its headers and body fd: the connection may be reset meanwhile
+    const ServerConfig* config;    // kept alive by releaseRetiredConfigs() while the job exists
+    HeaderTable         scriptHeaders;  // CGI handoff: applied to the response on completion
+    bool                handoff;
+    Response            response;
+    bool                failed;
+    std::string         error;     // what() of the exception that failed the job
+
+    FileJob(epollManager& owner, unsigned long jobId, int fd, const Request& source, const ServerConfig& server)
+        : manager(owner), id(jobId), clientFd(fd), request(source), config(&server), handoff(false), failed(false)
+    {
+        request.detachHeaders();
+    }
+
+    ~FileJob()
+    {
+        if (request.getBodyFd() != -1)
+            close(request.getBodyFd());
+    }
+
+    void run()
+    {
+        try {
+            response = manager.buildResponseForRequest(request, *config);
+        } catch (const std::exception& e) {
+            failed = true;
+            error = e.what();
+        } catch (...) {
+            failed = true;
+            error = "unknown exception";
+        }
+    }
+};
+
+
+// Starts the pool when some location uses aio threads; the first server with thread_pool
+// sizes it. A running pool keeps its size across reloads.
+void epollManager::configureThreadPool()
+{
+    bool wanted = false;
+    size_t threads = 0;
+    size_t maxQueue = 0;
+    for (std::map<int, std::vector<ServerConfig> >::const_iterator it = _config->serverGroups.begin(); it != _config->serverGroups.end(); ++it) {
+        for (size_t i = 0; i < it->second.size(); ++i) {
+            const ServerConfig& server = it->second[i];
+            const std::vector<LocationConfig>& locations = server.getLocations();
+            for (size_t j = 0; j < locations.size(); ++j)
+                wanted = wanted || locations[j].hasAioThreads();
+            if (!threads && server.getThreadPoolThreads()) {
+                threads = server.getThreadPoolThreads();
+                maxQueue = server.getThreadPoolQueue();
+            }
+        }
+    }
+    if (!threads) {
+        threads = AIO_THREADS;
+        maxQueue = AIO_MAX_QUEUE;
+    }
+    if (!wanted)
+        return;
+    if (_aioPool.running()) {
+        if (threads != _aioPool.threads())
+            INFO("thread_pool threads=" + toString(threads) + " applies after a restart or binary upgrade, the pool keeps "
+                + toString(_aioPool.threads()));
+        return;
+    }
+    if (!_aioPool.start(threads, maxQueue)) {
+        ERROR("aio threads unavailable, file work stays on the event loop");
+        return;
+    }
+    if (!_events->add(_aioPool.eventFd(), EPOLLIN)) {
+        ERROR_SYS("event add thread pool");
+        _aioPool.stop();
+        return;
+    }
+    INFO("Thread pool started: " + toString(_aioPool.threads()) + " threads, max_queue=" + toString(maxQueue));
+}
+
+
+// Hands the request to the pool; false leaves it to the caller, which builds the response
+// on the event loop (no aio here, or the queue is full). Reads stop until the job completes.
+bool epollManager::startFileJob(int clientFd, const Request& request, const ServerConfig& config,
+                                const LocationConfig* location, const HeaderTable* scriptHeaders)
+{
+    if (!location || !location->hasAioThreads() || location->getStatusHandler() != STATUS_NONE || !_aioPool.running())
+        return false;
+    int bodyFd = -1;
+    if (request.getBodyFd() != -1 && (bodyFd = fcntl(request.getBodyFd(), F_DUPFD_CLOEXEC, 0)) == -1) {
+        ERROR_SYS("dup spilled request body");
+        return false;
+    }
+    FileJob* job = new FileJob(*this, ++_nextAioJob, clientFd, request, config);
+    if (bodyFd != -1)
+        job->request.setBodyFile(bodyFd, request.getBodySize());
+    if (scriptHeaders) {
+        job->scriptHeaders = *scriptHeaders;
+        job->handoff = true;
+    }
+    if (!_aioPool.submit(job)) {
+        delete job;
+        _metrics.aioQueueFull++;
+        return false;
+    }
+    _aioJobs[job->id] = job;
+    _clientConnections[clientFd].aioJob = job->id;
+    _metrics.aioTasks++;
+    stopClientReads(clientFd);
+    return true;
+}
+
+
+// Queues the responses of finished jobs; those whose connection closed meanwhile are dropped.
+void epollManager::completeFileJobs()
+{
+    std::vector<ThreadJob*> finished;
+    _aioPool.collect(finished);
+    for (size_t i = 0; i < finished.size(); ++i) {
+        FileJob* job = static_cast<FileJob*>(finished[i]);
+        _aioJobs.erase(job->id);
+        std::map<int, ClientConnection>::iterator it = _clientConnections.find(job->clientFd);
+        if (it != _clientConnections.end() && it->second.aioJob == job->id) {
+            it->second.aioJob = 0;
+            if (job->failed) {
+                ERROR("aio job for " + job->request.getUri() + " fd=" + toString(job->clientFd) + " failed: " + job->error);
+                it->second.keepAlive = false;
+                queueErrorResponse(job->clientFd, 500, "Internal Server Error");
+            } else {
+                if (job->handoff)
+                    applyHandoffHeaders(job->response, job->scriptHeaders);
+                queueBuiltResponse(job->clientFd, job->response);
+            }
+            accountMemory(job->clientFd);
+        }
+        delete job;
+    }
+}
+
+
+// Servers the pending jobs build responses for, including jobs of connections already closed.
+void epollManager::fileJobConfigs(std::set<const ServerConfig*>& inUse) const
+{
+    for (std::map<unsigned long, FileJob*>::const_iterator it = _aioJobs.begin(); it != _aioJobs.end(); ++it)
+        inUse.insert(it->second->config);
+}
+
+
+// Joins the workers, then frees every job they held.
+void epollManager::stopFileJobs()
+{
+    _aioPool.stop();
+    for (std::map<unsigned long, FileJob*>::iterator it = _aioJobs.begin(); it != _aioJobs.end(); ++it)
+        delete it->second;
+    _aioJobs.clear();
+}
@@ -0,0 +1,161 @@
+#include "Webserv.hpp"
+#include "epollManager.hpp"
+#include "Cookie.hpp"
+
+
+// Splits "/dir/?page=2#top" into the directory URI and its query string.
+static void splitListingUri(const std::string& uri, std::string& path, std::string& query)
+{
+    size_t end = uri.find('#');
+    std::string target = uri.substr(0, end);
+    size_t qpos = target.find('?');
+    path = target.substr(0, qpos);
+    query = (qpos == std::string::npos) ? std::string() : target.substr(qpos + 1);
+}
+
+
+static std::string listingContentType(AutoindexFormat format)
+{
+    return format == AUTOINDEX_JSON ? "application/json" : "text/html; charset=utf-8";
+}
+
+
+static void appendChunk(std::string& out, const std::string& data)
+{
+    if (data.empty())
+        return;
+    std::ostringstream size;
+    size << std::hex << data.size();
+    out += size.str() + "\r\n";
+    out += data;
+    out += "\r\n";
+}
+
+
+// Selects the requested page of a directory; false (404) when unreadable or out of range.
+bool epollManager::openListing(const std::string& dirPath, const std::string& uri, const LocationConfig* location,
+                               ListingStream& stream) const
+{
+    std::string query;
+    splitListingUri(uri, stream.uri, query);
+    stream.format = location->getAutoindexFormat();
+    stream.listing = _autoindexCache.acquire(dirPath);
+    if (!stream.listing)
+        return false;
+    if (!selectListingPage(*stream.listing, query, location->getAutoindexPageSize(),
+                           stream.first, stream.end, stream.page, stream.pages)) {
+        _autoindexCache.release(stream.listing);
+        stream.listing = NULL;
+        return false;
+    }
+    stream.next = stream.first;
+    return true;
+}
+
+
+// Renders a whole listing page at once, for the responses that are not streamed (HEAD, HTTP/1.0).
+bool epollManager::renderDirectoryListing(const std::string& dirPath, const std::string& uri,
+                                          const LocationConfig* location, Response& response) const
+{
+    ListingStream stream;
+    if (!openListing(dirPath, uri, location, stream))
+        return false;
+    std::string body = renderListingHead(stream.uri, stream.format, stream.page, stream.pages);
+    renderListingEntries(body, *stream.listing, stream.uri, stream.format, stream.first, stream.first, stream.end);
+    body += renderListingTail(stream.uri, stream.format, stream.page, stream.pages);
+    _autoindexCache.release(stream.listing);
+
+    response.setStatus(200, "OK");
+    response.setHeader("Content-Type", listingContentType(stream.format));
+    std::string links = listingPageLinks(stream.uri, stream.page, stream.pages);
+    if (!links.empty())
+        response.setHeader("Link", links);
+    response.setBody(body);
+    return true;
+}
+
+
+// Answers a GET on an autoindexed directory with a chunked listing rendered as the client drains it.
+bool epollManager::startAutoindexStream(int clientFd, const Request& request, const ServerConfig& config,
+                                        const LocationConfig* location)
+{
+    if (!location || !location->getAutoindex() || location->hasReturn() || location->getStatusHandler() != STATUS_NONE)
+        return false;
+    const std::string uri = request.getUri();
+    if (request.getMethodId() != METHOD_GET || request.getVersion() != "HTTP/1.1" || uri == "/" || uri == "/index.html"
+        || !isMethodAllowed(METHOD_GET, uri, config))
+        return false;
+    std::string dirPath = resolveFilePath(uri, config);
+    if (dirPath.empty() || !isDirectory(dirPath))
+        return false;
+    ClientConnection& conn = _clientConnections[clientFd];
+    if (!openListing(dirPath, uri, location, conn.listing))
+        return false;   // buildResponseForRequest answers 404
+
+    ListingStream& stream = conn.listing;
+    Response response;
+    response.setStatus(200, "OK");
+    response.setHeader("Content-Type", listingContentType(stream.format));
+    response.setHeader("Transfer-Encoding", "chunked");
+    std::string links = listingPageLinks(stream.uri, stream.page, stream.pages);
+    if (!links.empty())
+        response.setHeader("Link", links);
+    addStandardHeaders(response, METHOD_GET);
+    if (conn.keepAlive) {
+        response.setHeader("Connection", "keep-alive");
+        response.setHeader("Keep-Alive", keepAliveHeader(conn));
+    } else
+        response.setHeader("Connection", "close");
+    attachSessionCookie(response, conn);
+
+    conn.outBuffer = response.getResponse();
+    conn.outOffset = 0;
+    LOG("Response " + conn.outBuffer.substr(0, conn.outBuffer.find("\r\n")) + " fd=" + toString(clientFd)
+        + " (autoindex, " + toString(stream.end - stream.first) + " entries)");
+    appendChunk(conn.outBuffer, renderListingHead(stream.uri, stream.format, stream.page, stream.pages));
+    conn.hasResponse = true;
+    conn.streamPending = true;
+    continueListingStream(clientFd);
+    return true;
+}
+
+
+// Called by resumeStreamingSource: renders the next slice once less than one slice is queued.
+void epollManager::continueListingStream(int clientFd)
+{
+    ClientConnection& conn = _clientConnections[clientFd];
+    ListingStream& stream = conn.listing;
+    if (conn.outBuffer.size() - conn.outOffset >= AUTOINDEX_CHUNK_BYTES)
+        return;
+    if (conn.outOffset >= AUTOINDEX_CHUNK_BYTES) {
+        conn.outBuffer.erase(0, conn.outOffset);
+        conn.outOffset = 0;
+    }
+
+    std::string data;
+    while (stream.next < stream.end && data.size() < AUTOINDEX_CHUNK_BYTES) {
+        size_t to = std::min(stream.end, stream.next + 64);
+        renderListingEntries(data, *stream.listing, stream.uri, stream.format, stream.first, stream.next, to);
+        stream.next = to;
+    }
+    if (stream.next >= stream.end) {
+        data += renderListingTail(stream.uri, stream.format, stream.page, stream.pages);
+        appendChunk(conn.outBuffer, data);
+        conn.outBuffer += "0\r\n\r\n";
+        endListingStream(conn);
+        conn.streamPending = false;
+    } else
+        appendChunk(conn.outBuffer, data);
+    conn.lastActivity = time(NULL);
+    updateClientInterest(clientFd, true);
+}
+
+
+// Drops the connection's reference on its listing (end of response or aborted client).
+void epollManager::endListingStream(ClientConnection& conn)
+{
+    if (!conn.listing.listing)
+        return;
+    _autoindexCache.release(conn.listing.listing);
+    conn.listing = ListingStream();
+}
@@ -0,0 +1,175 @@
+#include "Webserv.hpp"
+#include "epollManager.hpp"
+#include "Cookie.hpp"
+#include "RequestVariables.hpp"
+
+
+// Returns the runtime cache of the location's zone, created on first use (zone names are global).
+ResponseCache* epollManager::cacheForLocation(const LocationConfig* location, const ServerConfig& config)
+{
+    if (!location || !location->hasCgiCache())
+        return NULL;
+    const std::string& zone = location->getCgiCacheZone();
+    std::map<std::string, ResponseCache*>::iterator it = _responseCaches.find(zone);
+    if (it != _responseCaches.end())
+        return it->second;
+    std::map<std::string, CacheZoneConfig>::const_iterator zit = config.getCacheZones().find(zone);
+    if (zit == config.getCacheZones().end())
+        return NULL;
+    ResponseCache* cache = new ResponseCache();
+    cache->configure(zit->second);
+    _responseCaches[zone] = cache;
+    return cache;
+}
+
+
+ResponseCache* epollManager::cacheForConnection(const ClientConnection& conn)
+{
+    if (conn.cacheKey.empty())
+        return NULL;
+    std::map<std::string, ResponseCache*>::iterator it = _responseCaches.find(conn.cacheZone);
+    return it == _responseCaches.end() ? NULL : it->second;
+}
+
+
+// Answers GET/HEAD from cgi_cache; a stale entry is served while a single background refresh runs.
+bool epollManager::serveFromCache(int clientFd, const Request& request, const ServerConfig& config, const LocationConfig* location)
+{
+    ClientConnection& conn = _clientConnections[clientFd];
+    if (conn.methodId != METHOD_GET && conn.methodId != METHOD_HEAD)
+        return false;
+    ResponseCache* cache = cacheForLocation(location, config);
+    if (!cache)
+        return false;
+    conn.cacheZone = location->getCgiCacheZone();
+    conn.cacheKey = expandRequestVariables(location->getCgiCacheKey(), conn);
+
+    time_t now = time(NULL);
+    const CacheEntry* entry = NULL;
+    CacheStatus status = cache->lookup(conn.cacheKey, now, entry);
+    if (status == CACHE_HIT) {
+        sendCachedResponse(clientFd, *entry, "HIT", now);
+        return true;
+    }
+    if (status == CACHE_STALE) {
+        bool refresh = cache->beginRefresh(conn.cacheKey);
+        sendCachedResponse(clientFd, *entry, refresh ? "UPDATING" : "STALE", now);
+        if (refresh)
+            startBackgroundRefresh(clientFd, request, config, location);
+        return true;
+    }
+    return false;
+}
+
+
+// Queues a cached response, adding the per-client headers that are never stored.
+void epollManager::sendCachedResponse(int clientFd, const CacheEntry& entry, const std::string& status, time_t now)
+{
+    ClientConnection& conn = _clientConnections[clientFd];
+    std::string out = entry.head;
+    out += "Age: " + toString(now > entry.storedAt ? now - entry.storedAt : 0) + "\r\n";
+    out += "X-Cache-Status: " + status + "\r\n";
+    if (conn.keepAlive)
+        out += "Connection: keep-alive\r\nKeep-Alive: " + keepAliveHeader(conn) + "\r\n";
+    else
+        out += "Connection: close\r\n";
+    std::string cookie = takeSessionCookie(conn);
+    if (!cookie.empty())
+        out += "Set-Cookie: " + cookie + "\r\n";
+    out += "\r\n";
+    if (conn.methodId != METHOD_HEAD)
+        out += entry.body;
+    LOG("Response " + entry.head.substr(0, entry.head.find("\r\n")) + " (cache " + status + ") fd=" + toString(clientFd));
+    conn.outBuffer = out;
+    conn.outOffset = 0;
+    conn.hasResponse = true;
+    updateClientInterest(clientFd, true);
+}
+
+
+// Stores a finished CGI response under the request's key when its freshness headers allow it.
+void epollManager::storeCgiResponse(int clientFd, const Response& response)
+{
+    ClientConnection& conn = _clientConnections[clientFd];
+    ResponseCache* cache = cacheForConnection(conn);
+    const LocationConfig* location = findLocationConfig(conn.uri, *_serverForClientFd[clientFd]);
+    if (!cache || !location)
+        return;
+    time_t now = time(NULL);
+    CacheFreshness fresh = computeCacheFreshness(response.getStatusCode(), response.getHeaders(),
+        location->getCgiCacheValid(), location->getCgiCacheRevalidate(), location->getCgiCacheStaleError(), now);
+    std::string raw = response.getResponse();
+    cache->store(conn.cacheKey, raw.substr(0, raw.find("\r\n\r\n") + 2), response.getBody(), fresh, now);
+    if (fresh.cacheable)
+        LOG("Cached " + conn.cacheKey + " for " + toString(fresh.ttl) + "s");
+}
+
+
+// Falls back to the cached copy when the CGI failed (stale-if-error); false if none is usable.
+bool epollManager::serveStaleOnError(int clientFd)
+{
+    ClientConnection& conn = _clientConnections[clientFd];
+    if (conn.backgroundRefresh) {
+        LOG("Cache refresh failed for " + conn.cacheKey + ", keeping the stale entry");
+        finishBackgroundRefresh(clientFd);
+        return true;
+    }
+    ResponseCache* cache = cacheForConnection(conn);
+    if (!cache)
+        return false;
+    time_t now = time(NULL);
+    const CacheEntry* entry = cache->staleForError(conn.cacheKey, now);
+    if (!entry)
+        return false;
+    sendCachedResponse(clientFd, *entry, "STALE", now);
+    return true;
+}
+
+
+// Re-runs the CGI on a pseudo-connection (negative fd, no socket) while clients get the stale copy.
+void epollManager::startBackgroundRefresh(int clientFd, const Request& request, const ServerConfig& config, const LocationConfig* location)
+{
+    int refreshFd = _nextRefreshId--;
+    ClientConnection refresh = _clientConnections[clientFd];
+    refresh.fd = refreshFd;
+    refresh.backgroundRefresh = true;
+    refresh.tls = NULL;             // the session belongs to the client connection
+    refresh.bodyFd = -1;
+    refresh.memoryUsed = 0;
+    refresh.keepAlive = false;
+    refresh.outBuffer.clear();
+    refresh.outOffset = 0;
+    refresh.hasResponse = false;
+    refresh.sessionShouldSetCookie = false;
+    refresh.connLimits.clear();      // slots stay with the client connection
+    refresh.requestLimits.clear();
+    refresh.admitted = false;        // counted once, by the client connection
+    refresh.reserved = false;
+    refresh.lastActivity = time(NULL);
+    _clientConnections[refreshFd] = refresh;
+    _serverForClientFd[refreshFd] = &config;
+    LOG("Cache refresh " + refresh.cacheKey + " id=" + toString(refreshFd));
+    startCgiFor(refreshFd, request, config, location);
+}
+
+
+// Releases the refresh slot; the pseudo-connection is dropped at the end of the loop iteration.
+void epollManager::finishBackgroundRefresh(int refreshFd)
+{
+    ClientConnection& conn = _clientConnections[refreshFd];
+    ResponseCache* cache = cacheForConnection(conn);
+    if (cache)
+        cache->endRefresh(conn.cacheKey);
+    conn.hasResponse = true;
+    _finishedRefreshes.push_back(refreshFd);
+}
+
+
+void epollManager::purgeFinishedRefreshes()
+{
+    for (size_t i = 0; i < _finishedRefreshes.size(); ++i) {
+        closeClientSocket(_finishedRefreshes[i]);
+        removeClientState(_finishedRefreshes[i]);
+    }
+    _finishedRefreshes.clear();
+}
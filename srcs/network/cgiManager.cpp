@@ -33,6 +33,8 @@
         envStore.push_back(std::string("SERVER_PORT=") + toString(config.getPort()));
         envStore.push_back(std::string("REMOTE_ADDR=") + conn.remoteAddr);
         envStore.push_back(std::string("DOCUMENT_ROOT=") + documentRoot);
+        if (conn.tls)
+            envStore.push_back("HTTPS=on");
 
         std::vector<char*> envp;
         for (size_t i=0;i<envStore.size();++i)
@@ -47,8 +49,13 @@ void epollManager::execChild(std::string &scriptPath, const Request &request,
         // chdir to script directory
         std::string dir = dirnameOf(scriptPath);
         chdir(dir.c_str());
-        // dup stdio
-        dup2(pin[0], STDIN_FILENO);
+        std::signal(SIGPIPE, SIG_DFL);
+        // dup stdio; a body spilled under memory pressure is read straight from its file
+        if (conn.bodyFd != -1) {
+            lseek(conn.bodyFd, 0, SEEK_SET);
+            dup2(conn.bodyFd, STDIN_FILENO);
+        } else
+            dup2(pin[0], STDIN_FILENO);
 		dup2(pout[1], STDOUT_FILENO);
 		dup2(pout[1], STDERR_FILENO);
         safeClose(pin);
@@ -109,6 +116,8 @@ bool epollManager::startCgiFor(int clientFd, const Request& request, const Serve
         sendErrorResponse(clientFd, 503, "Server Busy");
         return false;
     }
+	if (!admitCgiUnderLoad(clientFd, location))
+		return false;
 	if (pipe(pin) == -1 || pipe(pout) == -1) {
 		sendErrorResponse(clientFd, 502, "Bad Gateway");
 		return false;
@@ -129,26 +138,22 @@ bool epollManager::startCgiFor(int clientFd, const Request& request, const Serve
         execChild(scriptPath, request, config, location, conn);
 
     // parent
+    conn.timing.cgiSpawn = monotonicUs();
     close(pin[0]);
 	close(pout[1]);
 
-    // register fds to epoll
-    struct epoll_event ev;
-    ev.data.fd = pout[0];
-	ev.events = EPOLLIN;
-
-	if (epoll_ctl(_epollFd, EPOLL_CTL_ADD, pout[0], &ev) == -1)
-		ERROR_SYS("epoll_ctl add cgi out");
+    // register fds with the event loop
+	if (!_events->add(pout[0], EPOLLIN))
+		ERROR_SYS("event add cgi out");
 
     _cgiOutToClient[pout[0]] = clientFd;
 	 _activeCgiCount++;
+	_metrics.cgiSpawned++;
 
     // register input if there is a body to send
     if (!conn.body.empty()) {
-		ev.data.fd = pin[1];
-		ev.events = EPOLLOUT;
-		if (epoll_ctl(_epollFd, EPOLL_CTL_ADD, pin[1], &ev) == -1)
-			ERROR_SYS("epoll_ctl add cgi in");
+		if (!_events->add(pin[1], EPOLLOUT))
+			ERROR_SYS("event add cgi in");
 		_cgiInToClient[pin[1]] = clientFd;
 	}
     // collect connection info
@@ -159,9 +164,13 @@ bool epollManager::startCgiFor(int clientFd, const Request& request, const Serve
 // Reads CGI stdout and appends it to the client connection buffer.
 void epollManager::drainCgiOutput(int pipeFd, uint32_t events)
 {
-    (void)events;
     int clientFd = _cgiOutToClient[pipeFd];
     ClientConnection &conn = _clientConnections[clientFd];
+    if (memoryExhausted() && !(events & (EPOLLHUP | EPOLLERR))) {
+        // the script blocks on a full pipe; once it exits the rest is read whatever the budget
+        pauseForMemory(clientFd, pipeFd);
+        return;
+    }
     char buf[BUFFER_SIZE]; 
     ssize_t n = read(pipeFd, buf, sizeof(buf));
 
@@ -172,7 +181,7 @@ void epollManager::drainCgiOutput(int pipeFd, uint32_t events)
 	}
     if (n == 0) 
     {
-        epoll_ctl(_epollFd, EPOLL_CTL_DEL, pipeFd, NULL);
+        _events->remove(pipeFd);
 		close(pipeFd);
 		_cgiOutToClient.erase(pipeFd);
 		conn.cgiOutFd = -1;
@@ -192,7 +201,7 @@ void epollManager::feedCgiInput(int pipeFd, uint32_t events)
     if (conn.body.empty() || conn.cgiInFd == -1)
     {
         // nothing to send
-        epoll_ctl(_epollFd, EPOLL_CTL_DEL, pipeFd, NULL);
+        _events->remove(pipeFd);
         close(pipeFd);
         _cgiInToClient.erase(pipeFd);
         conn.cgiInFd = -1;
@@ -203,7 +212,7 @@ void epollManager::feedCgiInput(int pipeFd, uint32_t events)
     if (remaining == 0)
     {
         // Terminé
-        epoll_ctl(_epollFd, EPOLL_CTL_DEL, pipeFd, NULL);
+        _events->remove(pipeFd);
         close(pipeFd);
         _cgiInToClient.erase(pipeFd);
         conn.cgiInFd = -1;
@@ -220,7 +229,7 @@ void epollManager::feedCgiInput(int pipeFd, uint32_t events)
         if (conn.cgiInOffset >= conn.body.size())
         {
             // tout envoyé, on retire le fd
-            epoll_ctl(_epollFd, EPOLL_CTL_DEL, pipeFd, NULL);
+            _events->remove(pipeFd);
             close(pipeFd);
             _cgiInToClient.erase(pipeFd);
             conn.cgiInFd = -1;
@@ -240,14 +249,14 @@ void epollManager::feedCgiInput(int pipeFd, uint32_t events)
     }
     if (conn.cgiOutFd != -1)
     {
-        epoll_ctl(_epollFd, EPOLL_CTL_DEL, conn.cgiOutFd, NULL);
+        _events->remove(conn.cgiOutFd);
         close(conn.cgiOutFd);
         _cgiOutToClient.erase(conn.cgiOutFd);
         conn.cgiOutFd = -1;
     }
     if (pipeFd != -1)
     {
-        epoll_ctl(_epollFd, EPOLL_CTL_DEL, pipeFd, NULL);
+        _events->remove(pipeFd);
         close(pipeFd);
         _cgiInToClient.erase(pipeFd);
     }
@@ -281,12 +290,14 @@ static void parseCgiOutputToResponse(const std::string& cgiOutput, Response& res
                     std::istringstream iss(value); iss >> statusCode; std::string rest; std::getline(iss, rest); if (!rest.empty() && rest[0]==' ') rest.erase(0,1); statusText = rest.empty()?"":rest;
                 } 
                 else 
-                    response.setHeader(name, value);
+                    response.addHeader(name, value);
             }
         }
         response.setStatus(statusCode, statusText.empty()?"OK":statusText);
         response.setBody(body);
-        if (response.getHeaders().find("Content-Type") == response.getHeaders().end()) response.setHeader("Content-Type", "text/html");
+        const HeaderTable& headers = response.getHeaders();
+        if (!headers.has(HEADER_CONTENT_TYPE) && !headers.has(HEADER_X_ACCEL_REDIRECT) && !headers.has(HEADER_X_SENDFILE))
+            response.setHeader("Content-Type", "text/html");
     } else
     {
         response.setStatus(200, "OK"); response.setHeader("Content-Type", "text/html"); response.setBody(cgiOutput);
@@ -298,17 +309,20 @@ void epollManager::finalizeCgiResponse(int clientFd)
 {
     ClientConnection &conn = _clientConnections[clientFd];
     conn.keepAlive = false;
+    conn.timing.cgiExit = monotonicUs();
+    if (conn.timing.cgiSpawn)
+        _admission.sampleCgi(conn.timing.cgiExit - conn.timing.cgiSpawn);
     
     // Clear fds
     if (conn.cgiInFd != -1) {
-        epoll_ctl(_epollFd, EPOLL_CTL_DEL, conn.cgiInFd, NULL);
+        _events->remove(conn.cgiInFd);
         close(conn.cgiInFd);
         _cgiInToClient.erase(conn.cgiInFd);
         conn.cgiInFd = -1;
     }
     
     if (conn.cgiOutFd != -1) {
-        epoll_ctl(_epollFd, EPOLL_CTL_DEL, conn.cgiOutFd, NULL);
+        _events->remove(conn.cgiOutFd);
         close(conn.cgiOutFd);
         _cgiOutToClient.erase(conn.cgiOutFd);
         conn.cgiOutFd = -1;
@@ -346,9 +360,28 @@ void epollManager::finalizeCgiResponse(int clientFd)
     // build response from CGI output
     Response resp; 
     parseCgiOutputToResponse(conn.cgiOutBuffer, resp);
+    conn.cgiOutBuffer.clear();
+    HeaderView handoff;
+    if (resp.getHeaders().find(HEADER_X_ACCEL_REDIRECT, handoff) || resp.getHeaders().find(HEADER_X_SENDFILE, handoff)) {
+        // not cached: a hit would replay the header instead of the file
+        if (conn.backgroundRefresh)
+            finishBackgroundRefresh(clientFd);
+        else
+            serveCgiHandoff(clientFd, handoff.str(), resp.getHeaders());
+        return;
+    }
+    if (!conn.cacheKey.empty()) {
+        if (resp.getStatusCode() >= 500 && serveStaleOnError(clientFd))
+            return;
+        storeCgiResponse(clientFd, resp);
+    }
+    if (conn.backgroundRefresh) {
+        finishBackgroundRefresh(clientFd);
+        return;
+    }
     if (conn.keepAlive) {
         resp.setHeader("Connection", "keep-alive");
-        resp.setHeader("Keep-Alive", "timeout=5, max=100");
+        resp.setHeader("Keep-Alive", keepAliveHeader(conn));
     } else {
         resp.setHeader("Connection", "close");
     }
@@ -358,5 +391,50 @@ void epollManager::finalizeCgiResponse(int clientFd)
     conn.outOffset = 0;
     conn.hasResponse = true;
     armWriteEvent(clientFd, true);
-    conn.cgiOutBuffer.clear();
+}
+
+
+// X-Accel-Redirect / X-Sendfile: the script only authorized the request, the URI it names is
+// served like a static GET (internal locations included) with the script's other headers.
+void epollManager::serveCgiHandoff(int clientFd, const std::string& uri, const HeaderTable& scriptHeaders)
+{
+    ClientConnection& conn = _clientConnections[clientFd];
+    const ServerConfig& cfg = *_serverForClientFd[clientFd];
+    const LocationConfig* location = findLocationConfig(uri, cfg);
+    if (uri.empty() || uri[0] != '/' || (location && (location->hasProxyPass() || location->isCgiRequest(uri)))) {
+        ERROR("CGI handoff from " + conn.uri + " to '" + uri + "' refused: not a static URI");
+        queueErrorResponse(clientFd, 502, "Bad Gateway");
+        return;
+    }
+    LOG("CGI handoff " + conn.uri + " -> " + uri + " fd=" + toString(clientFd));
+    Request request(conn.methodId == METHOD_HEAD ? "HEAD" : "GET", uri, conn.version, conn.headers, "");
+    if (startFileJob(clientFd, request, cfg, location, &scriptHeaders))
+        return;
+    Response response = buildResponseForRequest(request, cfg);
+    applyHandoffHeaders(response, scriptHeaders);
+    queueBuiltResponse(clientFd, response);
+}
+
+
+// Copies the script's headers onto a successful handoff response, replacing the static ones
+// of the same name (a Content-Type or Content-Disposition for a download); framing stays ours.
+void epollManager::applyHandoffHeaders(Response& response, const HeaderTable& scriptHeaders) const
+{
+    if (response.getStatusCode() >= 400)
+        return;
+    std::set<std::string> replaced;
+    for (size_t i = 0; i < scriptHeaders.size(); ++i) {
+        switch (scriptHeaders.id(i)) {
+            case HEADER_CONTENT_LENGTH: case HEADER_TRANSFER_ENCODING: case HEADER_CONNECTION:
+            case HEADER_KEEP_ALIVE: case HEADER_X_ACCEL_REDIRECT: case HEADER_X_SENDFILE:
+                continue;
+            default:
+                break;
+        }
+        std::string name = scriptHeaders.name(i).str();
+        if (replaced.insert(toLowerCase(name)).second)
+            response.setHeader(name, scriptHeaders.value(i).str());
+        else
+            response.addHeader(name, scriptHeaders.value(i).str());
+    }
 }
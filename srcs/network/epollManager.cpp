@@ -6,28 +6,38 @@
 #include "../utils/Utils.hpp"
 #include "../utils/ParserUtils.hpp"
 #include "Cookie.hpp"
+#include <netinet/tcp.h>
+#include <sys/mman.h>
 
 
-// Converts a binary IPv4 address into dotted-decimal notation.
-std::string formatIpv4Address(const struct in_addr& addr) 
+// Fills REMOTE_ADDR / REMOTE_PORT from the peer address: dotted IPv4, IPv6 text, or
+// "unix:" (port 0) for Unix-domain clients, as nginx reports them.
+void formatPeerAddress(const struct sockaddr_storage& peer, std::string& addr, int& port)
 {
-    unsigned long ip = ntohl(addr.s_addr);
-    std::string dotted = toString((ip >> 24) & 0xFF);
-    dotted += ".";
-    dotted += toString((ip >> 16) & 0xFF);
-    dotted += ".";
-    dotted += toString((ip >> 8) & 0xFF);
-    dotted += ".";
-    dotted += toString(ip & 0xFF);
-    return dotted;
+    char text[INET6_ADDRSTRLEN];
+    addr = "unix:";
+    port = 0;
+    if (peer.ss_family == AF_INET) {
+        const struct sockaddr_in* in4 = reinterpret_cast<const struct sockaddr_in*>(&peer);
+        if (inet_ntop(AF_INET, &in4->sin_addr, text, sizeof(text)))
+            addr = text;
+        port = ntohs(in4->sin_port);
+    } else if (peer.ss_family == AF_INET6) {
+        const struct sockaddr_in6* in6 = reinterpret_cast<const struct sockaddr_in6*>(&peer);
+        if (inet_ntop(AF_INET6, &in6->sin6_addr, text, sizeof(text)))
+            addr = text;
+        port = ntohs(in6->sin6_port);
+    }
 }
 
 
 // Splits the raw header buffer into the request line, header block and trailing body fragment.
+// The header block and the body fragment are ranges of the buffer, not copies.
 struct HeaderSections {
     std::string requestLine;
-    std::string headerBlock;
-    std::string remainder;
+    size_t      headerStart;
+    size_t      headerEnd;
+    size_t      bodyStart;
 };
 
 // Extracts header sections from the client buffer. Returns false while headers are incomplete.
@@ -36,15 +46,11 @@ bool extractHeaderSections(const std::string& buffer, HeaderSections& sections)
     if (headerEnd == std::string::npos)
         return false;
 
-    sections.headerBlock = buffer.substr(0, headerEnd);
-    sections.remainder = buffer.substr(headerEnd + 4);
-
-    size_t firstEol = sections.headerBlock.find("\r\n");
-    if (firstEol == std::string::npos)
-        return false;
-
-    sections.requestLine = sections.headerBlock.substr(0, firstEol);
-    sections.headerBlock.erase(0, firstEol + 2);
+    size_t firstEol = buffer.find("\r\n");
+    sections.requestLine.assign(buffer, 0, firstEol);
+    sections.headerStart = std::min(firstEol + 2, headerEnd); // a request without header lines
+    sections.headerEnd = headerEnd;
+    sections.bodyStart = headerEnd + 4;
     return true;
 }
 
@@ -56,103 +62,44 @@ bool parseRequestLine(const std::string& line, ClientConnection& conn) {
         return false;
 
     conn.method = line.substr(0, firstSpace);
+    conn.methodId = methodId(conn.method);
     conn.uri = line.substr(firstSpace + 1, secondSpace - firstSpace - 1);
     conn.version = line.substr(secondSpace + 1);
     return true;
 }
 
-// Inserts an HTTP header line into the connection header map (lowercased name).
-void storeHeaderLine(const std::string& line, ClientConnection& conn) {
-    size_t colon = line.find(':');
-    if (colon == std::string::npos)
-        return;
-
-    std::string name = line.substr(0, colon);
-    std::string value = line.substr(colon + 1);
-    while (!value.empty() && (value[0] == ' ' || value[0] == '\t'))
-        value.erase(0, 1);
-    while (!name.empty() && (name[name.size() - 1] == ' ' || name[name.size() - 1] == '\t'))
-        name.erase(name.size() - 1);
-    for (size_t i = 0; i < name.size(); ++i)
-        name[i] = static_cast<char>(std::tolower(static_cast<unsigned char>(name[i])));
-    if (!name.empty())
-        conn.headers[name] = value;
-}
-
-// Parses all header lines following the request line.
-void parseHeaderBlock(const std::string& block, ClientConnection& conn) {
-    size_t lineStart = 0;
-    while (lineStart < block.size()) {
-        size_t lineEnd = block.find("\r\n", lineStart);
-        if (lineEnd == std::string::npos)
-            break;
-        std::string line = block.substr(lineStart, lineEnd - lineStart);
-        storeHeaderLine(line, conn);
-        lineStart = lineEnd + 2;
-    }
-}
-
 // Normalises the body handling strategy depending on Content-Length / Transfer-Encoding.
-void configureBodyStrategy(ClientConnection& conn, const std::string& remainder) {
-    std::string transferEncoding;
-    std::string contentLength;
-    std::map<std::string, std::string>::const_iterator teIt = conn.headers.find("transfer-encoding");
-    if (teIt != conn.headers.end())
-        transferEncoding = teIt->second;
-    std::map<std::string, std::string>::const_iterator clIt = conn.headers.find("content-length");
-    if (clIt != conn.headers.end())
-        contentLength = clIt->second;
-
-    std::string transferLower = transferEncoding;
-    for (size_t i = 0; i < transferLower.size(); ++i)
-        transferLower[i] = static_cast<char>(std::tolower(static_cast<unsigned char>(transferLower[i])));
-
-    if (!transferLower.empty() && transferLower.find("chunked") != std::string::npos) {
+// The bytes of conn.buffer from bodyStart on already belong to the body.
+void configureBodyStrategy(ClientConnection& conn, size_t bodyStart) {
+    HeaderView transferEncoding;
+    HeaderView contentLength;
+    bool chunked = conn.headers.find(HEADER_TRANSFER_ENCODING, transferEncoding)
+        && toLowerCase(transferEncoding.str()).find("chunked") != std::string::npos;
+
+    if (chunked) {
         conn.bodyType = BODY_CHUNKED;
         conn.chunkState = CHUNK_READ_SIZE;
-    } else if (!contentLength.empty()) {
-        conn.contentLength = static_cast<size_t>(std::strtoul(contentLength.c_str(), NULL, 10));
+    } else if (conn.headers.find(HEADER_CONTENT_LENGTH, contentLength) && contentLength.size) {
+        conn.contentLength = static_cast<size_t>(std::strtoul(contentLength.str().c_str(), NULL, 10));
         conn.bodyType = (conn.contentLength > 0) ? BODY_FIXED : BODY_NONE;
     } else {
         conn.bodyType = BODY_NONE;
     }
 
-    conn.buffer.clear();
     if (conn.bodyType == BODY_FIXED) {
-        conn.body.append(remainder);
+        conn.body.append(conn.buffer, bodyStart, std::string::npos);
         conn.bodyReceived = conn.body.size();
     } else if (conn.bodyType == BODY_CHUNKED) {
-        conn.chunkBuffer.append(remainder);
+        conn.chunkBuffer.append(conn.buffer, bodyStart, std::string::npos);
     }
-}
-
-// Serialises the parsed connection data back into a raw HTTP request string.
-std::string buildRawHttpRequest(const ClientConnection& conn) 
-{
-    std::string raw = conn.method + " " + conn.uri + " " + conn.version + "\r\n";
-    for (std::map<std::string, std::string>::const_iterator it = conn.headers.begin(); it != conn.headers.end(); ++it) {
-        if (it->first == "transfer-encoding" || it->first == "content-length")
-            continue;
-        raw += it->first + ": " + it->second + "\r\n";
-    }
-    if (!conn.body.empty())
-        raw += std::string("Content-Length: ") + toString(conn.body.size()) + "\r\n";
-    raw += "\r\n";
-    raw += conn.body;
-    return raw;
+    conn.buffer.clear();
 }
 
 // Applies keep-alive / close rules according to version and Connection header.
+// Every Connection field counts: "close" in any of them wins over "keep-alive".
 void applyKeepAlivePolicy(ClientConnection& conn) 
 {
-    std::string connectionValue;
-    std::map<std::string, std::string>::iterator it = conn.headers.find("connection");
-    if (it != conn.headers.end())
-        connectionValue = it->second;
-
-    std::string connectionLower = connectionValue;
-    for (size_t i = 0; i < connectionLower.size(); ++i)
-        connectionLower[i] = static_cast<char>(std::tolower(static_cast<unsigned char>(connectionLower[i])));
+    std::string connectionLower = toLowerCase(conn.headers.join(HEADER_CONNECTION));
     bool explicitClose = connectionLower.find("close") != std::string::npos;
     bool explicitKeep = connectionLower.find("keep-alive") != std::string::npos;
 
@@ -174,13 +121,28 @@ void applyKeepAlivePolicy(ClientConnection& conn)
 }
 
 
+// Empties a buffer for the next request, freeing it when a large body or response made it grow.
+static void recycleBuffer(std::string& buffer)
+{
+    if (buffer.capacity() > BUFFER_KEEP_SIZE)
+        std::string().swap(buffer);
+    else
+        buffer.clear();
+}
+
+
 // Resets every per-request field so the connection can handle a new request.
 void resetClientState(ClientConnection& conn)
 {
     conn.headers.clear();
-    conn.body.clear();
-    conn.chunkBuffer.clear();
+    recycleBuffer(conn.body);
+    if (conn.bodyFd != -1) {
+        close(conn.bodyFd);
+        conn.bodyFd = -1;
+    }
+    recycleBuffer(conn.chunkBuffer);
     conn.method.clear();
+    conn.methodId = METHOD_UNKNOWN;
     conn.uri.clear();
     conn.version.clear();
     conn.state = READING_HEADERS;
@@ -192,46 +154,147 @@ void resetClientState(ClientConnection& conn)
     conn.currentChunkSize = 0;
     conn.hasResponse = false;
     conn.keepAlive = false;
-    conn.outBuffer.clear();
+    conn.streamPending = false;
+    recycleBuffer(conn.outBuffer);
     conn.outOffset = 0;
+    conn.proxy = ProxyState();
     conn.cgiRunning = false;
     conn.cgiPid = -1;
     conn.cgiInFd = -1;
     conn.cgiOutFd = -1;
     conn.cgiInOffset = 0;
-    conn.cgiOutBuffer.clear();
+    recycleBuffer(conn.cgiOutBuffer);
+    conn.cacheZone.clear();
+    conn.cacheKey.clear();
+    conn.sessionId.clear();
+    conn.sessionAssigned = false;
+    conn.sessionShouldSetCookie = false;
+    conn.limitReqPassed = false;
+    conn.limitDelayUntil = 0;
+    conn.limitReqCharges.clear();
+    conn.timing = RequestTimings();
+    conn.timing.idleSince = monotonicUs();
+    conn.responseStatus = 0;
+    conn.responseHeadSize = 0;
+    conn.bytesSent = 0;
+    conn.serverLatency = NULL;
+    conn.locationLatency = NULL;
     conn.isReading = false;
 }
 
 
+// First server setting event_backend picks it for the whole loop.
+static std::string eventBackendOf(const std::vector< std::vector<ServerConfig> >& serverGroups)
+{
+    for (size_t i = 0; i < serverGroups.size(); ++i) {
+        for (size_t j = 0; j < serverGroups[i].size(); ++j) {
+            if (!serverGroups[i][j].getEventBackend().empty())
+                return serverGroups[i][j].getEventBackend();
+        }
+    }
+    return "epoll";
+}
+
+
 // Registers every listening socket and prepares host:port groupings.
 epollManager::epollManager(const std::vector<int>& listenFds, const std::vector< std::vector<ServerConfig> >& serverGroups)
-    : _epollFd(-1)
+    : _events(NULL)
     , _running(true)
+    , _config(NULL)
+    , _reloadRequested(0)
+    , _generation(1)
+    , _upgradeRequested(0)
+    , _shutdownRequested(0)
+    , _draining(false)
+    , _drainDeadline(0)
+    , _upgradePid(-1)
+    , _nextRefreshId(-2)
     , _activeCgiCount(0)
+    , _memoryLimit(0)
+    , _memoryUsed(0)
+    , _memoryPeak(0)
+    , _requestsInFlight(0)
+    , _nextAioJob(0)
 {
     _lastCleanup = time(NULL);
-    _epollFd = epoll_create1(0);
-    if (_epollFd == -1)
-        throw std::runtime_error("epoll_create1 failed");
+    _eventBackendKind = eventBackendOf(serverGroups);
+    _events = EventBackend::create(_eventBackendKind);
+    if (!_events)
+        throw std::runtime_error("Failed to create the event backend");
 
     if (listenFds.size() != serverGroups.size()) {
         throw std::runtime_error("listenFds and serverConfigs size mismatch");
     }
 
+    _config = new ConfigSnapshot(_generation);
     for (size_t i = 0; i < listenFds.size(); ++i) {
         int sfd = listenFds[i];
         _listenSockets.insert(sfd);
-        _serverGroups[sfd] = serverGroups[i];
-
-        struct epoll_event event;
-        event.events = EPOLLIN; // monitor read on listening sockets
-        event.data.fd = sfd;
-        if (epoll_ctl(_epollFd, EPOLL_CTL_ADD, sfd, &event) == -1) {
-            close(_epollFd);
+        _config->serverGroups[sfd] = serverGroups[i];
+        std::vector<SSL_CTX*> tls;
+        std::string error;
+        if (!loadTlsContexts(*_config, serverGroups[i], tls, error))
+            throw std::runtime_error(error);
+        if (!tls.empty())
+            _config->listenTls[sfd] = tls;
+        compileListener(sfd);
+
+        if (!_events->add(sfd, EPOLLIN)) { // monitor read on listening sockets
+            delete _events;
+            _events = NULL;
             throw std::runtime_error("Failed to add server socket to epoll");
         }
     }
+    configureSessions();
+    configureUpstreams();
+    configureMemoryLimit();
+    configureAdmission();
+    configureThreadPool();
+}
+
+
+// Compiles the server_name table, access lists, limit zones and log targets of one listen socket.
+void epollManager::compileListener(int listenFd)
+{
+    const std::vector<ServerConfig>& group = _config->serverGroups[listenFd];
+    if (!group.empty())
+        _config->serverNames[listenFd].build(group, listenKey(group[0].getHost(), group[0].getPort()));
+    compileAccessLists(listenFd);
+    compileLimitZones(listenFd);
+    compileLogTargets(listenFd);
+}
+
+
+// Default server of a listen socket in the current configuration, NULL for an unknown socket.
+const ServerConfig* epollManager::defaultServerFor(int listenFd) const
+{
+    std::map<int, std::vector<ServerConfig> >::const_iterator it = _config->serverGroups.find(listenFd);
+    if (it == _config->serverGroups.end() || it->second.empty())
+        return NULL;
+    std::map<int, ServerNameTable>::const_iterator names = _config->serverNames.find(listenFd);
+    return &it->second[names == _config->serverNames.end() ? 0 : names->second.defaultServer()];
+}
+
+
+// Sizes the shared session store when some location has `session on`; the largest session_zone wins.
+// Once sized, the store and its sessions are kept across reloads.
+void epollManager::configureSessions()
+{
+    bool wanted = false;
+    size_t size = 0;
+    time_t idle = 0;
+    for (std::map<int, std::vector<ServerConfig> >::const_iterator it = _config->serverGroups.begin(); it != _config->serverGroups.end(); ++it) {
+        for (size_t i = 0; i < it->second.size(); ++i) {
+            const ServerConfig& server = it->second[i];
+            const std::vector<LocationConfig>& locations = server.getLocations();
+            for (size_t j = 0; j < locations.size(); ++j)
+                wanted = wanted || locations[j].hasSession();
+            size = std::max(size, server.getSessionZoneSize());
+            idle = std::max(idle, server.getSessionIdle());
+        }
+    }
+    if (wanted && !sessionStore().enabled())
+        sessionStore().configure(size ? size : SESSION_ZONE_SIZE, idle, time(NULL));
 }
 
 
@@ -239,21 +302,47 @@ epollManager::epollManager(const std::vector<int>& listenFds, const std::vector<
 epollManager::~epollManager()
 {
     _running = false;
+    stopFileJobs();
     std::vector<int> fds;
     for (std::map<int, ClientConnection>::iterator it = _clientConnections.begin();
         it != _clientConnections.end(); ++it)
         fds.push_back(it->first);
     for (size_t i = 0; i < fds.size(); ++i)
         closeClientSocket(fds[i]);
-    if (_epollFd != -1)
-        close(_epollFd);
+    for (std::map<std::string, UpstreamGroup>::iterator it = _upstreams.begin(); it != _upstreams.end(); ++it)
+        it->second.closeAll();
+    for (std::map<std::string, ResponseCache*>::iterator it = _responseCaches.begin(); it != _responseCaches.end(); ++it)
+        delete it->second;
+    _responseCaches.clear();
+    for (std::map<std::string, LimitZone*>::iterator it = _limitZones.begin(); it != _limitZones.end(); ++it)
+        delete it->second;
+    _limitZones.clear();
+    for (size_t i = 0; i < _replacedZones.size(); ++i)
+        delete _replacedZones[i];
+    _replacedZones.clear();
+    for (std::map<std::string, AccessLog*>::iterator it = _logFiles.begin(); it != _logFiles.end(); ++it)
+        delete it->second;
+    _logFiles.clear();
+    delete _events;
+    _events = NULL;
     _clientConnections.clear();
     _clientBuffers.clear();
     _cgiOutToClient.clear();
     _cgiInToClient.clear();
+    _upstreamToClient.clear();
+    _upstreams.clear();
     _listenSockets.clear();
     _serverForClientFd.clear();
-    _serverGroups.clear();
+    _serverAccess.clear();
+    _locationAccess.clear();
+    for (size_t i = 0; i < _retiredConfigs.size(); ++i)
+        delete _retiredConfigs[i];
+    _retiredConfigs.clear();
+    delete _config;
+    _config = NULL;
+    for (std::map<std::string, Server*>::iterator it = _listeners.begin(); it != _listeners.end(); ++it)
+        delete it->second;
+    _listeners.clear();
     sessionStore().clear();
 }
 
@@ -262,6 +351,32 @@ epollManager::~epollManager()
 void epollManager::requestStop() { _running = false; }
 
 
+// Called from the SIGTERM handler: the first signal drains, a second one stops right away.
+void epollManager::requestShutdown()
+{
+    if (_shutdownRequested)
+        _running = false;
+    _shutdownRequested = 1;
+}
+
+
+// Stops accepting and lets the requests already received finish, up to shutdown_timeout.
+// Connections still waiting in the listen queues are accepted first so they get served.
+void epollManager::gracefulShutdown()
+{
+    if (_draining)
+        return;
+    std::vector<int> listeners(_listenSockets.begin(), _listenSockets.end());
+    for (size_t i = 0; i < listeners.size(); ++i) {
+        while (acceptPendingConnections(listeners[i]))
+            ;
+    }
+    startDrain();
+    INFO("Shutting down: waiting up to " + toString(shutdownTimeout()) + "ms for "
+        + toString(_clientConnections.size()) + " connection(s)");
+}
+
+
 // Closes idle clients, enforces CGI/read timeouts and expires sessions.
 void epollManager::cleanupInactiveConnections() {
     time_t now = time(NULL);
@@ -274,13 +389,14 @@ void epollManager::cleanupInactiveConnections() {
         std::map<int, ClientConnection>::iterator connIt = _clientConnections.find(clientFd);
         if (connIt != _clientConnections.end()) {
             double idleTime = difftime(now, connIt->second.lastActivity);
-            if (idleTime > CONNECTION_TIMEOUT) {
+            if (idleTime > CONNECTION_TIMEOUT && !connIt->second.idleDeadline) {
                 std::map<int, std::string>::iterator next = bufIt;
                 ++next;
                 closeClientSocket(clientFd);
                 removeClientState(clientFd);
                 bufIt = next;
                 closedCount++;
+                _metrics.timeouts[TIMEOUT_IDLE]++;
                 continue;
             }
         }
@@ -298,69 +414,106 @@ void epollManager::cleanupInactiveConnections() {
 		        --_activeCgiCount;
             }
             if (c.cgiInFd != -1) {
-                epoll_ctl(_epollFd, EPOLL_CTL_DEL, c.cgiInFd, NULL);
+                _events->remove(c.cgiInFd);
                 close(c.cgiInFd);
                 _cgiInToClient.erase(c.cgiInFd);
                 c.cgiInFd = -1;
             }
             if (c.cgiOutFd != -1) {
-                epoll_ctl(_epollFd, EPOLL_CTL_DEL, c.cgiOutFd, NULL);
+                _events->remove(c.cgiOutFd);
                 close(c.cgiOutFd);
                 _cgiOutToClient.erase(c.cgiOutFd);
                 c.cgiOutFd = -1;
             }
             c.cgiRunning = false;
             c.keepAlive = false;
+            _metrics.timeouts[TIMEOUT_CGI]++;
+            _admission.sampleCgi(monotonicUs() - c.timing.cgiSpawn);
             queueErrorResponse(c.fd, 504, "Gateway Timeout");
+        } else if (c.proxy.active && !c.proxy.paused && difftime(now, c.proxy.lastActivity) > PROXY_TIMEOUT) {
+            _metrics.timeouts[TIMEOUT_UPSTREAM]++;
+            timeoutUpstream(c);
         } else if ((!c.headersParsed || c.state == READING_BODY) && idle > READ_TIMEOUT) {
             if (!c.hasResponse) {
                 c.keepAlive = false;
+                _metrics.timeouts[TIMEOUT_READ]++;
                 queueErrorResponse(c.fd, 408, "Request Timeout");
             }
         }
         ++it;
     }
+    for (std::map<std::string, UpstreamGroup>::iterator it = _upstreams.begin(); it != _upstreams.end(); ++it)
+        it->second.expireIdle(now, UPSTREAM_IDLE_TIMEOUT);
+    for (std::map<std::string, ResponseCache*>::iterator it = _responseCaches.begin(); it != _responseCaches.end(); ++it)
+        it->second->expire(now);
     removeExpiredSessions(now);
+    releaseRetiredConfigs();
+    flushLogs();
 }
 
 
-// Accepts every pending client connection on the given listening socket.
-void epollManager::acceptPendingConnections(int listenFd)
+// Accepts up to ACCEPT_BATCH pending connections so an accept storm cannot starve the
+// clients already served; the listener is level-triggered and fires again for the rest.
+// Returns true when the batch was full.
+bool epollManager::acceptPendingConnections(int listenFd)
 {
-    struct sockaddr_in clientAddress;
-    socklen_t clientAddrLen = sizeof(clientAddress);
+    struct sockaddr_storage clientAddress;
+    socklen_t clientAddrLen;
     int clientSocket;
     ClientConnection newConn;
 
-    while ((clientSocket = accept(listenFd, (struct sockaddr*)&clientAddress, &clientAddrLen)) != -1)
+    for (int accepted = 0; accepted < ACCEPT_BATCH; ++accepted)
     {
-        if (_clientBuffers.size() >= MAX_CLIENTS) {
-            close(clientSocket);
+        clientAddrLen = sizeof(clientAddress);
+        clientSocket = accept4(listenFd, (struct sockaddr*)&clientAddress, &clientAddrLen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (clientSocket == -1)
+            return false; // EAGAIN once the queue is drained
+        _metrics.accepted++;
+        if (_clientBuffers.size() >= MAX_CLIENTS)
+            reclaimIdleConnection();
+        if (_clientBuffers.size() >= MAX_CLIENTS + ADMISSION_RESERVE) {
+            rejectConnection(clientSocket, listenFd);
             continue;
         }
-        int flags = fcntl(clientSocket, F_GETFL, 0); // to check
-        fcntl(clientSocket, F_SETFL, flags | O_NONBLOCK);
-
-        struct epoll_event event;
-        event.events = EPOLLIN; // EPOLLOUT armed when needed
-        event.data.fd = clientSocket;
-        if (epoll_ctl(_epollFd, EPOLL_CTL_ADD, clientSocket, &event) == -1) {
-            ERROR_SYS("epoll_ctl add client"); close(clientSocket);
+        if (!acceptAllowed(listenFd, (struct sockaddr*)&clientAddress)) {
+            close(clientSocket);
             continue;
         }
+        // a response's last partial segment must not wait for the ACK of the previous one
+        int noDelay = 1;
+        setsockopt(clientSocket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay)); // fails harmlessly on Unix sockets
         newConn.fd = clientSocket;
         newConn.listenFd = listenFd;
         newConn.lastActivity = time(NULL);
         newConn.isReading = false;
-        newConn.remoteAddr = formatIpv4Address(clientAddress.sin_addr);
-        newConn.remotePort = ntohs(clientAddress.sin_port); //to check
+        newConn.reserved = _clientBuffers.size() >= MAX_CLIENTS;
+        formatPeerAddress(clientAddress, newConn.remoteAddr, newConn.remotePort);
+        newConn.timing.idleSince = monotonicUs();
+        if (!acceptWithinLimits(listenFd, newConn)) {
+            close(clientSocket);
+            continue;
+        }
+        if (!attachTls(listenFd, newConn)) {
+            close(clientSocket);
+            releaseLimits(newConn.connLimits);
+            continue;
+        }
+        if (!_events->add(clientSocket, EPOLLIN)) { // EPOLLOUT armed when needed
+            ERROR_SYS("event add client"); close(clientSocket);
+            releaseLimits(newConn.connLimits);
+            if (newConn.tls)
+                SSL_free(newConn.tls);
+            continue;
+        }
         _clientConnections[clientSocket] = newConn;
+        _metrics.handled++;
         _clientBuffers[clientSocket].clear();
-        // Default to first server of the group for this listen fd
-        if (_serverGroups.find(listenFd) != _serverGroups.end() && !_serverGroups[listenFd].empty())
-            _serverForClientFd[clientSocket] = _serverGroups[listenFd][0];
+        // Default server of the group until the Host header is known
+        const ServerConfig* defaultServer = defaultServerFor(listenFd);
+        if (defaultServer)
+            _serverForClientFd[clientSocket] = defaultServer;
     }
-    // EAGAIN acceptable when drained
+    return true;
 }
 
 
@@ -375,11 +528,23 @@ bool epollManager::parseClientHeaders(int clientFd)
     if (!parseRequestLine(sections.requestLine, conn))
         return false;
 
-    parseHeaderBlock(sections.headerBlock, conn);
-    configureBodyStrategy(conn, sections.remainder);
+    conn.headers.parse(conn.buffer.data() + sections.headerStart, sections.headerEnd - sections.headerStart);
+    // picking one of two different Host or Content-Length values invites request smuggling
+    if (conn.headers.conflicting(HEADER_HOST) || conn.headers.conflicting(HEADER_CONTENT_LENGTH)) {
+        conn.headersParsed = true;
+        conn.keepAlive = false;
+        refuseRequest(clientFd, 400, "Bad Request", 0);
+        return false;
+    }
+    selectVirtualServer(clientFd);
+    configureBodyStrategy(conn, sections.bodyStart);
 
     conn.headersParsed = true;
+    conn.timing.headersDone = monotonicUs();
+    _metrics.requests++;
     applyKeepAlivePolicy(conn);
+    if (!keepAliveAllowed(conn))
+        conn.keepAlive = false;
     conn.state = (conn.bodyType == BODY_NONE) ? READY : READING_BODY;
     return true;
 }
@@ -394,8 +559,10 @@ bool epollManager::consumeFixedBody(int clientFd)
         return true;
     }
     if (!conn.buffer.empty()) {
-        conn.body.append(conn.buffer);
-        conn.bodyReceived = conn.body.size();
+        if (!appendRequestBody(conn, conn.buffer.data(), conn.buffer.size())) {
+            refuseRequest(clientFd, 500, "Internal Server Error", 0);
+            return false;
+        }
         conn.buffer.clear();
     }
     if (conn.bodyReceived >= conn.contentLength) {
@@ -432,10 +599,16 @@ bool epollManager::consumeChunkedBody(int clientFd)
                 c.chunkState = CHUNK_READ_DATA;
         }
         if (c.chunkState == CHUNK_READ_DATA) {
-            if (c.chunkBuffer.size() < c.currentChunkSize)
+            // chunk data is moved out as it arrives, so a large chunk is never held twice
+            size_t take = std::min(c.chunkBuffer.size(), c.currentChunkSize);
+            if (!appendRequestBody(c, c.chunkBuffer.data(), take)) {
+                refuseRequest(clientFd, 500, "Internal Server Error", 0);
+                return false;
+            }
+            c.chunkBuffer.erase(0, take);
+            c.currentChunkSize -= take;
+            if (c.currentChunkSize > 0)
                 return false;
-            c.body.append(c.chunkBuffer.substr(0, c.currentChunkSize));
-            c.chunkBuffer.erase(0, c.currentChunkSize);
             c.chunkState = CHUNK_READ_CRLF;
         }
         if (c.chunkState == CHUNK_READ_CRLF) {
@@ -460,29 +633,121 @@ bool epollManager::consumeChunkedBody(int clientFd)
 }
 
 
+// Picks the server block of the listen group whose server_name matches the Host header.
+void epollManager::selectVirtualServer(int clientFd)
+{
+    ClientConnection &conn = _clientConnections[clientFd];
+    std::map<int, std::vector<ServerConfig> >::iterator group = _config->serverGroups.find(conn.listenFd);
+    if (group == _config->serverGroups.end() || group->second.empty())
+        return;
+    HeaderView host;
+    const ServerNameTable& names = _config->serverNames[conn.listenFd];
+    int index = conn.headers.find(HEADER_HOST, host) ? names.lookup(host.str()) : names.defaultServer();
+    _serverForClientFd[clientFd] = &group->second[index];
+}
+
+
+// Compiles a rule set once; servers and locations with identical rules share the result.
+const AccessList* epollManager::compileAccessList(const std::vector<AccessRule>& rules)
+{
+    if (rules.empty())
+        return NULL;
+    std::string signature;
+    for (size_t i = 0; i < rules.size(); ++i)
+        signature += std::string(rules[i].allow ? "+" : "-") + (rules[i].isFile ? "@" : "") + rules[i].source + "\n";
+    std::map<std::string, AccessList*>::iterator it = _config->accessLists.find(signature);
+    if (it != _config->accessLists.end())
+        return it->second;
+    AccessList* list = new AccessList();
+    list->compile(rules);
+    _config->accessLists[signature] = list;
+    return list;
+}
+
+
+// Prepares the allow/deny lists of every server and location reachable through a listen socket.
+void epollManager::compileAccessLists(int listenFd)
+{
+    const std::vector<ServerConfig>& group = _config->serverGroups[listenFd];
+    std::vector<const AccessList*>& atAccept = _config->listenAccess[listenFd];
+    bool everyServerFiltered = true;
+    for (size_t i = 0; i < group.size(); ++i) {
+        const AccessList* serverList = compileAccessList(group[i].getAccessRules());
+        if (serverList) {
+            _serverAccess[&group[i]] = serverList;
+            atAccept.push_back(serverList);
+        } else
+            everyServerFiltered = false;
+        const std::vector<LocationConfig>& locations = group[i].getLocations();
+        for (size_t j = 0; j < locations.size(); ++j) {
+            const AccessList* locationList = compileAccessList(locations[j].getAccessRules());
+            if (locationList)
+                _locationAccess[&locations[j]] = locationList;
+        }
+    }
+    // a peer can only be dropped before the Host header is known if no virtual server would take it
+    if (!everyServerFiltered)
+        atAccept.clear();
+}
+
+
+bool epollManager::acceptAllowed(int listenFd, const struct sockaddr* addr) const
+{
+    std::map<int, std::vector<const AccessList*> >::const_iterator it = _config->listenAccess.find(listenFd);
+    if (it == _config->listenAccess.end() || it->second.empty())
+        return true;
+    for (size_t i = 0; i < it->second.size(); ++i) {
+        if (it->second[i]->allows(addr))
+            return true;
+    }
+    return false;
+}
+
+
+// Location rules replace the server rules when present, as in nginx.
+bool epollManager::requestAllowed(const ClientConnection& conn, const ServerConfig& config, const LocationConfig* location) const
+{
+    if (location) {
+        std::map<const LocationConfig*, const AccessList*>::const_iterator lit = _locationAccess.find(location);
+        if (lit != _locationAccess.end())
+            return lit->second->allows(conn.remoteAddr);
+    }
+    std::map<const ServerConfig*, const AccessList*>::const_iterator sit = _serverAccess.find(&config);
+    return sit == _serverAccess.end() || sit->second->allows(conn.remoteAddr);
+}
+
+
 // Aggregates incoming data and reports when a full HTTP request is ready.
 bool epollManager::collectClientRequest(int clientFd) 
 {
     ClientConnection &conn = _clientConnections[clientFd];
-    const ServerConfig& cfg = _serverForClientFd[clientFd];
+    const ServerConfig& cfg = *_serverForClientFd[clientFd];
     const LocationConfig* location = findLocationConfig(conn.uri.empty() ? "/" : conn.uri, cfg);
     size_t maxBody = getEffectiveClientMax(location, cfg);
 
     // Enforce max body size early, as data is being received.
-    if (maxBody > 0 && (conn.body.size() + conn.buffer.size() + conn.chunkBuffer.size()) > maxBody) {
+    if (maxBody > 0 && (conn.bodyReceived + conn.buffer.size() + conn.chunkBuffer.size()) > maxBody) {
         queueErrorResponse(clientFd, 413, "Request Entity Too Large");
         return false; // Stop processing
     }
 
-    if (!conn.headersParsed && !parseClientHeaders(clientFd))
+    bool fresh = !conn.headersParsed;
+    if (fresh && !parseClientHeaders(clientFd))
         return false;
 
     if (conn.state == READING_BODY) {
+        // body bytes that came with the headers stay in memory until admitRequestBody() decides
+        if (!fresh && conn.bodyFd == -1 && memoryPressure() && !spillRequestBody(conn)) {
+            refuseRequest(clientFd, 500, "Internal Server Error", 0);
+            return false;
+        }
         if (conn.bodyType == BODY_FIXED)
             consumeFixedBody(clientFd);
         else if (conn.bodyType == BODY_CHUNKED)
             consumeChunkedBody(clientFd);
     }
+    if (fresh && !admitRequestBody(clientFd))
+        return false;
     /* if (conn.cgiRunning)
         return false; */
     return (conn.state == READY);
@@ -493,36 +758,68 @@ bool epollManager::collectClientRequest(int clientFd)
 void epollManager::handleReadyRequest(int clientFd)
 {
     ClientConnection &conn = _clientConnections[clientFd];
+    if (!conn.timing.bodyDone)
+        conn.timing.bodyDone = monotonicUs();
     try 
     {
-        std::string raw = buildRawHttpRequest(conn);
-        Request request(raw);
+        const ServerConfig& cfg = *_serverForClientFd[clientFd];
+        const LocationConfig* location = findLocationConfig(conn.uri, cfg);
+        if (memoryExhausted() && requestPriority(location) != PRIORITY_CRITICAL) {
+            // parked with its reads stopped until resumeMemoryPaused(); status pages still answer
+            pauseForMemory(clientFd, clientFd);
+            return;
+        }
+        Request request(conn.method, conn.uri, conn.version, conn.headers, conn.body);
+        // CGI, proxy_pass and uploads all read a spilled body from its file
+        if (conn.bodyFd != -1)
+            request.setBodyFile(conn.bodyFd, conn.bodyReceived);
         if (request.isComplete()) {
             LOG("Request " + request.getMethod() + " " + request.getUri() + " fd=" + toString(clientFd));
-            const ServerConfig& cfg = _serverForClientFd[clientFd];
-            const LocationConfig* location = findLocationConfig(conn.uri, cfg);
-            ensureConnectionSession(conn, request);
+            conn.serverLatency = _metrics.serverHistogram(&cfg, cfg.getServerName());
+            conn.locationLatency = location ? _metrics.locationHistogram(location, cfg.getServerName(), location->getPath()) : NULL;
+            if (location && location->hasSession())
+                ensureConnectionSession(conn);
             bool wantsCgi = (location && location->isCgiRequest(conn.uri));
-            if (wantsCgi) 
+            if (location && location->isInternal())
+            {
+                // served only as the target of a CGI X-Accel-Redirect / X-Sendfile
+                queueErrorResponse(clientFd, 404, "Not Found");
+            }
+            else if (!requestAllowed(conn, cfg, location))
             {
-                if (!startCgiFor(clientFd, request, cfg, location))
+                LOG("Access denied for " + conn.remoteAddr + " to " + conn.uri);
+                queueErrorResponse(clientFd, 403, "Forbidden");
+            }
+            else if (!admitRequest(clientFd, cfg, location))
+            {
+                // rejected with 503, or parked until resumeDelayedRequests()
+            }
+            else if (location && location->hasProxyPass())
+            {
+                if (!isMethodAllowed(conn.methodId, conn.uri, cfg))
+                    queueErrorResponse(clientFd, 405, "Method Not Allowed");
+                else if (!startProxyFor(clientFd, location))
+                    queueErrorResponse(clientFd, 502, "Bad Gateway");
+            }
+            else if (wantsCgi) 
+            {
+                // startCgiFor() answers its own refusals (404, 503)
+                if (!serveFromCache(clientFd, request, cfg, location) && !startCgiFor(clientFd, request, cfg, location)
+                    && !conn.hasResponse)
                     queueErrorResponse(clientFd, 502, "Bad Gateway");
             } 
+            else if (startFileJob(clientFd, request, cfg, location))
+            {
+                // completeFileJobs() queues the response built on the thread pool
+            }
+            else if (startAutoindexStream(clientFd, request, cfg, location))
+            {
+                // chunks are appended by continueListingStream() as the client drains them
+            }
             else 
             {
                 Response response = buildResponseForRequest(request, cfg);
-                if (conn.keepAlive) 
-                {
-                    response.setHeader("Connection", "keep-alive");
-                    response.setHeader("Keep-Alive", "timeout=5, max=100");
-                } 
-                else 
-                    response.setHeader("Connection", "close");
-                attachSessionCookie(response, conn);
-                std::string responseStr = response.getResponse();
-                std::string statusLine = responseStr.substr(0, responseStr.find("\r\n"));
-                LOG("Response " + statusLine + " fd=" + toString(clientFd));
-                conn.outBuffer = responseStr; conn.outOffset = 0; conn.hasResponse = true; updateClientInterest(clientFd, true);
+                queueBuiltResponse(clientFd, response);
             }
             
         } 
@@ -539,6 +836,25 @@ void epollManager::handleReadyRequest(int clientFd)
 }
 
 
+// Adds the connection headers and the session cookie, then queues a response for writing.
+void epollManager::queueBuiltResponse(int clientFd, Response& response)
+{
+    ClientConnection& conn = _clientConnections[clientFd];
+    if (conn.keepAlive) 
+    {
+        response.setHeader("Connection", "keep-alive");
+        response.setHeader("Keep-Alive", keepAliveHeader(conn));
+    } 
+    else 
+        response.setHeader("Connection", "close");
+    attachSessionCookie(response, conn);
+    std::string responseStr = response.getResponse();
+    std::string statusLine = responseStr.substr(0, responseStr.find("\r\n"));
+    LOG("Response " + statusLine + " fd=" + toString(clientFd));
+    conn.outBuffer = responseStr; conn.outOffset = 0; conn.hasResponse = true; updateClientInterest(clientFd, true);
+}
+
+
 // Finds the most specific matching location block for a given URI.
 const LocationConfig* epollManager::findLocationConfig(const std::string& uri, const ServerConfig& config) const
 {
@@ -724,15 +1040,10 @@ void epollManager::buildErrorResponse(Response& response, int code, const std::s
 
 
 // Checks whether the HTTP method is permitted for the requested resource.
-bool epollManager::isMethodAllowed(const std::string& method, const std::string& uri, const ServerConfig& config) const
+bool epollManager::isMethodAllowed(MethodId method, const std::string& uri, const ServerConfig& config) const
 {
     const LocationConfig* location = findLocationConfig(uri, config);
-    if (location) {
-        const std::vector<std::string>& allowedMethods = location->getAllowedMethods();
-        if (!allowedMethods.empty())
-            return std::find(allowedMethods.begin(), allowedMethods.end(), method) != allowedMethods.end();
-    }
-    return true;
+    return !location || location->allowsMethod(method);
 }
 
 
@@ -802,8 +1113,19 @@ static std::string sanitizeFilename(const std::string& name)
 }
 
 
-// Parses a multipart/form-data payload and persists uploaded files.
-bool epollManager::parseMultipartAndSave(const std::string& body, const std::string& boundary,
+// First occurrence of needle in body[from, size), npos when there is none.
+static size_t findInBody(const char* body, size_t size, size_t from, const std::string& needle)
+{
+    if (from > size)
+        return std::string::npos;
+    const void* hit = memmem(body + from, size - from, needle.data(), needle.size());
+    return hit ? static_cast<size_t>(static_cast<const char*>(hit) - body) : std::string::npos;
+}
+
+
+// Parses a multipart/form-data payload and persists uploaded files. body may be a mapping
+// of the spilled body file, so parts are written from it without being copied.
+bool epollManager::parseMultipartAndSave(const char* body, size_t size, const std::string& boundary,
                                          const std::string& basePath, const std::string& uri,
                                          size_t& savedCount, bool& anyCreated, std::string& lastSavedPath)
 {
@@ -813,23 +1135,23 @@ bool epollManager::parseMultipartAndSave(const std::string& body, const std::str
     if (boundary.empty())
         return false;
     std::string sep = std::string("--") + boundary; size_t pos = 0;
-    size_t start = body.find(sep, pos);
+    size_t start = findInBody(body, size, pos, sep);
     if (start == std::string::npos)
         return false;
     pos = start + sep.size();
     while (true)
     {
-        if (pos + 2 > body.size())
+        if (pos + 2 > size)
             break;
-        if (body.substr(pos, 2) == "--")
+        if (memcmp(body + pos, "--", 2) == 0)
             break;
-        if (body.substr(pos, 2) != "\r\n")
+        if (memcmp(body + pos, "\r\n", 2) != 0)
             return false;
         pos += 2;
-        size_t hdrEnd = body.find("\r\n\r\n", pos);
+        size_t hdrEnd = findInBody(body, size, pos, "\r\n\r\n");
         if (hdrEnd == std::string::npos)
             return false;
-        std::string headers = body.substr(pos, hdrEnd - pos);
+        std::string headers(body + pos, hdrEnd - pos);
         pos = hdrEnd + 4;
         std::string filename;
         size_t cd = headers.find("Content-Disposition:");
@@ -842,10 +1164,11 @@ bool epollManager::parseMultipartAndSave(const std::string& body, const std::str
                     filename = headers.substr(startq+1, endq-startq-1);
                 }
         }
-        size_t next = body.find(sep, pos);
+        size_t next = findInBody(body, size, pos, sep);
         if (next == std::string::npos)
             return false;
-        std::string content = body.substr(pos, next - pos - 2);
+        const char* content = body + pos;
+        size_t contentLength = next >= pos + 2 ? next - pos - 2 : 0;
         pos = next + sep.size();
         std::string dest = basePath;
         bool isDir = isDirectory(basePath) || (!uri.empty() && uri[uri.size()-1]=='/');
@@ -858,7 +1181,7 @@ bool epollManager::parseMultipartAndSave(const std::string& body, const std::str
         bool existed = fileExists(dest); std::ofstream ofs(dest.c_str(), std::ios::binary);
         if (!ofs.is_open())
             return false;
-        ofs.write(content.c_str(), content.size());
+        ofs.write(content, contentLength);
         ofs.close();
         savedCount += 1;
         anyCreated = anyCreated || (!existed); lastSavedPath = dest;
@@ -867,6 +1190,39 @@ bool epollManager::parseMultipartAndSave(const std::string& body, const std::str
 }
 
 
+// Bytes of a request body: the in-memory string, or a read-only mapping of the file the body
+// spilled to under memory pressure, so an upload is written out without coming back onto the heap.
+// data is NULL when the file cannot be mapped.
+struct RequestBody {
+    const char* data;
+    size_t      size;
+    void*       map;
+
+    RequestBody(const Request& request) : data(request.getBody().data()), size(request.getBodySize()), map(NULL)
+    {
+        if (request.getBodyFd() == -1 || size == 0)
+            return;
+        map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, request.getBodyFd(), 0);
+        if (map == MAP_FAILED) {
+            ERROR_SYS("mmap spilled request body");
+            map = NULL;
+            data = NULL;
+            return;
+        }
+        data = static_cast<const char*>(map);
+    }
+    ~RequestBody()
+    {
+        if (map)
+            munmap(map, size);
+    }
+
+private:
+    RequestBody(const RequestBody&);
+    RequestBody& operator=(const RequestBody&);
+};
+
+
 // Handles non-CGI POST requests such as form submissions and uploads.
 Response epollManager::handlePost(const Request& request, const LocationConfig* location, const ServerConfig& config) 
 {
@@ -888,10 +1244,16 @@ Response epollManager::handlePost(const Request& request, const LocationConfig*
         return response;
     }
     size_t maxBody = getEffectiveClientMax(location, config);
-    if (maxBody > 0 && request.getBody().size() > maxBody) {
+    if (maxBody > 0 && request.getBodySize() > maxBody) {
         buildErrorResponse(response, 413, "Request Entity Too Large", &config);
         return response;
     }
+    RequestBody body(request);
+    if (!body.data) {
+        buildErrorResponse(response, 503, "Service Unavailable", &config);
+        response.setHeader("Retry-After", toString(MEMORY_RETRY_AFTER));
+        return response;
+    }
     std::string ct = request.getHeader("Content-Type");
     std::string ctl = ct;
     for (size_t i=0;i<ctl.size();++i)
@@ -920,7 +1282,7 @@ Response epollManager::handlePost(const Request& request, const LocationConfig*
         size_t savedCount = 0;
         bool anyCreated = false;
         std::string lastPath;
-        if (!parseMultipartAndSave(request.getBody(), boundary, basePath, uri, savedCount, anyCreated, lastPath)) {
+        if (!parseMultipartAndSave(body.data, body.size, boundary, basePath, uri, savedCount, anyCreated, lastPath)) {
             buildErrorResponse(response, 400, "Bad Request", &config);
             return response;
         }
@@ -942,8 +1304,7 @@ Response epollManager::handlePost(const Request& request, const LocationConfig*
         buildErrorResponse(response, 403, "Forbidden", &config);
         return response;
     }
-    const std::string& data = request.getBody();
-    ofs.write(data.c_str(), data.size());
+    ofs.write(body.data, body.size);
     ofs.close();
     response.setStatus(existed?200:201, existed?"OK":"Created");
     response.setHeader("Content-Type","text/html");
@@ -952,12 +1313,11 @@ Response epollManager::handlePost(const Request& request, const LocationConfig*
 }
 
 
-// Ensures POST requests supply either a Content-Length, a Transfer-Encoding or an inline body.
+// Ensures POST requests come with a body; the Content-Length or chunked framing was already
+// consumed while reading it, so one announcing zero bytes is refused as well.
 bool epollManager::validatePostLengthHeader(const Request& request, Response& response, const ServerConfig& config) const 
 {
-    std::string contentLength = request.getHeader("Content-Length");
-    std::string transferEncoding = request.getHeader("Transfer-Encoding");
-    if (contentLength.empty() && transferEncoding.empty() && request.getBody().empty()) {
+    if (request.getBodySize() == 0) {
         buildErrorResponse(response, 411, "Length Required", &config);
         return false;
     }
@@ -968,7 +1328,7 @@ bool epollManager::validatePostLengthHeader(const Request& request, Response& re
 bool epollManager::validatePostBodySize(const Request& request, const LocationConfig* location, const ServerConfig& config, Response& response) const 
 {
     size_t effectiveMax = getEffectiveClientMax(location, config);
-    if (effectiveMax > 0 && request.getBody().length() > effectiveMax) {
+    if (effectiveMax > 0 && request.getBodySize() > effectiveMax) {
         buildErrorResponse(response, 413, "Request Entity Too Large", &config);
         return false;
     }
@@ -1021,9 +1381,8 @@ bool epollManager::tryServeResourceFromFilesystem(const std::string& uri, const
     }
     if (isDirectory(filePath)) {
         if (location && location->getAutoindex()) {
-            response.setStatus(200, "OK");
-            response.setHeader("Content-Type", "text/html");
-            response.setBody(generateDirectoryListing(filePath, uri));
+            if (!renderDirectoryListing(filePath, uri, location, response))
+                buildErrorResponse(response, 404, "Not Found", &config);
             return true;
         }
         std::string indexConf = (location && !location->getIndex().empty()) ? location->getIndex() : config.getIndex();
@@ -1050,11 +1409,11 @@ bool epollManager::tryServeResourceFromFilesystem(const std::string& uri, const
 }
 
 // Adds the standard headers expected on every locally generated response and trims HEAD bodies.
-void epollManager::addStandardHeaders(Response& response, const std::string& method) const 
+void epollManager::addStandardHeaders(Response& response, MethodId method) const 
 {
     response.setHeader("Server", "webserv");
     response.setHeader("Date", getCurrentDate());
-    if (method == "HEAD") {
+    if (method == METHOD_HEAD) {
         size_t len = response.getBodyLength();
         response.setHeader("Content-Length", toString(len));
         response.setBody("");
@@ -1071,7 +1430,7 @@ Response epollManager::buildResponseForRequest(const Request& request, const Ser
         return response;
     }
 
-    const std::string method = request.getMethod();
+    const MethodId method = request.getMethodId();
     const std::string uri = request.getUri();
     const LocationConfig* location = findLocationConfig(uri, config);
 
@@ -1081,7 +1440,7 @@ Response epollManager::buildResponseForRequest(const Request& request, const Ser
         return response;
     }
 
-    if (method == "POST" && !validatePostLengthHeader(request, response, config))
+    if (method == METHOD_POST && !validatePostLengthHeader(request, response, config))
         return response;
 
     if (handleConfiguredRedirect(location, response, config)) {
@@ -1089,15 +1448,21 @@ Response epollManager::buildResponseForRequest(const Request& request, const Ser
         return response;
     }
 
-    if (method == "DELETE")
+    if (location && location->getStatusHandler() != STATUS_NONE) {
+        buildStatusResponse(response, location->getStatusHandler());
+        addStandardHeaders(response, method);
+        return response;
+    }
+
+    if (method == METHOD_DELETE)
         return handleDelete(request, location, config);
 
-    if (method == "POST" && (!location || !location->isCgiRequest(uri))) {
+    if (method == METHOD_POST && (!location || !location->isCgiRequest(uri))) {
         Response postResponse = handlePost(request, location, config);
         return postResponse;
     }
 
-    if (method == "POST" && !validatePostBodySize(request, location, config, response))
+    if (method == METHOD_POST && !validatePostBodySize(request, location, config, response))
         return response;
 
     if (tryServeRootIndex(uri, location, config, response)) {
@@ -1137,21 +1502,43 @@ void epollManager::readClientData(int clientFd, uint32_t events)
         }
     }
     ClientConnection &conn = _clientConnections[clientFd];
+    if (conn.lingerUntil) {
+        drainLingering(clientFd);
+        return;
+    }
    if (_activeCgiCount > MAX_CGI_PROCESS) {
         conn.keepAlive = false;
         queueErrorResponse(clientFd, 503, "Too many CGI requests");
         return;
     }
-    if (conn.cgiRunning || conn.cgiPid > 0) {
+    if (conn.cgiRunning || conn.cgiPid > 0 || conn.proxy.active || conn.limitDelayUntil || conn.aioJob) {
+        return;
+    }
+    if (memoryExhausted() && (conn.state == READY || conn.buffer.size() >= BUFFER_KEEP_SIZE)) {
+        // request heads are still read (a complete one is parked by handleReadyRequest), bodies go to their spill file
+        pauseForMemory(clientFd, clientFd);
         return;
     }
     conn.isReading = true; conn.lastActivity = time(NULL);
-    char buffer[BUFFER_SIZE];
-    ssize_t bytesRead = recv(clientFd, buffer, BUFFER_SIZE, 0);
+    if (conn.tls && !conn.tlsReady && !continueTlsHandshake(clientFd))
+        return;
+    char buffer[TLS_RECORD_SIZE];
+    ssize_t bytesRead = conn.tls ? tlsRecv(conn.tls, buffer, sizeof(buffer)) : recv(clientFd, buffer, BUFFER_SIZE, 0);
+    if (bytesRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return; // TLS record not complete yet
     conn.keepAlive = false;
     if (bytesRead > 0) {
+        _metrics.bytesIn += static_cast<unsigned long long>(bytesRead);
+        unwatchIdle(conn); // the next request started
+        if (conn.buffer.empty() && !conn.headersParsed)
+            conn.timing.firstByte = monotonicUs();
         conn.buffer.append(buffer, bytesRead);
-        if (conn.buffer.size() + conn.body.size() > MAX_REQUEST_SIZE) {
+        // plaintext OpenSSL already decrypted is invisible to epoll: take it now
+        while (conn.tls && SSL_pending(conn.tls) > 0 && (bytesRead = tlsRecv(conn.tls, buffer, sizeof(buffer))) > 0) {
+            _metrics.bytesIn += static_cast<unsigned long long>(bytesRead);
+            conn.buffer.append(buffer, bytesRead);
+        }
+        if (conn.buffer.size() + conn.bodyReceived > MAX_REQUEST_SIZE) {
             conn.keepAlive = false;
             queueErrorResponse(clientFd, 413, "Request Entity Too Large"); return; }
         if (!collectClientRequest(clientFd)) { return; }
@@ -1172,38 +1559,56 @@ void epollManager::flushClientBuffer(int clientFd, uint32_t events)
     if (it == _clientConnections.end()) return;
 
     ClientConnection &conn = it->second;
+    if (conn.tls && !conn.tlsReady) {
+        continueTlsHandshake(clientFd);
+        return;
+    }
     if (!conn.hasResponse) return;
 
     size_t remaining = conn.outBuffer.size() - conn.outOffset;
+    if (remaining == 0 && conn.streamPending)
+    {
+        // producer (upstream) still running: wait until it appends more bytes
+        updateClientInterest(clientFd, false);
+        resumeStreamingSource(clientFd);
+        return;
+    }
     if (remaining == 0) 
     {
         updateClientInterest(clientFd, false);
-        if (conn.keepAlive) {
-            resetClientState(conn);
-            conn.lastActivity = time(NULL);
-        } else {
-            closeClientSocket(clientFd);
-            removeClientState(clientFd);
-        }
+        finishResponse(clientFd);
         return;
     }
 
-    size_t toSend = remaining > BUFFER_SIZE ? BUFFER_SIZE : remaining;
-    ssize_t n = send(clientFd, conn.outBuffer.data() + conn.outOffset, toSend, 0);
+    // a TLS write is one record: full-size records keep the framing overhead low
+    size_t chunk = conn.tls ? TLS_RECORD_SIZE : BUFFER_SIZE;
+    size_t toSend = remaining > chunk ? chunk : remaining;
+    ssize_t n = conn.tls ? tlsSend(conn.tls, conn.outBuffer.data() + conn.outOffset, toSend)
+                         : send(clientFd, conn.outBuffer.data() + conn.outOffset, toSend, 0);
+    if (n < 0 && conn.tls && errno == EAGAIN)
+        return; // retried with the same bytes on the next EPOLLOUT
 
     if (n > 0) 
     {
+        if (!conn.timing.firstSent) {
+            conn.timing.firstSent = monotonicUs();
+            if (conn.outOffset == 0 && conn.outBuffer.compare(0, 5, "HTTP/") == 0) {
+                conn.responseStatus = std::atoi(conn.outBuffer.c_str() + 9);
+                size_t headEnd = conn.outBuffer.find("\r\n\r\n");
+                conn.responseHeadSize = (headEnd == std::string::npos) ? 0 : headEnd + 4;
+            }
+        }
+        conn.bytesSent += static_cast<size_t>(n);
+        _metrics.bytesOut += static_cast<unsigned long long>(n);
         conn.outOffset += static_cast<size_t>(n);
+        if (conn.streamPending) {
+            resumeStreamingSource(clientFd);
+            return;
+        }
         if (conn.outOffset >= conn.outBuffer.size()) {
             LOG("Response sent to client " + toString(clientFd));
             updateClientInterest(clientFd, false); // cut the writing
-            if (conn.keepAlive) {
-            resetClientState(conn);
-                conn.lastActivity = time(NULL);
-            } else {
-                closeClientSocket(clientFd);
-                removeClientState(clientFd);
-            }
+            finishResponse(clientFd);
         }
         return;
     }
@@ -1216,19 +1621,23 @@ void epollManager::flushClientBuffer(int clientFd, uint32_t events)
 
 
 // Schedules an error response to be written back to the client.
-void epollManager::queueErrorResponse(int clientFd, int code, const std::string& message) 
+void epollManager::queueErrorResponse(int clientFd, int code, const std::string& message, int retryAfter) 
 {
     ClientConnection &conn = _clientConnections[clientFd];
     conn.keepAlive = false;
+    if ((conn.backgroundRefresh || (!conn.cacheKey.empty() && code >= 500)) && serveStaleOnError(clientFd))
+        return;
     Response response;
 
     const ServerConfig* cfgPtr = NULL;
-    std::map<int, ServerConfig>::iterator sit = _serverForClientFd.find(clientFd);
+    std::map<int, const ServerConfig*>::iterator sit = _serverForClientFd.find(clientFd);
     if (sit != _serverForClientFd.end())
-        cfgPtr = &sit->second;
+        cfgPtr = sit->second;
 
     buildErrorResponse(response, code, message, cfgPtr);
     response.setHeader("Connection", "close");
+    if (retryAfter > 0)
+        response.setHeader("Retry-After", toString(retryAfter));
     attachSessionCookie(response, conn);
     std::string responseStr = response.getResponse();
     std::string statusLine = responseStr.substr(0, responseStr.find("\r\n"));
@@ -1245,6 +1654,11 @@ void epollManager::reapZombies()
 
     while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
     {
+        if (pid == _upgradePid) {
+            ERROR("Upgraded process " + toString(pid) + " exited while this one was draining");
+            _upgradePid = -1;
+            continue;
+        }
         if (_activeCgiCount > 0)
             _activeCgiCount--;
 
@@ -1274,7 +1688,29 @@ void epollManager::run()
     struct epoll_event events[MAX_EVENTS];
     while (_running)
     {
-        int num = epoll_wait(_epollFd, events, MAX_EVENTS, 1000);
+        if (_reloadRequested) {
+            _reloadRequested = 0;
+            reloadConfiguration();
+        }
+        if (_upgradeRequested) {
+            _upgradeRequested = 0;
+            upgradeBinary();
+        }
+        if (_shutdownRequested && !_draining)
+            gracefulShutdown();
+        if (_draining && _clientConnections.empty()) {
+            LOG("Drained every connection, exiting");
+            break;
+        }
+        if (_draining && monotonicUs() / 1000 >= _drainDeadline) {
+            ERROR("Shutdown timeout reached, closing " + toString(_clientConnections.size()) + " connection(s)");
+            break;
+        }
+        if (!_memoryPaused.empty() && !memoryPressure())
+            resumeMemoryPaused();
+        updateAdmission();
+        int num = _events->wait(events, MAX_EVENTS, nextTimerTimeout());
+        long long busyStart = monotonicUs();
         if (num < 0) {
             if (errno == EINTR) {
                 cleanupInactiveConnections();
@@ -1282,32 +1718,61 @@ void epollManager::run()
                     break;
                 continue;
             }
-            ERROR_SYS("epoll_wait");
+            ERROR_SYS("event wait");
             cleanupInactiveConnections();
             continue;
         }
         if (num == 0) {
             cleanupInactiveConnections();
+            resumeDelayedRequests();
+            expireIdleConnections();
+            _admission.sampleLoop(monotonicUs() - busyStart);
             continue;
         }
         cleanupInactiveConnections();
         for (int i = 0; i < num; ++i)
         {
             int fd = events[i].data.fd;
-            if (_listenSockets.find(fd) != _listenSockets.end())
+            int owner = fd; // client whose buffers the event may have grown or freed
+            std::map<int, int>::iterator source;
+            if (_listenSockets.find(fd) != _listenSockets.end()) {
                 acceptPendingConnections(fd);
-            else if (_cgiOutToClient.find(fd) != _cgiOutToClient.end())
+                continue;
+            }
+            if (fd == _aioPool.eventFd()) {
+                completeFileJobs();
+                continue;
+            }
+            if ((source = _cgiOutToClient.find(fd)) != _cgiOutToClient.end()) {
+                owner = source->second;
                 drainCgiOutput(fd, events[i].events);
-            else if (_cgiInToClient.find(fd) != _cgiInToClient.end())
+            }
+            else if ((source = _cgiInToClient.find(fd)) != _cgiInToClient.end()) {
+                owner = source->second;
                 feedCgiInput(fd, events[i].events);
+            }
+            else if ((source = _upstreamToClient.find(fd)) != _upstreamToClient.end()) {
+                owner = source->second;
+                handleUpstreamEvent(fd, events[i].events);
+            }
             else {
                 if (events[i].events & EPOLLIN)
                     readClientData(fd, events[i].events);
                 if (events[i].events & EPOLLOUT)
                     flushClientBuffer(fd, events[i].events);
+                if (!(events[i].events & (EPOLLIN | EPOLLOUT))) {
+                    // error/hangup on a socket without interest (parked by limit_req)
+                    closeClientSocket(fd);
+                    removeClientState(fd);
+                }
             }
+            accountMemory(owner);
         }
+        resumeDelayedRequests();
+        expireIdleConnections();
         reapZombies();
+        purgeFinishedRefreshes();
+        _admission.sampleLoop(monotonicUs() - busyStart);
     }
 }
 
@@ -1315,19 +1780,17 @@ void epollManager::run()
 // Updates epoll interest for a client socket, optionally enabling EPOLLOUT.
 void epollManager::updateClientInterest(int clientFd, bool enable)
 {
-    struct epoll_event ev; 
-    ev.data.fd = clientFd; 
-    ev.events = EPOLLIN;
-    if (enable)
-        ev.events |= EPOLLOUT;
-    if (epoll_ctl(_epollFd, EPOLL_CTL_MOD, clientFd, &ev) == -1)
-        ERROR_SYS("epoll_ctl mod client");
+    if (!_events->modify(clientFd, enable ? EPOLLIN | EPOLLOUT : EPOLLIN))
+        ERROR_SYS("event mod client");
 }
 
 
 // Removes all bookkeeping for a client after the socket is closed.
 void epollManager::removeClientState(int clientFd)
 {
+    std::map<int, ClientConnection>::iterator it = _clientConnections.find(clientFd);
+    if (it != _clientConnections.end())
+        releaseMemory(it->second);
     _clientBuffers.erase(clientFd);
     _clientConnections.erase(clientFd);
     _serverForClientFd.erase(clientFd);
@@ -1351,37 +1814,47 @@ void epollManager::closeClientSocket(int clientFd)
                     --_activeCgiCount;
             }
             if (c.cgiInFd != -1) {
-                if (_epollFd != -1)
-                    epoll_ctl(_epollFd, EPOLL_CTL_DEL, c.cgiInFd, NULL);
+                if (_events)
+                    _events->remove(c.cgiInFd);
                 close(c.cgiInFd);
                 _cgiInToClient.erase(c.cgiInFd);
                 c.cgiInFd = -1;
                 c.cgiRunning = false;
             }
             if (c.cgiOutFd != -1) {
-                if (_epollFd != -1)
-                    epoll_ctl(_epollFd, EPOLL_CTL_DEL, c.cgiOutFd, NULL);
+                if (_events)
+                    _events->remove(c.cgiOutFd);
                 close(c.cgiOutFd);
                 _cgiOutToClient.erase(c.cgiOutFd);
                 c.cgiOutFd = -1;
                 c.cgiRunning = false;
             }
         }
+        if (c.proxy.active)
+            detachUpstream(c, false);
+        endListingStream(c);
+        releaseLimits(c.requestLimits);
+        releaseLimits(c.connLimits);
+        releaseAdmission(c);
+        unwatchIdle(c);
+        if (c.tls) {
+            tlsShutdown(c.tls);
+            SSL_free(c.tls);
+            c.tls = NULL;
+        }
+        releaseMemory(c);
+    }
+    if (clientFd >= 0) {
+        if (_events)
+            _events->remove(clientFd);
+        close(clientFd);
     }
-    if (_epollFd != -1)
-        epoll_ctl(_epollFd, EPOLL_CTL_DEL, clientFd, NULL);
-    close(clientFd);
     _clientConnections.erase(it);
 }
 
 
 void epollManager::armWriteEvent(int clientFd, bool enable)
 {
-    struct epoll_event ev; 
-    ev.data.fd = clientFd; 
-    ev.events = EPOLLIN;
-    if (enable)
-        ev.events |= EPOLLOUT;
-    if (epoll_ctl(_epollFd, EPOLL_CTL_MOD, clientFd, &ev) == -1)
-        ERROR_SYS("epoll_ctl mod client");
+    if (!_events->modify(clientFd, enable ? EPOLLIN | EPOLLOUT : EPOLLIN))
+        ERROR_SYS("event mod client");
 }
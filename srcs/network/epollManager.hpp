@@ -3,14 +3,33 @@
 #include "Webserv.hpp"
 #include "../http/Response.hpp"
 #include "../http/Request.hpp"
+#include "../http/ResponseCache.hpp"
 #include "../utils/Utils.hpp"
 #include "../config/ServerConfig.hpp"
 #include "ClientConnection.hpp"
+#include "Upstream.hpp"
+#include "ServerNameTable.hpp"
+#include "AccessList.hpp"
+#include "LimitZone.hpp"
+#include "AdmissionControl.hpp"
+#include "Metrics.hpp"
+#include "EventBackend.hpp"
+#include "AccessLog.hpp"
+#include "../http/DirectoryListing.hpp"
+#include "ConfigSnapshot.hpp"
+#include "Server.hpp"
+#include "ThreadPool.hpp"
+
+struct FileJob;
 
 class epollManager
 {
+    friend struct HotPathAccess;  // bench/micro measures the private request helpers
+    friend struct FileJob;        // builds responses on the aio threads pool
+
     private:
-        int _epollFd;
+        EventBackend* _events;
+        std::string _eventBackendKind; // event_backend the loop was started with
         std::map<int, std::string> _clientBuffers;
         std::map<int, ClientConnection> _clientConnections;
         time_t _lastCleanup;
@@ -18,8 +37,43 @@ class epollManager
 
         // Multi-listen support
         std::set<int> _listenSockets;                               // all listening fds
-        std::map<int, std::vector<ServerConfig> > _serverGroups;    // listen fd -> group of ServerConfig (first is default)
-        std::map<int, ServerConfig> _serverForClientFd;             // mapping client fd -> selected ServerConfig
+        std::map<std::string, Server*> _listeners;                  // host:port -> listening socket, when owned
+        ConfigSnapshot* _config;                                    // configuration new requests are served with
+        std::vector<ConfigSnapshot*> _retiredConfigs;               // replaced by a reload, still used by requests
+        std::map<int, const ServerConfig*> _serverForClientFd;      // client fd -> selected ServerConfig (points into a snapshot)
+
+        // SIGHUP reload
+        std::string _configPath;
+        volatile sig_atomic_t _reloadRequested;
+        unsigned long _generation;
+
+        // SIGUSR2 binary upgrade / SIGTERM: this process stops accepting and exits when
+        // its last connection is done, or at the drain deadline (shutdown_timeout)
+        volatile sig_atomic_t _upgradeRequested;
+        volatile sig_atomic_t _shutdownRequested;
+        bool _draining;
+        long long _drainDeadline;   // monotonic ms
+        pid_t _upgradePid;
+        std::vector<std::string> _argv;
+
+        // allow/deny lists of the servers / locations of every live snapshot
+        std::map<const ServerConfig*, const AccessList*> _serverAccess;
+        std::map<const LocationConfig*, const AccessList*> _locationAccess;
+
+        // limit_req / limit_conn zones by name, and requests parked by limit_req (due time in ms -> fd)
+        std::map<std::string, LimitZone*> _limitZones;
+        std::vector<LimitZone*> _replacedZones;     // redefined by a reload; slots may still be released into them
+        std::multimap<long long, int> _delayedRequests;
+
+        // connections waiting for their next request or lingering before close (deadline in ms -> fd)
+        std::multimap<long long, int> _idleConnections;
+
+        // counters and latency histograms served by stub_status / metrics locations
+        Metrics _metrics;
+
+        // access_log / slow_request_log files by path, and each server's targets
+        std::map<std::string, AccessLog*> _logFiles;
+        std::map<const ServerConfig*, ServerLogTargets> _serverLogs;
 
         // CGI pipe fd -> client fd
 
@@ -27,17 +81,45 @@ class epollManager
         std::map<int,int> _cgiInToClient;
 
         std::map<pid_t, int> _pidToClientFd;
+
+        // Reverse proxy: upstream socket -> client fd, upstream name -> runtime group
+        std::map<int,int> _upstreamToClient;
+        std::map<std::string, UpstreamGroup> _upstreams;
+
+        // cgi_cache zones by name, and pseudo-connections running background refreshes
+        std::map<std::string, ResponseCache*> _responseCaches;
+        int _nextRefreshId;
+        std::vector<int> _finishedRefreshes;
+
         // CGI count
         size_t _activeCgiCount;
 
-        void acceptPendingConnections(int listenFd);
+        // memory_limit: buffer capacity charged by accountMemory(), clients whose reads wait for the budget
+        size_t _memoryLimit;
+        size_t _memoryUsed;
+        size_t _memoryPeak;
+        std::set<int> _memoryPaused;
+
+        // admission_control: adaptive request / CGI limits, and the requests counted against them
+        AdmissionControl _admission;
+        size_t _requestsInFlight;
+
+        // autoindex listings by directory, filled from the const request helpers
+        mutable AutoindexCache _autoindexCache;
+
+        // aio threads: workers building responses of file locations, and the jobs they hold by id
+        ThreadPool _aioPool;
+        std::map<unsigned long, FileJob*> _aioJobs;
+        unsigned long _nextAioJob;
+
+        bool acceptPendingConnections(int listenFd);
         void readClientData(int clientFd, uint32_t events);
         void flushClientBuffer(int clientFd, uint32_t events);
         void drainCgiOutput(int pipeFd, uint32_t events);
         void feedCgiInput(int pipeFd, uint32_t events);
         void closeClientSocket(int clientFd);
         void removeClientState(int clientFd);
-        void queueErrorResponse(int clientFd, int code, const std::string& message);
+        void queueErrorResponse(int clientFd, int code, const std::string& message, int retryAfter = 0);
         inline void sendErrorResponse(int clientFd, int code, const std::string& message) {
             queueErrorResponse(clientFd, code, message);
         }
@@ -45,7 +127,7 @@ class epollManager
         // Per-request helpers using selected config
         Response buildResponseForRequest(const Request& request, const ServerConfig& config);
         bool isCgiRequest(const std::string& uri, const ServerConfig& config) const;
-        bool isMethodAllowed(const std::string& method, const std::string& uri, const ServerConfig& config) const;
+        bool isMethodAllowed(MethodId method, const std::string& uri, const ServerConfig& config) const;
         std::string resolveFilePath(const std::string& uri, const ServerConfig& config) const;
         Response handleDelete(const Request& request, const LocationConfig* location, const ServerConfig& config);
         Response handlePost(const Request& request, const LocationConfig* location, const ServerConfig& config);
@@ -57,12 +139,84 @@ class epollManager
         bool handleConfiguredRedirect(const LocationConfig* location, Response& response, const ServerConfig& config) const;
         bool tryServeRootIndex(const std::string& uri, const LocationConfig* location, const ServerConfig& config, Response& response) const;
         bool tryServeResourceFromFilesystem(const std::string& uri, const LocationConfig* location, const ServerConfig& config, Response& response) const;
-        void addStandardHeaders(Response& response, const std::string& method) const;
+        void addStandardHeaders(Response& response, MethodId method) const;
+        ConnectionGauges collectGauges() const;
+        void buildStatusResponse(Response& response, StatusHandler handler) const;
+        void recordRequestMetrics(ClientConnection& conn);
+        AccessLog* openLogFile(const std::string& path);
+        void compileLogTargets(int listenFd);
+        void completeRequest(ClientConnection& conn);
+        void logRequest(const ClientConnection& conn);
+        void flushLogs();
         bool collectClientRequest(int clientFd);
         bool parseClientHeaders(int clientFd);
+        void selectVirtualServer(int clientFd);
+        const AccessList* compileAccessList(const std::vector<AccessRule>& rules);
+        void compileAccessLists(int listenFd);
+        void compileListener(int listenFd);
+        bool loadTlsContexts(ConfigSnapshot& snapshot, const std::vector<ServerConfig>& group,
+                             std::vector<SSL_CTX*>& contexts, std::string& error);
+        bool attachTls(int listenFd, ClientConnection& conn);
+        bool continueTlsHandshake(int clientFd);
+        static int selectTlsServer(SSL* ssl, int* alert, void* arg);
+        const ServerConfig* defaultServerFor(int listenFd) const;
+        void reloadConfiguration();
+        bool openReloadListeners(const std::map<std::string, std::vector<ServerConfig> >& groups,
+                                 std::map<std::string, Server*>& opened);
+        void retireUpstreams();
+        void retireResponseCaches();
+        void releaseRetiredConfigs();
+        void forgetSnapshot(const ConfigSnapshot* snapshot);
+        bool connectionIdle(const ClientConnection& conn) const;
+        void upgradeBinary();
+        pid_t spawnUpgrade(int readyFd);
+        void startDrain();
+        long shutdownTimeout() const;
+        bool acceptAllowed(int listenFd, const struct sockaddr* addr) const;
+        bool requestAllowed(const ClientConnection& conn, const ServerConfig& config, const LocationConfig* location) const;
+        void configureSessions();
+        void compileLimitZones(int listenFd);
+        LimitZone* limitZone(const std::string& name) const;
+        bool acquireLimits(const std::vector<LimitConnRule>& rules, const ClientConnection& conn, LimitHolds& held);
+        void releaseLimits(LimitHolds& held);
+        bool acceptWithinLimits(int listenFd, ClientConnection& conn);
+        bool admitRequest(int clientFd, const ServerConfig& config, const LocationConfig* location);
+        int nextTimerTimeout() const;
+        void resumeDelayedRequests();
+        void configureMemoryLimit();
+        void accountMemory(int clientFd);
+        void releaseMemory(ClientConnection& conn);
+        bool memoryPressure() const;
+        bool memoryExhausted() const;
+        void pauseForMemory(int clientFd, int sourceFd);
+        void resumeMemoryPaused();
+        void stopClientReads(int clientFd);
+        void refuseRequest(int clientFd, int code, const std::string& message, int retryAfter);
+        bool admitRequestBody(int clientFd);
+        bool spillRequestBody(ClientConnection& conn);
+        bool appendRequestBody(ClientConnection& conn, const char* data, size_t len);
+        void collectMemoryGauges(ConnectionGauges& gauges) const;
+        void configureAdmission();
+        void updateAdmission();
+        RequestPriority requestPriority(const LocationConfig* location) const;
+        bool admitUnderLoad(int clientFd, const LocationConfig* location);
+        bool admitCgiUnderLoad(int clientFd, const LocationConfig* location);
+        void releaseAdmission(ClientConnection& conn);
+        void rejectConnection(int clientSocket, int listenFd);
+        void collectAdmissionGauges(ConnectionGauges& gauges) const;
+        const KeepAliveConfig& keepAliveConfig(int clientFd) const;
+        bool keepAliveAllowed(const ClientConnection& conn) const;
+        std::string keepAliveHeader(const ClientConnection& conn) const;
+        void finishResponse(int clientFd);
+        void watchIdle(ClientConnection& conn, long long deadline);
+        void unwatchIdle(ClientConnection& conn);
+        void expireIdleConnections();
+        bool reclaimIdleConnection();
+        bool startLingering(int clientFd);
+        void drainLingering(int clientFd);
         bool consumeFixedBody(int clientFd);
         bool consumeChunkedBody(int clientFd);
-        bool parseMultipartAndSave(const std::string& body, const std::string& boundary,
+        bool parseMultipartAndSave(const char* body, size_t size, const std::string& boundary,
                                    const std::string& basePath, const std::string& uri,
                                    size_t& savedCount, bool& anyCreated, std::string& lastSavedPath);
         void handleReadyRequest(int clientFd);
@@ -73,6 +227,50 @@ class epollManager
         void updateClientInterest(int clientFd, bool enableWrite);
         bool startCgiFor(int clientFd, const Request& request, const ServerConfig& config, const LocationConfig* location);
         void finalizeCgiResponse(int clientFd);
+        void serveCgiHandoff(int clientFd, const std::string& uri, const HeaderTable& scriptHeaders);
+        void applyHandoffHeaders(Response& response, const HeaderTable& scriptHeaders) const;
+
+        ResponseCache* cacheForLocation(const LocationConfig* location, const ServerConfig& config);
+        ResponseCache* cacheForConnection(const ClientConnection& conn);
+        bool serveFromCache(int clientFd, const Request& request, const ServerConfig& config, const LocationConfig* location);
+        void sendCachedResponse(int clientFd, const CacheEntry& entry, const std::string& status, time_t now);
+        void storeCgiResponse(int clientFd, const Response& response);
+        bool serveStaleOnError(int clientFd);
+        void startBackgroundRefresh(int clientFd, const Request& request, const ServerConfig& config, const LocationConfig* location);
+        void finishBackgroundRefresh(int refreshFd);
+        void purgeFinishedRefreshes();
+
+        void configureUpstreams();
+        bool startProxyFor(int clientFd, const LocationConfig* location);
+        bool connectUpstream(int clientFd);
+        void handleUpstreamEvent(int upstreamFd, uint32_t events);
+        void sendUpstreamRequest(int clientFd);
+        void readUpstreamResponse(int clientFd);
+        bool parseUpstreamHead(int clientFd);
+        void forwardUpstreamBody(int clientFd, const char* data, size_t len);
+        void resumeStreamingSource(int clientFd);
+        void finishProxy(int clientFd, bool reusable);
+        void failUpstream(int clientFd, bool countFailure);
+        void detachUpstream(ClientConnection& conn, bool reusable);
+        void timeoutUpstream(ClientConnection& conn);
+        void setUpstreamInterest(int upstreamFd, uint32_t events);
+
+        bool openListing(const std::string& dirPath, const std::string& uri, const LocationConfig* location,
+                         ListingStream& stream) const;
+        bool renderDirectoryListing(const std::string& dirPath, const std::string& uri,
+                                    const LocationConfig* location, Response& response) const;
+        bool startAutoindexStream(int clientFd, const Request& request, const ServerConfig& config,
+                                  const LocationConfig* location);
+        void continueListingStream(int clientFd);
+        void endListingStream(ClientConnection& conn);
+
+        void configureThreadPool();
+        bool startFileJob(int clientFd, const Request& request, const ServerConfig& config, const LocationConfig* location,
+                          const HeaderTable* scriptHeaders = NULL);
+        void completeFileJobs();
+        void stopFileJobs();
+        void fileJobConfigs(std::set<const ServerConfig*>& inUse) const;
+        void queueBuiltResponse(int clientFd, Response& response);
 
     public:
         void reapZombies();
@@ -83,6 +281,11 @@ class epollManager
         pid_t pin[2];
         pid_t pout[2];
         void requestStop();
+        void requestShutdown();
+        void requestReload();
+        void requestUpgrade();
+        void setUpgradeCommand(int argc, char** argv);
+        void adoptListeners(std::vector<Server*>& servers, const std::string& configPath);
         void run();
         void gracefulShutdown();
         void saveConnInfo(ClientConnection &conn, pid_t pid);
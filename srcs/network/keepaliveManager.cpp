@@ -0,0 +1,165 @@
+#include "Webserv.hpp"
+#include "epollManager.hpp"
+#include <sys/ioctl.h>
+
+
+// keepalive_* / lingering_* of the server a connection is bound to.
+const KeepAliveConfig& epollManager::keepAliveConfig(int clientFd) const
+{
+    static const KeepAliveConfig defaults;
+    std::map<int, const ServerConfig*>::const_iterator it = _serverForClientFd.find(clientFd);
+    if (it == _serverForClientFd.end() || !it->second)
+        return defaults;
+    return it->second->getKeepAlive();
+}
+
+
+// keepalive_timeout 0 turns keep-alive off; the keepalive_requests-th response closes the connection.
+bool epollManager::keepAliveAllowed(const ClientConnection& conn) const
+{
+    const KeepAliveConfig& config = keepAliveConfig(conn.fd);
+    return !_draining && config.timeoutMs > 0 && conn.requestCount + 1 < config.requests;
+}
+
+
+// Keep-Alive value advertising what this connection is actually allowed after the current response.
+std::string epollManager::keepAliveHeader(const ClientConnection& conn) const
+{
+    const KeepAliveConfig& config = keepAliveConfig(conn.fd);
+    long seconds = std::max(config.timeoutMs / 1000, 1L);
+    return "timeout=" + toString(seconds) + ", max=" + toString(config.requests - conn.requestCount - 1);
+}
+
+
+// Runs once the last response byte is written: waits for the next request for keepalive_timeout,
+// or closes the connection, lingering first when the client may still be sending.
+void epollManager::finishResponse(int clientFd)
+{
+    ClientConnection& conn = _clientConnections[clientFd];
+    completeRequest(conn);
+    if (conn.keepAlive && !_draining) {
+        releaseLimits(conn.requestLimits);
+        resetClientState(conn);
+        conn.lastActivity = time(NULL);
+        watchIdle(conn, monotonicUs() / 1000 + keepAliveConfig(clientFd).timeoutMs);
+    } else if (!startLingering(clientFd)) {
+        closeClientSocket(clientFd);
+        removeClientState(clientFd);
+    }
+}
+
+
+void epollManager::watchIdle(ClientConnection& conn, long long deadline)
+{
+    unwatchIdle(conn);
+    conn.idleDeadline = deadline;
+    _idleConnections.insert(std::make_pair(deadline, conn.fd));
+}
+
+
+void epollManager::unwatchIdle(ClientConnection& conn)
+{
+    if (!conn.idleDeadline)
+        return;
+    std::pair<std::multimap<long long, int>::iterator, std::multimap<long long, int>::iterator> range
+        = _idleConnections.equal_range(conn.idleDeadline);
+    for (std::multimap<long long, int>::iterator it = range.first; it != range.second; ++it) {
+        if (it->second == conn.fd) {
+            _idleConnections.erase(it);
+            break;
+        }
+    }
+    conn.idleDeadline = 0;
+}
+
+
+// Closes the keep-alive connections whose keepalive_timeout passed and the lingering ones
+// that stopped sending.
+void epollManager::expireIdleConnections()
+{
+    long long now = monotonicUs() / 1000;
+    while (!_idleConnections.empty() && _idleConnections.begin()->first <= now) {
+        int clientFd = _idleConnections.begin()->second;
+        _idleConnections.erase(_idleConnections.begin());
+        std::map<int, ClientConnection>::iterator it = _clientConnections.find(clientFd);
+        if (it == _clientConnections.end())
+            continue;
+        it->second.idleDeadline = 0;
+        _metrics.timeouts[it->second.lingerUntil ? TIMEOUT_LINGERING : TIMEOUT_KEEPALIVE]++;
+        closeClientSocket(clientFd);
+        removeClientState(clientFd);
+    }
+}
+
+
+// Out of slots: the connection closest to its idle deadline makes room for a new one.
+bool epollManager::reclaimIdleConnection()
+{
+    if (_idleConnections.empty())
+        return false;
+    int clientFd = _idleConnections.begin()->second;
+    _idleConnections.erase(_idleConnections.begin());
+    std::map<int, ClientConnection>::iterator it = _clientConnections.find(clientFd);
+    if (it == _clientConnections.end())
+        return false;
+    it->second.idleDeadline = 0;
+    _metrics.connectionsReclaimed++;
+    closeClientSocket(clientFd);
+    removeClientState(clientFd);
+    return true;
+}
+
+
+// close() with unread input makes the kernel reset the connection, and the reset can destroy
+// the response before the client read it (a 413 sent while the body is still uploading).
+// Lingering half-closes instead and discards what the client still sends, for up to
+// lingering_timeout between reads and LINGERING_TIME in total.
+bool epollManager::startLingering(int clientFd)
+{
+    ClientConnection& conn = _clientConnections[clientFd];
+    const KeepAliveConfig& config = keepAliveConfig(clientFd);
+    if (clientFd < 0 || conn.backgroundRefresh || config.lingering == LINGERING_OFF)
+        return false;
+    int unread = 0;
+    if (config.lingering == LINGERING_ON && conn.state != READING_BODY && conn.buffer.empty()
+        && (ioctl(clientFd, FIONREAD, &unread) == -1 || unread == 0))
+        return false;
+    if (conn.tls) {
+        tlsShutdown(conn.tls);
+        SSL_free(conn.tls);
+        conn.tls = NULL;
+    }
+    if (shutdown(clientFd, SHUT_WR) == -1)
+        return false;
+    releaseLimits(conn.requestLimits);
+    resetClientState(conn);
+    std::string().swap(conn.buffer);
+    if (!_events->modify(clientFd, EPOLLIN))
+        return false;
+    long long now = monotonicUs() / 1000;
+    conn.lingerUntil = now + LINGERING_TIME * 1000LL;
+    watchIdle(conn, std::min(now + config.lingeringTimeoutMs, conn.lingerUntil));
+    _metrics.lingeringCloses++;
+    return true;
+}
+
+
+// Reads and drops what a lingering client sends; EOF or an error ends the close.
+void epollManager::drainLingering(int clientFd)
+{
+    ClientConnection& conn = _clientConnections[clientFd];
+    char buffer[TLS_RECORD_SIZE];
+    ssize_t n = 0;
+    for (int reads = 0; reads < 16 && (n = recv(clientFd, buffer, sizeof(buffer), 0)) > 0; ++reads)
+        ;
+    if (n > 0 || (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))) {
+        long long now = monotonicUs() / 1000;
+        if (now < conn.lingerUntil) {
+            watchIdle(conn, std::min(now + keepAliveConfig(clientFd).lingeringTimeoutMs, conn.lingerUntil));
+            return;
+        }
+        _metrics.timeouts[TIMEOUT_LINGERING]++;
+    }
+    closeClientSocket(clientFd);
+    removeClientState(clientFd);
+}
@@ -0,0 +1,161 @@
+#include "Webserv.hpp"
+#include "epollManager.hpp"
+#include "RequestVariables.hpp"
+
+
+// Creates the runtime state of every limit zone declared in the group (zone names are global).
+void epollManager::compileLimitZones(int listenFd)
+{
+    const std::vector<ServerConfig>& group = _config->serverGroups[listenFd];
+    for (size_t i = 0; i < group.size(); ++i) {
+        const std::map<std::string, LimitZoneConfig>& zones = group[i].getLimitZones();
+        for (std::map<std::string, LimitZoneConfig>::const_iterator it = zones.begin(); it != zones.end(); ++it) {
+            if (_limitZones.count(it->first))
+                continue;
+            LimitZone* zone = new LimitZone();
+            zone->configure(it->second);
+            _limitZones[it->first] = zone;
+        }
+    }
+}
+
+
+LimitZone* epollManager::limitZone(const std::string& name) const
+{
+    std::map<std::string, LimitZone*>::const_iterator it = _limitZones.find(name);
+    return it == _limitZones.end() ? NULL : it->second;
+}
+
+
+// Takes one slot per rule, rolling back the ones already taken when a limit is reached.
+bool epollManager::acquireLimits(const std::vector<LimitConnRule>& rules, const ClientConnection& conn, LimitHolds& held)
+{
+    for (size_t i = 0; i < rules.size(); ++i) {
+        LimitZone* zone = limitZone(rules[i].zone);
+        if (!zone)
+            continue;
+        std::string key = expandRequestVariables(zone->keyPattern(), conn);
+        if (key.empty())
+            continue;
+        if (!zone->acquire(key, rules[i].max)) {
+            LOG("Limiting connections by zone \"" + zone->name() + "\", client " + conn.remoteAddr);
+            releaseLimits(held);
+            return false;
+        }
+        held.push_back(std::make_pair(zone, key));
+    }
+    return true;
+}
+
+
+void epollManager::releaseLimits(LimitHolds& held)
+{
+    for (size_t i = 0; i < held.size(); ++i)
+        held[i].first->release(held[i].second);
+    held.clear();
+}
+
+
+// Server-level limit_conn of the listen's default server, counted from accept to close.
+bool epollManager::acceptWithinLimits(int listenFd, ClientConnection& conn)
+{
+    conn.connLimits.clear();
+    const ServerConfig* server = defaultServerFor(listenFd);
+    if (!server)
+        return true;
+    return acquireLimits(server->getLimitConn(), conn, conn.connLimits);
+}
+
+
+// Gives back the limit_req charges of a request a later rule rejected, so it uses no quota.
+static void refundLimitReq(LimitHolds& charged)
+{
+    for (size_t i = 0; i < charged.size(); ++i)
+        charged[i].first->refundRequest(charged[i].second);
+    charged.clear();
+}
+
+
+// Applies limit_req (location rules override the server's), admission_control, then location limit_conn.
+// Returns false when the request was rejected with 503 or parked until its delay expires.
+bool epollManager::admitRequest(int clientFd, const ServerConfig& config, const LocationConfig* location)
+{
+    ClientConnection& conn = _clientConnections[clientFd];
+    if (!conn.limitReqPassed) {
+        const std::vector<LimitReqRule>& rules = (location && !location->getLimitReq().empty())
+            ? location->getLimitReq() : config.getLimitReq();
+        long long now = currentTimeMs();
+        long delay = 0;
+        for (size_t i = 0; i < rules.size(); ++i) {
+            LimitZone* zone = limitZone(rules[i].zone);
+            std::string key = zone ? expandRequestVariables(zone->keyPattern(), conn) : std::string();
+            if (key.empty())
+                continue;
+            long ruleDelay;
+            LimitResult result = zone->checkRequest(key, now, rules[i].burst, rules[i].nodelay, ruleDelay);
+            if (result == LIMIT_REJECT) {
+                LOG("Limiting requests by zone \"" + zone->name() + "\", client " + conn.remoteAddr);
+                refundLimitReq(conn.limitReqCharges);
+                queueErrorResponse(clientFd, 503, "Service Unavailable");
+                return false;
+            }
+            conn.limitReqCharges.push_back(std::make_pair(zone, key));
+            if (ruleDelay > delay)
+                delay = ruleDelay;
+        }
+        conn.limitReqPassed = true;
+        if (delay > 0) {
+            conn.limitDelayUntil = now + delay;
+            _delayedRequests.insert(std::make_pair(conn.limitDelayUntil, clientFd));
+            // no events while parked: a pipelined request must not wake the loop
+            if (clientFd >= 0 && !_events->modify(clientFd, 0))
+                ERROR_SYS("event mod client");
+            return false;
+        }
+    }
+    if (!admitUnderLoad(clientFd, location)) {
+        refundLimitReq(conn.limitReqCharges);
+        return false;
+    }
+    if (location && !acquireLimits(location->getLimitConn(), conn, conn.requestLimits)) {
+        refundLimitReq(conn.limitReqCharges);
+        queueErrorResponse(clientFd, 503, "Service Unavailable");
+        return false;
+    }
+    conn.limitReqCharges.clear();
+    conn.timing.dispatched = monotonicUs(); // the handler runs next
+    return true;
+}
+
+
+// Event wait timeout: one second, or less when a delayed request or an idle connection is
+// due sooner or admission_control has work in flight to watch.
+int epollManager::nextTimerTimeout() const
+{
+    long long timeout = (_admission.enabled() && (_requestsInFlight || _activeCgiCount)) ? ADMISSION_INTERVAL_MS : 1000;
+    if (!_delayedRequests.empty())
+        timeout = std::min(timeout, _delayedRequests.begin()->first - currentTimeMs());
+    if (!_idleConnections.empty())
+        timeout = std::min(timeout, _idleConnections.begin()->first - monotonicUs() / 1000);
+    return timeout < 0 ? 0 : static_cast<int>(timeout);
+}
+
+
+// Dispatches the requests whose limit_req delay has expired; stale entries (closed fds) are skipped.
+void epollManager::resumeDelayedRequests()
+{
+    long long now = currentTimeMs();
+    while (!_delayedRequests.empty() && _delayedRequests.begin()->first <= now) {
+        long long due = _delayedRequests.begin()->first;
+        int clientFd = _delayedRequests.begin()->second;
+        _delayedRequests.erase(_delayedRequests.begin());
+        std::map<int, ClientConnection>::iterator it = _clientConnections.find(clientFd);
+        if (it == _clientConnections.end() || it->second.limitDelayUntil != due)
+            continue;
+        it->second.limitDelayUntil = 0;
+        it->second.lastActivity = time(NULL);
+        updateClientInterest(clientFd, false);
+        handleReadyRequest(clientFd);
+        accountMemory(clientFd);
+    }
+}
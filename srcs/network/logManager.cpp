@@ -0,0 +1,86 @@
+#include "Webserv.hpp"
+#include "epollManager.hpp"
+#include "RequestVariables.hpp"
+
+// One line per request over the slow_request_log threshold, every phase in seconds.
+static const char* g_slowRequestFormat =
+    "[$time_local] slow request $request_time client=$remote_addr \"$request\" status=$status bytes=$bytes_sent"
+    " | wait=$wait_time headers=$header_time body=$body_time queue=$queue_time cgi_spawn=$cgi_spawn_time"
+    " upstream_header=$upstream_header_time upstream=$upstream_time first_byte=$first_byte_time send=$send_time";
+
+
+// Log files are opened once per path and shared by every server writing to it.
+AccessLog* epollManager::openLogFile(const std::string& path)
+{
+    std::map<std::string, AccessLog*>::iterator it = _logFiles.find(path);
+    if (it != _logFiles.end())
+        return it->second;
+    AccessLog* log = new AccessLog();
+    if (!log->open(path)) {
+        delete log;
+        return NULL;
+    }
+    _logFiles[path] = log;
+    return log;
+}
+
+
+void epollManager::compileLogTargets(int listenFd)
+{
+    const std::vector<ServerConfig>& group = _config->serverGroups[listenFd];
+    for (size_t i = 0; i < group.size(); ++i) {
+        const ServerConfig& server = group[i];
+        ServerLogTargets targets;
+        if (!server.getAccessLog().empty()) {
+            targets.access = openLogFile(server.getAccessLog());
+            targets.format = server.getLogFormat(server.getAccessLogFormat());
+        }
+        if (server.getSlowRequestMs() >= 0) {
+            targets.slowUs = static_cast<long long>(server.getSlowRequestMs()) * 1000;
+            if (!server.getSlowRequestLog().empty())
+                targets.slow = openLogFile(server.getSlowRequestLog());
+        }
+        if (targets.access || targets.slowUs >= 0)
+            _serverLogs[&server] = targets;
+    }
+}
+
+
+// Runs once the last response byte is written, before the connection is reset or closed.
+void epollManager::completeRequest(ClientConnection& conn)
+{
+    conn.timing.lastSent = monotonicUs();
+    conn.requestCount++;
+    endListingStream(conn);
+    releaseAdmission(conn);
+    recordRequestMetrics(conn);
+    logRequest(conn);
+}
+
+
+void epollManager::logRequest(const ClientConnection& conn)
+{
+    std::map<int, const ServerConfig*>::const_iterator sit = _serverForClientFd.find(conn.fd);
+    if (sit == _serverForClientFd.end())
+        return;
+    std::map<const ServerConfig*, ServerLogTargets>::const_iterator it = _serverLogs.find(sit->second);
+    if (it == _serverLogs.end())
+        return;
+    const ServerLogTargets& targets = it->second;
+    if (targets.access)
+        targets.access->write(expandRequestVariables(targets.format, conn));
+    if (targets.slowUs >= 0 && conn.timing.firstByte && conn.timing.lastSent - conn.timing.firstByte >= targets.slowUs) {
+        std::string line = expandRequestVariables(g_slowRequestFormat, conn);
+        if (targets.slow)
+            targets.slow->write(line);
+        else
+            INFO(line);
+    }
+}
+
+
+void epollManager::flushLogs()
+{
+    for (std::map<std::string, AccessLog*>::iterator it = _logFiles.begin(); it != _logFiles.end(); ++it)
+        it->second->flush();
+}
@@ -0,0 +1,229 @@
+#include "Webserv.hpp"
+#include "epollManager.hpp"
+
+
+// Buffer capacity of one connection by kind; capacity, not size, is what the allocator holds.
+static void measureConnection(const ClientConnection& conn, size_t kinds[MEMORY_KINDS])
+{
+    kinds[MEMORY_CONNECTION] += sizeof(ClientConnection);
+    kinds[MEMORY_REQUEST] += conn.buffer.capacity() + conn.chunkBuffer.capacity() + conn.headers.capacity();
+    kinds[MEMORY_BODY] += conn.body.capacity();
+    kinds[MEMORY_RESPONSE] += conn.outBuffer.capacity();
+    kinds[MEMORY_CGI] += conn.cgiOutBuffer.capacity();
+    kinds[MEMORY_UPSTREAM] += conn.proxy.request.capacity() + conn.proxy.head.capacity();
+}
+
+
+static bool writeAll(int fd, const char* data, size_t len)
+{
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = write(fd, data + done, len - done);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        done += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+
+static void setSourceInterest(EventBackend* events, int fd, uint32_t interest)
+{
+    if (!events->modify(fd, interest))
+        ERROR_SYS("event mod paused source");
+}
+
+
+// Largest memory_limit set in the running configuration; 0 keeps the accounting without a budget.
+void epollManager::configureMemoryLimit()
+{
+    size_t limit = 0;
+    for (std::map<int, std::vector<ServerConfig> >::const_iterator it = _config->serverGroups.begin(); it != _config->serverGroups.end(); ++it) {
+        for (size_t i = 0; i < it->second.size(); ++i)
+            limit = std::max(limit, it->second[i].getMemoryLimit());
+    }
+    if (limit != _memoryLimit && limit)
+        INFO("Memory limit " + toString(limit) + " bytes, " + toString(_memoryUsed) + " in use");
+    _memoryLimit = limit;
+}
+
+
+// Charges the current buffers of a client to the budget; called after each event handled for it.
+void epollManager::accountMemory(int clientFd)
+{
+    std::map<int, ClientConnection>::iterator it = _clientConnections.find(clientFd);
+    if (it == _clientConnections.end())
+        return;
+    ClientConnection& conn = it->second;
+    size_t kinds[MEMORY_KINDS] = { 0 };
+    measureConnection(conn, kinds);
+    size_t used = 0;
+    for (int i = 0; i < MEMORY_KINDS; ++i)
+        used += kinds[i];
+    _memoryUsed = _memoryUsed - conn.memoryUsed + used;
+    conn.memoryUsed = used;
+    if (_memoryUsed > _memoryPeak)
+        _memoryPeak = _memoryUsed;
+}
+
+
+// Returns a closing connection's share of the budget and drops its spilled body.
+void epollManager::releaseMemory(ClientConnection& conn)
+{
+    _memoryUsed -= conn.memoryUsed;
+    conn.memoryUsed = 0;
+    if (conn.bodyFd != -1) {
+        close(conn.bodyFd);
+        conn.bodyFd = -1;
+    }
+    _memoryPaused.erase(conn.fd);
+}
+
+
+// Near the budget: request bodies go to disk and large new requests are refused.
+bool epollManager::memoryPressure() const
+{
+    return _memoryLimit && _memoryUsed >= _memoryLimit / 100 * MEMORY_PRESSURE_PERCENT;
+}
+
+
+// At the budget: reads that would allocate stop until memoryPressure() clears.
+bool epollManager::memoryExhausted() const
+{
+    return _memoryLimit && _memoryUsed >= _memoryLimit;
+}
+
+
+// Stops watching a source that would grow the client's buffers (its socket, CGI pipe or upstream socket).
+void epollManager::pauseForMemory(int clientFd, int sourceFd)
+{
+    if (sourceFd == clientFd)
+        stopClientReads(clientFd);
+    else
+        setSourceInterest(_events, sourceFd, 0);
+    if (_memoryPaused.empty())
+        ERROR("Memory limit reached (" + toString(_memoryUsed) + " of " + toString(_memoryLimit) + " bytes), pausing reads");
+    if (_memoryPaused.insert(clientFd).second)
+        _metrics.memoryPauses++;
+}
+
+
+// Restarts every paused source and dispatches the parked requests once usage fell back under the pressure mark.
+void epollManager::resumeMemoryPaused()
+{
+    LOG("Memory back to " + toString(_memoryUsed) + " bytes, resuming " + toString(_memoryPaused.size()) + " connection(s)");
+    std::set<int> paused;
+    paused.swap(_memoryPaused);
+    time_t now = time(NULL);
+    for (std::set<int>::iterator it = paused.begin(); it != paused.end(); ++it) {
+        std::map<int, ClientConnection>::iterator cit = _clientConnections.find(*it);
+        if (cit == _clientConnections.end())
+            continue;
+        ClientConnection& conn = cit->second;
+        conn.lastActivity = now;
+        if (conn.cgiOutFd != -1)
+            setSourceInterest(_events, conn.cgiOutFd, EPOLLIN);
+        ProxyState& p = conn.proxy;
+        if (p.active && p.paused && conn.outBuffer.size() - conn.outOffset <= PROXY_MAX_PENDING / 2) {
+            p.paused = false;
+            p.lastActivity = now;
+            setSourceInterest(_events, p.fd, EPOLLIN);
+        }
+        if (conn.fd < 0 || conn.cgiRunning || p.active || conn.limitDelayUntil)
+            continue;
+        updateClientInterest(conn.fd, conn.hasResponse);
+        if (conn.headersParsed && conn.state == READY && !conn.hasResponse) {
+            handleReadyRequest(conn.fd);
+            accountMemory(*it);
+        }
+    }
+}
+
+
+// Keeps only EPOLLOUT (or nothing) on a client socket; hangups are still reported.
+void epollManager::stopClientReads(int clientFd)
+{
+    ClientConnection& conn = _clientConnections[clientFd];
+    if (!_events->modify(clientFd, conn.hasResponse ? static_cast<uint32_t>(EPOLLOUT) : 0))
+        ERROR_SYS("event mod client");
+}
+
+
+// Answers before the body is read and stops reading it; the connection closes after the response.
+void epollManager::refuseRequest(int clientFd, int code, const std::string& message, int retryAfter)
+{
+    queueErrorResponse(clientFd, code, message, retryAfter);
+    stopClientReads(clientFd);
+}
+
+
+// Under memory pressure, refuses bodies that are large or of unknown size before buffering them.
+bool epollManager::admitRequestBody(int clientFd)
+{
+    ClientConnection& conn = _clientConnections[clientFd];
+    if (conn.state != READING_BODY || !memoryPressure())
+        return true;
+    if (conn.bodyType == BODY_FIXED && conn.contentLength <= MEMORY_LARGE_REQUEST)
+        return true;
+    _metrics.memoryRefused++;
+    LOG("Refusing a " + (conn.bodyType == BODY_FIXED ? toString(conn.contentLength) + " byte" : std::string("chunked"))
+        + " body from " + conn.remoteAddr + " under memory pressure");
+    refuseRequest(clientFd, 503, "Service Unavailable", MEMORY_RETRY_AFTER);
+    return false;
+}
+
+
+// Moves the body received so far to an unlinked temporary file; the rest of it is appended there.
+bool epollManager::spillRequestBody(ClientConnection& conn)
+{
+    char path[] = BODY_TEMP_PATH;
+    int fd = mkstemp(path);
+    if (fd == -1) {
+        ERROR_SYS("mkstemp request body");
+        return false;
+    }
+    unlink(path);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    if (!writeAll(fd, conn.body.data(), conn.body.size())) {
+        ERROR_SYS("write request body to temporary file");
+        close(fd);
+        return false;
+    }
+    conn.bodyFd = fd;
+    std::string().swap(conn.body);
+    _metrics.bodiesSpilled++;
+    return true;
+}
+
+
+// Appends request body bytes in memory, or to the spill file once the body has been moved there.
+bool epollManager::appendRequestBody(ClientConnection& conn, const char* data, size_t len)
+{
+    if (conn.bodyFd == -1) {
+        conn.body.append(data, len);
+        conn.bodyReceived += len;
+        return true;
+    }
+    if (!writeAll(conn.bodyFd, data, len)) {
+        ERROR_SYS("write request body to temporary file");
+        return false;
+    }
+    conn.bodyReceived += len;
+    return true;
+}
+
+
+void epollManager::collectMemoryGauges(ConnectionGauges& gauges) const
+{
+    for (std::map<int, ClientConnection>::const_iterator it = _clientConnections.begin(); it != _clientConnections.end(); ++it) {
+        measureConnection(it->second, gauges.memory);
+        if (it->second.bodyFd != -1)
+            gauges.bodySpilled += it->second.bodyReceived;
+    }
+    gauges.memoryUsed = _memoryUsed;
+    gauges.memoryLimit = _memoryLimit;
+    gauges.memoryPeak = _memoryPeak;
+    gauges.memoryPaused = _memoryPaused.size();
+}
@@ -0,0 +1,557 @@
+#include "Webserv.hpp"
+#include "epollManager.hpp"
+#include "Cookie.hpp"
+#include "RequestVariables.hpp"
+#include "../utils/Utils.hpp"
+#include "../utils/ParserUtils.hpp"
+
+
+// Headers that only make sense on a single hop and are never forwarded as-is.
+static bool isHopByHopHeader(HeaderId id)
+{
+    return id == HEADER_CONNECTION || id == HEADER_KEEP_ALIVE || id == HEADER_PROXY_CONNECTION || id == HEADER_TE
+        || id == HEADER_TRAILER || id == HEADER_TRANSFER_ENCODING || id == HEADER_UPGRADE || id == HEADER_CONTENT_LENGTH;
+}
+
+
+// Builds the request head sent to the backend; the body is streamed afterwards from conn.body or its spill file.
+static std::string buildUpstreamRequest(const ClientConnection& conn, const LocationConfig* location, bool keepAlive)
+{
+    std::string uri = conn.uri;
+    const std::string& proxyUri = location->getProxyUri();
+    if (!proxyUri.empty()) {
+        const std::string& mount = location->getPath();
+        std::string rest = (uri.compare(0, mount.size(), mount) == 0) ? uri.substr(mount.size()) : uri;
+        if (!rest.empty() && rest[0] == '/' && proxyUri[proxyUri.size() - 1] == '/')
+            rest.erase(0, 1);
+        uri = proxyUri + rest;
+    }
+
+    std::string head = conn.method + " " + uri + " HTTP/1.1\r\n";
+    std::string forwardedFor;
+    for (size_t i = 0; i < conn.headers.size(); ++i) {
+        HeaderId id = conn.headers.id(i);
+        HeaderView name = conn.headers.name(i);
+        HeaderView value = conn.headers.value(i);
+        if (isHopByHopHeader(id))
+            continue;
+        if (id == HEADER_X_FORWARDED_FOR) {
+            forwardedFor.append(value.data, value.size).append(", ");
+            continue;
+        }
+        head.append(name.data, name.size).append(": ").append(value.data, value.size).append("\r\n");
+    }
+    if (!conn.headers.has(HEADER_HOST))
+        head += "host: " + location->getProxyUpstream().getName() + "\r\n";
+    head += "x-forwarded-for: " + forwardedFor + conn.remoteAddr + "\r\n";
+    head += "x-real-ip: " + conn.remoteAddr + "\r\n";
+    head += conn.tls ? "x-forwarded-proto: https\r\n" : "x-forwarded-proto: http\r\n";
+    if (conn.bodyReceived || conn.methodId == METHOD_POST)
+        head += "content-length: " + toString(conn.bodyReceived) + "\r\n";
+    head += keepAlive ? "connection: keep-alive\r\n" : "connection: close\r\n";
+    head += "\r\n";
+    return head;
+}
+
+
+// Advances the chunked framing scanner over data; sets complete after the terminating trailer.
+static size_t scanChunkedBody(ProxyState& p, const char* data, size_t len, bool& complete)
+{
+    size_t i = 0;
+    while (i < len) {
+        if (p.chunkState == CHUNK_READ_DATA) {
+            size_t take = std::min(p.remaining, len - i);
+            i += take;
+            p.remaining -= take;
+            if (p.remaining == 0)
+                p.chunkState = CHUNK_READ_CRLF;
+            continue;
+        }
+        char c = data[i++];
+        if (c != '\n') {
+            if (p.chunkLine.size() < 1024)
+                p.chunkLine += c;
+            continue;
+        }
+        std::string line = p.chunkLine;
+        p.chunkLine.clear();
+        if (!line.empty() && line[line.size() - 1] == '\r')
+            line.erase(line.size() - 1);
+        if (p.chunkState == CHUNK_READ_SIZE) {
+            p.remaining = std::strtoul(line.c_str(), NULL, 16);
+            p.chunkState = (p.remaining == 0) ? CHUNK_COMPLETE : CHUNK_READ_DATA;
+        } else if (p.chunkState == CHUNK_READ_CRLF)
+            p.chunkState = CHUNK_READ_SIZE;
+        else if (line.empty()) {
+            complete = true;
+            return i;
+        }
+    }
+    return i;
+}
+
+
+// Builds the group of every proxy_pass target when the configuration is loaded, so the
+// blocking getaddrinfo() of its peers never runs on a request. The first definition of a name wins.
+void epollManager::configureUpstreams()
+{
+    for (std::map<int, std::vector<ServerConfig> >::const_iterator it = _config->serverGroups.begin(); it != _config->serverGroups.end(); ++it) {
+        for (size_t i = 0; i < it->second.size(); ++i) {
+            const std::vector<LocationConfig>& locations = it->second[i].getLocations();
+            for (size_t j = 0; j < locations.size(); ++j) {
+                if (!locations[j].hasProxyPass())
+                    continue;
+                const UpstreamConfig& upstream = locations[j].getProxyUpstream();
+                if (_upstreams.count(upstream.getName()))
+                    continue;
+                _upstreams[upstream.getName()].configure(upstream);
+            }
+        }
+    }
+}
+
+
+// Prepares the upstream exchange for a proxied location and opens the first backend connection.
+bool epollManager::startProxyFor(int clientFd, const LocationConfig* location)
+{
+    ClientConnection &conn = _clientConnections[clientFd];
+    const UpstreamConfig& upstream = location->getProxyUpstream();
+
+    if (!_upstreams.count(upstream.getName())) {
+        ERROR("Upstream " + upstream.getName() + " was not configured");
+        return false;
+    }
+    conn.proxy = ProxyState();
+    conn.proxy.active = true;
+    conn.proxy.group = upstream.getName();
+    conn.timing.upstreamStart = monotonicUs();
+    conn.proxy.request = buildUpstreamRequest(conn, location, upstream.getKeepalive() > 0);
+    return connectUpstream(clientFd);
+}
+
+
+// Picks a peer, reusing a pooled keep-alive connection when possible, and starts a non-blocking connect.
+bool epollManager::connectUpstream(int clientFd)
+{
+    ClientConnection &conn = _clientConnections[clientFd];
+    UpstreamGroup& group = _upstreams[conn.proxy.group];
+    time_t now = time(NULL);
+    std::string key;
+    if (!group.getHashKey().empty())
+        key = expandRequestVariables(group.getHashKey(), conn);
+
+    while (true) {
+        int index = group.selectPeer(key, conn.proxy.tried, now);
+        if (index == -1) {
+            ERROR("Upstream " + group.getName() + ": no live peer for client " + toString(clientFd));
+            return false;
+        }
+        conn.proxy.tried.push_back(index);
+        UpstreamPeer& peer = group.peer(index);
+
+        int fd = group.acquireConnection(index);
+        bool reused = (fd != -1);
+        if (!reused) {
+            fd = socket(peer.addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (fd == -1) {
+                ERROR_SYS("upstream socket");
+                return false;
+            }
+            if (connect(fd, reinterpret_cast<struct sockaddr*>(&peer.addr), peer.addrLen) == -1 && errno != EINPROGRESS) {
+                ERROR_SYS("connect to upstream " + peer.label);
+                close(fd);
+                group.markFailure(index, now);
+                continue;
+            }
+        }
+        if (!_events->add(fd, EPOLLOUT)) {
+            ERROR_SYS("event add upstream");
+            close(fd);
+            return false;
+        }
+        _upstreamToClient[fd] = clientFd;
+        peer.active++;
+
+        ProxyState& p = conn.proxy;
+        p.fd = fd;
+        p.peer = index;
+        p.connected = reused;
+        p.reused = reused;
+        p.sent = 0;
+        p.headersDone = false;
+        p.head.clear();
+        p.lastActivity = now;
+        LOG("Proxy fd=" + toString(clientFd) + " -> " + group.getName() + " (" + peer.label + (reused ? ", pooled" : "") + ")");
+        return true;
+    }
+}
+
+
+// Dispatches readiness on an upstream socket: connect completion, request writing, response reading.
+void epollManager::handleUpstreamEvent(int upstreamFd, uint32_t events)
+{
+    std::map<int, int>::iterator it = _upstreamToClient.find(upstreamFd);
+    if (it == _upstreamToClient.end())
+        return;
+    int clientFd = it->second;
+    ClientConnection &conn = _clientConnections[clientFd];
+    ProxyState& p = conn.proxy;
+    p.lastActivity = time(NULL);
+
+    if (!p.connected) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        if (getsockopt(upstreamFd, SOL_SOCKET, SO_ERROR, &err, &len) == -1 || err != 0) {
+            errno = err;
+            ERROR_SYS("connect to upstream " + _upstreams[p.group].peer(p.peer).label);
+            failUpstream(clientFd, true);
+            return;
+        }
+        p.connected = true;
+    }
+    if (p.sent < p.request.size() + conn.bodyReceived) {
+        if (events & (EPOLLOUT | EPOLLERR | EPOLLHUP))
+            sendUpstreamRequest(clientFd);
+        return;
+    }
+    if (events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+        readUpstreamResponse(clientFd);
+}
+
+
+// Writes the next slice of the request head or body; waits for the response once everything is sent.
+void epollManager::sendUpstreamRequest(int clientFd)
+{
+    ClientConnection &conn = _clientConnections[clientFd];
+    ProxyState& p = conn.proxy;
+    size_t headSize = p.request.size();
+    size_t total = headSize + conn.bodyReceived;
+    char buf[PROXY_BUFFER_SIZE];
+    const char* data;
+    size_t len;
+    if (p.sent < headSize) {
+        data = p.request.data() + p.sent;
+        len = headSize - p.sent;
+    } else if (conn.bodyFd != -1) {
+        ssize_t r = pread(conn.bodyFd, buf, std::min(sizeof(buf), total - p.sent), static_cast<off_t>(p.sent - headSize));
+        if (r <= 0) {
+            ERROR_SYS("read spilled request body");
+            failUpstream(clientFd, false);
+            return;
+        }
+        data = buf;
+        len = static_cast<size_t>(r);
+    } else {
+        data = conn.body.data() + (p.sent - headSize);
+        len = total - p.sent;
+    }
+    ssize_t n = send(p.fd, data, len, MSG_NOSIGNAL);
+    if (n > 0) {
+        p.sent += static_cast<size_t>(n);
+        if (p.sent >= total)
+            setUpstreamInterest(p.fd, EPOLLIN);
+        return;
+    }
+    if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return;
+    failUpstream(clientFd, !p.reused);
+}
+
+
+// Reads backend output: parses the status/header block first, then streams the body to the client.
+void epollManager::readUpstreamResponse(int clientFd)
+{
+    ClientConnection &conn = _clientConnections[clientFd];
+    ProxyState& p = conn.proxy;
+    if (memoryExhausted() && !p.paused) {
+        p.paused = true;
+        pauseForMemory(clientFd, p.fd);
+        return;
+    }
+    char buf[PROXY_BUFFER_SIZE];
+    ssize_t n = recv(p.fd, buf, sizeof(buf), 0);
+    if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return;
+
+    if (n <= 0) {
+        if (!p.headersDone) {
+            // a pooled connection closed by the backend before answering is not a peer failure
+            failUpstream(clientFd, !(p.reused && p.head.empty()));
+            return;
+        }
+        if (p.framing != UPSTREAM_UNTIL_CLOSE) {
+            ERROR("Upstream closed mid-response for client " + toString(clientFd));
+            conn.keepAlive = false;
+        }
+        finishProxy(clientFd, false);
+        return;
+    }
+
+    if (p.headersDone) {
+        forwardUpstreamBody(clientFd, buf, static_cast<size_t>(n));
+        return;
+    }
+    p.head.append(buf, n);
+    size_t headerEnd = p.head.find("\r\n\r\n");
+    if (headerEnd == std::string::npos) {
+        if (p.head.size() > PROXY_MAX_HEADER)
+            failUpstream(clientFd, true);
+        return;
+    }
+    std::string rest = p.head.substr(headerEnd + 4);
+    p.head.erase(headerEnd + 2);
+    if (!parseUpstreamHead(clientFd)) {
+        ERROR("Invalid response header from upstream " + p.group);
+        failUpstream(clientFd, true);
+        return;
+    }
+    conn.timing.upstreamHeader = monotonicUs();
+    if (!rest.empty())
+        forwardUpstreamBody(clientFd, rest.data(), rest.size());
+    else if (p.framing == UPSTREAM_NO_BODY || (p.framing == UPSTREAM_LENGTH && p.remaining == 0))
+        finishProxy(clientFd, p.reusable);
+}
+
+
+// Rewrites the backend status line and headers for the client and picks the body framing.
+bool epollManager::parseUpstreamHead(int clientFd)
+{
+    ClientConnection &conn = _clientConnections[clientFd];
+    ProxyState& p = conn.proxy;
+
+    size_t eol = p.head.find("\r\n");
+    std::string statusLine = p.head.substr(0, eol);
+    size_t sp = statusLine.find(' ');
+    if (statusLine.compare(0, 5, "HTTP/") != 0 || sp == std::string::npos)
+        return false;
+    int status = std::atoi(statusLine.c_str() + sp + 1);
+    bool upstreamClose = (statusLine.compare(0, 8, "HTTP/1.1") != 0);
+    bool chunked = false;
+    bool hasLength = false;
+    size_t length = 0;
+
+    std::string out = "HTTP/1.1" + statusLine.substr(sp) + "\r\n";
+    size_t lineStart = eol + 2;
+    while (lineStart < p.head.size()) {
+        size_t lineEnd = p.head.find("\r\n", lineStart);
+        if (lineEnd == std::string::npos)
+            break;
+        std::string line = p.head.substr(lineStart, lineEnd - lineStart);
+        lineStart = lineEnd + 2;
+        size_t colon = line.find(':');
+        if (colon == std::string::npos)
+            continue;
+        std::string name = ParserUtils::trim(line.substr(0, colon));
+        std::string value = ParserUtils::trim(line.substr(colon + 1));
+        std::string lname = toLowerCase(name);
+        if (lname == "connection") {
+            std::string lvalue = toLowerCase(value);
+            if (lvalue.find("close") != std::string::npos)
+                upstreamClose = true;
+            else if (lvalue.find("keep-alive") != std::string::npos)
+                upstreamClose = false;
+            continue;
+        }
+        if (lname == "keep-alive" || lname == "proxy-connection")
+            continue;
+        if (lname == "transfer-encoding" && toLowerCase(value).find("chunked") != std::string::npos)
+            chunked = true;
+        if (lname == "content-length") {
+            hasLength = true;
+            length = std::strtoul(value.c_str(), NULL, 10);
+        }
+        out += name + ": " + value + "\r\n";
+    }
+
+    if (conn.methodId == METHOD_HEAD || status / 100 == 1 || status == 204 || status == 304)
+        p.framing = UPSTREAM_NO_BODY;
+    else if (chunked) {
+        p.framing = UPSTREAM_CHUNKED;
+        p.chunkState = CHUNK_READ_SIZE;
+    } else if (hasLength) {
+        p.framing = UPSTREAM_LENGTH;
+        p.remaining = length;
+    } else {
+        p.framing = UPSTREAM_UNTIL_CLOSE;
+        conn.keepAlive = false;
+    }
+    p.reusable = !upstreamClose && p.framing != UPSTREAM_UNTIL_CLOSE;
+    p.headersDone = true;
+
+    if (conn.keepAlive) {
+        out += "Connection: keep-alive\r\n";
+        out += "Keep-Alive: " + keepAliveHeader(conn) + "\r\n";
+    } else
+        out += "Connection: close\r\n";
+    std::string cookie = takeSessionCookie(conn);
+    if (!cookie.empty())
+        out += "Set-Cookie: " + cookie + "\r\n";
+    out += "\r\n";
+
+    _upstreams[p.group].markSuccess(p.peer);
+    LOG("Response " + out.substr(0, out.find("\r\n")) + " fd=" + toString(clientFd) + " (proxied)");
+    conn.outBuffer = out;
+    conn.outOffset = 0;
+    conn.hasResponse = true;
+    conn.streamPending = true;
+    updateClientInterest(clientFd, true);
+    return true;
+}
+
+
+// Appends backend body bytes to the client buffer and pauses the upstream when the client lags.
+void epollManager::forwardUpstreamBody(int clientFd, const char* data, size_t len)
+{
+    ClientConnection &conn = _clientConnections[clientFd];
+    ProxyState& p = conn.proxy;
+    size_t consumed = len;
+    bool complete = false;
+
+    if (p.framing == UPSTREAM_NO_BODY) {
+        consumed = 0;
+        complete = true;
+    } else if (p.framing == UPSTREAM_LENGTH) {
+        consumed = std::min(len, p.remaining);
+        p.remaining -= consumed;
+        complete = (p.remaining == 0);
+    } else if (p.framing == UPSTREAM_CHUNKED)
+        consumed = scanChunkedBody(p, data, len, complete);
+    if (consumed < len)
+        p.reusable = false; // backend sent more than it announced
+
+    if (conn.outOffset >= conn.outBuffer.size()) {
+        conn.outBuffer.clear();
+        conn.outOffset = 0;
+    } else if (conn.outOffset > PROXY_MAX_PENDING) {
+        conn.outBuffer.erase(0, conn.outOffset);
+        conn.outOffset = 0;
+    }
+    conn.outBuffer.append(data, consumed);
+    conn.lastActivity = time(NULL);
+    updateClientInterest(clientFd, true);
+
+    if (complete) {
+        finishProxy(clientFd, p.reusable);
+        return;
+    }
+    if (!p.paused && conn.outBuffer.size() - conn.outOffset > PROXY_MAX_PENDING) {
+        p.paused = true;
+        setUpstreamInterest(p.fd, 0);
+    }
+}
+
+
+// Called by flushClientBuffer: refills a streamed listing, or resumes a paused upstream once the client drained enough.
+void epollManager::resumeStreamingSource(int clientFd)
+{
+    ClientConnection &conn = _clientConnections[clientFd];
+    if (conn.listing.listing) {
+        continueListingStream(clientFd);
+        return;
+    }
+    ProxyState& p = conn.proxy;
+    if (p.active && p.paused && conn.outBuffer.size() - conn.outOffset <= PROXY_MAX_PENDING / 2) {
+        p.paused = false;
+        p.lastActivity = time(NULL);
+        setUpstreamInterest(p.fd, EPOLLIN);
+    }
+}
+
+
+// Ends the upstream exchange; flushClientBuffer completes the client side once outBuffer drains.
+void epollManager::finishProxy(int clientFd, bool reusable)
+{
+    ClientConnection &conn = _clientConnections[clientFd];
+    conn.timing.upstreamDone = monotonicUs();
+    detachUpstream(conn, reusable);
+    conn.streamPending = false;
+    updateClientInterest(clientFd, true);
+}
+
+
+// Gives up on the current peer, retrying the next one while nothing was sent to the client.
+void epollManager::failUpstream(int clientFd, bool countFailure)
+{
+    ClientConnection &conn = _clientConnections[clientFd];
+    ProxyState& p = conn.proxy;
+    UpstreamGroup& group = _upstreams[p.group];
+    bool staleReuse = p.reused && p.head.empty() && !countFailure;
+    if (countFailure && p.peer != -1)
+        group.markFailure(p.peer, time(NULL));
+    if (staleReuse && !p.tried.empty())
+        p.tried.pop_back(); // the peer itself is fine, retry it with a fresh connection
+
+    // once bytes went out the peer may have acted on the request, even when a pooled connection
+    // closes without answering: only an idempotent request is replayed then, a stale one in full,
+    // otherwise while none of its body was written
+    bool idempotent = conn.methodId == METHOD_GET || conn.methodId == METHOD_HEAD || conn.methodId == METHOD_OPTIONS;
+    bool bodyStarted = p.sent > p.request.size();
+    bool headersDone = p.headersDone;
+    bool retry = !headersDone && (p.sent == 0 || (idempotent && (staleReuse || !bodyStarted)));
+    detachUpstream(conn, false);
+    if (retry) {
+        p.active = true;
+        if (connectUpstream(clientFd))
+            return;
+        p.active = false;
+    }
+    if (!headersDone) {
+        queueErrorResponse(clientFd, 502, "Bad Gateway");
+        return;
+    }
+    conn.keepAlive = false;
+    conn.streamPending = false;
+    updateClientInterest(clientFd, true);
+}
+
+
+// Removes the upstream socket from epoll and either pools it or closes it.
+void epollManager::detachUpstream(ClientConnection& conn, bool reusable)
+{
+    ProxyState& p = conn.proxy;
+    if (p.fd != -1) {
+        if (_events)
+            _events->remove(p.fd);
+        _upstreamToClient.erase(p.fd);
+        std::map<std::string, UpstreamGroup>::iterator git = _upstreams.find(p.group);
+        if (git != _upstreams.end() && p.peer != -1) {
+            UpstreamPeer& peer = git->second.peer(p.peer);
+            if (peer.active > 0)
+                peer.active--;
+            if (reusable)
+                git->second.releaseConnection(p.peer, p.fd, time(NULL));
+            else
+                close(p.fd);
+        } else
+            close(p.fd);
+        p.fd = -1;
+    }
+    p.active = false;
+    p.paused = false;
+}
+
+
+// Handles backends that stopped answering: 504 before the header, truncated close afterwards.
+void epollManager::timeoutUpstream(ClientConnection& conn)
+{
+    ProxyState& p = conn.proxy;
+    ERROR("Upstream " + p.group + " timed out for client " + toString(conn.fd));
+    if (p.peer != -1)
+        _upstreams[p.group].markFailure(p.peer, time(NULL));
+    bool headersDone = p.headersDone;
+    detachUpstream(conn, false);
+    if (!headersDone) {
+        queueErrorResponse(conn.fd, 504, "Gateway Timeout");
+        return;
+    }
+    conn.keepAlive = false;
+    conn.streamPending = false;
+    updateClientInterest(conn.fd, true);
+}
+
+
+void epollManager::setUpstreamInterest(int upstreamFd, uint32_t events)
+{
+    if (!_events->modify(upstreamFd, events))
+        ERROR_SYS("event mod upstream");
+}
@@ -0,0 +1,305 @@
+#include "Webserv.hpp"
+#include "epollManager.hpp"
+#include "../config/ParseConfig.hpp"
+
+
+// Takes ownership of the startup listening sockets so a reload can keep, add or close them.
+void epollManager::adoptListeners(std::vector<Server*>& servers, const std::string& configPath)
+{
+    for (size_t i = 0; i < servers.size(); ++i)
+        _listeners[listenKey(servers[i]->getHost(), servers[i]->getPort())] = servers[i];
+    servers.clear();
+    _configPath = configPath;
+}
+
+
+// Called from the SIGHUP handler; the loop reloads at the top of its next iteration.
+void epollManager::requestReload() { _reloadRequested = 1; }
+
+
+static bool sameCacheZone(const CacheZoneConfig& a, const CacheZoneConfig& b)
+{
+    return a.path == b.path && a.memSize == b.memSize && a.maxSize == b.maxSize && a.inactive == b.inactive;
+}
+
+
+// Re-reads the configuration file and swaps it in. Any parse, validation or bind error
+// leaves the running configuration untouched.
+void epollManager::reloadConfiguration()
+{
+    long long start = monotonicUs();
+    if (_configPath.empty()) {
+        ERROR("Reload requested but no configuration file is known");
+        return;
+    }
+    if (_draining) {
+        LOG("Reload ignored, this process is draining after an upgrade");
+        return;
+    }
+    LOG("Reloading configuration from " + _configPath);
+    std::vector<ServerConfig> configs;
+    try {
+        ParseConfig parser;
+        configs = parser.parse(_configPath);
+    } catch (const std::exception& e) {
+        ERROR("Reload failed, keeping the running configuration: " + std::string(e.what()));
+        return;
+    }
+    if (configs.empty()) {
+        ERROR("Reload failed, no server block in " + _configPath);
+        return;
+    }
+    std::map<std::string, std::vector<ServerConfig> > groups;
+    groupHostPort(configs, groups);
+    // certificates are loaded before anything changes; unchanged ones keep their context
+    ConfigSnapshot* next = new ConfigSnapshot(_generation + 1);
+    std::map<std::string, std::vector<SSL_CTX*> > tls;
+    for (std::map<std::string, std::vector<ServerConfig> >::iterator it = groups.begin(); it != groups.end(); ++it) {
+        std::string error;
+        if (!loadTlsContexts(*next, it->second, tls[it->first], error)) {
+            ERROR("Reload failed, keeping the running configuration: " + error);
+            delete next;
+            return;
+        }
+    }
+    std::map<std::string, Server*> opened;
+    if (!openReloadListeners(groups, opened)) {
+        delete next;
+        return;
+    }
+
+    // listening sockets: unchanged host:port pairs keep their fd and their accept queue
+    ConfigSnapshot* previous = _config;
+    _config = next;
+    ++_generation;
+    std::map<std::string, Server*> listeners;
+    for (std::map<std::string, std::vector<ServerConfig> >::iterator it = groups.begin(); it != groups.end(); ++it) {
+        std::map<std::string, Server*>::iterator kept = _listeners.find(it->first);
+        Server* srv = (kept != _listeners.end()) ? kept->second : opened[it->first];
+        ListenOptions options = it->second[0].getListenOptions(it->first);
+        if (kept != _listeners.end() && options != srv->getOptions()) {
+            srv->applyOptions(options);
+            LOG("Socket options of " + it->first + " updated");
+        }
+        listeners[it->first] = srv;
+        _config->serverGroups[srv->getListeningSocket()] = it->second;
+        if (!tls[it->first].empty())
+            _config->listenTls[srv->getListeningSocket()] = tls[it->first];
+    }
+    size_t closed = 0;
+    for (std::map<std::string, Server*>::iterator it = _listeners.begin(); it != _listeners.end(); ++it) {
+        if (listeners.count(it->first))
+            continue;
+        int fd = it->second->getListeningSocket();
+        _events->remove(fd);
+        _listenSockets.erase(fd);
+        LOG("Stopped listening on " + it->first);
+        delete it->second;
+        closed++;
+    }
+    for (std::map<std::string, Server*>::iterator it = opened.begin(); it != opened.end(); ++it) {
+        int fd = it->second->getListeningSocket();
+        if (!_events->add(fd, EPOLLIN))
+            ERROR_SYS("event add listener " + it->first);
+        _listenSockets.insert(fd);
+        LOG("Listening on " + it->first);
+    }
+    _listeners.swap(listeners);
+
+    // a zone keeps its counters unless its key, rate or size changed (first definition wins)
+    std::set<std::string> seenZones;
+    for (size_t i = 0; i < configs.size(); ++i) {
+        const std::map<std::string, LimitZoneConfig>& zones = configs[i].getLimitZones();
+        for (std::map<std::string, LimitZoneConfig>::const_iterator it = zones.begin(); it != zones.end(); ++it) {
+            if (!seenZones.insert(it->first).second)
+                continue;
+            std::map<std::string, LimitZone*>::iterator zone = _limitZones.find(it->first);
+            if (zone == _limitZones.end() || zone->second->matches(it->second))
+                continue;
+            LOG("Limit zone " + it->first + " redefined, its state starts over");
+            _replacedZones.push_back(zone->second);
+            _limitZones.erase(zone);
+        }
+    }
+    for (std::map<int, std::vector<ServerConfig> >::iterator it = _config->serverGroups.begin(); it != _config->serverGroups.end(); ++it)
+        compileListener(it->first);
+    retireUpstreams();
+    configureUpstreams();
+    retireResponseCaches();
+    configureSessions();
+    configureMemoryLimit();
+    configureAdmission();
+    configureThreadPool();
+    std::string backend;
+    for (std::map<int, std::vector<ServerConfig> >::iterator it = _config->serverGroups.begin(); it != _config->serverGroups.end() && backend.empty(); ++it) {
+        for (size_t i = 0; i < it->second.size() && backend.empty(); ++i)
+            backend = it->second[i].getEventBackend();
+    }
+    if (backend.empty())
+        backend = "epoll";
+    if (backend != _eventBackendKind)
+        INFO("event_backend " + backend + " applies after a restart or binary upgrade, the loop keeps " + _events->name());
+
+    _retiredConfigs.push_back(previous);
+    releaseRetiredConfigs();
+    long long elapsed = monotonicUs() - start;
+    INFO("Configuration generation " + toString(_generation) + " loaded in " + toString(elapsed / 1000) + "."
+        + toString(elapsed / 100 % 10) + "ms: " + toString(_listeners.size()) + " listeners ("
+        + toString(opened.size()) + " opened, " + toString(closed) + " closed), "
+        + toString(_retiredConfigs.size()) + " previous generation(s) still serving requests");
+}
+
+
+// Binds the host:port pairs the new configuration adds; all or nothing.
+bool epollManager::openReloadListeners(const std::map<std::string, std::vector<ServerConfig> >& groups,
+                                       std::map<std::string, Server*>& opened)
+{
+    for (std::map<std::string, std::vector<ServerConfig> >::const_iterator it = groups.begin(); it != groups.end(); ++it) {
+        if (it->second.empty() || _listeners.count(it->first))
+            continue;
+        try {
+            opened[it->first] = new Server(it->second[0]);
+        } catch (const std::exception& e) {
+            ERROR("Reload failed, cannot listen on " + it->first + ": " + std::string(e.what()));
+            for (std::map<std::string, Server*>::iterator o = opened.begin(); o != opened.end(); ++o)
+                delete o->second;
+            opened.clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+
+// Upstream groups are rebuilt from the new definitions by configureUpstreams(). Exchanges in flight
+// keep their group under a generation-qualified name until releaseRetiredConfigs() drops it.
+void epollManager::retireUpstreams()
+{
+    std::string suffix = "#" + toString(_generation - 1);
+    std::map<std::string, UpstreamGroup> retired;
+    for (std::map<int, ClientConnection>::iterator it = _clientConnections.begin(); it != _clientConnections.end(); ++it) {
+        ProxyState& p = it->second.proxy;
+        if (!p.active || p.group.empty())
+            continue;
+        std::string name = p.group + suffix;
+        if (!retired.count(name))
+            retired[name] = _upstreams[p.group];
+        p.group = name;
+    }
+    for (std::map<std::string, UpstreamGroup>::iterator it = _upstreams.begin(); it != _upstreams.end(); ++it) {
+        if (!retired.count(it->first + suffix))
+            it->second.closeAll();
+    }
+    _upstreams.swap(retired);
+}
+
+
+// Caches whose zone is still declared with the same settings stay warm; the others are dropped.
+void epollManager::retireResponseCaches()
+{
+    std::map<std::string, CacheZoneConfig> zones;
+    for (std::map<int, std::vector<ServerConfig> >::iterator it = _config->serverGroups.begin(); it != _config->serverGroups.end(); ++it) {
+        for (size_t i = 0; i < it->second.size(); ++i)
+            zones.insert(it->second[i].getCacheZones().begin(), it->second[i].getCacheZones().end());
+    }
+    for (std::map<std::string, ResponseCache*>::iterator it = _responseCaches.begin(); it != _responseCaches.end(); ) {
+        std::map<std::string, CacheZoneConfig>::iterator zone = zones.find(it->first);
+        if (zone != zones.end() && sameCacheZone(zone->second, it->second->getConfig())) {
+            ++it;
+            continue;
+        }
+        LOG("Cache zone " + it->first + " " + (zone == zones.end() ? "removed" : "redefined") + ", dropping its entries");
+        delete it->second;
+        _responseCaches.erase(it++);
+    }
+}
+
+
+// Frees the snapshots replaced by reloads once no request runs under them. Connections
+// between requests move to the current configuration; idle ones whose listener was
+// closed by the reload are closed.
+void epollManager::releaseRetiredConfigs()
+{
+    std::set<std::string> activeGroups;
+    for (std::map<int, ClientConnection>::iterator it = _clientConnections.begin(); it != _clientConnections.end(); ++it) {
+        if (it->second.proxy.active)
+            activeGroups.insert(it->second.proxy.group);
+    }
+    for (std::map<std::string, UpstreamGroup>::iterator it = _upstreams.begin(); it != _upstreams.end(); ) {
+        if (it->first.find('#') == std::string::npos || activeGroups.count(it->first)) {
+            ++it;
+            continue;
+        }
+        it->second.closeAll();
+        _upstreams.erase(it++);
+    }
+    if (_retiredConfigs.empty())
+        return;
+
+    std::set<const ServerConfig*> inUse;
+    fileJobConfigs(inUse);
+    std::vector<int> orphans;
+    for (std::map<int, ClientConnection>::iterator it = _clientConnections.begin(); it != _clientConnections.end(); ++it) {
+        std::map<int, const ServerConfig*>::iterator sit = _serverForClientFd.find(it->first);
+        if (sit == _serverForClientFd.end())
+            continue;
+        const ClientConnection& conn = it->second;
+        if (!connectionIdle(conn)) {
+            inUse.insert(sit->second);
+            continue;
+        }
+        const ServerConfig* current = defaultServerFor(conn.listenFd);
+        if (current)
+            sit->second = current;
+        else
+            orphans.push_back(it->first);
+    }
+    for (size_t i = 0; i < orphans.size(); ++i) {
+        closeClientSocket(orphans[i]);
+        removeClientState(orphans[i]);
+    }
+
+    for (size_t i = 0; i < _retiredConfigs.size(); ) {
+        ConfigSnapshot* snapshot = _retiredConfigs[i];
+        bool used = false;
+        for (std::map<int, std::vector<ServerConfig> >::iterator it = snapshot->serverGroups.begin();
+             it != snapshot->serverGroups.end() && !used; ++it) {
+            for (size_t j = 0; j < it->second.size() && !used; ++j)
+                used = inUse.count(&it->second[j]) != 0;
+        }
+        if (used) {
+            ++i;
+            continue;
+        }
+        LOG("Configuration generation " + toString(snapshot->generation) + " released");
+        forgetSnapshot(snapshot);
+        delete snapshot;
+        _retiredConfigs.erase(_retiredConfigs.begin() + i);
+    }
+}
+
+
+// True between requests on a keep-alive connection: nothing parsed, queued or running.
+bool epollManager::connectionIdle(const ClientConnection& conn) const
+{
+    return !conn.backgroundRefresh && !conn.headersParsed && !conn.hasResponse && conn.buffer.empty();
+}
+
+
+// Removes the per-server / per-location entries that point into a snapshot about to be freed.
+void epollManager::forgetSnapshot(const ConfigSnapshot* snapshot)
+{
+    for (std::map<int, std::vector<ServerConfig> >::const_iterator it = snapshot->serverGroups.begin(); it != snapshot->serverGroups.end(); ++it) {
+        for (size_t i = 0; i < it->second.size(); ++i) {
+            const ServerConfig& server = it->second[i];
+            _serverAccess.erase(&server);
+            _serverLogs.erase(&server);
+            _metrics.forgetConfig(&server);
+            const std::vector<LocationConfig>& locations = server.getLocations();
+            for (size_t j = 0; j < locations.size(); ++j) {
+                _locationAccess.erase(&locations[j]);
+                _metrics.forgetConfig(&locations[j]);
+            }
+        }
+    }
+}
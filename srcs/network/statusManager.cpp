@@ -0,0 +1,54 @@
+#include "Webserv.hpp"
+#include "epollManager.hpp"
+
+
+// Classifies every client socket the way nginx stub_status does (background refreshes have no socket).
+ConnectionGauges epollManager::collectGauges() const
+{
+    ConnectionGauges gauges;
+    for (std::map<int, ClientConnection>::const_iterator it = _clientConnections.begin(); it != _clientConnections.end(); ++it) {
+        const ClientConnection& conn = it->second;
+        if (conn.fd < 0)
+            continue;
+        gauges.active++;
+        if (conn.headersParsed && conn.state == READY)
+            gauges.writing++;
+        else if (conn.headersParsed || !conn.buffer.empty())
+            gauges.reading++;
+        else
+            gauges.idle++;
+    }
+    gauges.cgiActive = _activeCgiCount;
+    gauges.cgiMax = MAX_CGI_PROCESS;
+    collectMemoryGauges(gauges);
+    collectAdmissionGauges(gauges);
+    return gauges;
+}
+
+
+void epollManager::buildStatusResponse(Response& response, StatusHandler handler) const
+{
+    ConnectionGauges gauges = collectGauges();
+    response.setStatus(200, "OK");
+    response.setHeader("Cache-Control", "no-cache");
+    if (handler == STATUS_PROMETHEUS) {
+        response.setHeader("Content-Type", "text/plain; version=0.0.4; charset=utf-8");
+        response.setBody(_metrics.renderPrometheus(gauges));
+    } else {
+        response.setHeader("Content-Type", "text/plain");
+        response.setBody(_metrics.renderStubStatus(gauges));
+    }
+}
+
+
+void epollManager::recordRequestMetrics(ClientConnection& conn)
+{
+    _metrics.countResponse(conn.responseStatus);
+    if (!conn.timing.firstByte)
+        return;
+    long long elapsed = conn.timing.lastSent - conn.timing.firstByte;
+    if (conn.serverLatency)
+        conn.serverLatency->observe(elapsed);
+    if (conn.locationLatency)
+        conn.locationLatency->observe(elapsed);
+}
@@ -0,0 +1,132 @@
+#include "Webserv.hpp"
+#include "epollManager.hpp"
+
+
+// Contexts of a listen group: empty when no server flags the address ssl, otherwise one per
+// server (SNI picks it), servers without a certificate using the first one that has one.
+// Contexts already loaded by this snapshot or the running one are shared.
+bool epollManager::loadTlsContexts(ConfigSnapshot& snapshot, const std::vector<ServerConfig>& group,
+                                   std::vector<SSL_CTX*>& contexts, std::string& error)
+{
+    contexts.clear();
+    if (group.empty())
+        return true;
+    std::string key = listenKey(group[0].getHost(), group[0].getPort());
+    bool ssl = false;
+    for (size_t i = 0; i < group.size() && !ssl; ++i)
+        ssl = group[i].isSslListen(key);
+    if (!ssl)
+        return true;
+
+    SSL_CTX* fallback = NULL;
+    for (size_t i = 0; i < group.size(); ++i) {
+        const TlsConfig& tls = group[i].getTls();
+        if (tls.certificate.empty()) {
+            contexts.push_back(NULL);
+            continue;
+        }
+        std::string signature = tlsContextKey(tls);
+        std::map<std::string, SSL_CTX*>::iterator found = snapshot.tlsContexts.find(signature);
+        SSL_CTX* ctx = (found != snapshot.tlsContexts.end()) ? found->second : NULL;
+        if (!ctx && _config && _config != &snapshot && _config->tlsContexts.count(signature)) {
+            ctx = _config->tlsContexts[signature];
+            SSL_CTX_up_ref(ctx);
+            snapshot.tlsContexts[signature] = ctx;
+        }
+        if (!ctx) {
+            ctx = createTlsContext(tls, error);
+            if (!ctx)
+                return false;
+            SSL_CTX_set_tlsext_servername_callback(ctx, selectTlsServer);
+            SSL_CTX_set_tlsext_servername_arg(ctx, this);
+            snapshot.tlsContexts[signature] = ctx;
+            LOG("TLS certificate " + tls.certificate + " loaded");
+        }
+        contexts.push_back(ctx);
+        if (!fallback)
+            fallback = ctx;
+    }
+    if (!fallback) {
+        error = "No server listening on " + key + " with ssl has an ssl_certificate";
+        return false;
+    }
+    for (size_t i = 0; i < contexts.size(); ++i) {
+        if (!contexts[i])
+            contexts[i] = fallback;
+    }
+    return true;
+}
+
+
+// Starts a server-side session on a client of an ssl listener; plain listeners need nothing.
+bool epollManager::attachTls(int listenFd, ClientConnection& conn)
+{
+    conn.tls = NULL;
+    conn.tlsReady = false;
+    std::map<int, std::vector<SSL_CTX*> >::const_iterator it = _config->listenTls.find(listenFd);
+    if (it == _config->listenTls.end())
+        return true;
+    const ServerConfig* server = defaultServerFor(listenFd);
+    size_t index = server ? static_cast<size_t>(server - &_config->serverGroups[listenFd][0]) : 0;
+    SSL* ssl = SSL_new(it->second[index < it->second.size() ? index : 0]);
+    if (!ssl || SSL_set_fd(ssl, conn.fd) != 1) {
+        ERROR("TLS session for client " + toString(conn.fd) + ": " + tlsErrorString());
+        SSL_free(ssl);
+        return false;
+    }
+    SSL_set_accept_state(ssl);
+    conn.tls = ssl;
+    return true;
+}
+
+
+// Runs the handshake as far as the socket allows, waiting for the direction OpenSSL asks
+// for. True once it is done; a failed handshake closes the connection.
+bool epollManager::continueTlsHandshake(int clientFd)
+{
+    ClientConnection& conn = _clientConnections[clientFd];
+    TlsStatus status = tlsHandshake(conn.tls);
+    if (status == TLS_WANT_READ || status == TLS_WANT_WRITE) {
+        updateClientInterest(clientFd, status == TLS_WANT_WRITE);
+        return false;
+    }
+    if (status == TLS_FAILED) {
+        _metrics.tlsFailed++;
+        LOG("TLS handshake with client " + toString(clientFd) + " failed: " + tlsErrorString());
+        closeClientSocket(clientFd);
+        removeClientState(clientFd);
+        return false;
+    }
+    conn.tlsReady = true;
+    conn.timing.idleSince = monotonicUs();
+    _metrics.tlsHandshakes++;
+    if (SSL_session_reused(conn.tls))
+        _metrics.tlsResumed++;
+    if (tlsKernelOffload(conn.tls))
+        _metrics.tlsOffloaded++;
+    updateClientInterest(clientFd, conn.hasResponse);
+    return true;
+}
+
+
+// SNI: switches the session to the certificate of the server the client names. The
+// lookup is the one the Host header goes through, on the current configuration.
+int epollManager::selectTlsServer(SSL* ssl, int* alert, void* arg)
+{
+    (void)alert;
+    epollManager* self = static_cast<epollManager*>(arg);
+    const char* name = SSL_get_servername(ssl, TLSEXT_NAMETYPE_host_name);
+    std::map<int, ClientConnection>::const_iterator conn = self->_clientConnections.find(SSL_get_fd(ssl));
+    if (!name || conn == self->_clientConnections.end())
+        return SSL_TLSEXT_ERR_NOACK;
+    std::map<int, ServerNameTable>::const_iterator names = self->_config->serverNames.find(conn->second.listenFd);
+    std::map<int, std::vector<SSL_CTX*> >::const_iterator tls = self->_config->listenTls.find(conn->second.listenFd);
+    if (names == self->_config->serverNames.end() || tls == self->_config->listenTls.end())
+        return SSL_TLSEXT_ERR_NOACK;
+    int index = names->second.lookup(name);
+    if (index < 0 || static_cast<size_t>(index) >= tls->second.size())
+        return SSL_TLSEXT_ERR_NOACK;
+    if (tls->second[index] != SSL_get_SSL_CTX(ssl))
+        SSL_set_SSL_CTX(ssl, tls->second[index]);
+    return SSL_TLSEXT_ERR_OK;
+}
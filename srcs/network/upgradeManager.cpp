@@ -0,0 +1,177 @@
+#include "Webserv.hpp"
+#include "epollManager.hpp"
+#include <poll.h>
+
+
+// Remembers the command line the upgraded binary is started with.
+void epollManager::setUpgradeCommand(int argc, char** argv)
+{
+    _argv.assign(argv, argv + argc);
+}
+
+
+// Called from the SIGUSR2 handler; the loop upgrades at the top of its next iteration.
+void epollManager::requestUpgrade() { _upgradeRequested = 1; }
+
+
+// Starts the binary on disk with our listening sockets and, once it reports that it
+// is serving, stops accepting here and lets the open connections finish.
+void epollManager::upgradeBinary()
+{
+    if (_draining) {
+        LOG("Upgrade ignored, this process is already draining");
+        return;
+    }
+    if (_argv.empty() || _listeners.empty()) {
+        ERROR("Upgrade requested but no listening socket is owned by this process");
+        return;
+    }
+    LOG("Upgrading: starting " + _argv[0] + " with " + toString(_listeners.size()) + " listening socket(s)");
+
+    int ready[2];
+    if (pipe(ready) == -1) {
+        ERROR_SYS("pipe for upgrade");
+        return;
+    }
+    fcntl(ready[0], F_SETFD, FD_CLOEXEC);
+    pid_t pid = spawnUpgrade(ready[1]);
+    close(ready[1]);
+    if (pid == -1) {
+        close(ready[0]);
+        return;
+    }
+
+    // bounded wait: the new process only has to parse its configuration and adopt the sockets
+    long long deadline = monotonicUs() + UPGRADE_READY_TIMEOUT * 1000LL;
+    char byte = 0;
+    ssize_t got = -1;
+    while (true) {
+        struct pollfd pfd;
+        pfd.fd = ready[0];
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        long long left = (deadline - monotonicUs()) / 1000;
+        int n = poll(&pfd, 1, left > 0 ? static_cast<int>(left) : 0);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n > 0)
+            got = read(ready[0], &byte, 1);
+        break;
+    }
+    close(ready[0]);
+
+    if (got != 1 || byte != 'R') {
+        ERROR(std::string("Upgrade failed, process ") + toString(pid)
+            + (got == -1 ? " did not report ready in time" : " exited before listening")
+            + "; keeping the running binary");
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        return;
+    }
+    _upgradePid = pid;
+    for (std::map<std::string, Server*>::iterator it = _listeners.begin(); it != _listeners.end(); ++it)
+        it->second->handOver();
+    INFO("Upgrade: process " + toString(pid) + " is serving, draining " + toString(_clientConnections.size())
+        + " connection(s) before exiting");
+    startDrain();
+}
+
+
+// Forks and execs the upgraded binary with the listening sockets and the ready pipe
+// as its only descriptors besides stdio.
+pid_t epollManager::spawnUpgrade(int readyFd)
+{
+    std::string listenEnv;
+    std::set<int> keep;
+    for (std::map<std::string, Server*>::const_iterator it = _listeners.begin(); it != _listeners.end(); ++it) {
+        int fd = it->second->getListeningSocket();
+        if (!listenEnv.empty())
+            listenEnv += ";";
+        listenEnv += it->first + "=" + toString(fd);
+        keep.insert(fd);
+    }
+    keep.insert(readyFd);
+    std::string readyEnv = toString(readyFd);
+    std::vector<char*> args;
+    for (size_t i = 0; i < _argv.size(); ++i)
+        args.push_back(const_cast<char*>(_argv[i].c_str()));
+    args.push_back(NULL);
+
+    pid_t pid = fork();
+    if (pid == -1) {
+        ERROR_SYS("fork for upgrade");
+        return -1;
+    }
+    if (pid > 0)
+        return pid;
+
+    // child: drop epoll, clients, pipes and upstreams; keep what the new binary adopts
+    std::vector<int> fds;
+    DIR* dir = opendir("/proc/self/fd");
+    if (dir) {
+        for (struct dirent* ent = readdir(dir); ent; ent = readdir(dir)) {
+            if (ent->d_name[0] != '.')
+                fds.push_back(std::atoi(ent->d_name));
+        }
+        closedir(dir);
+    } else {
+        long maxFd = sysconf(_SC_OPEN_MAX);
+        for (int fd = 3; fd < (maxFd > 0 ? maxFd : 1024); ++fd)
+            fds.push_back(fd);
+    }
+    for (size_t i = 0; i < fds.size(); ++i) {
+        if (fds[i] > 2 && !keep.count(fds[i]))
+            close(fds[i]);
+    }
+    for (std::set<int>::iterator it = keep.begin(); it != keep.end(); ++it)
+        fcntl(*it, F_SETFD, 0);
+    std::signal(SIGINT, SIG_DFL);
+    std::signal(SIGTERM, SIG_DFL);
+    std::signal(SIGHUP, SIG_DFL);
+    std::signal(SIGUSR2, SIG_DFL);
+    std::signal(SIGPIPE, SIG_DFL);
+    setenv(UPGRADE_LISTEN_ENV, listenEnv.c_str(), 1);
+    setenv(UPGRADE_READY_ENV, readyEnv.c_str(), 1);
+    execvp(args[0], &args[0]);
+    _exit(127);
+}
+
+
+// Stops accepting and closes the listening sockets (after an upgrade the new process
+// keeps its copies). Idle keep-alive connections are closed, the others get
+// "Connection: close" on their response and run() returns once the last one is gone.
+void epollManager::startDrain()
+{
+    _draining = true;
+    _drainDeadline = monotonicUs() / 1000 + shutdownTimeout();
+    for (std::map<std::string, Server*>::iterator it = _listeners.begin(); it != _listeners.end(); ++it) {
+        int fd = it->second->getListeningSocket();
+        _events->remove(fd);
+        _listenSockets.erase(fd);
+        delete it->second;
+    }
+    _listeners.clear();
+
+    std::vector<int> idle;
+    for (std::map<int, ClientConnection>::iterator it = _clientConnections.begin(); it != _clientConnections.end(); ++it) {
+        // a connection that has not sent its first request yet still gets it served
+        if (it->first >= 0 && it->second.requestCount && connectionIdle(it->second))
+            idle.push_back(it->first);
+    }
+    for (size_t i = 0; i < idle.size(); ++i) {
+        closeClientSocket(idle[i]);
+        removeClientState(idle[i]);
+    }
+}
+
+
+// Longest shutdown_timeout set in the running configuration, SHUTDOWN_TIMEOUT if none is.
+long epollManager::shutdownTimeout() const
+{
+    long timeout = -1;
+    for (std::map<int, std::vector<ServerConfig> >::const_iterator it = _config->serverGroups.begin(); it != _config->serverGroups.end(); ++it) {
+        for (size_t i = 0; i < it->second.size(); ++i)
+            timeout = std::max(timeout, it->second[i].getShutdownTimeout());
+    }
+    return timeout < 0 ? SHUTDOWN_TIMEOUT * 1000L : timeout;
+}
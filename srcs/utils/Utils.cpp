@@ -1,5 +1,6 @@
 #include "Webserv.hpp"
 #include "Utils.hpp"
+#include "../http/HttpTokens.hpp"
 
 
 
@@ -14,7 +15,8 @@ char* ft_strdup(const std::string& value)
 std::string getCurrentDate() 
 {
     time_t now = time(0);
-    struct tm tm = *gmtime(&now);
+    struct tm tm;
+    gmtime_r(&now, &tm);
     char buf[100];
     strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tm);
     return std::string(buf);
@@ -62,87 +64,41 @@ bool isDirectory(const std::string& path) {
     return S_ISDIR(buffer.st_mode);
 }
 
+// Reads a whole file into a string sized from fstat(). Files of READAHEAD_MIN_SIZE and more
+// are announced as read sequentially, which widens the kernel readahead for them.
 std::string readFileContent(const std::string& path) {
-    std::ifstream file(path.c_str(), std::ios::binary);
-    if (!file.is_open()) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
         ERROR("Cannot open file: " + path);
         return "";
     }
-    
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    return buffer.str();
+    struct stat st;
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return "";
+    }
+    if (st.st_size >= READAHEAD_MIN_SIZE)
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    std::string content(static_cast<size_t>(st.st_size), '\0');
+    size_t filled = 0;
+    while (filled < content.size()) {
+        ssize_t n = read(fd, &content[filled], content.size() - filled);
+        if (n > 0)
+            filled += static_cast<size_t>(n);
+        else if (n == 0 || errno != EINTR)
+            break;
+    }
+    close(fd);
+    content.resize(filled);
+    return content;
 }
 
 std::string getContentType(const std::string& path) {
     size_t dotPos = path.find_last_of('.');
     if (dotPos == std::string::npos) return "text/plain";
-    
-    std::string extension = path.substr(dotPos + 1);
-    
-    // Convertir en minuscules pour case-insensitive
-    for (size_t i = 0; i < extension.size(); ++i) {
-        extension[i] = std::tolower(extension[i]);
-    }
-    
-    static std::map<std::string, std::string> contentTypes;
-    if (contentTypes.empty()) {
-        contentTypes["html"] = "text/html";
-        contentTypes["htm"] = "text/html";
-        contentTypes["css"] = "text/css";
-        contentTypes["js"] = "application/javascript";
-        contentTypes["json"] = "application/json";
-        contentTypes["jpg"] = "image/jpeg";
-        contentTypes["jpeg"] = "image/jpeg";
-        contentTypes["png"] = "image/png";
-        contentTypes["gif"] = "image/gif";
-        contentTypes["bmp"] = "image/bmp";
-        contentTypes["ico"] = "image/x-icon";
-        contentTypes["txt"] = "text/plain";
-        contentTypes["pdf"] = "application/pdf";
-        contentTypes["zip"] = "application/zip";
-        contentTypes["xml"] = "application/xml";
-    }
-    
-    std::map<std::string, std::string>::iterator it = contentTypes.find(extension);
-    if (it != contentTypes.end()) {
-        return it->second;
-    }
-    
-    return "application/octet-stream";
-}
 
-// Fonction pour générer le listing de répertoire (simplifié)
-std::string generateDirectoryListing(const std::string& dirPath, const std::string& uri) {
-    DIR* dir = opendir(dirPath.c_str());
-    if (!dir) {
-        return "<h1>Error reading directory</h1>";
-    }
-    
-    std::string html = "<!DOCTYPE html><html><head><title>Index of " + uri + "</title></head><body>";
-    html += "<h1>Index of " + uri + "</h1><hr><ul>";
-    
-    struct dirent* entry;
-    while ((entry = readdir(dir)) != NULL) {
-        std::string name = entry->d_name;
-        if (name == "." || name == "..") continue;
-        
-        std::string fullPath = dirPath + "/" + name;
-        std::string link = uri + (uri == "/" ? "" : "/") + name;
-        
-        struct stat fileStat;
-        stat(fullPath.c_str(), &fileStat);
-        
-        html += "<li><a href=\"" + link + "\">" + name;
-        if (S_ISDIR(fileStat.st_mode)) {
-            html += "/";
-        }
-        html += "</a> (" + toString(fileStat.st_size) + " bytes)</li>";
-    }
-    
-    html += "</ul><hr></body></html>";
-    closedir(dir);
-    return html;
+    const char* type = mimeTypeForExtension(path.data() + dotPos + 1, path.size() - dotPos - 1);
+    return type ? type : "application/octet-stream";
 }
 
 bool isCgiFile(const std::string& uri, const std::vector<LocationConfig>& locations) {
@@ -220,3 +176,54 @@ void safeClose(int pipefd[2])
     if (pipefd[1] != -1)
         close(pipefd[1]);
 }
+
+
+// FNV-1a followed by a murmur finaliser so nearby keys spread over the whole range.
+unsigned int hashBytes32(const char* data, size_t len)
+{
+    unsigned int h = 2166136261u;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= static_cast<unsigned char>(data[i]);
+        h *= 16777619u;
+    }
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+
+unsigned int hashKey32(const std::string& key)
+{
+    return hashBytes32(key.data(), key.size());
+}
+
+
+// Fills out with bytes from /dev/urandom, read ahead in blocks to keep syscalls off the request path.
+bool secureRandomBytes(unsigned char* out, size_t len)
+{
+    static int fd = -1;
+    static unsigned char pool[4096];
+    static size_t offset = 0;
+    static size_t filled = 0;
+    if (fd == -1 && (fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC)) == -1)
+        return false;
+    while (len > 0) {
+        if (offset == filled) {
+            ssize_t n = read(fd, pool, sizeof(pool));
+            if (n <= 0)
+                return false;
+            offset = 0;
+            filled = static_cast<size_t>(n);
+        }
+        size_t take = std::min(len, filled - offset);
+        std::memcpy(out, pool + offset, take);
+        std::memset(pool + offset, 0, take);  // handed-out bytes never stay in memory
+        offset += take;
+        out += take;
+        len -= take;
+    }
+    return true;
+}
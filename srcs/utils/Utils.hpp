@@ -12,7 +12,6 @@ bool		dirExists(const std::string& path);
 bool		isDirectory(const std::string& path);
 std::string	readFileContent(const std::string& path);
 std::string	getContentType(const std::string& path);
-std::string	generateDirectoryListing(const std::string& dirPath, const std::string& uri);
 bool 		isCgiFile(const std::string& uri, const std::vector<LocationConfig>& locations);
 
 std::string toUpperCase(const std::string& str);
@@ -22,3 +21,6 @@ std::string toLowerCase(const std::string &str);
 std::string dirnameOf(const std::string& path);
 void safeClose(int pipefd[2]);
 char* ft_strdup(const std::string& value);
+unsigned int hashBytes32(const char* data, size_t len);
+unsigned int hashKey32(const std::string& key);
+bool secureRandomBytes(unsigned char* out, size_t len);
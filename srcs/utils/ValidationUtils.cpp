@@ -1,5 +1,6 @@
 #include "Webserv.hpp"
 #include "ValidationUtils.hpp"
+#include "../http/HttpTokens.hpp"
 
 
 // Vérifie que l'octet IPv4 est constitué uniquement de chiffres et reste dans [0, 255].
@@ -71,16 +72,13 @@ bool ValidationUtils::isValidIP(const std::string &ip){
 	return segments == 4;
 }
 
+bool ValidationUtils::isValidIPv6(const std::string &ip){
+	struct in6_addr addr;
+	return ip.find(':') != std::string::npos && inet_pton(AF_INET6, ip.c_str(), &addr) == 1;
+}
+
 bool ValidationUtils::isValidMethod(const std::string &method) {
-    static const std::string validMethods[] = {
-        "GET", "POST", "PUT", "DELETE", "HEAD", 
-        "OPTIONS", "TRACE", "CONNECT", "PATCH"
-    };
-    static const std::vector<std::string> validMethodsVec(
-        validMethods, 
-        validMethods + sizeof(validMethods) / sizeof(validMethods[0])
-    );
-    return std::find(validMethodsVec.begin(), validMethodsVec.end(), method) != validMethodsVec.end();
+    return methodId(method) != METHOD_UNKNOWN;
 }
 
 bool ValidationUtils::isValidCIDR(const std::string& cidr) {
@@ -90,18 +88,18 @@ bool ValidationUtils::isValidCIDR(const std::string& cidr) {
     
     std::string ip = cidr.substr(0, slashPos);
     std::string mask = cidr.substr(slashPos + 1);
-    if (!isValidIP(ip))
+    if (!isValidIP(ip) && !isValidIPv6(ip))
 		return false;
-    try {
-        int maskValue = std::atoi(mask.c_str());
-        if (ip.find(':') != std::string::npos) { // IPv6 - to modify
-            return maskValue >= 0 && maskValue <= 128;
-        } else { // IPv4
-            return maskValue >= 0 && maskValue <= 32;
-        }
-    } catch (...) {
+    if (mask.empty() || mask.size() > 3 || mask.find_first_not_of("0123456789") != std::string::npos)
         return false;
-    }
+    int maskValue = std::atoi(mask.c_str());
+    if (ip.find(':') != std::string::npos) // IPv6
+        return maskValue <= 128;
+    return maskValue <= 32;
+}
+
+bool ValidationUtils::isNumber(const std::string& str) {
+    return !str.empty() && str.size() <= 9 && str.find_first_not_of("0123456789") == std::string::npos;
 }
 
 bool ValidationUtils::isHttpStatusCode(int code) {
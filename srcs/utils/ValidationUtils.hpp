@@ -9,8 +9,10 @@ namespace ValidationUtils {
 	bool isValidPath(const std::string &path);
 	bool isValidName(const std::string &name);
 	bool isValidIP(const std::string &ip);
+	bool isValidIPv6(const std::string &ip);
 	bool isValidMethod(const std::string &method);
 	bool isValidCIDR(const std::string& cidr);
+	bool isNumber(const std::string& str);
 	bool isHttpStatusCode(int code);
 	bool isValidBodySize(const std::string& sizeStr);
 